@@ -17,12 +17,57 @@ SOURCES += main.cpp\
     createbedlevelinggcode.cpp \
     gcodeeditor.cpp \
     logger.cpp \
-    changegcodefeedrates.cpp
+    changegcodefeedrates.cpp \
+    gcodelinereader.cpp \
+    gcodewriter.cpp \
+    gcodetokenizer.cpp \
+    gcodescanner.cpp \
+    gcodeoutput.cpp \
+    commandline.cpp \
+    batchprocessor.cpp \
+    gcodeworker.cpp \
+    gcodenumberformatter.cpp \
+    gcodepiecetable.cpp \
+    gcodeprogram.cpp \
+    gcodeprogramcache.cpp \
+    gcodetimeestimator.cpp \
+    gcodemoveoptimizer.cpp \
+    gcodearcfitter.cpp \
+    gcodetraveloptimizer.cpp \
+    gcodeheightmap.cpp \
+    gcodezcompensator.cpp \
+    gcodefeedpolicy.cpp \
+    gcodelookaheadplanner.cpp \
+    gcodemodaltracker.cpp \
+    profiler.cpp
 
 HEADERS  += mainwindow.h \
     createbedlevelinggcode.h \
     gcodeeditor.h \
     logger.h \
-    changegcodefeedrates.h
+    changegcodefeedrates.h \
+    gcodelinereader.h \
+    gcodewriter.h \
+    gcodetokenizer.h \
+    gcodescanner.h \
+    gcodeoutput.h \
+    commandline.h \
+    batchprocessor.h \
+    gcodeworker.h \
+    gcodeprogress.h \
+    gcodenumberformatter.h \
+    gcodepiecetable.h \
+    gcodeprogram.h \
+    gcodeprogramcache.h \
+    gcodetimeestimator.h \
+    gcodemoveoptimizer.h \
+    gcodearcfitter.h \
+    gcodetraveloptimizer.h \
+    gcodeheightmap.h \
+    gcodezcompensator.h \
+    gcodefeedpolicy.h \
+    gcodelookaheadplanner.h \
+    gcodemodaltracker.h \
+    profiler.h
 
 FORMS    += mainwindow.ui
@@ -0,0 +1,147 @@
+#include "batchprocessor.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QMutexLocker>
+
+#include <stdio.h>
+
+// How many files can wait in the queue for each one that is being processed.
+#define BATCH_QUEUED_PER_THREAD              2
+
+/*
+ * Processes one file of a batch on the thread pool.
+ */
+class BatchFileJob : public QRunnable
+{
+public:
+    BatchFileJob(BatchProcessor *owner, QString inputFile, QString outputFile);
+
+    void run();
+
+private:
+    BatchProcessor *mOwner;
+    QString mInputFile;
+    QString mOutputFile;
+};
+
+BatchFileJob::BatchFileJob(BatchProcessor *owner, QString inputFile, QString outputFile)
+{
+    mOwner = owner;
+    mInputFile = inputFile;
+    mOutputFile = outputFile;
+}
+
+/**
+ * @brief BatchFileJob::run - Process the file with a copy of the batch settings.  (Called on a worker thread.)
+ */
+void BatchFileJob::run()
+{
+    ChangeGCodeFeedRates feedRates(mOwner->mSettings);
+    QElapsedTimer timer;
+    int result;
+
+    feedRates.setInputFile(mInputFile);
+    feedRates.setOutputFile(mOutputFile);
+
+    timer.start();
+    result = feedRates.processGCodeFile();
+
+    mOwner->fileDone(mInputFile, mOutputFile, result, QFileInfo(mInputFile).size(), timer.elapsed());
+}
+
+/**
+ * @brief BatchProcessor::BatchProcessor - Set up a batch.
+ *
+ * @param settings - The feed rate changes to make to every file.  (The input and output files are ignored.)
+ * @param concurrentFiles - How many files to process at the same time.
+ */
+BatchProcessor::BatchProcessor(const ChangeGCodeFeedRates &settings, int concurrentFiles) :
+    mSettings(settings), mQueueSlots(concurrentFiles * BATCH_QUEUED_PER_THREAD)
+{
+    mPool.setMaxThreadCount(concurrentFiles);
+
+    mFiles = 0;
+    mFailed = 0;
+    mBytes = 0;
+
+    mTimer.start();
+}
+
+BatchProcessor::~BatchProcessor()
+{
+    mPool.waitForDone();
+}
+
+/**
+ * @brief BatchProcessor::addFile - Queue a file to be processed.  If the queue is full, this waits until
+ *      there is room in it.
+ *
+ * @param inputFile - The file to read.
+ * @param outputFile - The file to write the changed G-code to.
+ */
+void BatchProcessor::addFile(QString inputFile, QString outputFile)
+{
+    mQueueSlots.acquire();
+    mPool.start(new BatchFileJob(this, inputFile, outputFile));
+}
+
+/**
+ * @brief BatchProcessor::waitForDone - Wait for every queued file to be processed, and print a summary.
+ *
+ * @return int containing the number of files that couldn't be processed.
+ */
+int BatchProcessor::waitForDone()
+{
+    qint64 elapsed;
+    double seconds;
+
+    mPool.waitForDone();
+
+    elapsed = mTimer.elapsed();
+    seconds = (elapsed > 0) ? ((double)elapsed / 1000.0) : 0.001;
+
+    printf("Processed %d file(s), %d failed.  %.1f MB in %lld ms (%.1f MB/s).\n", mFiles, mFailed,
+           (double)mBytes / (1024.0 * 1024.0), (long long)elapsed, ((double)mBytes / (1024.0 * 1024.0)) / seconds);
+    fflush(stdout);
+
+    return mFailed;
+}
+
+/**
+ * @brief BatchProcessor::fileDone - Record the result of one file, and make room in the queue for another.
+ *      (Called on a worker thread.)
+ *
+ * @param inputFile - The file that was read.
+ * @param outputFile - The file that was written.
+ * @param result - One of the CHANGE_GCODE_* values.
+ * @param bytes - The size of the input file.
+ * @param milliseconds - How long the file took to process.
+ */
+void BatchProcessor::fileDone(const QString &inputFile, const QString &outputFile, int result, quint64 bytes, qint64 milliseconds)
+{
+    ChangeGCodeFeedRates resultText;
+    double seconds = (milliseconds > 0) ? ((double)milliseconds / 1000.0) : 0.001;
+
+    {
+        QMutexLocker locker(&mMutex);
+
+        mFiles++;
+
+        if (result == CHANGE_GCODE_SUCCESS) {
+            mBytes += bytes;
+            printf("%s -> %s : %llu bytes in %lld ms (%.1f MB/s)\n", QFile::encodeName(inputFile).constData(),
+                   QFile::encodeName(outputFile).constData(), (unsigned long long)bytes, (long long)milliseconds,
+                   ((double)bytes / (1024.0 * 1024.0)) / seconds);
+        } else {
+            mFailed++;
+            fprintf(stderr, "%s : %s\n", QFile::encodeName(inputFile).constData(),
+                    resultText.resultCodeAsString(result).toLocal8Bit().constData());
+        }
+
+        fflush(stdout);
+    }
+
+    mQueueSlots.release();
+}
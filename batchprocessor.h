@@ -0,0 +1,38 @@
+#ifndef BATCHPROCESSOR_H
+#define BATCHPROCESSOR_H
+
+#include <QString>
+#include <QMutex>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QElapsedTimer>
+
+#include "changegcodefeedrates.h"
+
+// Runs the same feed rate changes over many files at once.  Files are queued with addFile(), which
+// blocks while the queue is full, so a huge directory of jobs doesn't all sit in memory at once.
+class BatchProcessor
+{
+public:
+    BatchProcessor(const ChangeGCodeFeedRates &settings, int concurrentFiles);
+    ~BatchProcessor();
+
+    void addFile(QString inputFile, QString outputFile);
+    int waitForDone();
+
+private:
+    friend class BatchFileJob;
+
+    void fileDone(const QString &inputFile, const QString &outputFile, int result, quint64 bytes, qint64 milliseconds);
+
+    ChangeGCodeFeedRates mSettings;
+    QThreadPool mPool;
+    QSemaphore mQueueSlots;         // One for each file that can be queued (or running) at once.
+    QMutex mMutex;                  // Protects the totals below, and keeps the per-file output lines together.
+    QElapsedTimer mTimer;
+    int mFiles;
+    int mFailed;
+    quint64 mBytes;
+};
+
+#endif // BATCHPROCESSOR_H
@@ -0,0 +1,72 @@
+#-------------------------------------------------
+#
+# Micro-benchmarks for the G-code processing code, and benchmarks of the
+# whole pipeline (load, tokenize, rewrite, bed leveling and write).
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = FAB-tweak-tom-benchmarks
+CONFIG   += console
+CONFIG   -= app_bundle
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+SOURCES += main.cpp \
+    scannerbenchmark.cpp \
+    formatterbenchmark.cpp \
+    pipelinebenchmark.cpp \
+    ../createbedlevelinggcode.cpp \
+    ../gcodeeditor.cpp \
+    ../logger.cpp \
+    ../changegcodefeedrates.cpp \
+    ../gcodelinereader.cpp \
+    ../gcodewriter.cpp \
+    ../gcodetokenizer.cpp \
+    ../gcodescanner.cpp \
+    ../gcodeoutput.cpp \
+    ../gcodenumberformatter.cpp \
+    ../gcodepiecetable.cpp \
+    ../gcodeprogram.cpp \
+    ../gcodeprogramcache.cpp \
+    ../gcodetimeestimator.cpp \
+    ../gcodemoveoptimizer.cpp \
+    ../gcodearcfitter.cpp \
+    ../gcodetraveloptimizer.cpp \
+    ../gcodeheightmap.cpp \
+    ../gcodezcompensator.cpp \
+    ../gcodefeedpolicy.cpp \
+    ../gcodelookaheadplanner.cpp \
+    ../gcodemodaltracker.cpp \
+    ../profiler.cpp
+
+HEADERS  += scannerbenchmark.h \
+    formatterbenchmark.h \
+    pipelinebenchmark.h \
+    ../createbedlevelinggcode.h \
+    ../gcodeeditor.h \
+    ../logger.h \
+    ../changegcodefeedrates.h \
+    ../gcodelinereader.h \
+    ../gcodewriter.h \
+    ../gcodetokenizer.h \
+    ../gcodescanner.h \
+    ../gcodeoutput.h \
+    ../gcodeprogress.h \
+    ../gcodenumberformatter.h \
+    ../gcodepiecetable.h \
+    ../gcodeprogram.h \
+    ../gcodeprogramcache.h \
+    ../gcodetimeestimator.h \
+    ../gcodemoveoptimizer.h \
+    ../gcodearcfitter.h \
+    ../gcodetraveloptimizer.h \
+    ../gcodeheightmap.h \
+    ../gcodezcompensator.h \
+    ../gcodefeedpolicy.h \
+    ../gcodelookaheadplanner.h \
+    ../gcodemodaltracker.h \
+    ../profiler.h
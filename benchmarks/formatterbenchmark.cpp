@@ -0,0 +1,187 @@
+#include "formatterbenchmark.h"
+
+#include "gcodenumberformatter.h"
+
+#include <QString>
+#include <QByteArray>
+#include <QElapsedTimer>
+
+#include <stdio.h>
+#include <string.h>
+
+// How many moves to format.  (Each move has three numbers, the same as GCodeEditor::setMove() writes.)
+#define FORMATTER_BENCHMARK_MOVES    (1000 * 1000)
+
+// How many random values to check against QString::number().
+#define FORMATTER_CHECK_VALUES       (1000 * 1000)
+
+FormatterBenchmark::FormatterBenchmark()
+{
+}
+
+/**
+ * @brief FormatterBenchmark::run - Compare the ways of building a move line, and check that the formatter
+ *      writes the same numbers that QString::number() does.
+ */
+void FormatterBenchmark::run()
+{
+    createTestData();
+
+    printf("Move formatting (%d moves) :\n", FORMATTER_BENCHMARK_MOVES);
+    benchmarkQString();
+    benchmarkSnprintf();
+    benchmarkFormatter(false);
+    benchmarkFormatter(true);
+
+    printf("\n");
+    checkResults();
+}
+
+/**
+ * @brief FormatterBenchmark::createTestData - Build a list of coordinates that look like a bed leveling
+ *      program.  (Positions on a 0.15mm grid, so many of them have trailing zeros.)
+ */
+void FormatterBenchmark::createTestData()
+{
+    mValues.clear();
+    mValues.reserve(FORMATTER_BENCHMARK_MOVES * 3);
+
+    for (int i = 0; i < FORMATTER_BENCHMARK_MOVES; i++) {
+        mValues.append((double)(i % 1000) * 0.15);
+        mValues.append((double)(i / 1000) * 0.15);
+        mValues.append(400);
+    }
+}
+
+/**
+ * @brief FormatterBenchmark::benchmarkQString - The way GCodeEditor::setMove() used to build a line.
+ */
+void FormatterBenchmark::benchmarkQString()
+{
+    QElapsedTimer timer;
+    QString gcode;
+    quint64 bytes = 0;
+
+    timer.start();
+    for (int i = 0; i < mValues.size(); i += 3) {
+        gcode = "G01 ";
+        gcode += "X" + QString::number(mValues.at(i), 'f', 4) + " ";
+        gcode += "Y" + QString::number(mValues.at(i + 1), 'f', 4) + " ";
+        gcode += "F" + QString::number(mValues.at(i + 2), 'f', 4);
+
+        bytes += gcode.toLatin1().size();
+    }
+
+    report("QString::number()", timer.nsecsElapsed(), bytes);
+}
+
+/**
+ * @brief FormatterBenchmark::benchmarkSnprintf - Building the line with snprintf(), for comparison.
+ */
+void FormatterBenchmark::benchmarkSnprintf()
+{
+    QElapsedTimer timer;
+    char gcode[128];
+    quint64 bytes = 0;
+
+    timer.start();
+    for (int i = 0; i < mValues.size(); i += 3) {
+        bytes += snprintf(gcode, sizeof(gcode), "G01 X%.4f Y%.4f F%.4f", mValues.at(i), mValues.at(i + 1), mValues.at(i + 2));
+    }
+
+    report("snprintf()", timer.nsecsElapsed(), bytes);
+}
+
+/**
+ * @brief FormatterBenchmark::benchmarkFormatter - The way GCodeEditor::setMove() builds a line now.
+ *
+ * @param trimZeros - Passed to the formatter.
+ */
+void FormatterBenchmark::benchmarkFormatter(bool trimZeros)
+{
+    QElapsedTimer timer;
+    char gcode[128];
+    size_t length;
+    quint64 bytes = 0;
+
+    timer.start();
+    for (int i = 0; i < mValues.size(); i += 3) {
+        length = 4;
+        memcpy(gcode, "G01 ", length);
+
+        gcode[length++] = 'X';
+        length += GCodeNumberFormatter::formatFixed(gcode + length, mValues.at(i), 4, trimZeros);
+        gcode[length++] = ' ';
+
+        gcode[length++] = 'Y';
+        length += GCodeNumberFormatter::formatFixed(gcode + length, mValues.at(i + 1), 4, trimZeros);
+        gcode[length++] = ' ';
+
+        gcode[length++] = 'F';
+        length += GCodeNumberFormatter::formatFixed(gcode + length, mValues.at(i + 2), 4, trimZeros);
+
+        bytes += length;
+    }
+
+    if (trimZeros == true) {
+        report("GCodeNumberFormatter (trim zeros)", timer.nsecsElapsed(), bytes);
+    } else {
+        report("GCodeNumberFormatter", timer.nsecsElapsed(), bytes);
+    }
+}
+
+/**
+ * @brief FormatterBenchmark::checkResults - Format a spread of values with QString::number() and the
+ *      formatter, and count how many of them come out differently.  (None of them should.)
+ */
+void FormatterBenchmark::checkResults()
+{
+    QByteArray expected;
+    char result[GCODE_NUMBER_MAX_LENGTH];
+    unsigned int seed = 12345;
+    quint64 differences = 0;
+    size_t length;
+    double value;
+
+    for (int i = 0; i < FORMATTER_CHECK_VALUES; i++) {
+        // A simple LCG, so the values are the same on every run.
+        seed = (seed * 1103515245) + 12345;
+        value = ((double)(seed % 2000000) - 1000000.0) / (double)(1 + (i % 7) * 997);
+
+        expected = QString::number(value, 'f', 4).toLatin1();
+        length = GCodeNumberFormatter::formatFixed(result, value, 4, false);
+
+        // QString::number() writes "-0.0000" for tiny negative numbers, the formatter leaves the sign off.
+        if ((expected == "-0.0000") && (length == 6) && (memcmp(result, "0.0000", 6) == 0)) {
+            continue;
+        }
+
+        if (((size_t)expected.size() != length) || (memcmp(expected.constData(), result, length) != 0)) {
+            differences++;
+        }
+    }
+
+    printf("Checked %d values against QString::number(), %llu were rounded differently.\n", FORMATTER_CHECK_VALUES,
+           (unsigned long long)differences);
+}
+
+/**
+ * @brief FormatterBenchmark::report - Print the result of one test.
+ *
+ * @param name - The name of the test.
+ * @param nanoseconds - How long it took.
+ * @param checkValue - The number of bytes that were written, so the outputs can be compared (and so that
+ *      the compiler can't optimize the loops away.)
+ */
+void FormatterBenchmark::report(const char *name, qint64 nanoseconds, quint64 checkValue)
+{
+    double seconds = (double)nanoseconds / 1e9;
+
+    if (seconds <= 0) {
+        seconds = 1e-9;
+    }
+
+    printf("  %-36s %10.1f ns/move  %8.1f M moves/s  (%llu bytes)\n", name,
+           (double)nanoseconds / FORMATTER_BENCHMARK_MOVES, ((double)FORMATTER_BENCHMARK_MOVES / 1e6) / seconds,
+           (unsigned long long)checkValue);
+}
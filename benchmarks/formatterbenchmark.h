@@ -0,0 +1,25 @@
+#ifndef FORMATTERBENCHMARK_H
+#define FORMATTERBENCHMARK_H
+
+#include <QVector>
+
+class FormatterBenchmark
+{
+public:
+    FormatterBenchmark();
+
+    void run();
+
+private:
+    void createTestData();
+    void benchmarkQString();
+    void benchmarkSnprintf();
+    void benchmarkFormatter(bool trimZeros);
+    void checkResults();
+
+    void report(const char *name, qint64 nanoseconds, quint64 checkValue);
+
+    QVector<double> mValues;
+};
+
+#endif // FORMATTERBENCHMARK_H
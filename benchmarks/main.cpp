@@ -0,0 +1,122 @@
+#include "scannerbenchmark.h"
+#include "formatterbenchmark.h"
+#include "pipelinebenchmark.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief printUsage - Show the options.
+ */
+static void printUsage()
+{
+    printf("Usage :\n"
+           "  FAB-tweak-tom-benchmarks [options]\n"
+           "\n"
+           "With no options, the micro-benchmarks and the pipeline benchmarks (on the small and 100MB corpora) are run.\n"
+           "\n"
+           "  --micro                     Run the micro-benchmarks.\n"
+           "  --pipeline                  Run the pipeline benchmarks.\n"
+           "  --size <name>               Add a generated corpus to the pipeline benchmarks.  One of small, 100mb or\n"
+           "                              1gb.  (Can be given more than once.)\n"
+           "  --file <file>               Add a real G-code file to the pipeline benchmarks.  (Can be given more than\n"
+           "                              once.)\n"
+           "  --repetitions <count>       How many times to run each pipeline stage.  (Default : %d)\n"
+           "  --dir <directory>           Where to write the generated corpora and output.  (Default : the temp directory)\n"
+           "  --json <file>               Write the pipeline results to this file, in Google Benchmark's JSON format.\n"
+           "  --label <text>              Added to the JSON file, to tell runs apart.  (The commit, say.)\n",
+           PIPELINE_BENCHMARK_DEFAULT_REPETITIONS);
+}
+
+int main(int argc, char *argv[])
+{
+    ScannerBenchmark scanner;
+    FormatterBenchmark formatter;
+    PipelineBenchmark pipeline;
+    bool micro = false;
+    bool runPipeline = false;
+    bool haveCorpus = false;
+    const char *jsonFile = NULL;
+    const char *label = "";
+    int result = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *option = argv[i];
+        const char *value = ((i + 1) < argc) ? argv[i + 1] : NULL;
+
+        if (strcmp(option, "--micro") == 0) {
+            micro = true;
+        } else if (strcmp(option, "--pipeline") == 0) {
+            runPipeline = true;
+        } else if (value == NULL) {
+            printUsage();
+            return 1;
+        } else if (strcmp(option, "--size") == 0) {
+            if (strcmp(value, "small") == 0) {
+                pipeline.addGeneratedCorpus("small", PIPELINE_BENCHMARK_SMALL);
+            } else if (strcmp(value, "100mb") == 0) {
+                pipeline.addGeneratedCorpus("100MB", PIPELINE_BENCHMARK_MEDIUM);
+            } else if (strcmp(value, "1gb") == 0) {
+                pipeline.addGeneratedCorpus("1GB", PIPELINE_BENCHMARK_LARGE);
+            } else {
+                printUsage();
+                return 1;
+            }
+            haveCorpus = true;
+            runPipeline = true;
+            i++;
+        } else if (strcmp(option, "--file") == 0) {
+            pipeline.addFileCorpus(QString::fromLocal8Bit(value));
+            haveCorpus = true;
+            runPipeline = true;
+            i++;
+        } else if (strcmp(option, "--repetitions") == 0) {
+            pipeline.setRepetitions(atoi(value));
+            i++;
+        } else if (strcmp(option, "--dir") == 0) {
+            pipeline.setDirectory(QString::fromLocal8Bit(value));
+            i++;
+        } else if (strcmp(option, "--json") == 0) {
+            jsonFile = value;
+            i++;
+        } else if (strcmp(option, "--label") == 0) {
+            label = value;
+            i++;
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    if ((micro == false) && (runPipeline == false)) {
+        micro = true;
+        runPipeline = true;
+    }
+
+    if ((runPipeline == true) && (haveCorpus == false)) {
+        pipeline.addGeneratedCorpus("small", PIPELINE_BENCHMARK_SMALL);
+        pipeline.addGeneratedCorpus("100MB", PIPELINE_BENCHMARK_MEDIUM);
+    }
+
+    if (micro == true) {
+        scanner.run();
+
+        printf("\n");
+        formatter.run();
+        printf("\n");
+    }
+
+    if (runPipeline == true) {
+        if (pipeline.run() == false) {
+            result = 1;
+        }
+
+        if ((jsonFile != NULL) && (pipeline.writeJson(QString::fromLocal8Bit(jsonFile), QString::fromLocal8Bit(label)) == false)) {
+            printf("Unable to write the results to %s.\n", jsonFile);
+            result = 1;
+        }
+    }
+
+    return result;
+}
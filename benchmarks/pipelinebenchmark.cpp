@@ -0,0 +1,659 @@
+#include "pipelinebenchmark.h"
+
+#include "gcodeeditor.h"
+#include "gcodelinereader.h"
+#include "gcodescanner.h"
+#include "gcodetokenizer.h"
+#include "gcodewriter.h"
+#include "changegcodefeedrates.h"
+#include "createbedlevelinggcode.h"
+#include "logger.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QThread>
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+// The number of moves in each generated contour, and how far apart the contours are.  (In mm.)
+#define PIPELINE_CONTOUR_MOVES               40
+#define PIPELINE_CONTOUR_SPACING             12
+
+// The bed leveling job is a 1000mm square, milled in as many passes as it takes to write about as much G-code
+// as the corpus it is run alongside.  (Each pass of the square writes about this many bytes.)
+#define PIPELINE_BED_LEVEL_SIZE              1000
+#define PIPELINE_BED_LEVEL_DEPTH             2
+#define PIPELINE_BED_LEVEL_BYTES_PER_PASS    (550 * 1024)
+
+PipelineBenchmark::PipelineBenchmark()
+{
+    mRepetitions = PIPELINE_BENCHMARK_DEFAULT_REPETITIONS;
+    mDirectory = QDir::tempPath();
+    mIterationStart = 0;
+    mIterationCpuStart = 0;
+}
+
+/**
+ * @brief PipelineBenchmark::setRepetitions - Set how many times each stage is run.
+ *
+ * @param count - The number of times.  (At least 1.)
+ */
+void PipelineBenchmark::setRepetitions(int count)
+{
+    mRepetitions = (count < 1) ? 1 : count;
+}
+
+/**
+ * @brief PipelineBenchmark::setDirectory - Set where the generated corpora and the output of each stage
+ *      are written.  (The 1GB corpus needs a little over 2GB free.)
+ *
+ * @param directory - The directory.
+ */
+void PipelineBenchmark::setDirectory(QString directory)
+{
+    mDirectory = directory;
+}
+
+/**
+ * @brief PipelineBenchmark::addGeneratedCorpus - Add a corpus of CAM-like G-code that is generated before
+ *      it is used, and removed again afterwards.
+ *
+ * @param name - The name used in the results.
+ * @param size - About how many bytes to generate.
+ */
+void PipelineBenchmark::addGeneratedCorpus(QByteArray name, quint64 size)
+{
+    PipelineCorpus corpus;
+
+    corpus.name = name;
+    corpus.filename = mDirectory + "/fabtweaktom-pipeline-" + QString(name) + ".gcode";
+    corpus.size = size;
+    corpus.bytes = 0;
+    corpus.lines = 0;
+
+    mCorpora.append(corpus);
+}
+
+/**
+ * @brief PipelineBenchmark::addFileCorpus - Add a real G-code file to run the stages on.  (It is only read.)
+ *
+ * @param filename - The file.
+ */
+void PipelineBenchmark::addFileCorpus(QString filename)
+{
+    PipelineCorpus corpus;
+
+    corpus.name = QFileInfo(filename).fileName().toUtf8();
+    corpus.filename = filename;
+    corpus.size = 0;
+    corpus.bytes = 0;
+    corpus.lines = 0;
+
+    mCorpora.append(corpus);
+}
+
+/**
+ * @brief PipelineBenchmark::run - Run every stage on every corpus, and print the results.
+ *
+ * @return true if every corpus could be used.  false otherwise.
+ */
+bool PipelineBenchmark::run()
+{
+    bool result = true;
+    int threads = QThread::idealThreadCount();
+
+    // Only problems are worth the time it takes to log them.
+    logger.setLevel(LOG_LEVEL_WARNING);
+
+    for (int i = 0; i < mCorpora.size(); i++) {
+        PipelineCorpus &corpus = mCorpora[i];
+
+        if (prepareCorpus(corpus) == false) {
+            printf("Unable to use the corpus %s (%s).\n\n", corpus.name.constData(), QFile::encodeName(corpus.filename).constData());
+            result = false;
+            continue;
+        }
+
+        printf("Pipeline, %s : %llu bytes, %llu lines.\n", corpus.name.constData(), (unsigned long long)corpus.bytes,
+               (unsigned long long)corpus.lines);
+
+        benchmarkLoad(corpus, false);
+        benchmarkLoad(corpus, true);
+        benchmarkTokenize(corpus);
+        benchmarkRewrite(corpus, 1);
+        if (threads > 1) {
+            benchmarkRewrite(corpus, threads);
+        }
+        benchmarkWrite(corpus);
+        benchmarkBedLevel(corpus);
+
+        if (corpus.size > 0) {
+            QFile::remove(corpus.filename);
+        }
+
+        printf("\n");
+    }
+
+    return result;
+}
+
+/**
+ * @brief PipelineBenchmark::prepareCorpus - Generate the corpus if it needs to be, and count its lines.
+ *
+ * @param corpus - The corpus.  Its size and line count are filled in.
+ *
+ * @return true if the corpus is ready to use.  false otherwise.
+ */
+bool PipelineBenchmark::prepareCorpus(PipelineCorpus &corpus)
+{
+    if ((corpus.size > 0) && (generateCorpus(corpus) == false)) {
+        return false;
+    }
+
+    QFileInfo info(corpus.filename);
+    if (info.exists() == false) {
+        return false;
+    }
+
+    corpus.bytes = info.size();
+    corpus.lines = countLines(corpus.filename);
+
+    return true;
+}
+
+/**
+ * @brief PipelineBenchmark::generateCorpus - Write G-code that looks like the output of a CAM program.  Each
+ *      block retracts, travels to the next contour, plunges, and follows the contour in short moves (with an
+ *      arc every so often), with a comment now and then.
+ *
+ * @param corpus - The corpus to write.
+ *
+ * @return true if the file was written.  false otherwise.
+ */
+bool PipelineBenchmark::generateCorpus(const PipelineCorpus &corpus)
+{
+    GCodeWriter writer;
+    char line[160];
+    int length;
+    unsigned long block = 0;
+    double centerX;
+    double centerY;
+    double radius;
+    double angle;
+
+    if (writer.open(corpus.filename) == false) {
+        return false;
+    }
+
+    writer.write(QByteArray("(Generated by FAB-tweak-tom-benchmarks)\nG21\nG90\nM03 S12000\nG04 P5\n"));
+
+    while (writer.getBytesWritten() < corpus.size) {
+        centerX = (double)(block % 20) * PIPELINE_CONTOUR_SPACING + 10;
+        centerY = (double)((block / 20) % 20) * PIPELINE_CONTOUR_SPACING + 10;
+        radius = 2 + (double)(block % 7) * 0.5;
+
+        if ((block % 25) == 0) {
+            length = snprintf(line, sizeof(line), "(Contour %lu)\n", block);
+            writer.write(line, length);
+        }
+
+        length = snprintf(line, sizeof(line), "G00 Z2.0000\nG00 X%.4f Y%.4f\nG01 Z-0.1500 F100\n", centerX + radius, centerY);
+        writer.write(line, length);
+
+        for (int i = 1; i <= PIPELINE_CONTOUR_MOVES; i++) {
+            angle = (2 * M_PI * i) / PIPELINE_CONTOUR_MOVES;
+
+            if (i == 1) {
+                length = snprintf(line, sizeof(line), "G01 X%.4f Y%.4f F600\n", centerX + radius * cos(angle), centerY + radius * sin(angle));
+            } else if (((block % 10) == 0) && (i == PIPELINE_CONTOUR_MOVES)) {
+                length = snprintf(line, sizeof(line), "G02 X%.4f Y%.4f I%.4f J%.4f\n", centerX + radius, centerY,
+                                  -radius * cos(angle), -radius * sin(angle));
+            } else {
+                length = snprintf(line, sizeof(line), "G01 X%.4f Y%.4f\n", centerX + radius * cos(angle), centerY + radius * sin(angle));
+            }
+
+            writer.write(line, length);
+        }
+
+        block++;
+    }
+
+    writer.write(QByteArray("G00 Z5.0000\nM05\nM02\n"));
+
+    return writer.close();
+}
+
+/**
+ * @brief PipelineBenchmark::benchmarkLoad - Time GCodeEditor::loadExistingFile(), the way the GUI opens a file.
+ *
+ * @param corpus - The corpus to load.
+ * @param memoryMap - true to memory map the file, false to read it in.
+ */
+void PipelineBenchmark::benchmarkLoad(const PipelineCorpus &corpus, bool memoryMap)
+{
+    quint64 lines = 0;
+    bool loaded;
+
+    startStage();
+    for (int i = 0; i < mRepetitions; i++) {
+        GCodeEditor editor;
+
+        editor.setMemoryMapFiles(memoryMap);
+
+        startIteration();
+        loaded = editor.loadExistingFile(corpus.filename);
+        lines = editor.getLineCount();
+        endIteration();
+
+        if (loaded == false) {
+            printf("  Loading %s failed.\n", corpus.name.constData());
+            return;
+        }
+    }
+
+    finishStage("load/" + corpus.name + (memoryMap == true ? "/mapped" : "/read"), corpus.bytes, lines);
+}
+
+/**
+ * @brief PipelineBenchmark::benchmarkTokenize - Time splitting the corpus in to words with GCodeTokenizer.
+ *      The file is read in first, so only the tokenizer is timed.
+ *
+ * @param corpus - The corpus to tokenize.
+ */
+void PipelineBenchmark::benchmarkTokenize(const PipelineCorpus &corpus)
+{
+    QFile file(corpus.filename);
+    QByteArray data;
+    GCodeWord word;
+    const char *cursor;
+    const char *end;
+    const char *lineEnd;
+    quint64 lines = 0;
+    quint64 words = 0;
+
+    if (file.open(QIODevice::ReadOnly) == false) {
+        return;
+    }
+
+    data = file.readAll();
+    file.close();
+
+    startStage();
+    for (int i = 0; i < mRepetitions; i++) {
+        startIteration();
+        lines = 0;
+        words = 0;
+        cursor = data.constData();
+        end = cursor + data.size();
+
+        while (cursor < end) {
+            lineEnd = GCodeScanner::findNewline(cursor, end);
+
+            GCodeTokenizer tokenizer(cursor, lineEnd - cursor);
+            while (tokenizer.nextWord(&word) == true) {
+                words++;
+            }
+
+            lines++;
+            cursor = lineEnd + 1;
+        }
+        endIteration();
+    }
+
+    // The word count keeps the loop from being optimized away.
+    if (words == 0) {
+        printf("  (No words were found in %s.)\n", corpus.name.constData());
+    }
+
+    finishStage("tokenize/" + corpus.name, corpus.bytes, lines);
+}
+
+/**
+ * @brief PipelineBenchmark::benchmarkRewrite - Time ChangeGCodeFeedRates::processGCodeFile() with the options
+ *      that the GUI uses by default.  (Clean up, and redefine both feed rates.)
+ *
+ * @param corpus - The corpus to rewrite.
+ * @param threads - The number of threads to process the file on.
+ */
+void PipelineBenchmark::benchmarkRewrite(const PipelineCorpus &corpus, int threads)
+{
+    QString outputFile = mDirectory + "/fabtweaktom-pipeline-rewrite.gcode";
+    int result;
+
+    startStage();
+    for (int i = 0; i < mRepetitions; i++) {
+        ChangeGCodeFeedRates changer;
+
+        changer.setInputFile(corpus.filename);
+        changer.setOutputFile(outputFile);
+        changer.setCleanUpGCode(true);
+        changer.setRedefineFeedRates(true);
+        changer.setNewXYFeedRate("800");
+        changer.setNewZFeedRate("80");
+        changer.setThreadCount(threads);
+
+        startIteration();
+        result = changer.processGCodeFile();
+        endIteration();
+
+        if (result != CHANGE_GCODE_SUCCESS) {
+            printf("  Rewriting %s failed : %s\n", corpus.name.constData(), changer.resultCodeAsString(result).toUtf8().constData());
+            QFile::remove(outputFile);
+            return;
+        }
+    }
+
+    QFile::remove(outputFile);
+    finishStage("rewrite/" + corpus.name + "/threads:" + QByteArray::number(threads), corpus.bytes, corpus.lines);
+}
+
+/**
+ * @brief PipelineBenchmark::benchmarkWrite - Time GCodeEditor::writeFile(), the way the GUI saves a file that
+ *      was loaded.  (Loading it isn't timed.)
+ *
+ * @param corpus - The corpus to write out again.
+ */
+void PipelineBenchmark::benchmarkWrite(const PipelineCorpus &corpus)
+{
+    QString outputFile = mDirectory + "/fabtweaktom-pipeline-write.gcode";
+    GCodeEditor editor;
+    bool written;
+
+    if (editor.loadExistingFile(corpus.filename) == false) {
+        return;
+    }
+
+    startStage();
+    for (int i = 0; i < mRepetitions; i++) {
+        startIteration();
+        written = editor.writeFile(outputFile);
+        endIteration();
+
+        if (written == false) {
+            printf("  Writing %s failed.\n", corpus.name.constData());
+            QFile::remove(outputFile);
+            return;
+        }
+    }
+
+    QFile::remove(outputFile);
+    finishStage("write/" + corpus.name, corpus.bytes, corpus.lines);
+}
+
+/**
+ * @brief PipelineBenchmark::benchmarkBedLevel - Time CreateBedLevelingGCode::createGCodeFile() making a job that
+ *      writes about as much G-code as the corpus has in it.
+ *
+ * @param corpus - The corpus to match the size of.
+ */
+void PipelineBenchmark::benchmarkBedLevel(const PipelineCorpus &corpus)
+{
+    QString outputFile = mDirectory + "/fabtweaktom-pipeline-bedlevel.gcode";
+    int passes = (int)((corpus.bytes + PIPELINE_BED_LEVEL_BYTES_PER_PASS - 1) / PIPELINE_BED_LEVEL_BYTES_PER_PASS);
+    QString error;
+
+    if (passes < 1) {
+        passes = 1;
+    }
+
+    startStage();
+    for (int i = 0; i < mRepetitions; i++) {
+        CreateBedLevelingGCode bedleveling;
+
+        bedleveling.setMillSize(0.3);
+        bedleveling.setOverlapSize(0.15);
+        bedleveling.setCutDepth(-1 * PIPELINE_BED_LEVEL_DEPTH);
+        bedleveling.setMaxStepDown((double)PIPELINE_BED_LEVEL_DEPTH / passes);
+        bedleveling.setLevelWidth(PIPELINE_BED_LEVEL_SIZE);
+        bedleveling.setLevelHeight(PIPELINE_BED_LEVEL_SIZE);
+        bedleveling.setSpindleSpeed(15000);
+        bedleveling.setXYFeedRate(400);
+        bedleveling.setZFeedRate(30);
+
+        startIteration();
+        error = bedleveling.createGCodeFile(outputFile);
+        endIteration();
+
+        if (error.isEmpty() == false) {
+            printf("  Creating the bed leveling G-code failed : %s\n", error.toUtf8().constData());
+            QFile::remove(outputFile);
+            return;
+        }
+    }
+
+    finishStage("bedlevel/" + corpus.name, QFileInfo(outputFile).size(), countLines(outputFile));
+    QFile::remove(outputFile);
+}
+
+/**
+ * @brief PipelineBenchmark::startStage - Get ready to time the iterations of a stage.
+ */
+void PipelineBenchmark::startStage()
+{
+    mWallTimes.clear();
+    mCpuTimes.clear();
+    resetPeakRss();
+    mTimer.start();
+}
+
+/**
+ * @brief PipelineBenchmark::startIteration - Start timing one iteration.
+ */
+void PipelineBenchmark::startIteration()
+{
+    mIterationCpuStart = cpuSeconds();
+    mIterationStart = mTimer.nsecsElapsed();
+}
+
+/**
+ * @brief PipelineBenchmark::endIteration - Stop timing one iteration.
+ */
+void PipelineBenchmark::endIteration()
+{
+    mWallTimes.append((double)(mTimer.nsecsElapsed() - mIterationStart) / 1e9);
+    mCpuTimes.append(cpuSeconds() - mIterationCpuStart);
+}
+
+/**
+ * @brief PipelineBenchmark::finishStage - Work out the result of a stage from the times of its iterations,
+ *      print it, and keep it for writeJson().
+ *
+ * @param name - The name of the result.
+ * @param bytes - The number of bytes that one iteration processed.
+ * @param lines - The number of lines that one iteration processed.
+ */
+void PipelineBenchmark::finishStage(QByteArray name, quint64 bytes, quint64 lines)
+{
+    PipelineResult result;
+    QVector<double> wallTimes = mWallTimes;
+    QVector<double> cpuTimes = mCpuTimes;
+    double seconds;
+
+    if (wallTimes.isEmpty() == true) {
+        return;
+    }
+
+    std::sort(wallTimes.begin(), wallTimes.end());
+    std::sort(cpuTimes.begin(), cpuTimes.end());
+
+    result.name = name;
+    result.iterations = wallTimes.size();
+    result.medianSeconds = wallTimes.at(wallTimes.size() / 2);
+    result.bestSeconds = wallTimes.first();
+    result.cpuSeconds = cpuTimes.at(cpuTimes.size() / 2);
+    result.bytes = bytes;
+    result.lines = lines;
+    result.peakRss = getPeakRss();
+    mResults.append(result);
+
+    seconds = (result.medianSeconds > 0) ? result.medianSeconds : 1e-9;
+
+    printf("  %-36s %9.1f MB/s %12.0f lines/s %9.1f MB peak  (%.3f s)\n", name.constData(),
+           ((double)bytes / (1024.0 * 1024.0)) / seconds, (double)lines / seconds,
+           (double)result.peakRss / (1024.0 * 1024.0), result.medianSeconds);
+}
+
+/**
+ * @brief PipelineBenchmark::writeJson - Write the results in the JSON format that Google Benchmark uses, so
+ *      that the results from two commits can be compared with its tools/compare.py.
+ *
+ * @param filename - The file to write.
+ * @param label - Something to tell this run apart from others by.  (A commit, say.)  May be empty.
+ *
+ * @return true if the file was written.  false otherwise.
+ */
+bool PipelineBenchmark::writeJson(QString filename, QString label)
+{
+    FILE *file;
+    QByteArray escaped;
+
+    file = fopen(QFile::encodeName(filename).constData(), "w");
+    if (file == NULL) {
+        return false;
+    }
+
+    escaped = label.toUtf8();
+    escaped.replace("\\", "\\\\").replace("\"", "\\\"");
+
+    fprintf(file, "{\n  \"context\": {\n");
+    fprintf(file, "    \"date\": \"%s\",\n", QDateTime::currentDateTime().toString(Qt::ISODate).toUtf8().constData());
+    fprintf(file, "    \"executable\": \"FAB-tweak-tom-benchmarks\",\n");
+    fprintf(file, "    \"num_cpus\": %d,\n", QThread::idealThreadCount());
+    fprintf(file, "    \"scanner\": \"%s\",\n", GCodeScanner::implementationName(GCodeScanner::getImplementation()));
+#ifdef QT_NO_DEBUG
+    fprintf(file, "    \"library_build_type\": \"release\",\n");
+#else
+    fprintf(file, "    \"library_build_type\": \"debug\",\n");
+#endif
+    fprintf(file, "    \"label\": \"%s\"\n  },\n", escaped.constData());
+    fprintf(file, "  \"benchmarks\": [");
+
+    for (int i = 0; i < mResults.size(); i++) {
+        const PipelineResult &result = mResults.at(i);
+        double seconds = (result.medianSeconds > 0) ? result.medianSeconds : 1e-9;
+
+        escaped = result.name;
+        escaped.replace("\\", "\\\\").replace("\"", "\\\"");
+
+        fprintf(file, "%s\n    {\n", (i == 0) ? "" : ",");
+        fprintf(file, "      \"name\": \"%s\",\n", escaped.constData());
+        fprintf(file, "      \"run_name\": \"%s\",\n", escaped.constData());
+        fprintf(file, "      \"run_type\": \"iteration\",\n");
+        fprintf(file, "      \"iterations\": %d,\n", result.iterations);
+        fprintf(file, "      \"real_time\": %.6f,\n", result.medianSeconds * 1000);
+        fprintf(file, "      \"cpu_time\": %.6f,\n", result.cpuSeconds * 1000);
+        fprintf(file, "      \"best_real_time\": %.6f,\n", result.bestSeconds * 1000);
+        fprintf(file, "      \"time_unit\": \"ms\",\n");
+        fprintf(file, "      \"bytes\": %llu,\n", (unsigned long long)result.bytes);
+        fprintf(file, "      \"lines\": %llu,\n", (unsigned long long)result.lines);
+        fprintf(file, "      \"bytes_per_second\": %.1f,\n", (double)result.bytes / seconds);
+        fprintf(file, "      \"items_per_second\": %.1f,\n", (double)result.lines / seconds);
+        fprintf(file, "      \"peak_rss_bytes\": %llu\n", (unsigned long long)result.peakRss);
+        fprintf(file, "    }");
+    }
+
+    fprintf(file, "\n  ]\n}\n");
+
+    return (fclose(file) == 0);
+}
+
+/**
+ * @brief PipelineBenchmark::countLines - Count the lines in a file.
+ *
+ * @param filename - The file.
+ *
+ * @return quint64 containing the number of lines.  (A last line without a line ending is counted.)
+ */
+quint64 PipelineBenchmark::countLines(QString filename)
+{
+    GCodeLineReader reader;
+    const char *line;
+    size_t length;
+    quint64 lines = 0;
+
+    if (reader.open(filename) == false) {
+        return 0;
+    }
+
+    while (reader.readLine(&line, &length) == true) {
+        lines++;
+    }
+
+    return lines;
+}
+
+/**
+ * @brief PipelineBenchmark::cpuSeconds - Get the CPU time that the whole process (every thread) has used.
+ *
+ * @return double containing the time, in seconds.
+ */
+double PipelineBenchmark::cpuSeconds()
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+/**
+ * @brief PipelineBenchmark::resetPeakRss - Start measuring the peak resident memory again, so that each stage
+ *      gets its own peak.  (Only Linux can do this.  Elsewhere the peak is the peak of the whole run so far.)
+ */
+void PipelineBenchmark::resetPeakRss()
+{
+#ifdef Q_OS_LINUX
+    FILE *file = fopen("/proc/self/clear_refs", "w");
+
+    if (file != NULL) {
+        fputs("5", file);
+        fclose(file);
+    }
+#endif
+}
+
+/**
+ * @brief PipelineBenchmark::getPeakRss - Get the most resident memory the process has used since the last
+ *      resetPeakRss().
+ *
+ * @return quint64 containing the peak, in bytes.  0 if it can't be found.
+ */
+quint64 PipelineBenchmark::getPeakRss()
+{
+#ifdef Q_OS_LINUX
+    FILE *file = fopen("/proc/self/status", "r");
+    char line[256];
+    unsigned long long kilobytes = 0;
+
+    if (file != NULL) {
+        while (fgets(line, sizeof(line), file) != NULL) {
+            if (sscanf(line, "VmHWM: %llu kB", &kilobytes) == 1) {
+                break;
+            }
+        }
+        fclose(file);
+    }
+
+    return kilobytes * 1024;
+#elif defined(Q_OS_UNIX)
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+
+#ifdef Q_OS_MAC
+    return usage.ru_maxrss;
+#else
+    return (quint64)usage.ru_maxrss * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
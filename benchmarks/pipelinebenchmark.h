@@ -0,0 +1,91 @@
+#ifndef PIPELINEBENCHMARK_H
+#define PIPELINEBENCHMARK_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include <QElapsedTimer>
+
+// The sizes of the generated corpora.
+#define PIPELINE_BENCHMARK_SMALL             (4ULL * 1024 * 1024)
+#define PIPELINE_BENCHMARK_MEDIUM            (100ULL * 1024 * 1024)
+#define PIPELINE_BENCHMARK_LARGE             (1024ULL * 1024 * 1024)
+
+// How many times each stage is run, when no other count is set.
+#define PIPELINE_BENCHMARK_DEFAULT_REPETITIONS   3
+
+// A set of G-code that the stages are run on.
+struct PipelineCorpus
+{
+    QByteArray name;                // Used in the names of the results.  ("100MB", or the name of a real file.)
+    QString filename;
+    quint64 size;                   // The size to generate, or 0 for a real file.
+    quint64 bytes;                  // The size of the file, once it exists.
+    quint64 lines;
+};
+
+// The result of running one stage on one corpus.  (The same fields that Google Benchmark writes, so its
+// compare.py can compare two runs.)
+struct PipelineResult
+{
+    QByteArray name;
+    int iterations;
+    double medianSeconds;           // Wall clock.
+    double bestSeconds;
+    double cpuSeconds;              // The median CPU time of the whole process.  (All threads.)
+    quint64 bytes;                  // Processed by one iteration.
+    quint64 lines;
+    quint64 peakRss;                // Bytes, or 0 if it can't be found.
+};
+
+// Times each stage of the G-code pipeline from start to end, the way the GUI and command line use it, on
+// generated corpora of CAM-like G-code and on real files.  Every stage is run a number of times, and the
+// median is reported as MB/s and lines/s, along with the peak resident memory the stage used.  The results
+// can be written as JSON, so that runs on two commits can be compared.
+class PipelineBenchmark
+{
+public:
+    PipelineBenchmark();
+
+    void setRepetitions(int count);
+    void setDirectory(QString directory);
+    void addGeneratedCorpus(QByteArray name, quint64 size);
+    void addFileCorpus(QString filename);
+
+    bool run();
+    bool writeJson(QString filename, QString label);
+
+private:
+    bool prepareCorpus(PipelineCorpus &corpus);
+    bool generateCorpus(const PipelineCorpus &corpus);
+
+    void benchmarkLoad(const PipelineCorpus &corpus, bool memoryMap);
+    void benchmarkTokenize(const PipelineCorpus &corpus);
+    void benchmarkRewrite(const PipelineCorpus &corpus, int threads);
+    void benchmarkWrite(const PipelineCorpus &corpus);
+    void benchmarkBedLevel(const PipelineCorpus &corpus);
+
+    void startStage();
+    void startIteration();
+    void endIteration();
+    void finishStage(QByteArray name, quint64 bytes, quint64 lines);
+
+    static quint64 countLines(QString filename);
+    static double cpuSeconds();
+    static void resetPeakRss();
+    static quint64 getPeakRss();
+
+    int mRepetitions;
+    QString mDirectory;
+    QVector<PipelineCorpus> mCorpora;
+    QVector<PipelineResult> mResults;
+
+    // The stage being timed.
+    QVector<double> mWallTimes;
+    QVector<double> mCpuTimes;
+    QElapsedTimer mTimer;
+    qint64 mIterationStart;         // ns, from mTimer.
+    double mIterationCpuStart;
+};
+
+#endif // PIPELINEBENCHMARK_H
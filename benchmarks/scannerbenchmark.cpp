@@ -0,0 +1,248 @@
+#include "scannerbenchmark.h"
+
+#include "gcodescanner.h"
+#include "gcodelinereader.h"
+
+#include <QDir>
+#include <QFile>
+#include <QTextStream>
+#include <QElapsedTimer>
+
+#include <stdio.h>
+
+// How much synthetic G-code to scan.
+#define SCANNER_BENCHMARK_SIZE       (64 * 1024 * 1024)
+
+ScannerBenchmark::ScannerBenchmark()
+{
+    mFilename = QDir::tempPath() + "/fabtweaktom-scanner-benchmark.gcode";
+}
+
+/**
+ * @brief ScannerBenchmark::run - Create the test data, and compare the line splitting and comment
+ *      finding loops that the G-code classes use (or used to use.)
+ */
+void ScannerBenchmark::run()
+{
+    createTestData();
+
+    printf("Line splitting (from a file) :\n");
+    benchmarkFgets();
+    benchmarkTextStream();
+    benchmarkLineReader();
+
+    printf("\nLine splitting (in memory) :\n");
+    benchmarkNewlines();
+
+    printf("\nComment finding (in memory) :\n");
+    benchmarkComments();
+
+    QFile::remove(mFilename);
+}
+
+/**
+ * @brief ScannerBenchmark::createTestData - Build a buffer of G-code that looks like typical CAM output, with
+ *      the occasional comment, and write it to a temporary file for the file based tests.
+ */
+void ScannerBenchmark::createTestData()
+{
+    QFile file(mFilename);
+    char line[128];
+    int length;
+    unsigned long i = 0;
+
+    mData.clear();
+    mData.reserve(SCANNER_BENCHMARK_SIZE + sizeof(line));
+
+    while (mData.size() < SCANNER_BENCHMARK_SIZE) {
+        if ((i % 50) == 0) {
+            length = snprintf(line, sizeof(line), "(Pass %lu)\n", i / 50);
+        } else if ((i % 7) == 0) {
+            length = snprintf(line, sizeof(line), "G1 X%lu.%04lu Y%lu.%04lu F600 ; feed\n", i % 200, i % 10000, (i * 7) % 200, (i * 13) % 10000);
+        } else {
+            length = snprintf(line, sizeof(line), "G1 X%lu.%04lu Y%lu.%04lu\n", i % 200, i % 10000, (i * 7) % 200, (i * 13) % 10000);
+        }
+
+        mData.append(line, length);
+        i++;
+    }
+
+    if (file.open(QIODevice::WriteOnly) == true) {
+        file.write(mData);
+        file.close();
+    }
+
+    printf("Test data : %d bytes, %lu lines.\n\n", mData.size(), i);
+}
+
+/**
+ * @brief ScannerBenchmark::benchmarkFgets - The loop that ChangeGCodeFeedRates::processGCodeFile() used to use.
+ */
+void ScannerBenchmark::benchmarkFgets()
+{
+    QElapsedTimer timer;
+    FILE *infile;
+    char oneLine[1024];
+    quint64 lines = 0;
+
+    infile = fopen(QFile::encodeName(mFilename).constData(), "r");
+    if (infile == NULL) {
+        return;
+    }
+
+    timer.start();
+    while (fgets(oneLine, sizeof(oneLine), infile) != NULL) {
+        lines++;
+    }
+
+    report("fgets()", mData.size(), timer.nsecsElapsed(), lines);
+    fclose(infile);
+}
+
+/**
+ * @brief ScannerBenchmark::benchmarkTextStream - The loop that GCodeEditor::loadExistingFile() used to use.
+ */
+void ScannerBenchmark::benchmarkTextStream()
+{
+    QElapsedTimer timer;
+    QFile file(mFilename);
+    QTextStream stream(&file);
+    quint64 lines = 0;
+
+    if (file.open(QIODevice::ReadOnly) == false) {
+        return;
+    }
+
+    timer.start();
+    while (stream.atEnd() == false) {
+        stream.readLine();
+        lines++;
+    }
+
+    report("QTextStream::readLine()", mData.size(), timer.nsecsElapsed(), lines);
+    file.close();
+}
+
+/**
+ * @brief ScannerBenchmark::benchmarkLineReader - The block reader that the G-code classes use now.
+ */
+void ScannerBenchmark::benchmarkLineReader()
+{
+    QElapsedTimer timer;
+    GCodeLineReader reader;
+    const char *line;
+    size_t length;
+    quint64 lines = 0;
+
+    if (reader.open(mFilename) == false) {
+        return;
+    }
+
+    timer.start();
+    while (reader.readLine(&line, &length) == true) {
+        lines++;
+    }
+
+    report("GCodeLineReader::readLine()", mData.size(), timer.nsecsElapsed(), lines);
+}
+
+/**
+ * @brief ScannerBenchmark::benchmarkNewlines - Split the in memory data in to lines with each of the
+ *      scanner implementations.
+ */
+void ScannerBenchmark::benchmarkNewlines()
+{
+    QElapsedTimer timer;
+    const char *start = mData.constData();
+    const char *end = start + mData.size();
+    const char *cursor;
+    quint64 lines;
+    QByteArray name;
+    int i;
+
+    // The plain loop that the scanner replaces.
+    timer.start();
+    lines = 0;
+    for (cursor = start; cursor < end; cursor++) {
+        if (*cursor == '\n') {
+            lines++;
+        }
+    }
+    report("byte at a time loop", mData.size(), timer.nsecsElapsed(), lines);
+
+    for (i = GCodeScanner::Scalar; i <= GCodeScanner::AVX2; i++) {
+        if (GCodeScanner::setImplementation((GCodeScanner::Implementation)i) == false) {
+            printf("  %-36s not supported on this CPU\n", GCodeScanner::implementationName((GCodeScanner::Implementation)i));
+            continue;
+        }
+
+        timer.start();
+        lines = 0;
+        cursor = start;
+        while (cursor < end) {
+            cursor = GCodeScanner::findNewline(cursor, end) + 1;
+            lines++;
+        }
+        name = QByteArray("findNewline() ") + GCodeScanner::implementationName((GCodeScanner::Implementation)i);
+        report(name.constData(), mData.size(), timer.nsecsElapsed(), lines);
+
+        timer.start();
+        lines = GCodeScanner::countNewlines(start, end);
+        name = QByteArray("countNewlines() ") + GCodeScanner::implementationName((GCodeScanner::Implementation)i);
+        report(name.constData(), mData.size(), timer.nsecsElapsed(), lines);
+    }
+}
+
+/**
+ * @brief ScannerBenchmark::benchmarkComments - Find every comment in the in memory data with each of the
+ *      scanner implementations.
+ */
+void ScannerBenchmark::benchmarkComments()
+{
+    QElapsedTimer timer;
+    const char *start = mData.constData();
+    const char *end = start + mData.size();
+    const char *cursor;
+    quint64 comments;
+    QByteArray name;
+    int i;
+
+    for (i = GCodeScanner::Scalar; i <= GCodeScanner::AVX2; i++) {
+        if (GCodeScanner::setImplementation((GCodeScanner::Implementation)i) == false) {
+            continue;
+        }
+
+        timer.start();
+        comments = 0;
+        cursor = start;
+        while (cursor < end) {
+            cursor = GCodeScanner::findCommentOrNewline(cursor, end);
+            if ((cursor < end) && (*cursor != '\n')) {
+                comments++;
+            }
+            cursor++;
+        }
+        name = QByteArray("findCommentOrNewline() ") + GCodeScanner::implementationName((GCodeScanner::Implementation)i);
+        report(name.constData(), mData.size(), timer.nsecsElapsed(), comments);
+    }
+}
+
+/**
+ * @brief ScannerBenchmark::report - Print the result of one test.
+ *
+ * @param name - The name of the test.
+ * @param bytes - The number of bytes that were processed.
+ * @param nanoseconds - How long it took.
+ * @param checkValue - The count the test came up with, so that the tests can be compared (and so that
+ *      the compiler can't optimize the loops away.)
+ */
+void ScannerBenchmark::report(const char *name, quint64 bytes, qint64 nanoseconds, quint64 checkValue)
+{
+    double seconds = (double)nanoseconds / 1e9;
+
+    if (seconds <= 0) {
+        seconds = 1e-9;
+    }
+
+    printf("  %-36s %10.1f MB/s  (%llu)\n", name, ((double)bytes / (1024.0 * 1024.0)) / seconds, (unsigned long long)checkValue);
+}
@@ -0,0 +1,28 @@
+#ifndef SCANNERBENCHMARK_H
+#define SCANNERBENCHMARK_H
+
+#include <QByteArray>
+#include <QString>
+
+class ScannerBenchmark
+{
+public:
+    ScannerBenchmark();
+
+    void run();
+
+private:
+    void createTestData();
+    void benchmarkFgets();
+    void benchmarkTextStream();
+    void benchmarkLineReader();
+    void benchmarkNewlines();
+    void benchmarkComments();
+
+    void report(const char *name, quint64 bytes, qint64 nanoseconds, quint64 checkValue);
+
+    QByteArray mData;
+    QString mFilename;
+};
+
+#endif // SCANNERBENCHMARK_H
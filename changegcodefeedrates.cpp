@@ -1,5 +1,433 @@
 #include "changegcodefeedrates.h"
+#include "gcodelinereader.h"
+#include "gcodescanner.h"
+#include "gcodetokenizer.h"
+#include "gcodewriter.h"
+#include "gcodeoutput.h"
+#include "gcodeprogress.h"
+#include "gcodeprogram.h"
+#include "gcodeprogramcache.h"
+#include "gcodetimeestimator.h"
+#include "gcodemoveoptimizer.h"
+#include "gcodearcfitter.h"
+#include "gcodetraveloptimizer.h"
+#include "gcodezcompensator.h"
+#include "gcodefeedpolicy.h"
+#include "gcodelookaheadplanner.h"
 #include "logger.h"
+#include "profiler.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QList>
+#include <QThread>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QElapsedTimer>
+
+#include <string.h>
+
+// The amount of the input given to each worker when a file is processed on more than one thread.
+#define CHANGE_GCODE_CHUNK_SIZE              (4 * 1024 * 1024)
+
+// How much of the end of the previous chunk is looked at to guess the modal state a chunk starts with.
+#define CHANGE_GCODE_GUESS_WINDOW            (16 * 1024)
+
+// How much of a file that isn't mapped in to memory is read at a time, while looking back from the end of it
+// for the last M05.
+#define CHANGE_GCODE_SEARCH_BLOCK_SIZE       (64 * 1024)
+
+// The words on a line of G-code that the feed rate changes care about.
+struct ParsedGCodeLine
+{
+    int motionMode;                 // 0-3 if the line has a G00-G03, otherwise -1.
+    int positioningMode;            // 90 or 91 if the line has a G90 or G91, otherwise -1.
+    bool hasXY;
+    bool hasZ;
+    int wordCount;
+    const char *feedRateStart;      // The value of the F word (without the 'F'), or NULL.
+    const char *feedRateEnd;
+    double feedRate;
+    const char *spindleStopStart;   // The whole M05 word, or NULL.
+    const char *spindleStopEnd;
+    const char *wordsEnd;           // One past the last word on the line.  New words are added here.
+};
+
+// A change to make to a line while it is copied to the output.
+struct LineEdit
+{
+    const char *start;
+    const char *end;
+    const char *prefix;
+    const char *replacement;
+    size_t replacementLength;
+};
+
+/**
+ * @brief parseNumber - Convert the text of a feed rate to a double.
+ *
+ * @param text - The text to convert.
+ *
+ * @return double containing the value of the number.
+ */
+static double parseNumber(const QByteArray &text)
+{
+    return GCodeTokenizer::parseNumber(text.constData(), text.constData() + text.size());
+}
+
+/**
+ * @brief parseGCodeLine - Find the words on a line of G-code that we are interested in.
+ *
+ * @param line - The first character of the line.
+ * @param end - One past the last character of the line.
+ * @param parsed[out] - The words that were found.
+ */
+static void parseGCodeLine(const char *line, const char *end, ParsedGCodeLine *parsed)
+{
+    GCodeTokenizer tokenizer(line, end - line);
+    GCodeWord word;
+
+    parsed->motionMode = -1;
+    parsed->positioningMode = -1;
+    parsed->hasXY = false;
+    parsed->hasZ = false;
+    parsed->wordCount = 0;
+    parsed->feedRateStart = NULL;
+    parsed->feedRateEnd = NULL;
+    parsed->feedRate = 0;
+    parsed->spindleStopStart = NULL;
+    parsed->spindleStopEnd = NULL;
+
+    while (tokenizer.nextWord(&word) == true) {
+        parsed->wordCount++;
+
+        switch (word.letter) {
+        case 'G':
+            if ((word.value == 0) || (word.value == 1) || (word.value == 2) || (word.value == 3)) {
+                parsed->motionMode = (int)word.value;
+            } else if ((word.value == 90) || (word.value == 91)) {
+                parsed->positioningMode = (int)word.value;
+            }
+            break;
+
+        case 'X':
+        case 'Y':
+            parsed->hasXY = true;
+            break;
+
+        case 'Z':
+            parsed->hasZ = true;
+            break;
+
+        case 'F':
+            parsed->feedRateStart = word.valueStart;
+            parsed->feedRateEnd = word.end;
+            parsed->feedRate = word.value;
+            break;
+
+        case 'M':
+            if (word.value == 5) {
+                parsed->spindleStopStart = word.start;
+                parsed->spindleStopEnd = word.end;
+            }
+            break;
+        }
+    }
+
+    parsed->wordsEnd = tokenizer.getWordsEnd();
+}
+
+/**
+ * @brief findLastSpindleStop - Find the last line in a block of G-code that has an M05.  The lines are looked
+ *      at from the end, since that is where it usually is.
+ *
+ * @param start - The first character of the block.  (The start of a line.)
+ * @param end - One past the last character of the block.  (The end of a line.)
+ *
+ * @return const char* pointing to the start of the line, or NULL if there isn't an M05 in the block.
+ */
+static const char *findLastSpindleStop(const char *start, const char *end)
+{
+    ParsedGCodeLine parsed;
+    const char *lineStart;
+
+    while (end > start) {
+        lineStart = end;
+        if (lineStart[-1] == '\n') {
+            lineStart--;
+        }
+
+        while ((lineStart > start) && (lineStart[-1] != '\n')) {
+            lineStart--;
+        }
+
+        parseGCodeLine(lineStart, end, &parsed);
+        if (parsed.spindleStopStart != NULL) {
+            return lineStart;
+        }
+
+        end = lineStart;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief findLastSpindleStop - Find the last line in a file that has an M05, reading it a block at a time from
+ *      the end.
+ *
+ * @param filename - The file to look in.
+ *
+ * @return qint64 containing where the line starts in the file, or -1 if there isn't an M05 in it (or the file
+ *      couldn't be read).
+ */
+static qint64 findLastSpindleStop(const QString &filename)
+{
+    QFile file(filename);
+    QByteArray block;
+    qint64 blockSize = CHANGE_GCODE_SEARCH_BLOCK_SIZE;
+    qint64 start;
+    qint64 end;
+    const char *blockEnd;
+    const char *first;
+    const char *found;
+
+    if (file.open(QIODevice::ReadOnly) == false) {
+        return -1;
+    }
+
+    end = file.size();
+    while (end > 0) {
+        start = qMax((qint64)0, end - blockSize);
+        if (file.seek(start) == false) {
+            return -1;
+        }
+
+        block = file.read(end - start);
+        if (block.size() != (end - start)) {
+            return -1;
+        }
+
+        blockEnd = block.constData() + block.size();
+
+        // The first line in the block might start in the one before it, so it is left for the next block.
+        first = block.constData();
+        if (start > 0) {
+            first = GCodeScanner::findNewline(first, blockEnd);
+            if ((first + 1) >= blockEnd) {
+                // Not even one whole line, so look at more of the file at once.
+                blockSize *= 2;
+                continue;
+            }
+            first++;
+        }
+
+        found = findLastSpindleStop(first, blockEnd);
+        if (found != NULL) {
+            return start + (found - block.constData());
+        }
+
+        end = start + (first - block.constData());
+    }
+
+    return -1;
+}
+
+/**
+ * @brief isValidFeedRate - Check that a user provided feed rate is either empty (not in use) or a number.
+ *
+ * @param feedRate - The feed rate to check.
+ *
+ * @return true if the feed rate can be used.  false otherwise.
+ */
+static bool isValidFeedRate(const QString &feedRate)
+{
+    bool ok;
+
+    if (feedRate.trimmed().isEmpty() == true) {
+        return true;
+    }
+
+    feedRate.trimmed().toDouble(&ok);
+
+    return ok;
+}
+
+/**
+ * @brief megabytesPerSecond - Work out the throughput of an operation.
+ *
+ * @param bytes - The number of bytes that were processed.
+ * @param milliseconds - How long it took to process them.
+ *
+ * @return double containing the throughput in MB/s.
+ */
+static double megabytesPerSecond(quint64 bytes, qint64 milliseconds)
+{
+    if (milliseconds <= 0) {
+        milliseconds = 1;
+    }
+
+    return ((double)bytes / (1024.0 * 1024.0)) / ((double)milliseconds / 1000.0);
+}
+
+/**
+ * @brief stateUsed - Note that a line needed part of the modal state.  Only matters if the line (or one
+ *      before it in the same run) didn't set it first.
+ *
+ * @param context - The context the line is being processed with.
+ * @param field - The GCODE_STATE_* field that was used.
+ */
+static inline void stateUsed(GCodeProcessingContext &context, unsigned int field)
+{
+    if ((context.stateWritten & field) == 0) {
+        context.stateRead |= field;
+    }
+}
+
+/**
+ * @brief stateSet - Note that a line set part of the modal state.
+ *
+ * @param context - The context the line is being processed with.
+ * @param field - The GCODE_STATE_* field that was set.
+ */
+static inline void stateSet(GCodeProcessingContext &context, unsigned int field)
+{
+    context.stateWritten |= field;
+}
+
+/**
+ * @brief sameState - Compare some of the fields of two modal states.
+ *
+ * @param first - The first state to compare.
+ * @param second - The second state to compare.
+ * @param fields - The GCODE_STATE_* fields to compare.
+ *
+ * @return true if all of the fields match.  false otherwise.
+ */
+static bool sameState(const GCodeModalState &first, const GCodeModalState &second, unsigned int fields)
+{
+    if (((fields & GCODE_STATE_MOTION_MODE) != 0) && (first.motionMode != second.motionMode)) {
+        return false;
+    }
+
+    if (((fields & GCODE_STATE_POSITIONING) != 0) && (first.absolutePositioning != second.absolutePositioning)) {
+        return false;
+    }
+
+    if ((fields & GCODE_STATE_FEED_RATE) != 0) {
+        if (first.haveEmittedFeedRate != second.haveEmittedFeedRate) {
+            return false;
+        }
+
+        if ((first.haveEmittedFeedRate == true) && (first.emittedFeedRate != second.emittedFeedRate)) {
+            return false;
+        }
+    }
+
+    if (((fields & GCODE_STATE_PENDING_FEED_RATE) != 0) && (first.pendingFeedRate != second.pendingFeedRate)) {
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief copyState - Copy some of the fields of one modal state in to another.
+ *
+ * @param to - The state to update.
+ * @param from - The state to copy from.
+ * @param fields - The GCODE_STATE_* fields to copy.
+ */
+static void copyState(GCodeModalState &to, const GCodeModalState &from, unsigned int fields)
+{
+    if ((fields & GCODE_STATE_MOTION_MODE) != 0) {
+        to.motionMode = from.motionMode;
+    }
+
+    if ((fields & GCODE_STATE_POSITIONING) != 0) {
+        to.absolutePositioning = from.absolutePositioning;
+    }
+
+    if ((fields & GCODE_STATE_FEED_RATE) != 0) {
+        to.haveEmittedFeedRate = from.haveEmittedFeedRate;
+        to.emittedFeedRate = from.emittedFeedRate;
+    }
+
+    if ((fields & GCODE_STATE_PENDING_FEED_RATE) != 0) {
+        to.pendingFeedRate = from.pendingFeedRate;
+    }
+}
+
+/*
+ * One newline aligned chunk of the input, processed on the thread pool.  The modal state at the start
+ * of the chunk isn't known until all of the chunks before it are done, so the job guesses it from the
+ * end of the previous chunk, and keeps track of which parts of the state it actually depended on.
+ * Once the real state is known, the output is only used if the guess was right for all of those.
+ */
+class FeedRateChunkJob : public QRunnable
+{
+public:
+    FeedRateChunkJob(const ChangeGCodeFeedRates *owner, const char *guessStart, const char *start, const char *end, quint64 offset);
+
+    void run();
+    void waitForFinished();
+
+    const char *mStart;
+    const char *mEnd;
+    GCodeModalState mGuess;             // The state the chunk was processed from.
+    GCodeProcessingContext mContext;    // The state at the end of the chunk, and what it depended on.
+    QByteArray mOutput;
+
+private:
+    const ChangeGCodeFeedRates *mOwner;
+    const char *mGuessStart;
+    quint64 mOffset;                    // Where the chunk starts in the input.
+    QSemaphore mFinished;
+};
+
+FeedRateChunkJob::FeedRateChunkJob(const ChangeGCodeFeedRates *owner, const char *guessStart, const char *start, const char *end,
+                                   quint64 offset)
+{
+    mOwner = owner;
+    mGuessStart = guessStart;
+    mStart = start;
+    mEnd = end;
+    mOffset = offset;
+
+    // We hang on to the job until its output has been written.
+    setAutoDelete(false);
+}
+
+/**
+ * @brief FeedRateChunkJob::run - Guess the starting state, then process the chunk.  (Called on a worker thread.)
+ */
+void FeedRateChunkJob::run()
+{
+    GCodeNullOutput nothing;
+    GCodeMemoryOutput output(&mOutput);
+
+    mOwner->resetContext(mContext);
+    mOwner->processLines(mContext, mGuessStart, mStart, nothing);
+
+    mGuess = mContext.state;
+    mOwner->resetContext(mContext);
+    mContext.state = mGuess;
+    mContext.inputOffset = mOffset;
+
+    mOutput.reserve((mEnd - mStart) + ((mEnd - mStart) / 8));
+    mOwner->processLines(mContext, mStart, mEnd, output);
+
+    mFinished.release();
+}
+
+/**
+ * @brief FeedRateChunkJob::waitForFinished - Block until run() has completed.
+ */
+void FeedRateChunkJob::waitForFinished()
+{
+    mFinished.acquire();
+}
 
 ChangeGCodeFeedRates::ChangeGCodeFeedRates()
 {
@@ -7,160 +435,1093 @@ ChangeGCodeFeedRates::ChangeGCodeFeedRates()
     mCleanupGCode = true;
     mFeedRatesSameLine = true;
     mReplaceM05 = true;
+    mStripComments = false;
     mOnlyReplaceExistingFeedRates = false;
     mRedefineFeedRates = true;              // Probably should be false?
 
-    mNewXYFeedRate.clear();
-    mNewZFeedRate.clear();
-    mInputFile.clear();
-    mOutputFile.clear();
-}
+    mNewXYFeedRate.clear();
+    mNewZFeedRate.clear();
+    mInputFile.clear();
+    mOutputFile.clear();
+
+    mThreadCount = 1;
+    mUseCache = false;
+    mOptimizeMoves = false;
+    mFitArcs = false;
+    mReorderTravel = false;
+    mTravelTimeBudget = GCODE_TRAVEL_DEFAULT_TIME_BUDGET;
+    mMoveTolerance = GCODE_OPTIMIZER_DEFAULT_TOLERANCE;
+    mHeightMap = NULL;
+    mSegmentLength = GCODE_COMPENSATION_DEFAULT_SEGMENT_LENGTH;
+    mUseFeedPolicy = false;
+    mPlungeFeedRate = 0;
+    mRetractFeedRate = 0;
+    mShortSegmentLength = GCODE_FEED_POLICY_DEFAULT_SHORT_LENGTH;
+    mShortSegmentScale = GCODE_FEED_POLICY_DEFAULT_SHORT_SCALE;
+    mLookAhead = false;
+    mAcceleration = GCODE_PLANNER_DEFAULT_ACCELERATION;
+    mZAcceleration = GCODE_PLANNER_DEFAULT_Z_ACCELERATION;
+    mJunctionDeviation = GCODE_PLANNER_DEFAULT_JUNCTION_DEVIATION;
+    mLookAheadWindow = GCODE_PLANNER_DEFAULT_WINDOW;
+    mProgress = NULL;
+    mBeforeEstimate = NULL;
+    mAfterEstimate = NULL;
+    mSpindleStopOffset = -1;
+
+    prepareFeedRates();
+}
+
+void ChangeGCodeFeedRates::setCleanUpGCode(bool newval)
+{
+    mCleanupGCode = newval;
+}
+
+void ChangeGCodeFeedRates::setFeedRateSameLine(bool newval)
+{
+    mFeedRatesSameLine = newval;
+}
+
+void ChangeGCodeFeedRates::setReplaceM05(bool newval)
+{
+    mReplaceM05 = newval;
+}
+
+void ChangeGCodeFeedRates::setStripComments(bool newval)
+{
+    mStripComments = newval;
+}
+
+void ChangeGCodeFeedRates::setRedefineFeedRates(bool newval)
+{
+    mRedefineFeedRates = newval;
+}
+
+void ChangeGCodeFeedRates::setOnlyReplaceExistingFeedRates(bool newval)
+{
+    mOnlyReplaceExistingFeedRates = newval;
+}
+
+void ChangeGCodeFeedRates::setNewXYFeedRate(QString newval)
+{
+    mNewXYFeedRate = newval;
+}
+
+void ChangeGCodeFeedRates::setNewZFeedRate(QString newval)
+{
+    mNewZFeedRate = newval;
+}
+
+void ChangeGCodeFeedRates::setInputFile(QString filename)
+{
+    mInputFile = filename;
+}
+
+void ChangeGCodeFeedRates::setOutputFile(QString filename)
+{
+    mOutputFile = filename;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::setThreadCount - Set how many threads should be used to process a file.  The
+ *      output is the same no matter how many are used.
+ *
+ * @param threads - The number of threads to use, or 0 to use one per CPU core.
+ */
+void ChangeGCodeFeedRates::setThreadCount(int threads)
+{
+    mThreadCount = threads;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::setUseCache - Select if the parsed form of the input file should be kept in a
+ *      cache file next to it.  When the same (unchanged) file is processed again, for example with different
+ *      feed rates while they are being tuned, the lines are loaded from the cache instead of being parsed.
+ *      The whole input has to be memory mapped for this, and it is always processed on one thread.  (So it
+ *      is best used when several files are processed at once, rather than one file on several threads.)
+ *
+ * @param newval - true to use (and write) the cache, false to always parse the input.
+ */
+void ChangeGCodeFeedRates::setUseCache(bool newval)
+{
+    mUseCache = newval;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::setOptimizeMoves - Select if runs of collinear G01 moves should be merged, and
+ *      moves, F words and G90/G91 lines that don't do anything left out, once the feed rates have been changed.
+ *      (See GCodeMoveOptimizer.)  Like the cache, this needs the whole input in memory, so the input is always
+ *      processed on one thread.
+ *
+ * @param newval - true to optimize the moves.
+ */
+void ChangeGCodeFeedRates::setOptimizeMoves(bool newval)
+{
+    mOptimizeMoves = newval;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::setFitArcs - Select if runs of G01 moves that follow a circle should be
+ *      replaced with G02/G03 arcs, once the feed rates have been changed.  (See GCodeArcFitter.)  The arcs
+ *      are fitted as the lines are written, so this works with any of the ways the input is processed.
+ *
+ * @param newval - true to fit arcs.
+ */
+void ChangeGCodeFeedRates::setFitArcs(bool newval)
+{
+    mFitArcs = newval;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::setReorderTravel - Select if the blocks of cutting moves between rapid travels
+ *      should be put in an order that travels less, once everything else has been changed.  (See
+ *      GCodeTravelOptimizer.)  The order is improved on the threads set by setThreadCount(), but like the
+ *      cache this needs the whole input in memory, so the rest of the processing is done on one thread.
+ *
+ * @param newval - true to reorder the blocks.
+ */
+void ChangeGCodeFeedRates::setReorderTravel(bool newval)
+{
+    mReorderTravel = newval;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::setTravelTimeBudget - Set how long the order of the blocks may be improved for.
+ *
+ * @param milliseconds - The time.
+ */
+void ChangeGCodeFeedRates::setTravelTimeBudget(int milliseconds)
+{
+    mTravelTimeBudget = milliseconds;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::setHeightMap - Set a heightmap of the board, so that the output follows its
+ *      surface.  (See GCodeZCompensator.)  The heightmap isn't copied, so it has to stay around until the
+ *      file (and any copies of these settings) have been processed.
+ *
+ * @param heightMap - The heightmap, or NULL to leave the Z of each move alone.
+ */
+void ChangeGCodeFeedRates::setHeightMap(const GCodeHeightMap *heightMap)
+{
+    mHeightMap = heightMap;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::setSegmentLength - Set how long a cutting move can be before it is split, so
+ *      that it follows the heightmap.
+ *
+ * @param length - The length, in mm.  0 to never split moves.
+ */
+void ChangeGCodeFeedRates::setSegmentLength(double length)
+{
+    mSegmentLength = length;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::setUseFeedPolicy - Work out the feed rate of each cutting move from the
+ *      direction and length of the move, instead of only from the axes it uses.  (See GCodeFeedPolicy.)  The
+ *      X/Y and Z feed rates to redefine are used as the limits, so both of them have to be set.
+ *
+ * @param newval - true to use the feed policy.
+ */
+void ChangeGCodeFeedRates::setUseFeedPolicy(bool newval)
+{
+    mUseFeedPolicy = newval;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::setPlungeFeedRate - Set the fastest that Z can move down while cutting, when
+ *      the feed policy is used.
+ *
+ * @param feedrate - The feed rate, in mm/min.  0 to use the Z feed rate.
+ */
+void ChangeGCodeFeedRates::setPlungeFeedRate(double feedrate)
+{
+    mPlungeFeedRate = feedrate;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::setRetractFeedRate - Set the fastest that Z can move up while cutting, when the
+ *      feed policy is used.
+ *
+ * @param feedrate - The feed rate, in mm/min.  0 to use the Z feed rate.
+ */
+void ChangeGCodeFeedRates::setRetractFeedRate(double feedrate)
+{
+    mRetractFeedRate = feedrate;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::setShortSegment - Set how short moves are slowed down, when the feed policy is
+ *      used.
+ *
+ * @param length - Moves shorter than this (in mm) are slowed down in proportion to their length.  0 to leave
+ *      them alone.
+ * @param scale - The slowest a short move is made, as a fraction (0 to 1) of its feed rate.
+ */
+void ChangeGCodeFeedRates::setShortSegment(double length, double scale)
+{
+    mShortSegmentLength = length;
+    mShortSegmentScale = scale;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::setLookAhead - Plan the speed of the machine over a long window of the output,
+ *      and lower the feed rate of each G01 move to the speed it can actually reach.  (See
+ *      GCodeLookAheadPlanner.)
+ *
+ * @param newval - true to plan the speeds.
+ */
+void ChangeGCodeFeedRates::setLookAhead(bool newval)
+{
+    mLookAhead = newval;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::setAcceleration - Set how quickly the machine can change speed, for the
+ *      look-ahead planner.
+ *
+ * @param xy - The acceleration along X and Y, in mm/s^2.
+ * @param z - The acceleration along Z, in mm/s^2.
+ */
+void ChangeGCodeFeedRates::setAcceleration(double xy, double z)
+{
+    mAcceleration = xy;
+    mZAcceleration = z;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::setJunctionDeviation - Set how far the path may be rounded off at a corner, for
+ *      the look-ahead planner.
+ *
+ * @param deviation - The distance, in mm.
+ */
+void ChangeGCodeFeedRates::setJunctionDeviation(double deviation)
+{
+    mJunctionDeviation = deviation;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::setLookAheadWindow - Set how many lines the look-ahead planner holds at once.
+ *
+ * @param lines - The number of lines.
+ */
+void ChangeGCodeFeedRates::setLookAheadWindow(int lines)
+{
+    mLookAheadWindow = lines;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::setMoveTolerance - Set how far a merged move, or an arc, may be from the moves
+ *      it replaces.
+ *
+ * @param tolerance - The tolerance.  (mm)
+ */
+void ChangeGCodeFeedRates::setMoveTolerance(double tolerance)
+{
+    mMoveTolerance = tolerance;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::setProgress - Set something to report progress to while a file is processed.
+ *      It can also cancel the processing.
+ *
+ * @param progress - The object to report to, or NULL to not report progress.
+ */
+void ChangeGCodeFeedRates::setProgress(GCodeProgress *progress)
+{
+    mProgress = progress;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::setRunTimeEstimates - Estimate how long the input and the output take to run
+ *      while processGCodeFile() reads and writes them.  The input is estimated as it is read, so the estimate
+ *      is right even when the output is written over the input, and neither file is read again.
+ *
+ * @param before - Where to put the totals for the input, or NULL to not estimate the run times.
+ * @param after - Where to put the totals for the output, or NULL to not estimate the run times.
+ */
+void ChangeGCodeFeedRates::setRunTimeEstimates(GCodeTimeEstimate *before, GCodeTimeEstimate *after)
+{
+    if ((before == NULL) || (after == NULL)) {
+        before = NULL;
+        after = NULL;
+    }
+
+    mBeforeEstimate = before;
+    mAfterEstimate = after;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::resultCodeAsString - Given one of the CHANGE_GCODE_* result code values, return
+ *      a string describing what the code means.
+ *
+ * @param resultCode - One of the CHANGE_GCODE_* values.
+ *
+ * @return std::string containing the description of the result code.
+ */
+QString ChangeGCodeFeedRates::resultCodeAsString(int resultCode)
+{
+    switch (resultCode) {
+    case CHANGE_GCODE_INPUT_MISSING:
+        return "The input G-code file was not provided.";
+
+    case CHANGE_GCODE_NOTHING_TO_DO:
+        return "The combination of configuration values resulted in nothing to be done.";
+
+    case CHANGE_GCODE_OUTPUT_MISSING:
+        return "The output G-code file was not provided.";
+
+    case CHANGE_GCODE_SUCCESS:
+        return "The operation completed successfully.";
+
+    case CHANGE_GCODE_CLEANUP_INVALID:
+        return "No options were selected to clean up, but the option to clean up the G-code file was selected.";
+
+    case CHANGE_GCODE_REDEFINE_INVALID:
+        return "No options were selected to redefine, but the option to redefine feed rates was selected.";
+
+    case CHANGE_GCODE_NO_VALID_FEED_RATES:
+        return "The replacement feed rates are missing, or aren't valid numbers.";
+
+    case CHANGE_GCODE_FEED_POLICY_INVALID:
+        return "The feed policy needs both an X/Y and a Z feed rate to work between.";
+
+    case CHANGE_GCODE_UNABLE_TO_OPEN_IN_FILE:
+        return "Unable to open the input G-code file.";
+
+    case CHANGE_GCODE_UNABLE_TO_OPEN_OUT_FILE:
+        return "Unable to open the output G-code file.";
+
+    case CHANGE_GCODE_READ_FAILED:
+        return "An error occurred while reading the input G-code file.";
+
+    case CHANGE_GCODE_WRITE_FAILED:
+        return "An error occurred while writing the output G-code file.";
+
+    case CHANGE_GCODE_CANCELLED:
+        return "The operation was cancelled.";
+
+    default:
+        return "An unknown result code was provided to resultCodeAsString()!";
+    }
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::processGCodeFile - Actually handle processing the G-Code file based on the values
+ *      that have been input through the set*() calls.  On one thread, the input is read in large blocks and each
+ *      line is rewritten straight in to a buffered output file, so memory use doesn't depend on the size of the
+ *      file.  With more than one thread, the input is mapped in to memory and split in to chunks that are
+ *      processed in parallel.  The output is written to a ".part" file that only replaces the output file once it
+ *      is complete, so a failed or cancelled run never leaves a half written output file behind.
+ *
+ * @return int containing one of the CHANGE_GCODE_* values defined in the header.
+ */
+int ChangeGCodeFeedRates::processGCodeFile()
+{
+    int result;
+    int threads = mThreadCount;
+    GCodeLineReader infile;
+    QFile mappedFile(mInputFile);
+    const char *mappedData = NULL;
+    const char *spindleStop;
+    GCodeWriter outfile;
+    GCodeArcFitter arcFitter(NULL);
+    GCodeArcFitterReport arcReport;
+    GCodeZCompensator compensator(NULL, mHeightMap);
+    GCodeCompensationReport compensation;
+    GCodeFeedPolicy feedPolicy(NULL);
+    GCodeFeedPolicyReport feedPolicyReport;
+    GCodeLookAheadPlanner planner(NULL);
+    GCodePlannerReport plannerReport;
+    GCodeEstimatingOutput inputEstimate(NULL, GCodeTimeEstimator());
+    GCodeEstimatingOutput outputEstimate(&outfile, GCodeTimeEstimator());
+    GCodeOutput *output;
+    QString partialFile = mOutputFile + CHANGE_GCODE_PARTIAL_SUFFIX;
+    GCodeProcessingContext context;
+    unsigned long reprocessedChunks = 0;
+    quint64 bytesRead;
+    bool completed;
+    QElapsedTimer timer;
+    qint64 elapsed;
+
+    // Validate the data variables that were passed in to make sure that we can actually
+    // process the available data.
+    result = validateInputValues();
+    if (result != CHANGE_GCODE_SUCCESS) {
+        LOG_WARNING("Input validation failed while changing a G-code file : " + resultCodeAsString(result));
+        return result;
+    }
+
+    if (threads <= 0) {
+        threads = QThread::idealThreadCount();
+    }
+
+    // Open up the file we want to read in (in read only mode)
+    if ((threads > 1) || (mUseCache == true) || (mOptimizeMoves == true) || (mReorderTravel == true)) {
+        if (mappedFile.open(QIODevice::ReadOnly) == false) {
+            LOG_ERROR("Unable to open the input G-code file : " + mInputFile);
+            return CHANGE_GCODE_UNABLE_TO_OPEN_IN_FILE;
+        }
+
+        if (mappedFile.size() > 0) {
+            mappedData = (const char *)mappedFile.map(0, mappedFile.size());
+            if (mappedData == NULL) {
+                LOG_WARNING("Unable to map the input G-code file in to memory.  It will be processed on one thread, without a cache, move optimization or travel reordering.");
+            }
+        }
+
+        if (mappedData == NULL) {
+            mappedFile.close();
+            threads = 1;
+        }
+    }
+
+    if ((mappedData == NULL) && (infile.open(mInputFile) == false)) {
+        LOG_ERROR("Unable to open the input G-code file : " + mInputFile);
+        return CHANGE_GCODE_UNABLE_TO_OPEN_IN_FILE;
+    }
+
+    // Open up the file we want to write to.
+    if (outfile.open(partialFile) == false) {
+        LOG_ERROR("Unable to open the output G-code file : " + partialFile);
+        return CHANGE_GCODE_UNABLE_TO_OPEN_OUT_FILE;
+    }
+
+    prepareFeedRates();
+    resetContext(context);
+
+    // Only the M05 at the end of the program is replaced, so find it first.
+    mSpindleStopOffset = -1;
+    if ((mCleanupGCode == true) && (mReplaceM05 == true)) {
+        if (mappedData != NULL) {
+            spindleStop = findLastSpindleStop(mappedData, mappedData + mappedFile.size());
+            if (spindleStop != NULL) {
+                mSpindleStopOffset = spindleStop - mappedData;
+            }
+        } else {
+            mSpindleStopOffset = findLastSpindleStop(mInputFile);
+        }
+    }
+
+    if (mBeforeEstimate != NULL) {
+        context.inputEstimate = &inputEstimate;
+        output = connectStages(&outputEstimate, arcFitter, compensator, feedPolicy, planner);
+    } else {
+        output = connectStages(&outfile, arcFitter, compensator, feedPolicy, planner);
+    }
+
+    timer.start();
+    if ((mappedData != NULL) && ((mUseCache == true) || (mOptimizeMoves == true) || (mReorderTravel == true))) {
+        completed = processAsProgram(mappedData, mappedFile.size(), *output, context);
+        bytesRead = mappedFile.size();
+        threads = 1;
+    } else if (mappedData != NULL) {
+        completed = processInParallel(mappedData, mappedData + mappedFile.size(), threads, *output, context, &reprocessedChunks);
+        bytesRead = mappedFile.size();
+    } else {
+        completed = processSequentially(infile, QFileInfo(mInputFile).size(), *output, context);
+        bytesRead = infile.getBytesRead();
+    }
+
+    if (completed == true) {
+        finishStages(arcFitter, compensator, feedPolicy, planner);
+
+        if (mFitArcs == true) {
+            arcFitter.getReport(&arcReport);
+            context.linesRemoved += arcReport.linesRemoved;
+        }
+
+        if (mBeforeEstimate != NULL) {
+            inputEstimate.finish();
+            outputEstimate.finish();
+            inputEstimate.getEstimate(mBeforeEstimate);
+            outputEstimate.getEstimate(mAfterEstimate);
+        }
+    }
+
+    // Clean up.
+    if (completed == false) {
+        LOG_INFO("Processing of the G-code file was cancelled : " + mInputFile);
+        outfile.close();
+        QFile::remove(partialFile);
+        return CHANGE_GCODE_CANCELLED;
+    }
+
+    if (infile.hasError() == true) {
+        LOG_ERROR("Failed while reading the input G-code file : " + mInputFile);
+        outfile.close();
+        QFile::remove(partialFile);
+        return CHANGE_GCODE_READ_FAILED;
+    }
+
+    if (outfile.close() == false) {
+        LOG_ERROR("Failed while writing the output G-code file : " + partialFile);
+        QFile::remove(partialFile);
+        return CHANGE_GCODE_WRITE_FAILED;
+    }
+
+    // The input has to be let go before it can be replaced, in case we were asked to write over it.
+    infile.close();
+    mappedFile.close();
+
+    if (QFile::exists(mOutputFile) == true) {
+        QFile::remove(mOutputFile);
+    }
+
+    if (QFile::rename(partialFile, mOutputFile) == false) {
+        LOG_ERROR("Unable to rename " + partialFile + " to " + mOutputFile);
+        QFile::remove(partialFile);
+        return CHANGE_GCODE_WRITE_FAILED;
+    }
+
+    PROFILE_COUNT(PROFILE_STAGE_REWRITE, PROFILE_COUNTER_BYTES_IN, bytesRead);
+    PROFILE_COUNT(PROFILE_STAGE_REWRITE, PROFILE_COUNTER_LINES, context.lines);
+    PROFILE_COUNT(PROFILE_STAGE_REWRITE, PROFILE_COUNTER_WORDS_REWRITTEN, context.feedRatesRewritten + context.linesRemoved);
+
+    elapsed = timer.elapsed();
+    LOG_INFO("Processed " + QString::number(context.lines) + " lines (" + QString::number(bytesRead) + " bytes in, " +
+             QString::number(outfile.getBytesWritten()) + " bytes out, " + QString::number(context.feedRatesRewritten) +
+             " feed rates rewritten, " + QString::number(context.linesRemoved) + " lines removed) on " + QString::number(threads) + " thread(s) in " + QString::number(elapsed) + " ms (" +
+             QString::number(megabytesPerSecond(bytesRead, elapsed), 'f', 1) + " MB/s).");
+
+    if (mFitArcs == true) {
+        LOG_INFO("Replaced " + QString::number(arcReport.movesReplaced) + " moves in " + mInputFile + " with " +
+                 QString::number(arcReport.arcs) + " arcs (" + QString::number(arcReport.linesRemoved) + " lines removed).");
+    }
+
+    if (mHeightMap != NULL) {
+        compensator.getReport(&compensation);
+        LOG_INFO("Followed the heightmap in " + mInputFile + " : " + QString::number(compensation.movesCompensated) + " moves compensated, " +
+                 QString::number(compensation.segmentsAdded) + " lines added to split long moves, " +
+                 QString::number(compensation.movesSkipped) + " moves left as they were.");
+
+        if (compensation.movesSkipped > 0) {
+            LOG_WARNING(QString::number(compensation.movesSkipped) + " moves in " + mInputFile + " weren't compensated, because they are relative, or " +
+                        "came before X, Y and Z were all set.");
+        }
+    }
+
+    if (mUseFeedPolicy == true) {
+        feedPolicy.getReport(&feedPolicyReport);
+        LOG_INFO("Applied the feed policy to " + mInputFile + " : " + QString::number(feedPolicyReport.movesRated) + " moves rated, " +
+                 QString::number(feedPolicyReport.feedRatesWritten) + " feed rates written, " +
+                 QString::number(feedPolicyReport.movesSkipped) + " moves left as they were.");
+    }
+
+    if (mLookAhead == true) {
+        planner.getReport(&plannerReport);
+        LOG_INFO("Planned the speeds in " + mInputFile + " : " + QString::number(plannerReport.segmentsPlanned) + " segments planned, " +
+                 QString::number(plannerReport.segmentsSlowed) + " slowed to the speed they can reach, " +
+                 QString::number(plannerReport.feedRatesWritten) + " feed rates written.");
+    }
+
+    if (reprocessedChunks > 0) {
+        LOG_DEBUG(QString::number(reprocessedChunks) + " chunk(s) had to be processed again, because the modal state they started with was guessed wrong.");
+    }
+
+    // Success!
+    return CHANGE_GCODE_SUCCESS;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::estimateRunTime - Work out how long the input file takes to run as it is, and
+ *      how long it would take with the selected changes made to it.  Nothing is written.  (The cache is used,
+ *      and written, the same way processGCodeFile() would.)
+ *
+ * @param estimator - The estimator to use, set up with the limits of the machine.
+ * @param before[out] - The totals for the input file.
+ * @param after[out] - The totals for the changed file.
+ *
+ * @return int containing one of the CHANGE_GCODE_* values defined in the header.
+ */
+int ChangeGCodeFeedRates::estimateRunTime(GCodeTimeEstimator &estimator, GCodeTimeEstimate *before, GCodeTimeEstimate *after)
+{
+    QFile file(mInputFile);
+    QByteArray loadedData;
+    const char *data = NULL;
+    qint64 size;
+    GCodeProgram program;
+    GCodeProcessingContext context;
+    QElapsedTimer timer;
+    int result;
+
+    if (mInputFile.isEmpty() == true) {
+        LOG_WARNING("There is no input G-code file defined.  Cannot estimate the run time!");
+        return CHANGE_GCODE_INPUT_MISSING;
+    }
+
+    result = validateOptions();
+    if (result != CHANGE_GCODE_SUCCESS) {
+        LOG_WARNING("Input validation failed while estimating the run time of a G-code file : " + resultCodeAsString(result));
+        return result;
+    }
+
+    if (file.open(QIODevice::ReadOnly) == false) {
+        LOG_ERROR("Unable to open the input G-code file : " + mInputFile);
+        return CHANGE_GCODE_UNABLE_TO_OPEN_IN_FILE;
+    }
+
+    timer.start();
+    size = file.size();
+    if (size > 0) {
+        data = (const char *)file.map(0, size);
+        if (data == NULL) {
+            loadedData = file.readAll();
+            if (loadedData.size() != size) {
+                LOG_ERROR("Failed while reading the input G-code file : " + mInputFile);
+                return CHANGE_GCODE_READ_FAILED;
+            }
+            data = loadedData.constData();
+        }
+    }
+
+    if ((mUseCache == false) || (GCodeProgramCache::load(mInputFile, data, size, &program) == false)) {
+        program.parse(data, size);
+
+        if (mUseCache == true) {
+            GCodeProgramCache::save(mInputFile, data, size, program);
+        }
+    }
+
+    estimator.estimate(program, before);
+
+    prepareFeedRates();
+    resetContext(context);
+    processProgramLines(context, program);
+    optimizeMoves(context, program);
+
+    if ((mFitArcs == true) || (mHeightMap != NULL) || (mUseFeedPolicy == true) || (mLookAhead == true)) {
+        // The stages that work on the lines as they are written change the moves too, so estimate what they
+        // write, a line at a time.
+        GCodeEstimatingOutput staged(NULL, estimator);
+        GCodeArcFitter arcFitter(NULL);
+        GCodeZCompensator compensator(NULL, mHeightMap);
+        GCodeFeedPolicy feedPolicy(NULL);
+        GCodeLookAheadPlanner planner(NULL);
+
+        program.write(connectStages(&staged, arcFitter, compensator, feedPolicy, planner));
+        finishStages(arcFitter, compensator, feedPolicy, planner);
+        staged.finish();
+        staged.getEstimate(after);
+    } else {
+        estimator.estimate(program, after);
+    }
+
+    LOG_INFO("Estimated the run time of " + mInputFile + " (" + QString::number(before->moves) + " moves) in " +
+             QString::number(timer.elapsed()) + " ms : " + GCodeTimeEstimator::formatDuration(before->seconds) + " before, " +
+             GCodeTimeEstimator::formatDuration(after->seconds) + " after.");
+
+    return CHANGE_GCODE_SUCCESS;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::processProgram - Apply the selected clean up and feed rate changes to a program
+ *      that is already in memory.  This makes the same changes as processGCodeFile(), but works over the arrays
+ *      of the program instead of parsing each line of text again.  The input and output files aren't used.
+ *      (The stages that change the lines as they are written, like fitting arcs, aren't run.)
+ *
+ * @param program - The program to change.
+ *
+ * @return int containing one of the CHANGE_GCODE_* values defined in the header.
+ */
+int ChangeGCodeFeedRates::processProgram(GCodeProgram &program)
+{
+    GCodeProcessingContext context;
+    int result;
+
+    result = validateOptions();
+    if (result != CHANGE_GCODE_SUCCESS) {
+        LOG_WARNING("Input validation failed while changing a G-code program : " + resultCodeAsString(result));
+        return result;
+    }
+
+    prepareFeedRates();
+    resetContext(context);
+    processProgramLines(context, program);
+    optimizeMoves(context, program);
+
+    LOG_DEBUG("Processed " + QString::number(context.lines) + " lines of a G-code program in memory (" +
+              QString::number(context.feedRatesRewritten) + " feed rates rewritten, " +
+              QString::number(context.linesRemoved) + " lines removed).");
+
+    return CHANGE_GCODE_SUCCESS;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::processProgramLines - Make the changes to every line of a program.  This is
+ *      the same as running each line through processOneGCodeLine(), but only the arrays of the program are
+ *      looked at.
+ *
+ * @param context - The context to process the program with.  Only the counts are updated.
+ * @param program - The program to change.
+ */
+void ChangeGCodeFeedRates::processProgramLines(GCodeProcessingContext &context, GCodeProgram &program) const
+{
+    int lineCount = program.getLineCount();
+    const quint8 *commands = program.commands();
+    const quint32 *flags = program.flags();
+    const double *feedRates = program.feedRates();
+    int motionMode = -1;
+    bool haveEmittedFeedRate = false;
+    double emittedFeedRate = 0;
+    QByteArray pendingFeedRate;
+    const QByteArray *newFeedRate;
+    QByteArray incomingFeedRate;
+    bool motionLine;
+    bool feedMove;
+    bool hasFeedRate;
+    bool xyMove;
+    bool zMove;
+    int spindleStopLine = -1;
+
+    PROFILE_SCOPE(PROFILE_STAGE_REWRITE);
+
+    // Only the M05 at the end of the program is replaced.
+    if ((mCleanupGCode == true) && (mReplaceM05 == true)) {
+        for (int i = lineCount - 1; i >= 0; i--) {
+            if ((flags[i] & GCODE_LINE_SPINDLE_STOP) != 0) {
+                spindleStopLine = i;
+                break;
+            }
+        }
+    }
+
+    for (int i = 0; i < lineCount; i++) {
+        newFeedRate = NULL;
+
+        if ((mCleanupGCode == true) && (mStripComments == true)) {
+            if (program.stripComments(i) == false) {
+                // There was nothing but a comment on the line, so it was dropped.
+                continue;
+            }
+        }
+
+        if ((commands[i] >= GCODE_COMMAND_G0) && (commands[i] <= GCODE_COMMAND_G3)) {
+            motionMode = commands[i] - GCODE_COMMAND_G0;
+        }
+
+        hasFeedRate = ((flags[i] & GCODE_LINE_HAS_F) != 0);
+        xyMove = ((flags[i] & (GCODE_LINE_HAS_X | GCODE_LINE_HAS_Y)) != 0);
+        zMove = ((flags[i] & GCODE_LINE_HAS_Z) != 0);
+        motionLine = (((xyMove == true) || (zMove == true)) && (motionMode >= 0));
+        feedMove = ((motionLine == true) && (motionMode > 0));
+
+        if ((flags[i] & GCODE_LINE_FEED_ONLY) != 0) {
+            // The line does nothing but set the feed rate.
+            if (mRedefineFeedRates == true) {
+                newFeedRate = replacementFeedRate(false, false);
+            }
+
+            if ((mCleanupGCode == true) && (mFeedRatesSameLine == true)) {
+                // Hold on to it, and put it on the next move instead.
+                if (newFeedRate != NULL) {
+                    pendingFeedRate = *newFeedRate;
+                } else {
+                    pendingFeedRate = program.getFeedRateText(i);
+                }
+
+                // (Its comment, if it has one, is kept on a line of its own.)
+                program.removeFeedRate(i);
+                continue;
+            }
+        } else if (motionLine == true) {
+            if (hasFeedRate == true) {
+                incomingFeedRate = program.getFeedRateText(i);
+            } else {
+                incomingFeedRate = pendingFeedRate;
+            }
+
+            if ((mRedefineFeedRates == true) && (feedMove == true)) {
+                newFeedRate = replacementFeedRate(xyMove, zMove);
+
+                if ((newFeedRate != NULL) && (incomingFeedRate.isEmpty() == true)) {
+                    // There wasn't a feed rate to replace, so only add one if it is needed.
+                    if ((mOnlyReplaceExistingFeedRates == true) ||
+                            ((haveEmittedFeedRate == true) && (emittedFeedRate == parseNumber(*newFeedRate)))) {
+                        newFeedRate = NULL;
+                    }
+                }
+            }
+
+            if ((newFeedRate == NULL) && (hasFeedRate == false) && (incomingFeedRate.isEmpty() == false)) {
+                // Merge the pending feed rate in to this move, unless it wouldn't change anything.
+                if ((haveEmittedFeedRate == false) || (emittedFeedRate != parseNumber(incomingFeedRate))) {
+                    newFeedRate = &pendingFeedRate;
+                }
+            }
+        } else if ((hasFeedRate == true) && (mRedefineFeedRates == true)) {
+            // Some other line (like a G94) that also sets the feed rate.
+            newFeedRate = replacementFeedRate(false, false);
+        }
+
+        if (newFeedRate != NULL) {
+            program.setFeedRate(i, *newFeedRate);
+            haveEmittedFeedRate = true;
+            emittedFeedRate = parseNumber(*newFeedRate);
+            context.feedRatesRewritten++;
+        } else if (hasFeedRate == true) {
+            haveEmittedFeedRate = true;
+            emittedFeedRate = feedRates[i];
+        }
+
+        if (i == spindleStopLine) {
+            program.replaceSpindleStop(i);
+        }
+
+        if ((motionLine == true) || (hasFeedRate == true)) {
+            // Whatever was pending has now been used, or was replaced by a feed rate on this line.
+            pendingFeedRate.clear();
+        }
+    }
 
-void ChangeGCodeFeedRates::setCleanUpGCode(bool newval)
-{
-    mCleanupGCode = newval;
+    context.lines += lineCount;
 }
 
-void ChangeGCodeFeedRates::setFeedRateSameLine(bool newval)
+/**
+ * @brief ChangeGCodeFeedRates::processAsProgram - Process the whole input as a program.  If the cache is
+ *      being used, the program is loaded from the cache for the input file if there is a usable one, and
+ *      otherwise the input is parsed and the cache is written for next time.  The moves are optimized once the
+ *      feed rates have been changed, if that was selected.
+ *
+ * @param data - The input file.
+ * @param size - The size of the input file.
+ * @param output - Where the processed G-code should be sent.
+ * @param context - The context to process the program with.
+ *
+ * @return true if the input was processed.  false if processing was cancelled.
+ */
+bool ChangeGCodeFeedRates::processAsProgram(const char *data, qint64 size, GCodeOutput &output, GCodeProcessingContext &context)
 {
-    mFeedRatesSameLine = newval;
-}
+    GCodeProgram program;
 
-void ChangeGCodeFeedRates::setReplaceM05(bool newval)
-{
-    mReplaceM05 = newval;
-}
+    if ((mUseCache == true) && (GCodeProgramCache::load(mInputFile, data, size, &program) == true)) {
+        LOG_INFO("Using the cached G-code for " + mInputFile + ".");
+    } else {
+        program.parse(data, size);
 
-void ChangeGCodeFeedRates::setRedefineFeedRates(bool newval)
-{
-    mRedefineFeedRates = newval;
-}
+        // Not being able to write the cache doesn't stop this file being processed.
+        if (mUseCache == true) {
+            GCodeProgramCache::save(mInputFile, data, size, program);
+        }
+    }
 
-void ChangeGCodeFeedRates::setNewXYFeedRate(QString newval)
-{
-    mNewXYFeedRate = newval;
-}
+    if (reportProgress(0, size, context) == false) {
+        return false;
+    }
 
-void ChangeGCodeFeedRates::setNewZFeedRate(QString newval)
-{
-    mNewZFeedRate = newval;
-}
+    // Estimate the input before it is changed, a chunk at a time so that it can be cancelled.
+    if (context.inputEstimate != NULL) {
+        for (qint64 offset = 0; offset < size; offset += CHANGE_GCODE_CHUNK_SIZE) {
+            context.inputEstimate->write(data + offset, qMin((qint64)CHANGE_GCODE_CHUNK_SIZE, size - offset));
 
-void ChangeGCodeFeedRates::setInputFile(QString filename)
-{
-    mInputFile = filename;
-}
+            if (reportProgress(0, size, context) == false) {
+                return false;
+            }
+        }
+    }
 
-void ChangeGCodeFeedRates::setOutputFile(QString filename)
-{
-    mOutputFile = filename;
+    processProgramLines(context, program);
+    optimizeMoves(context, program);
+
+    {
+        PROFILE_SCOPE(PROFILE_STAGE_WRITE);
+        program.write(&output);
+    }
+
+    return reportProgress(size, size, context);
 }
 
 /**
- * @brief ChangeGCodeFeedRates::resultCodeAsString - Given one of the CHANGE_GCODE_* result code values, return
- *      a string describing what the code means.
- *
- * @param resultCode - One of the CHANGE_GCODE_* values.
+ * @brief ChangeGCodeFeedRates::optimizeMoves - Run the move optimizer, then the travel optimizer, over a
+ *      program, if they were selected.  (Arcs are fitted later, as the program is written.)
  *
- * @return std::string containing the description of the result code.
+ * @param context - The context the program is being processed with.  The lines removed are added to it.
+ * @param program - The program to optimize.
  */
-QString ChangeGCodeFeedRates::resultCodeAsString(int resultCode)
+void ChangeGCodeFeedRates::optimizeMoves(GCodeProcessingContext &context, GCodeProgram &program) const
 {
-    switch (resultCode) {
-    case CHANGE_GCODE_INPUT_MISSING:
-        return "The input G-code file was not provided.";
+    GCodeMoveOptimizer optimizer;
+    GCodeOptimizerReport report;
+    GCodeTravelOptimizer travelOptimizer;
+    GCodeTravelReport travelReport;
 
-    case CHANGE_GCODE_NOTHING_TO_DO:
-        return "The combination of configuration values resulted in nothing to be done.";
+    PROFILE_SCOPE(PROFILE_STAGE_OPTIMIZE);
 
-    case CHANGE_GCODE_OUTPUT_MISSING:
-        return "The output G-code file was not provided.";
+    if (mOptimizeMoves == true) {
+        optimizer.setTolerance(mMoveTolerance);
+        optimizer.optimize(program, &report);
+        context.linesRemoved += report.linesRemoved;
 
-    case CHANGE_GCODE_SUCCESS:
-        return "The operation completed successfully.";
+        LOG_INFO("Removed " + QString::number(report.linesRemoved) + " lines from " + mInputFile + " (" +
+                 QString::number(report.mergedMoves) + " collinear moves merged, " +
+                 QString::number(report.zeroLengthMoves) + " zero length moves, " +
+                 QString::number(report.redundantFeedRates) + " repeated feed rates, " +
+                 QString::number(report.redundantModes) + " repeated G90/G91).");
+    }
 
-    case CHANGE_GCODE_CLEANUP_INVALID:
-        return "No options were selected to clean up, but the option to clean up the G-code file was selected.";
+    if (mReorderTravel == true) {
+        travelOptimizer.setTimeBudget(mTravelTimeBudget);
+        travelOptimizer.setThreadCount(mThreadCount);
+        travelOptimizer.optimize(program, &travelReport);
 
-    case CHANGE_GCODE_REDEFINE_INVALID:
-        return "No options were selected to redefine, but the option to redefine feed rates was selected.";
+        LOG_INFO("Reordered " + QString::number(travelReport.runs) + " runs of the " + QString::number(travelReport.blocks) +
+                 " movable blocks in " + mInputFile + " : travel between them " + QString::number(travelReport.travelBefore, 'f', 1) +
+                 " mm before, " + QString::number(travelReport.travelAfter, 'f', 1) + " mm after, saving about " +
+                 GCodeTimeEstimator::formatDuration(travelReport.secondsSaved) + ".");
+    }
+}
 
-    case CHANGE_GCODE_UNABLE_TO_OPEN_IN_FILE:
-        return "Unable to open the input G-code file.";
+/**
+ * @brief ChangeGCodeFeedRates::processSequentially - Process every line of the input, in order, on this thread.
+ *
+ * @param infile - The file to read the lines from.
+ * @param totalBytes - The size of the input file.  (Only used to report progress.)
+ * @param output - Where the processed lines should be sent.
+ * @param context - The context to process the lines with.
+ *
+ * @return true if every line was processed.  false if processing was cancelled.
+ */
+bool ChangeGCodeFeedRates::processSequentially(GCodeLineReader &infile, quint64 totalBytes, GCodeOutput &output, GCodeProcessingContext &context)
+{
+    const char *oneLine;
+    size_t lineLength;
+    quint64 bytesReported = 0;
 
-    case CHANGE_GCODE_UNABLE_TO_OPEN_OUT_FILE:
-        return "Unable to open the output G-code file.";
+    PROFILE_SCOPE(PROFILE_STAGE_REWRITE);
 
-    default:
-        return "An unknown result code was provided to resultCodeAsString()!";
+    while (infile.readLine(&oneLine, &lineLength) == true) {
+        if (context.inputEstimate != NULL) {
+            context.inputEstimate->write(oneLine, lineLength);
+        }
+
+        processOneGCodeLine(context, oneLine, lineLength, output);
+
+        // Report each time another block has been read.
+        if (infile.getBytesRead() != bytesReported) {
+            bytesReported = infile.getBytesRead();
+            if (reportProgress(bytesReported, totalBytes, context) == false) {
+                return false;
+            }
+        }
     }
+
+    // Blocks are reported as soon as they are read, so report the lines in the last one.
+    return reportProgress(infile.getBytesRead(), totalBytes, context);
 }
 
 /**
- * @brief ChangeGCodeFeedRates::processGCodeFile - Actually handle processing the G-Code file based on the values
- *      that have been input through the set*() calls.
+ * @brief ChangeGCodeFeedRates::processInParallel - Split the input in to chunks, and process them on a pool of
+ *      worker threads.  The chunk outputs are written in order as they complete.  Each chunk has to guess the
+ *      modal state it starts with, so as each one completes its guess is checked against the real state left
+ *      by the chunks before it.  In the rare case that it was wrong, the chunk is processed again here with the
+ *      real state, so the output is always exactly what processing on one thread would produce.
  *
- * @return int containing one of the CHANGE_GCODE_* values defined in the header.
+ * @param data - The start of the input.
+ * @param end - One past the end of the input.
+ * @param threads - The number of worker threads to use.
+ * @param output - Where the processed lines should be sent.
+ * @param context - The context to process the lines with.  Holds the totals for the whole file when we return.
+ * @param reprocessedChunks[out] - The number of chunks that had to be processed again.
+ *
+ * @return true if every chunk was processed.  false if processing was cancelled.
  */
-int ChangeGCodeFeedRates::processGCodeFile()
+bool ChangeGCodeFeedRates::processInParallel(const char *data, const char *end, int threads, GCodeOutput &output, GCodeProcessingContext &context,
+                                             unsigned long *reprocessedChunks)
 {
-    int result;
-    FILE *infile, *outfile;
-    char oneLine[1024];         // Should be large enough for a standard g-code line.  (Unless *ALL* the g-codes are on a single line..  But, we don't handle that. ;)
-    QString inputLine;
-    unsigned long lineNumber = 0;
-    unsigned long outputLineNumber = 0;
-    QString outputLine;
+    QThreadPool pool;
+    QList<FeedRateChunkJob *> jobs;
+    FeedRateChunkJob *job;
+    const char *chunkStart = data;
+    const char *chunkEnd;
+    const char *guessStart;
+    bool cancelled = false;
 
-    // Validate the data variables that were passed in to make sure that we can actually
-    // process the available data.
-    result = validateInputValues();
-    if (result != CHANGE_GCODE_SUCCESS) {
-        logger.addLine("Input validation failed while changing a G-code file : " + resultCodeAsString(result));
-        return result;
-    }
+    *reprocessedChunks = 0;
 
-    // Open up the file we want to read in (in read only mode)
-    infile = fopen(mInputFile.toStdString().c_str(), "r");
-    if (infile == NULL) {
-        logger.addLine("Unable to open the input G-code file : " + mInputFile);
-        return CHANGE_GCODE_UNABLE_TO_OPEN_IN_FILE;
-    }
+    pool.setMaxThreadCount(threads);
 
-    // Open up the file we want to write to.
-    outfile = fopen(mOutputFile.toStdString().c_str(), "w");
-    if (outfile == NULL) {
-        logger.addLine("Unable to open the output G-code file : " + mOutputFile);
+    while ((chunkStart < end) || (jobs.isEmpty() == false)) {
+        // Keep the workers busy, without holding too much output in memory.
+        while ((chunkStart < end) && (jobs.size() < (threads * 2))) {
+            chunkEnd = end;
+            if ((end - chunkStart) > CHANGE_GCODE_CHUNK_SIZE) {
+                chunkEnd = GCodeScanner::findNewline(chunkStart + CHANGE_GCODE_CHUNK_SIZE, end);
+                if (chunkEnd < end) {
+                    chunkEnd++;
+                }
+            }
 
-        // Clean up.
-        fclose(infile);
+            guessStart = data;
+            if ((chunkStart - data) > CHANGE_GCODE_GUESS_WINDOW) {
+                guessStart = GCodeScanner::findNewline(chunkStart - CHANGE_GCODE_GUESS_WINDOW, chunkStart);
+                if (guessStart < chunkStart) {
+                    guessStart++;
+                }
+            }
 
-        return CHANGE_GCODE_UNABLE_TO_OPEN_OUT_FILE;
-    }
+            job = new FeedRateChunkJob(this, guessStart, chunkStart, chunkEnd, chunkStart - data);
+            jobs.append(job);
+            pool.start(job);
 
-    logger.addLine("Parsed line log format [<input file line number>/<output file line number>] <input line to be processed>/<output line processed>");
-    while (fgets(oneLine, sizeof(oneLine), infile) != NULL) {
-        inputLine = oneLine;
-        lineNumber++;
+            chunkStart = chunkEnd;
+        }
+
+        job = jobs.takeFirst();
+        job->waitForFinished();
+
+        if (cancelled == true) {
+            // Just waiting for the jobs that were already started.
+            delete job;
+            continue;
+        }
 
-        if (inputLine.isEmpty() == true) {
-            logger.addLine("[" + QString::number(lineNumber) + "/" + QString::number(outputLineNumber) + "] *** Input line is empty.  Skipping.");
+        // The input is estimated a chunk at a time, in order, as each one is written.
+        if (context.inputEstimate != NULL) {
+            context.inputEstimate->write(job->mStart, job->mEnd - job->mStart);
+        }
+
+        if (sameState(context.state, job->mGuess, job->mContext.stateRead) == true) {
+            output.write(job->mOutput.constData(), job->mOutput.size());
+            copyState(context.state, job->mContext.state, job->mContext.stateWritten);
+            context.lines += job->mContext.lines;
+            context.feedRatesRewritten += job->mContext.feedRatesRewritten;
         } else {
-           outputLineNumber++;
+            context.inputOffset = job->mStart - data;
+            processLines(context, job->mStart, job->mEnd, output);
+            (*reprocessedChunks)++;
+        }
 
-           outputLine = processOneGCodeLine(inputLine);
-           // XXX FINISH!
+        if (reportProgress(job->mEnd - data, end - data, context) == false) {
+            cancelled = true;
+            chunkStart = end;
         }
-    }
 
-    // Clean up.
-    fclose(infile);
-    fclose(outfile);
+        delete job;
+    }
 
-    // Success!
-    return CHANGE_GCODE_SUCCESS;
+    return (cancelled == false);
 }
 
+/**
+ * @brief ChangeGCodeFeedRates::reportProgress - Tell whoever is interested how far through the file we are.
+ *
+ * @param bytesProcessed - How much of the input has been processed.
+ * @param totalBytes - The size of the input.
+ * @param context - The context the input is being processed with.
+ *
+ * @return true if processing should carry on.  false if it has been cancelled.
+ */
+bool ChangeGCodeFeedRates::reportProgress(quint64 bytesProcessed, quint64 totalBytes, const GCodeProcessingContext &context)
+{
+    if (mProgress == NULL) {
+        return true;
+    }
+
+    mProgress->progress(bytesProcessed, totalBytes, context.lines);
+
+    return (mProgress->isCancelled() == false);
+}
 /**
  * @brief ChangeGCodeFeedRates::validateInputValues - Check the various combinations of input values to make sure
  *      that they have all of the data that they need to operate on the file.
@@ -170,25 +1531,36 @@ int ChangeGCodeFeedRates::processGCodeFile()
 int ChangeGCodeFeedRates::validateInputValues()
 {
     if (mInputFile.isEmpty() == true) {
-        logger.addLine("There is no input G-code file defined.  Cannot process G-code changes!");
+        LOG_WARNING("There is no input G-code file defined.  Cannot process G-code changes!");
         return CHANGE_GCODE_INPUT_MISSING;
     }
 
     if (mOutputFile.isEmpty() == true) {
-        logger.addLine("There is no output G-code file defined.  Cannot process G-code changes!");
+        LOG_WARNING("There is no output G-code file defined.  Cannot process G-code changes!");
         return CHANGE_GCODE_OUTPUT_MISSING;
     }
 
-    // If these are both false, all other options will be disabled.
-    if ((mCleanupGCode == false) && (mRedefineFeedRates == false)) {
-        logger.addLine("Neither the 'clean up G-code' nor the 'redefine feed rates' options are selected.  Nothing to do.");
+    return validateOptions();
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::validateOptions - Check that the selected options give us something to do, and
+ *      that the replacement feed rates are usable.  (The input and output files aren't needed for this.)
+ *
+ * @return int containing one of the CHANGE_GCODE_* values defined in the header.
+ */
+int ChangeGCodeFeedRates::validateOptions()
+{
+    // If these are both false (and there is no heightmap to follow, or speeds to plan), all other options will be disabled.
+    if ((mCleanupGCode == false) && (mRedefineFeedRates == false) && (mHeightMap == NULL) && (mLookAhead == false)) {
+        LOG_WARNING("Neither the 'clean up G-code' nor the 'redefine feed rates' options are selected.  Nothing to do.");
         return CHANGE_GCODE_NOTHING_TO_DO;
     }
 
     // If "Cleanup G-code" is checked, make sure at least one option under it is checked as well.
     if (mCleanupGCode == true) {
-        if ((mFeedRatesSameLine == false) && (mReplaceM05 == false)) {
-            logger.addLine("The 'clean up G-code' option is selected, but none of the options for what to clean up are selected.  Nothing to do.");
+        if ((mFeedRatesSameLine == false) && (mReplaceM05 == false) && (mStripComments == false)) {
+            LOG_WARNING("The 'clean up G-code' option is selected, but none of the options for what to clean up are selected.  Nothing to do.");
             return CHANGE_GCODE_CLEANUP_INVALID;
         }
     }
@@ -197,17 +1569,422 @@ int ChangeGCodeFeedRates::validateInputValues()
     if (mRedefineFeedRates == true) {
         // Make sure we have at least one feed rate defined.
         if ((mNewXYFeedRate.isEmpty() == true) && (mNewZFeedRate.isEmpty())) {
-            logger.addLine("The 'redefine feed rates' option is selected, but no replacement feed rates were defined.  Nothing to do.");
+            LOG_WARNING("The 'redefine feed rates' option is selected, but no replacement feed rates were defined.  Nothing to do.");
             return CHANGE_GCODE_NO_VALID_FEED_RATES;
         }
+
+        // And that the ones we have are actually numbers.
+        if ((isValidFeedRate(mNewXYFeedRate) == false) || (isValidFeedRate(mNewZFeedRate) == false)) {
+            LOG_WARNING("The 'redefine feed rates' option is selected, but one of the replacement feed rates isn't a valid number.");
+            return CHANGE_GCODE_NO_VALID_FEED_RATES;
+        }
+    }
+
+    // The feed policy works between the X/Y and Z feed rates, so it needs both of them.
+    if (mUseFeedPolicy == true) {
+        if ((mRedefineFeedRates == false) || (mNewXYFeedRate.isEmpty() == true) || (mNewZFeedRate.isEmpty() == true)) {
+            LOG_WARNING("The feed policy is selected, but it needs both an X/Y and a Z feed rate to work between.");
+            return CHANGE_GCODE_FEED_POLICY_INVALID;
+        }
     }
 
     // Everything looks good!  Move on!
     return CHANGE_GCODE_SUCCESS;
 }
 
-QString ChangeGCodeFeedRates::processOneGCodeLine(QString inputLine)
+/**
+ * @brief ChangeGCodeFeedRates::prepareFeedRates - Set up the parsed copies of the feed rates, so that we are
+ *      ready to start processing a new file.
+ */
+void ChangeGCodeFeedRates::prepareFeedRates()
+{
+    mXYFeedRateText.clear();
+    mZFeedRateText.clear();
+    mXYFeedRateValue = 0;
+    mZFeedRateValue = 0;
+
+    if (mRedefineFeedRates == true) {
+        mXYFeedRateText = mNewXYFeedRate.trimmed().toLatin1();
+        mZFeedRateText = mNewZFeedRate.trimmed().toLatin1();
+        mXYFeedRateValue = mXYFeedRateText.toDouble();
+        mZFeedRateValue = mZFeedRateText.toDouble();
+    }
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::connectStages - Set up the stages that change the lines as they are written,
+ *      and connect the ones that are selected in front of the output.  Fitting arcs comes first, then
+ *      following the board, then working out the feed rate of each move, then planning the speeds the moves
+ *      can reach.  (prepareFeedRates() has to have been called first.)
+ *
+ * @param writer - Where the lines should end up.
+ * @param arcFitter - The stages.
+ * @param compensator
+ * @param feedPolicy
+ * @param planner
+ *
+ * @return GCodeOutput* pointing to where the processed lines should be written.
+ */
+GCodeOutput *ChangeGCodeFeedRates::connectStages(GCodeOutput *writer, GCodeArcFitter &arcFitter, GCodeZCompensator &compensator,
+                                                 GCodeFeedPolicy &feedPolicy, GCodeLookAheadPlanner &planner) const
+{
+    GCodeOutput *output = writer;
+
+    if (mLookAhead == true) {
+        planner.setAcceleration(mAcceleration, mZAcceleration);
+        planner.setJunctionDeviation(mJunctionDeviation);
+        planner.setWindow(mLookAheadWindow);
+        planner.setOutput(output);
+        output = &planner;
+    }
+
+    if (mUseFeedPolicy == true) {
+        feedPolicy.setXYFeedRate(mXYFeedRateValue);
+        feedPolicy.setZFeedRate(mZFeedRateValue);
+        feedPolicy.setPlungeFeedRate(mPlungeFeedRate);
+        feedPolicy.setRetractFeedRate(mRetractFeedRate);
+        feedPolicy.setShortSegmentLength(mShortSegmentLength);
+        feedPolicy.setShortSegmentScale(mShortSegmentScale);
+        feedPolicy.setOutput(output);
+        output = &feedPolicy;
+    }
+
+    if (mHeightMap != NULL) {
+        compensator.setSegmentLength(mSegmentLength);
+        compensator.setOutput(output);
+        output = &compensator;
+    }
+
+    if (mFitArcs == true) {
+        arcFitter.setTolerance(mMoveTolerance);
+        arcFitter.setOutput(output);
+        output = &arcFitter;
+    }
+
+    return output;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::finishStages - Push everything that the selected stages are holding on to out
+ *      to the output, first stage first.
+ *
+ * @param arcFitter - The stages.
+ * @param compensator
+ * @param feedPolicy
+ * @param planner
+ */
+void ChangeGCodeFeedRates::finishStages(GCodeArcFitter &arcFitter, GCodeZCompensator &compensator, GCodeFeedPolicy &feedPolicy,
+                                        GCodeLookAheadPlanner &planner) const
+{
+    GCodeArcFitterReport arcReport;
+    GCodeCompensationReport compensation;
+    GCodeFeedPolicyReport feedPolicyReport;
+    GCodePlannerReport plannerReport;
+
+    if (mFitArcs == true) {
+        arcFitter.finish();
+        arcFitter.getReport(&arcReport);
+        PROFILE_COUNT(PROFILE_STAGE_OPTIMIZE, PROFILE_COUNTER_WORDS_REWRITTEN, arcReport.movesReplaced);
+    }
+
+    if (mHeightMap != NULL) {
+        compensator.finish();
+        compensator.getReport(&compensation);
+        PROFILE_COUNT(PROFILE_STAGE_COMPENSATE, PROFILE_COUNTER_WORDS_REWRITTEN, compensation.movesCompensated + compensation.segmentsAdded);
+    }
+
+    if (mUseFeedPolicy == true) {
+        feedPolicy.finish();
+        feedPolicy.getReport(&feedPolicyReport);
+        PROFILE_COUNT(PROFILE_STAGE_FEED_POLICY, PROFILE_COUNTER_WORDS_REWRITTEN, feedPolicyReport.feedRatesWritten);
+    }
+
+    if (mLookAhead == true) {
+        planner.finish();
+        planner.getReport(&plannerReport);
+        PROFILE_COUNT(PROFILE_STAGE_LOOK_AHEAD, PROFILE_COUNTER_WORDS_REWRITTEN, plannerReport.feedRatesWritten);
+    }
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::resetContext - Put a context back to the state it should be in at the start
+ *      of a file.
+ *
+ * @param context - The context to reset.
+ */
+void ChangeGCodeFeedRates::resetContext(GCodeProcessingContext &context) const
+{
+    context.state.motionMode = -1;
+    context.state.absolutePositioning = true;
+    context.state.haveEmittedFeedRate = false;
+    context.state.emittedFeedRate = 0;
+    context.state.pendingFeedRate.clear();
+
+    context.stateRead = 0;
+    context.stateWritten = 0;
+    context.lines = 0;
+    context.feedRatesRewritten = 0;
+    context.linesRemoved = 0;
+    context.inputOffset = 0;
+    context.inputEstimate = NULL;
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::processLines - Split a block of the input in to lines, and process each of them.
+ *
+ * @param context - The context to process the lines with.
+ * @param start - The first character of the first line.
+ * @param end - One past the last character of the last line.
+ * @param output - Where the processed lines should be sent.
+ */
+void ChangeGCodeFeedRates::processLines(GCodeProcessingContext &context, const char *start, const char *end, GCodeOutput &output) const
+{
+    const char *lineEnd;
+
+    PROFILE_SCOPE(PROFILE_STAGE_REWRITE);
+
+    while (start < end) {
+        lineEnd = GCodeScanner::findNewline(start, end);
+        if (lineEnd < end) {
+            lineEnd++;
+        }
+
+        processOneGCodeLine(context, start, lineEnd - start, output);
+        start = lineEnd;
+    }
+}
+
+/**
+ * @brief ChangeGCodeFeedRates::replacementFeedRate - Work out which of the new feed rates should be used for
+ *      a move, based on the axes that the move uses.  If there is movement on both the X/Y and Z axes, the
+ *      slowest feed rate is used.
+ *
+ * @param xyMove - true if the move has an X or Y word.
+ * @param zMove - true if the move has a Z word.
+ *
+ * @return const QByteArray* pointing to the text of the feed rate to use, or NULL if we don't have a new
+ *      feed rate for this kind of move.
+ */
+const QByteArray *ChangeGCodeFeedRates::replacementFeedRate(bool xyMove, bool zMove) const
 {
+    bool haveXY = (mXYFeedRateText.isEmpty() == false);
+    bool haveZ = (mZFeedRateText.isEmpty() == false);
+
+    if ((xyMove == true) && (zMove == true) && (haveXY == true) && (haveZ == true)) {
+        if (mXYFeedRateValue < mZFeedRateValue) {
+            return &mXYFeedRateText;
+        }
+
+        return &mZFeedRateText;
+    }
+
+    if ((xyMove == true) && (haveXY == true)) {
+        return &mXYFeedRateText;
+    }
+
+    if ((zMove == true) && (haveZ == true)) {
+        return &mZFeedRateText;
+    }
+
+    // A line that only sets the feed rate gets the X/Y rate, since that is what most of a job is milled at.
+    if ((xyMove == false) && (zMove == false)) {
+        if (haveXY == true) {
+            return &mXYFeedRateText;
+        }
 
+        if (haveZ == true) {
+            return &mZFeedRateText;
+        }
+    }
+
+    return NULL;
 }
 
+/**
+ * @brief ChangeGCodeFeedRates::processOneGCodeLine - Apply the selected clean up and feed rate changes to a
+ *      single line of G-code, and write the result to the output.  Any use of the modal state is recorded in
+ *      the context, so that chunks processed in parallel can be checked.  Everything on the line that we don't
+ *      change (spacing, comments, the line ending) is copied through exactly as it was.
+ *
+ * @param context - The modal state (and other per run data) to process the line with.
+ * @param line - The line to process, including its line ending.
+ * @param length - The number of bytes in line.
+ * @param output - Where the processed line should be sent.
+ */
+void ChangeGCodeFeedRates::processOneGCodeLine(GCodeProcessingContext &context, const char *line, size_t length, GCodeOutput &output) const
+{
+    GCodeModalState &state = context.state;
+    ParsedGCodeLine parsed;
+    LineEdit edits[2];
+    int editCount = 0;
+    bool motionLine;
+    bool feedMove;
+    bool hasFeedRate;
+    const QByteArray *newFeedRate = NULL;
+    QByteArray incomingFeedRate;
+    const char *copyFrom;
+    const char *lineEnd;
+    quint64 lineOffset = context.inputOffset;
+
+    context.lines++;
+    context.inputOffset += length;
+
+    if ((mCleanupGCode == true) && (mStripComments == true)) {
+        if (GCodeProgram::stripComments(context.lineBuffer, line, length, &line, &length) == false) {
+            // There was nothing but a comment on the line, so drop it.
+            return;
+        }
+    }
+
+    copyFrom = line;
+    parseGCodeLine(line, line + length, &parsed);
+
+    if (parsed.motionMode >= 0) {
+        state.motionMode = parsed.motionMode;
+        stateSet(context, GCODE_STATE_MOTION_MODE);
+    }
+
+    if (parsed.positioningMode == 90) {
+        state.absolutePositioning = true;
+        stateSet(context, GCODE_STATE_POSITIONING);
+    } else if (parsed.positioningMode == 91) {
+        state.absolutePositioning = false;
+        stateSet(context, GCODE_STATE_POSITIONING);
+    }
+
+    hasFeedRate = (parsed.feedRateStart != NULL);
+    motionLine = false;
+    if ((parsed.hasXY == true) || (parsed.hasZ == true)) {
+        stateUsed(context, GCODE_STATE_MOTION_MODE);
+        motionLine = (state.motionMode >= 0);
+    }
+    feedMove = ((motionLine == true) && (state.motionMode > 0));
+
+    if ((hasFeedRate == true) && (parsed.wordCount == 1)) {
+        // The line does nothing but set the feed rate.
+        if (mRedefineFeedRates == true) {
+            newFeedRate = replacementFeedRate(false, false);
+        }
+
+        if ((mCleanupGCode == true) && (mFeedRatesSameLine == true)) {
+            // Hold on to it, and put it on the next move instead.
+            if (newFeedRate != NULL) {
+                state.pendingFeedRate = *newFeedRate;
+            } else {
+                state.pendingFeedRate = QByteArray(parsed.feedRateStart, parsed.feedRateEnd - parsed.feedRateStart);
+            }
+            stateSet(context, GCODE_STATE_PENDING_FEED_RATE);
+
+            if ((memchr(line, '(', length) != NULL) || (memchr(line, ';', length) != NULL)) {
+                // Keep its comment on a line of its own.  (Take out the F word, and the space in front of it, or
+                // after it if it is the first thing on the line.)
+                copyFrom = parsed.feedRateStart - 1;
+                lineEnd = line + length;
+                while ((copyFrom > line) && ((copyFrom[-1] == ' ') || (copyFrom[-1] == '\t'))) {
+                    copyFrom--;
+                }
+                output.write(line, copyFrom - line);
+
+                if (copyFrom == line) {
+                    copyFrom = parsed.feedRateEnd;
+                    while ((copyFrom < lineEnd) && ((*copyFrom == ' ') || (*copyFrom == '\t'))) {
+                        copyFrom++;
+                    }
+                } else {
+                    copyFrom = parsed.feedRateEnd;
+                }
+                output.write(copyFrom, lineEnd - copyFrom);
+            }
+
+            return;
+        }
+    } else if (motionLine == true) {
+        if (hasFeedRate == true) {
+            incomingFeedRate = QByteArray::fromRawData(parsed.feedRateStart, parsed.feedRateEnd - parsed.feedRateStart);
+        } else {
+            stateUsed(context, GCODE_STATE_PENDING_FEED_RATE);
+            incomingFeedRate = state.pendingFeedRate;
+        }
+
+        if ((mRedefineFeedRates == true) && (feedMove == true)) {
+            newFeedRate = replacementFeedRate(parsed.hasXY, parsed.hasZ);
+
+            if ((newFeedRate != NULL) && (incomingFeedRate.isEmpty() == true)) {
+                // There wasn't a feed rate to replace, so only add one if it is needed.
+                stateUsed(context, GCODE_STATE_FEED_RATE);
+                if ((mOnlyReplaceExistingFeedRates == true) ||
+                        ((state.haveEmittedFeedRate == true) && (state.emittedFeedRate == parseNumber(*newFeedRate)))) {
+                    newFeedRate = NULL;
+                }
+            }
+        }
+
+        if ((newFeedRate == NULL) && (hasFeedRate == false) && (incomingFeedRate.isEmpty() == false)) {
+            // Merge the pending feed rate in to this move, unless it wouldn't change anything.
+            stateUsed(context, GCODE_STATE_FEED_RATE);
+            if ((state.haveEmittedFeedRate == false) || (state.emittedFeedRate != parseNumber(incomingFeedRate))) {
+                newFeedRate = &state.pendingFeedRate;
+            }
+        }
+    } else if ((hasFeedRate == true) && (mRedefineFeedRates == true)) {
+        // Some other line (like a G94) that also sets the feed rate.
+        newFeedRate = replacementFeedRate(false, false);
+    }
+
+    // Work out what needs to change on the line.
+    if (newFeedRate != NULL) {
+        if (hasFeedRate == true) {
+            edits[editCount].start = parsed.feedRateStart;
+            edits[editCount].end = parsed.feedRateEnd;
+            edits[editCount].prefix = "";
+        } else {
+            edits[editCount].start = parsed.wordsEnd;
+            edits[editCount].end = parsed.wordsEnd;
+            edits[editCount].prefix = " F";
+        }
+        edits[editCount].replacement = newFeedRate->constData();
+        edits[editCount].replacementLength = newFeedRate->size();
+        editCount++;
+
+        state.haveEmittedFeedRate = true;
+        state.emittedFeedRate = parseNumber(*newFeedRate);
+        stateSet(context, GCODE_STATE_FEED_RATE);
+        context.feedRatesRewritten++;
+    } else if (hasFeedRate == true) {
+        state.haveEmittedFeedRate = true;
+        state.emittedFeedRate = parsed.feedRate;
+        stateSet(context, GCODE_STATE_FEED_RATE);
+    }
+
+    if ((mCleanupGCode == true) && (mReplaceM05 == true) && (parsed.spindleStopStart != NULL) &&
+            ((qint64)lineOffset == mSpindleStopOffset)) {
+        edits[editCount].start = parsed.spindleStopStart;
+        edits[editCount].end = parsed.spindleStopEnd;
+        edits[editCount].prefix = "";
+        edits[editCount].replacement = GCODE_SPINDLE_STOP_REPLACEMENT;
+        edits[editCount].replacementLength = strlen(GCODE_SPINDLE_STOP_REPLACEMENT);
+        editCount++;
+    }
+
+    // The edits need to be applied in the order they appear on the line.
+    if ((editCount == 2) && (edits[1].start < edits[0].start)) {
+        LineEdit swap = edits[0];
+        edits[0] = edits[1];
+        edits[1] = swap;
+    }
+
+    for (int i = 0; i < editCount; i++) {
+        output.write(copyFrom, edits[i].start - copyFrom);
+        output.write(edits[i].prefix, strlen(edits[i].prefix));
+        output.write(edits[i].replacement, edits[i].replacementLength);
+        copyFrom = edits[i].end;
+    }
+
+    output.write(copyFrom, (line + length) - copyFrom);
+
+    if ((motionLine == true) || (hasFeedRate == true)) {
+        // Whatever was pending has now been used, or was replaced by a feed rate on this line.
+        state.pendingFeedRate.clear();
+        stateSet(context, GCODE_STATE_PENDING_FEED_RATE);
+    }
+}
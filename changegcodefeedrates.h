@@ -2,7 +2,20 @@
 #define CHANGEGCODEFEEDRATES_H
 
 #include <QString>
-#include "logger.h"
+#include <QByteArray>
+
+class GCodeOutput;
+class GCodeProgress;
+class GCodeLineReader;
+class GCodeProgram;
+class GCodeTimeEstimator;
+class GCodeHeightMap;
+class GCodeArcFitter;
+class GCodeFeedPolicy;
+class GCodeZCompensator;
+class GCodeLookAheadPlanner;
+class GCodeEstimatingOutput;
+struct GCodeTimeEstimate;
 
 // Result values that can be retured from the processGCodeFile() call.
 #define CHANGE_GCODE_NOTHING_TO_DO           1
@@ -14,6 +27,43 @@
 #define CHANGE_GCODE_NO_VALID_FEED_RATES     -5
 #define CHANGE_GCODE_UNABLE_TO_OPEN_IN_FILE  -6
 #define CHANGE_GCODE_UNABLE_TO_OPEN_OUT_FILE -7
+#define CHANGE_GCODE_READ_FAILED             -8
+#define CHANGE_GCODE_WRITE_FAILED            -9
+#define CHANGE_GCODE_CANCELLED               -10
+#define CHANGE_GCODE_FEED_POLICY_INVALID     -11
+
+// The output is written to a file with this added to its name, and only renamed once it is complete.
+#define CHANGE_GCODE_PARTIAL_SUFFIX          ".part"
+
+// The modal state that carries over from one G-code line to the next while a file is processed.
+struct GCodeModalState
+{
+    int motionMode;                 // 0-3 for the last G00-G03 seen, or -1 if there hasn't been one yet.
+    bool absolutePositioning;       // false after a G91, true after a G90.
+    bool haveEmittedFeedRate;       // true once an F word has been written to the output.
+    double emittedFeedRate;         // The last F value written to the output.
+    QByteArray pendingFeedRate;     // A feed rate from an "F" only line that is waiting to be merged in to the next move.
+};
+
+// Bits for the GCodeModalState fields, used to track which parts of the state a chunk of a file depended on.
+#define GCODE_STATE_MOTION_MODE              0x01
+#define GCODE_STATE_POSITIONING              0x02
+#define GCODE_STATE_FEED_RATE                0x04
+#define GCODE_STATE_PENDING_FEED_RATE        0x08
+
+// Everything that changes while a run of lines is processed.  Each thread has its own.
+struct GCodeProcessingContext
+{
+    GCodeModalState state;
+    unsigned int stateRead;         // GCODE_STATE_* fields that were used before they were set.
+    unsigned int stateWritten;      // GCODE_STATE_* fields that were set.
+    QByteArray lineBuffer;          // Holds a line while its comments are stripped.
+    quint64 inputOffset;            // Where the next line starts in the input.
+    unsigned long lines;
+    unsigned long feedRatesRewritten;
+    unsigned long linesRemoved;     // By the move optimizer and arc fitter.
+    GCodeEstimatingOutput *inputEstimate;   // Follows the input as it is read, to estimate its run time, or NULL.
+};
 
 class ChangeGCodeFeedRates
 {
@@ -23,25 +73,69 @@ public:
     void setCleanUpGCode(bool newval);
     void setFeedRateSameLine(bool newval);
     void setReplaceM05(bool newval);
+    void setStripComments(bool newval);
     void setRedefineFeedRates(bool newval);
+    void setOnlyReplaceExistingFeedRates(bool newval);
     void setNewXYFeedRate(QString newval);
     void setNewZFeedRate(QString newval);
 
     void setInputFile(QString filename);
     void setOutputFile(QString filename);
 
+    void setThreadCount(int threads);
+    void setUseCache(bool newval);
+    void setOptimizeMoves(bool newval);
+    void setMoveTolerance(double tolerance);
+    void setFitArcs(bool newval);
+    void setReorderTravel(bool newval);
+    void setTravelTimeBudget(int milliseconds);
+    void setHeightMap(const GCodeHeightMap *heightMap);
+    void setSegmentLength(double length);
+    void setUseFeedPolicy(bool newval);
+    void setPlungeFeedRate(double feedrate);
+    void setRetractFeedRate(double feedrate);
+    void setShortSegment(double length, double scale);
+    void setLookAhead(bool newval);
+    void setAcceleration(double xy, double z);
+    void setJunctionDeviation(double deviation);
+    void setLookAheadWindow(int lines);
+    void setProgress(GCodeProgress *progress);
+    void setRunTimeEstimates(GCodeTimeEstimate *before, GCodeTimeEstimate *after);
+
     QString resultCodeAsString(int resultCode);
 
     int processGCodeFile();
+    int processProgram(GCodeProgram &program);
+    int estimateRunTime(GCodeTimeEstimator &estimator, GCodeTimeEstimate *before, GCodeTimeEstimate *after);
 
 protected:
     int validateInputValues();
-    QString processOneGCodeLine(QString inputLine);
+    int validateOptions();
+    void processLines(GCodeProcessingContext &context, const char *start, const char *end, GCodeOutput &output) const;
+    void processOneGCodeLine(GCodeProcessingContext &context, const char *line, size_t length, GCodeOutput &output) const;
+    void processProgramLines(GCodeProcessingContext &context, GCodeProgram &program) const;
 
 private:
+    friend class FeedRateChunkJob;
+
+    void prepareFeedRates();
+    GCodeOutput *connectStages(GCodeOutput *writer, GCodeArcFitter &arcFitter, GCodeZCompensator &compensator,
+                               GCodeFeedPolicy &feedPolicy, GCodeLookAheadPlanner &planner) const;
+    void finishStages(GCodeArcFitter &arcFitter, GCodeZCompensator &compensator, GCodeFeedPolicy &feedPolicy,
+                      GCodeLookAheadPlanner &planner) const;
+    void resetContext(GCodeProcessingContext &context) const;
+    bool processSequentially(GCodeLineReader &infile, quint64 totalBytes, GCodeOutput &output, GCodeProcessingContext &context);
+    bool processInParallel(const char *data, const char *end, int threads, GCodeOutput &output, GCodeProcessingContext &context,
+                           unsigned long *reprocessedChunks);
+    bool processAsProgram(const char *data, qint64 size, GCodeOutput &output, GCodeProcessingContext &context);
+    void optimizeMoves(GCodeProcessingContext &context, GCodeProgram &program) const;
+    bool reportProgress(quint64 bytesProcessed, quint64 totalBytes, const GCodeProcessingContext &context);
+    const QByteArray *replacementFeedRate(bool xyMove, bool zMove) const;
+
     bool mCleanupGCode;
     bool mFeedRatesSameLine;
     bool mReplaceM05;
+    bool mStripComments;
     bool mRedefineFeedRates;
     bool mOnlyReplaceExistingFeedRates;
     QString mNewXYFeedRate;
@@ -49,6 +143,36 @@ private:
 
     QString mInputFile;
     QString mOutputFile;
+
+    int mThreadCount;               // 1 to process on the calling thread, 0 to use one thread per core.
+    bool mUseCache;                 // true to load (and save) the parsed input from a cache file next to it.
+    bool mOptimizeMoves;            // true to merge collinear moves, and drop lines that don't do anything.
+    bool mFitArcs;                  // true to replace runs of moves that follow a circle with arcs.
+    bool mReorderTravel;            // true to put the blocks between rapid travels in a better order.
+    int mTravelTimeBudget;          // How long (ms) the order of the blocks may be improved for.
+    double mMoveTolerance;          // How far (mm) a merged move or arc may be from the moves it replaces.
+    const GCodeHeightMap *mHeightMap;   // The board to follow the surface of, or NULL.  (Not owned, and shared between copies.)
+    double mSegmentLength;          // How long (mm) a move can be before it is split to follow the board.
+    bool mUseFeedPolicy;            // true to work out the feed rate of each move from its direction and length.
+    double mPlungeFeedRate;         // mm/min, or 0 to use the Z feed rate.
+    double mRetractFeedRate;        // mm/min, or 0 to use the Z feed rate.
+    double mShortSegmentLength;     // Moves shorter than this (mm) are slowed down.
+    double mShortSegmentScale;      // The slowest a short move is made, as a fraction of its feed rate.
+    bool mLookAhead;                // true to lower the feed rate of each move to the speed it can reach.
+    double mAcceleration;           // mm/s^2 along X/Y, for the look-ahead planner.
+    double mZAcceleration;          // mm/s^2 along Z.
+    double mJunctionDeviation;      // mm
+    int mLookAheadWindow;           // How many lines the planner holds at once.
+    GCodeProgress *mProgress;       // Told how processing is going, or NULL.
+    GCodeTimeEstimate *mBeforeEstimate; // Given the run time of the input while it is processed, or NULL.  (Not owned.)
+    GCodeTimeEstimate *mAfterEstimate;  // Given the run time of the output.
+    qint64 mSpindleStopOffset;      // Where the line with the last M05 in the input starts, or -1.
+
+    // Parsed copies of the feed rates, set up when processing starts.
+    QByteArray mXYFeedRateText;
+    QByteArray mZFeedRateText;
+    double mXYFeedRateValue;
+    double mZFeedRateValue;
 };
 
 #endif // CHANGEGCODEFEEDRATES_H
@@ -0,0 +1,71 @@
+#-------------------------------------------------
+#
+# Command line only build, for machines without a GUI.
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = FAB-tweak-tom-cli
+CONFIG   += console
+CONFIG   -= app_bundle
+TEMPLATE = app
+
+DEFINES += FABTWEAKTOM_NO_GUI
+
+INCLUDEPATH += ..
+
+SOURCES += ../main.cpp \
+    ../commandline.cpp \
+    ../batchprocessor.cpp \
+    ../createbedlevelinggcode.cpp \
+    ../gcodeeditor.cpp \
+    ../logger.cpp \
+    ../changegcodefeedrates.cpp \
+    ../gcodelinereader.cpp \
+    ../gcodewriter.cpp \
+    ../gcodetokenizer.cpp \
+    ../gcodescanner.cpp \
+    ../gcodeoutput.cpp \
+    ../gcodenumberformatter.cpp \
+    ../gcodepiecetable.cpp \
+    ../gcodeprogram.cpp \
+    ../gcodeprogramcache.cpp \
+    ../gcodetimeestimator.cpp \
+    ../gcodemoveoptimizer.cpp \
+    ../gcodearcfitter.cpp \
+    ../gcodetraveloptimizer.cpp \
+    ../gcodeheightmap.cpp \
+    ../gcodezcompensator.cpp \
+    ../gcodefeedpolicy.cpp \
+    ../gcodelookaheadplanner.cpp \
+    ../gcodemodaltracker.cpp \
+    ../profiler.cpp
+
+HEADERS  += ../commandline.h \
+    ../batchprocessor.h \
+    ../createbedlevelinggcode.h \
+    ../gcodeeditor.h \
+    ../logger.h \
+    ../changegcodefeedrates.h \
+    ../gcodelinereader.h \
+    ../gcodewriter.h \
+    ../gcodetokenizer.h \
+    ../gcodescanner.h \
+    ../gcodeoutput.h \
+    ../gcodeprogress.h \
+    ../gcodenumberformatter.h \
+    ../gcodepiecetable.h \
+    ../gcodeprogram.h \
+    ../gcodeprogramcache.h \
+    ../gcodetimeestimator.h \
+    ../gcodemoveoptimizer.h \
+    ../gcodearcfitter.h \
+    ../gcodetraveloptimizer.h \
+    ../gcodeheightmap.h \
+    ../gcodezcompensator.h \
+    ../gcodefeedpolicy.h \
+    ../gcodelookaheadplanner.h \
+    ../gcodemodaltracker.h \
+    ../profiler.h
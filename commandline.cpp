@@ -0,0 +1,895 @@
+#include "commandline.h"
+#include "batchprocessor.h"
+#include "changegcodefeedrates.h"
+#include "createbedlevelinggcode.h"
+#include "gcodeprogram.h"
+#include "gcodeprogramcache.h"
+#include "gcodemoveoptimizer.h"
+#include "gcodetraveloptimizer.h"
+#include "gcodetimeestimator.h"
+#include "gcodeheightmap.h"
+#include "gcodezcompensator.h"
+#include "gcodefeedpolicy.h"
+#include "gcodelookaheadplanner.h"
+#include "logger.h"
+#include "profiler.h"
+
+#include <QDir>
+#include <QFile>
+#include <QThread>
+#include <QFileInfo>
+#include <QHash>
+#include <QElapsedTimer>
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// Exit codes.
+#define COMMAND_LINE_SUCCESS                 0
+#define COMMAND_LINE_FAILED                  1
+#define COMMAND_LINE_USAGE                   2
+
+CommandLine::CommandLine()
+{
+}
+
+/**
+ * @brief CommandLine::wantsCommandLine - Check if we were started with any arguments, and so should run
+ *      from the command line instead of bringing up the GUI.
+ *
+ * @param argc - The argument count passed to main().
+ * @param argv - The arguments passed to main().
+ *
+ * @return true if the command line should be used.  false if the GUI should be started.
+ */
+bool CommandLine::wantsCommandLine(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        // OS X adds a process serial number when an app is started from the Finder.
+        if (strncmp(argv[i], "-psn_", 5) != 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief CommandLine::printUsage - Tell the user how to run us.
+ */
+void CommandLine::printUsage()
+{
+    printf("Usage :\n"
+           "  FAB-tweak-tom                                 Start the GUI.\n"
+           "  FAB-tweak-tom feedrates [options] <file or directory>...\n"
+           "  FAB-tweak-tom bedlevel [options] --output <file>\n"
+           "\n"
+           "Feed rate options :\n"
+           "  --output <file>             Where to write the changed G-code.  (Only with a single input file.)\n"
+           "  --output-dir <directory>    Write the changed G-code to files with the same names in this directory.\n"
+           "                              (Otherwise <name>-tweaked.gcode is written next to each input file.)\n"
+           "                              Nothing is run if two inputs would be written to the same file.\n"
+           "  --xy-feed-rate <rate>       Redefine the X/Y feed rate.\n"
+           "  --z-feed-rate <rate>        Redefine the Z feed rate.\n"
+           "  --only-replace-existing     Only change feed rates that are already in the file.\n"
+           "  --feed-policy               Work out the feed rate of each move from its direction, instead of using the\n"
+           "                              slower of the two for moves that use both.  (Needs both feed rates.)\n"
+           "  --plunge-feed-rate <rate>   The Z feed rate for moves going down.  (Turns on --feed-policy.)\n"
+           "  --retract-feed-rate <rate>  The Z feed rate for moves going up.  (Turns on --feed-policy.)\n"
+           "  --short-segment <mm>        Slow down moves shorter than this.  (Turns on --feed-policy.  Default : %g)\n"
+           "  --short-segment-scale <n>   The slowest a short move is made, as a fraction of its feed rate.\n"
+           "                              (Default : %g)\n"
+           "  --look-ahead                Plan the speed of the machine over thousands of moves, and lower the feed\n"
+           "                              rate of each G01 move to the speed it can actually reach.\n"
+           "  --acceleration <mm/s^2>     The X/Y acceleration to plan with.  (Turns on --look-ahead.  Default : %d)\n"
+           "  --z-acceleration <mm/s^2>   The Z acceleration to plan with.  (Turns on --look-ahead.  Default : %d)\n"
+           "  --junction-deviation <mm>   How far a corner may be rounded off.  (Turns on --look-ahead.  Default : %g)\n"
+           "  --look-ahead-window <lines> How many lines to plan over at once.  (Default : %d)\n"
+           "  --no-cleanup                Don't clean up the G-code.\n"
+           "  --no-same-line              Don't merge lines that only set a feed rate in to the next move.\n"
+           "  --no-replace-m05            Don't replace the last M05 with \"%s\".\n"
+           "  --strip-comments            Remove comments.\n"
+           "  --jobs <count>              How many files to process at once.  (Default : one per CPU core.)\n"
+           "  --threads-per-file <count>  How many threads to use for each file.  (Default : 1, 0 for one per CPU core.)\n"
+           "  --cache                     Keep the parsed G-code in a \"" GCODE_CACHE_SUFFIX "\" file next to each input, so that\n"
+           "                              running again on the same input doesn't have to parse it.\n"
+           "  --merge-moves               Merge runs of collinear G01 moves, and leave out moves, F words and G90/G91\n"
+           "                              lines that don't change anything.\n"
+           "  --fit-arcs                  Replace runs of G01 moves that follow a circle with G02/G03 arcs.\n"
+           "  --move-tolerance <mm>       How far a merged move or arc may stray from the moves it replaces.\n"
+           "                              (Default : %g)\n"
+           "  --reorder-travel            Cut the blocks between rapid travels in an order that travels less.\n"
+           "  --travel-time <ms>          How long to spend improving the order.  (Default : %d)\n"
+           "  --heightmap <file>          Follow the surface of a board that isn't flat, from a heightmap of X,Y,Z\n"
+           "                              points.  (Made by running a bedlevel --probe file.)\n"
+           "  --segment-length <mm>       Split cutting moves longer than this, so they follow the heightmap.\n"
+           "                              (Default : %g)\n"
+           "  --bicubic                   Fit a smooth surface to the heightmap, instead of straight lines between\n"
+           "                              its points.\n"
+           "  --estimate                  Don't write anything.  Show how long each file takes to run, before and\n"
+           "                              after the changes.\n"
+           "\n"
+           "Bed leveling options :\n"
+           "  --output <file>             The G-code file to create.\n"
+           "  --mill-size <mm>            (Default : 0.3)\n"
+           "  --overlap <mm>              (Default : half of the mill size)\n"
+           "  --depth <mm>                (Default : 0.5)\n"
+           "  --width <mm>                (Default : 100)\n"
+           "  --height <mm>               (Default : 100)\n"
+           "  --spindle-speed <rpm>       (Default : 15000)\n"
+           "  --xy-feed-rate <rate>       (Default : 400)\n"
+           "  --z-feed-rate <rate>        (Default : 30)\n"
+           "  --trim-zeros                Leave the trailing zeros off of numbers.  (\"X1.5\" instead of \"X1.5000\")\n"
+           "  --strategy <name>           How to cover the area.  One of squares (shrink by the overlap each time),\n"
+           "                              zigzag or concentric (passes spaced by the mill size less the overlap).\n"
+           "                              (Default : squares)\n"
+           "  --direction <name>          Which way the zigzag and concentric passes cut.  One of either, climb or\n"
+           "                              conventional.  (Default : either)\n"
+           "  --step-down <mm>            The deepest each pass can cut.  (Default : 0, the full depth in one pass)\n"
+           "  --tile-size <mm>            Mill large areas in tiles no bigger than this, one at a time.\n"
+           "                              (Default : 0, the whole area at once)\n"
+           "  --probe                     Create a file that probes the height of the area, instead of milling it.\n"
+           "  --probe-spacing <mm>        The furthest apart the probed points can be.  (Default : %d)\n"
+           "  --probe-depth <mm>          How far below the start to look for the board.  (Default : %d)\n"
+           "\n"
+           "Options for both commands :\n"
+           "  --log-level <level>         How much to write to the log.  One of trace, debug, info, warning, error\n"
+           "                              or none.  (Default : info.  Release builds leave out trace and debug.)\n"
+           "  --profile                   Print how long each stage of the work took, and what went through it.\n"
+           "  --profile-trace <file>      Also write the stages out as a Chrome trace event file, to look at in\n"
+           "                              chrome://tracing or Perfetto.  (Turns on --profile.)\n", GCODE_FEED_POLICY_DEFAULT_SHORT_LENGTH,
+           GCODE_FEED_POLICY_DEFAULT_SHORT_SCALE, GCODE_PLANNER_DEFAULT_ACCELERATION, GCODE_PLANNER_DEFAULT_Z_ACCELERATION,
+           GCODE_PLANNER_DEFAULT_JUNCTION_DEVIATION, GCODE_PLANNER_DEFAULT_WINDOW, GCODE_SPINDLE_STOP_REPLACEMENT, GCODE_OPTIMIZER_DEFAULT_TOLERANCE, GCODE_TRAVEL_DEFAULT_TIME_BUDGET, (double)GCODE_COMPENSATION_DEFAULT_SEGMENT_LENGTH,
+           BED_LEVEL_DEFAULT_PROBE_SPACING, BED_LEVEL_DEFAULT_PROBE_DEPTH);
+}
+
+/**
+ * @brief CommandLine::run - Run the command given on the command line.
+ *
+ * @param arguments - All of the command line arguments, including the program name.
+ *
+ * @return int containing the exit code for the process.
+ */
+int CommandLine::run(QStringList arguments)
+{
+    QString command;
+    QElapsedTimer timer;
+    int result;
+
+    if (arguments.size() < 2) {
+        printUsage();
+        return COMMAND_LINE_USAGE;
+    }
+
+    command = arguments.at(1);
+    timer.start();
+
+    if (command == "feedrates") {
+        result = runFeedRates(arguments.mid(2));
+        writeProfile(timer.elapsed());
+        return result;
+    }
+
+    if (command == "bedlevel") {
+        result = runBedLeveling(arguments.mid(2));
+        writeProfile(timer.elapsed());
+        return result;
+    }
+
+    printUsage();
+
+    if ((command == "--help") || (command == "-h")) {
+        return COMMAND_LINE_SUCCESS;
+    }
+
+    return COMMAND_LINE_USAGE;
+}
+
+/**
+ * @brief CommandLine::writeProfile - If --profile was given, print what the profiler collected while the
+ *      command ran, and write its trace if one was asked for.
+ *
+ * @param elapsed - How long the command took, in ms.
+ */
+void CommandLine::writeProfile(qint64 elapsed)
+{
+    if (Profiler::instance().isEnabled() == false) {
+        return;
+    }
+
+    // Nothing more is collected while the results are written.
+    Profiler::instance().setEnabled(false);
+
+    printf("\nRan for %lld ms.\n", (long long)elapsed);
+    Profiler::instance().writeReport(stdout);
+
+    if (mTraceFile.isEmpty() == false) {
+        if (Profiler::instance().writeTrace(mTraceFile) == false) {
+            fprintf(stderr, "Unable to write the trace to %s\n", mTraceFile.toLocal8Bit().constData());
+            return;
+        }
+
+        printf("Wrote the trace to %s\n", QFile::encodeName(mTraceFile).constData());
+    }
+}
+
+/**
+ * @brief CommandLine::runFeedRates - Parse the options for changing feed rates, and run them over every
+ *      input file.
+ *
+ * @param arguments - The arguments that followed the "feedrates" command.
+ *
+ * @return int containing the exit code for the process.
+ */
+int CommandLine::runFeedRates(const QStringList &arguments)
+{
+    ChangeGCodeFeedRates settings;
+    GCodeHeightMap heightMap;
+    QStringList inputs;
+    QStringList inputFiles;
+    QStringList outputFiles;
+    QString outputFile;
+    QString outputDir;
+    QString value;
+    int jobs = QThread::idealThreadCount();
+    int threadsPerFile = 1;
+    bool redefine = false;
+    bool cleanup = true;
+    bool queued = true;
+    bool estimate = false;
+    double tolerance;
+    double segmentLength;
+    double feedRate;
+    double shortLength = GCODE_FEED_POLICY_DEFAULT_SHORT_LENGTH;
+    double shortScale = GCODE_FEED_POLICY_DEFAULT_SHORT_SCALE;
+    double acceleration = GCODE_PLANNER_DEFAULT_ACCELERATION;
+    double zAcceleration = GCODE_PLANNER_DEFAULT_Z_ACCELERATION;
+    double junctionDeviation;
+    int window;
+    int travelTime;
+    int i;
+
+    settings.setNewXYFeedRate("");
+    settings.setNewZFeedRate("");
+
+    for (i = 0; i < arguments.size(); i++) {
+        const QString &option = arguments.at(i);
+
+        if (option == "--output") {
+            if (nextValue(arguments, &i, &outputFile) == false) {
+                return COMMAND_LINE_USAGE;
+            }
+        } else if (option == "--output-dir") {
+            if (nextValue(arguments, &i, &outputDir) == false) {
+                return COMMAND_LINE_USAGE;
+            }
+        } else if ((option == "--xy-feed-rate") || (option == "--z-feed-rate")) {
+            if (nextValue(arguments, &i, &value) == false) {
+                return COMMAND_LINE_USAGE;
+            }
+
+            if (option == "--xy-feed-rate") {
+                settings.setNewXYFeedRate(value);
+            } else {
+                settings.setNewZFeedRate(value);
+            }
+            redefine = true;
+        } else if (option == "--only-replace-existing") {
+            settings.setOnlyReplaceExistingFeedRates(true);
+        } else if (option == "--no-cleanup") {
+            cleanup = false;
+        } else if (option == "--no-same-line") {
+            settings.setFeedRateSameLine(false);
+        } else if (option == "--no-replace-m05") {
+            settings.setReplaceM05(false);
+        } else if (option == "--strip-comments") {
+            settings.setStripComments(true);
+        } else if (option == "--cache") {
+            settings.setUseCache(true);
+        } else if (option == "--merge-moves") {
+            settings.setOptimizeMoves(true);
+        } else if (option == "--fit-arcs") {
+            settings.setFitArcs(true);
+        } else if (option == "--move-tolerance") {
+            if (nextNumber(arguments, &i, &tolerance) == false) {
+                return COMMAND_LINE_USAGE;
+            }
+            settings.setMoveTolerance(tolerance);
+        } else if (option == "--reorder-travel") {
+            settings.setReorderTravel(true);
+        } else if (option == "--travel-time") {
+            if (nextInteger(arguments, &i, &travelTime) == false) {
+                return COMMAND_LINE_USAGE;
+            }
+            settings.setTravelTimeBudget(travelTime);
+        } else if (option == "--heightmap") {
+            if (nextValue(arguments, &i, &value) == false) {
+                return COMMAND_LINE_USAGE;
+            }
+
+            value = heightMap.load(value);
+            if (value.isEmpty() == false) {
+                fprintf(stderr, "%s\n", value.toLocal8Bit().constData());
+                return COMMAND_LINE_FAILED;
+            }
+            settings.setHeightMap(&heightMap);
+        } else if (option == "--segment-length") {
+            if (nextNumber(arguments, &i, &segmentLength) == false) {
+                return COMMAND_LINE_USAGE;
+            }
+            settings.setSegmentLength(segmentLength);
+        } else if (option == "--bicubic") {
+            heightMap.setInterpolation(HEIGHT_MAP_BICUBIC);
+        } else if (option == "--feed-policy") {
+            settings.setUseFeedPolicy(true);
+        } else if ((option == "--plunge-feed-rate") || (option == "--retract-feed-rate")) {
+            if (nextNumber(arguments, &i, &feedRate) == false) {
+                return COMMAND_LINE_USAGE;
+            }
+
+            if (option == "--plunge-feed-rate") {
+                settings.setPlungeFeedRate(feedRate);
+            } else {
+                settings.setRetractFeedRate(feedRate);
+            }
+            settings.setUseFeedPolicy(true);
+        } else if ((option == "--short-segment") || (option == "--short-segment-scale")) {
+            if (nextNumber(arguments, &i, (option == "--short-segment") ? &shortLength : &shortScale) == false) {
+                return COMMAND_LINE_USAGE;
+            }
+
+            if (option == "--short-segment") {
+                settings.setUseFeedPolicy(true);
+            }
+        } else if (option == "--look-ahead") {
+            settings.setLookAhead(true);
+        } else if ((option == "--acceleration") || (option == "--z-acceleration")) {
+            if (nextNumber(arguments, &i, (option == "--acceleration") ? &acceleration : &zAcceleration) == false) {
+                return COMMAND_LINE_USAGE;
+            }
+            settings.setLookAhead(true);
+        } else if (option == "--junction-deviation") {
+            if (nextNumber(arguments, &i, &junctionDeviation) == false) {
+                return COMMAND_LINE_USAGE;
+            }
+            settings.setJunctionDeviation(junctionDeviation);
+            settings.setLookAhead(true);
+        } else if (option == "--look-ahead-window") {
+            if (nextInteger(arguments, &i, &window) == false) {
+                return COMMAND_LINE_USAGE;
+            }
+            settings.setLookAheadWindow(window);
+        } else if (option == "--estimate") {
+            estimate = true;
+        } else if (option == "--jobs") {
+            if (nextInteger(arguments, &i, &jobs) == false) {
+                return COMMAND_LINE_USAGE;
+            }
+        } else if (option == "--threads-per-file") {
+            if (nextInteger(arguments, &i, &threadsPerFile) == false) {
+                return COMMAND_LINE_USAGE;
+            }
+        } else if (option == "--log-level") {
+            if (nextLogLevel(arguments, &i) == false) {
+                return COMMAND_LINE_USAGE;
+            }
+        } else if (option == "--profile") {
+            Profiler::instance().setEnabled(true);
+        } else if (option == "--profile-trace") {
+            if (nextValue(arguments, &i, &mTraceFile) == false) {
+                return COMMAND_LINE_USAGE;
+            }
+            Profiler::instance().setEnabled(true);
+        } else if (option.startsWith("--") == true) {
+            fprintf(stderr, "Unknown option : %s\n", option.toLocal8Bit().constData());
+            return COMMAND_LINE_USAGE;
+        } else {
+            inputs.append(option);
+        }
+    }
+
+    if (inputs.isEmpty() == true) {
+        fprintf(stderr, "No input files were given.\n");
+        return COMMAND_LINE_USAGE;
+    }
+
+    if ((outputFile.isEmpty() == false) && ((inputs.size() > 1) || (QFileInfo(inputs.at(0)).isDir() == true))) {
+        fprintf(stderr, "--output can only be used with a single input file.  Use --output-dir instead.\n");
+        return COMMAND_LINE_USAGE;
+    }
+
+    if ((outputDir.isEmpty() == false) && (QDir().mkpath(outputDir) == false)) {
+        fprintf(stderr, "Unable to create the output directory : %s\n", outputDir.toLocal8Bit().constData());
+        return COMMAND_LINE_FAILED;
+    }
+
+    if (jobs < 1) {
+        jobs = 1;
+    }
+
+    settings.setCleanUpGCode(cleanup);
+    settings.setRedefineFeedRates(redefine);
+    settings.setShortSegment(shortLength, shortScale);
+    settings.setAcceleration(acceleration, zAcceleration);
+    settings.setThreadCount(threadsPerFile);
+
+    if (estimate == true) {
+        return estimateFiles(settings, inputs);
+    }
+
+    for (i = 0; i < inputs.size(); i++) {
+        if (findInputFiles(inputs.at(i), outputFile, outputDir, &inputFiles, &outputFiles) == false) {
+            queued = false;
+        }
+    }
+
+    // Nothing is started if two of the files would be written to the same place.
+    if (checkOutputFiles(inputFiles, outputFiles) == false) {
+        return COMMAND_LINE_FAILED;
+    }
+
+    BatchProcessor batch(settings, jobs);
+
+    for (i = 0; i < inputFiles.size(); i++) {
+        batch.addFile(inputFiles.at(i), outputFiles.at(i));
+    }
+
+    if ((batch.waitForDone() != 0) || (queued == false)) {
+        return COMMAND_LINE_FAILED;
+    }
+
+    return COMMAND_LINE_SUCCESS;
+}
+
+/**
+ * @brief CommandLine::runBedLeveling - Parse the options for creating bed leveling G-code, and create it.
+ *
+ * @param arguments - The arguments that followed the "bedlevel" command.
+ *
+ * @return int containing the exit code for the process.
+ */
+int CommandLine::runBedLeveling(const QStringList &arguments)
+{
+    CreateBedLevelingGCode bedleveling;
+    QString outputFile;
+    QString error;
+    QElapsedTimer timer;
+    double millSize = 0.3;
+    double overlapSize = -1;
+    double depth = 0.5;
+    double width = 100;
+    double height = 100;
+    int spindleSpeed = 15000;
+    double xyFeedRate = 400;
+    double zFeedRate = 30;
+    double stepDown = 0;
+    double tileSize = 0;
+    double probeSpacing = BED_LEVEL_DEFAULT_PROBE_SPACING;
+    double probeDepth = BED_LEVEL_DEFAULT_PROBE_DEPTH;
+    bool probe = false;
+    bool trimZeros = false;
+    int strategy = BED_LEVEL_STRATEGY_SQUARES;
+    int direction = BED_LEVEL_DIRECTION_EITHER;
+    QString name;
+    GCodeTimeEstimate estimate;
+    bool ok = true;
+
+    for (int i = 0; i < arguments.size(); i++) {
+        const QString &option = arguments.at(i);
+
+        if (option == "--output") {
+            ok = nextValue(arguments, &i, &outputFile);
+        } else if (option == "--strategy") {
+            ok = nextValue(arguments, &i, &name);
+            if (ok == true) {
+                if (name == "squares") {
+                    strategy = BED_LEVEL_STRATEGY_SQUARES;
+                } else if (name == "zigzag") {
+                    strategy = BED_LEVEL_STRATEGY_ZIGZAG;
+                } else if (name == "concentric") {
+                    strategy = BED_LEVEL_STRATEGY_CONCENTRIC;
+                } else {
+                    fprintf(stderr, "Unknown strategy : %s\n", name.toLocal8Bit().constData());
+                    ok = false;
+                }
+            }
+        } else if (option == "--direction") {
+            ok = nextValue(arguments, &i, &name);
+            if (ok == true) {
+                if (name == "either") {
+                    direction = BED_LEVEL_DIRECTION_EITHER;
+                } else if (name == "climb") {
+                    direction = BED_LEVEL_DIRECTION_CLIMB;
+                } else if (name == "conventional") {
+                    direction = BED_LEVEL_DIRECTION_CONVENTIONAL;
+                } else {
+                    fprintf(stderr, "Unknown milling direction : %s\n", name.toLocal8Bit().constData());
+                    ok = false;
+                }
+            }
+        } else if (option == "--probe") {
+            probe = true;
+        } else if (option == "--probe-spacing") {
+            ok = nextNumber(arguments, &i, &probeSpacing);
+        } else if (option == "--probe-depth") {
+            ok = nextNumber(arguments, &i, &probeDepth);
+        } else if (option == "--step-down") {
+            ok = nextNumber(arguments, &i, &stepDown);
+        } else if (option == "--tile-size") {
+            ok = nextNumber(arguments, &i, &tileSize);
+        } else if (option == "--mill-size") {
+            ok = nextNumber(arguments, &i, &millSize);
+        } else if (option == "--overlap") {
+            ok = nextNumber(arguments, &i, &overlapSize);
+        } else if (option == "--depth") {
+            ok = nextNumber(arguments, &i, &depth);
+        } else if (option == "--width") {
+            ok = nextNumber(arguments, &i, &width);
+        } else if (option == "--height") {
+            ok = nextNumber(arguments, &i, &height);
+        } else if (option == "--spindle-speed") {
+            ok = nextInteger(arguments, &i, &spindleSpeed);
+        } else if (option == "--xy-feed-rate") {
+            ok = nextNumber(arguments, &i, &xyFeedRate);
+        } else if (option == "--z-feed-rate") {
+            ok = nextNumber(arguments, &i, &zFeedRate);
+        } else if (option == "--trim-zeros") {
+            trimZeros = true;
+        } else if (option == "--log-level") {
+            ok = nextLogLevel(arguments, &i);
+        } else if (option == "--profile") {
+            Profiler::instance().setEnabled(true);
+        } else if (option == "--profile-trace") {
+            ok = nextValue(arguments, &i, &mTraceFile);
+            Profiler::instance().setEnabled(true);
+        } else {
+            fprintf(stderr, "Unknown option : %s\n", option.toLocal8Bit().constData());
+            ok = false;
+        }
+
+        if (ok == false) {
+            return COMMAND_LINE_USAGE;
+        }
+    }
+
+    if (outputFile.isEmpty() == true) {
+        fprintf(stderr, "No output file was given.  (Use --output <file>.)\n");
+        return COMMAND_LINE_USAGE;
+    }
+
+    // The same default the GUI uses.
+    if (overlapSize < 0) {
+        overlapSize = millSize / 2;
+    }
+
+    // Sizes that would cut nothing, or never finish cutting.
+    if (millSize <= 0) {
+        fprintf(stderr, "--mill-size has to be more than 0.\n");
+        return COMMAND_LINE_USAGE;
+    }
+
+    if ((overlapSize <= 0) || (overlapSize >= millSize)) {
+        fprintf(stderr, "--overlap has to be more than 0, and less than the mill size.\n");
+        return COMMAND_LINE_USAGE;
+    }
+
+    if ((width <= 0) || (height <= 0)) {
+        fprintf(stderr, "--width and --height have to be more than 0.\n");
+        return COMMAND_LINE_USAGE;
+    }
+
+    if (depth <= 0) {
+        fprintf(stderr, "--depth has to be more than 0.\n");
+        return COMMAND_LINE_USAGE;
+    }
+
+    if (stepDown < 0) {
+        fprintf(stderr, "--step-down can't be less than 0.\n");
+        return COMMAND_LINE_USAGE;
+    }
+
+    if ((tileSize < 0) ||
+            ((tileSize > 0) && ((ceil(width / tileSize) * ceil(height / tileSize)) > BED_LEVEL_MAX_TILES))) {
+        fprintf(stderr, "--tile-size can't be less than 0, or split the area in to more than %d tiles.\n", BED_LEVEL_MAX_TILES);
+        return COMMAND_LINE_USAGE;
+    }
+
+    bedleveling.setCutDepth(-1 * depth);
+    bedleveling.setLevelHeight(height);
+    bedleveling.setLevelWidth(width);
+    bedleveling.setMillSize(millSize);
+    bedleveling.setOverlapSize(overlapSize);
+    bedleveling.setSpindleSpeed(spindleSpeed);
+    bedleveling.setXYFeedRate(xyFeedRate);
+    bedleveling.setZFeedRate(zFeedRate);
+    bedleveling.setTrimTrailingZeros(trimZeros);
+    bedleveling.setStrategy(strategy);
+    bedleveling.setMillingDirection(direction);
+    bedleveling.setMaxStepDown(stepDown);
+    bedleveling.setTileSize(tileSize);
+    bedleveling.setProbeSpacing(probeSpacing);
+    bedleveling.setProbeDepth(probeDepth);
+
+    timer.start();
+    if (probe == true) {
+        error = bedleveling.createProbingFile(outputFile);
+    } else {
+        error = bedleveling.createGCodeFile(outputFile);
+    }
+
+    if (error.isEmpty() == false) {
+        fprintf(stderr, "%s : %s\n", outputFile.toLocal8Bit().constData(), error.toLocal8Bit().constData());
+        return COMMAND_LINE_FAILED;
+    }
+
+    printf("%s : %lld bytes created in %lld ms\n", QFile::encodeName(outputFile).constData(),
+           (long long)QFileInfo(outputFile).size(), (long long)timer.elapsed());
+
+    bedleveling.getEstimate(&estimate);
+    printf("%s : cuts %.2f m, estimated run time %s\n", QFile::encodeName(outputFile).constData(), estimate.cutLength / 1000,
+           GCodeTimeEstimator::formatDuration(estimate.seconds).toLocal8Bit().constData());
+
+    return COMMAND_LINE_SUCCESS;
+}
+
+/**
+ * @brief CommandLine::estimateFiles - Show how long each input file takes to run, before and after the feed
+ *      rate changes.
+ *
+ * @param settings - The changes to make.
+ * @param inputs - The files (or directories of G-code files) given on the command line.
+ *
+ * @return int containing the exit code for the process.
+ */
+int CommandLine::estimateFiles(const ChangeGCodeFeedRates &settings, const QStringList &inputs)
+{
+    GCodeTimeEstimator estimator;
+    GCodeTimeEstimate before;
+    GCodeTimeEstimate after;
+    QStringList files;
+    QFileInfoList found;
+    int exitCode = COMMAND_LINE_SUCCESS;
+    int result;
+
+    for (int i = 0; i < inputs.size(); i++) {
+        if (QFileInfo(inputs.at(i)).isDir() == true) {
+            found = QDir(inputs.at(i)).entryInfoList(QStringList() << "*.gcode", QDir::Files, QDir::Name);
+            for (int j = 0; j < found.size(); j++) {
+                files.append(found.at(j).filePath());
+            }
+        } else {
+            files.append(inputs.at(i));
+        }
+    }
+
+    for (int i = 0; i < files.size(); i++) {
+        ChangeGCodeFeedRates feedRates(settings);
+
+        feedRates.setInputFile(files.at(i));
+        result = feedRates.estimateRunTime(estimator, &before, &after);
+        if (result != CHANGE_GCODE_SUCCESS) {
+            fprintf(stderr, "%s : %s\n", files.at(i).toLocal8Bit().constData(), feedRates.resultCodeAsString(result).toLocal8Bit().constData());
+            exitCode = COMMAND_LINE_FAILED;
+            continue;
+        }
+
+        printf("%s : %s before, %s after (%.1f min saved).  %.1f mm cutting, %.1f mm rapid, %llu moves.\n",
+               files.at(i).toLocal8Bit().constData(), GCodeTimeEstimator::formatDuration(before.seconds).toLocal8Bit().constData(),
+               GCodeTimeEstimator::formatDuration(after.seconds).toLocal8Bit().constData(), (before.seconds - after.seconds) / 60,
+               after.cutLength, after.rapidLength, (unsigned long long)after.moves);
+    }
+
+    return exitCode;
+}
+
+/**
+ * @brief CommandLine::findInputFiles - Find the files to process for an input (the input file, or every G-code
+ *      file in an input directory), and where each of them should be written.
+ *
+ * @param input - The file or directory given on the command line.
+ * @param outputFile - The output file given on the command line, if any.
+ * @param outputDir - The output directory given on the command line, if any.
+ * @param inputFiles[out] - The files are added to this.
+ * @param outputFiles[out] - Where each of them should be written is added to this.
+ *
+ * @return true if the input was found.  false if it doesn't exist.
+ */
+bool CommandLine::findInputFiles(const QString &input, const QString &outputFile, const QString &outputDir,
+                                 QStringList *inputFiles, QStringList *outputFiles)
+{
+    QFileInfo info(input);
+    QFileInfoList files;
+
+    if (info.isDir() == true) {
+        files = QDir(input).entryInfoList(QStringList() << "*.gcode", QDir::Files, QDir::Name);
+        for (int i = 0; i < files.size(); i++) {
+            inputFiles->append(files.at(i).filePath());
+            outputFiles->append(outputFileFor(files.at(i).filePath(), outputDir));
+        }
+
+        return true;
+    }
+
+    if (info.exists() == false) {
+        fprintf(stderr, "%s : No such file or directory.\n", input.toLocal8Bit().constData());
+        return false;
+    }
+
+    inputFiles->append(input);
+    if (outputFile.isEmpty() == false) {
+        outputFiles->append(outputFile);
+    } else {
+        outputFiles->append(outputFileFor(input, outputDir));
+    }
+
+    return true;
+}
+
+/**
+ * @brief CommandLine::checkOutputFiles - Make sure that no two files will be written to the same place, and that
+ *      nothing will be written over one of the inputs.  (Which can happen with --output-dir, when inputs from
+ *      different directories have the same name.)  Each problem is reported.
+ *
+ * @param inputFiles - The files that will be processed.
+ * @param outputFiles - Where each of them will be written.
+ *
+ * @return true if every output file is different.  false otherwise.
+ */
+bool CommandLine::checkOutputFiles(const QStringList &inputFiles, const QStringList &outputFiles)
+{
+    QHash<QString, int> inputIndex;
+    QHash<QString, int> outputIndex;
+    QString path;
+    int other;
+    bool ok = true;
+
+    for (int i = 0; i < inputFiles.size(); i++) {
+        inputIndex.insert(QDir::cleanPath(QFileInfo(inputFiles.at(i)).absoluteFilePath()), i);
+    }
+
+    for (int i = 0; i < outputFiles.size(); i++) {
+        path = QDir::cleanPath(QFileInfo(outputFiles.at(i)).absoluteFilePath());
+
+        other = outputIndex.value(path, -1);
+        if (other >= 0) {
+            fprintf(stderr, "%s and %s would both be written to %s.\n", inputFiles.at(other).toLocal8Bit().constData(),
+                    inputFiles.at(i).toLocal8Bit().constData(), outputFiles.at(i).toLocal8Bit().constData());
+            ok = false;
+            continue;
+        }
+
+        other = inputIndex.value(path, -1);
+        if (other >= 0) {
+            fprintf(stderr, "%s would be written over the input file %s.\n", inputFiles.at(i).toLocal8Bit().constData(),
+                    inputFiles.at(other).toLocal8Bit().constData());
+            ok = false;
+            continue;
+        }
+
+        outputIndex.insert(path, i);
+    }
+
+    return ok;
+}
+
+/**
+ * @brief CommandLine::outputFileFor - Work out where the changed version of an input file should go.
+ *
+ * @param inputFile - The input file.
+ * @param outputDir - The output directory, or an empty string to write next to the input file.
+ *
+ * @return QString containing the output file name.
+ */
+QString CommandLine::outputFileFor(const QString &inputFile, const QString &outputDir)
+{
+    QFileInfo info(inputFile);
+
+    if (outputDir.isEmpty() == false) {
+        return QDir(outputDir).filePath(info.fileName());
+    }
+
+    return QDir(info.path()).filePath(info.completeBaseName() + "-tweaked.gcode");
+}
+
+/**
+ * @brief CommandLine::nextValue - Get the value that follows an option.
+ *
+ * @param arguments - The command line arguments.
+ * @param index[in,out] - The index of the option.  Moved on to the value.
+ * @param value[out] - The value.
+ *
+ * @return true if there was a value.  false otherwise.
+ */
+bool CommandLine::nextValue(const QStringList &arguments, int *index, QString *value)
+{
+    if ((*index + 1) >= arguments.size()) {
+        fprintf(stderr, "%s needs a value.\n", arguments.at(*index).toLocal8Bit().constData());
+        return false;
+    }
+
+    (*index)++;
+    *value = arguments.at(*index);
+
+    return true;
+}
+
+/**
+ * @brief CommandLine::nextNumber - Get the number that follows an option.
+ *
+ * @param arguments - The command line arguments.
+ * @param index[in,out] - The index of the option.  Moved on to the value.
+ * @param value[out] - The number.
+ *
+ * @return true if there was a valid number.  false otherwise.
+ */
+bool CommandLine::nextNumber(const QStringList &arguments, int *index, double *value)
+{
+    QString text;
+    bool ok;
+
+    if (nextValue(arguments, index, &text) == false) {
+        return false;
+    }
+
+    *value = text.toDouble(&ok);
+    if (ok == false) {
+        fprintf(stderr, "%s needs a number, not '%s'.\n", arguments.at(*index - 1).toLocal8Bit().constData(), text.toLocal8Bit().constData());
+    }
+
+    return ok;
+}
+
+/**
+ * @brief CommandLine::nextInteger - Get the whole number that follows an option.
+ *
+ * @param arguments - The command line arguments.
+ * @param index[in,out] - The index of the option.  Moved on to the value.
+ * @param value[out] - The number.
+ *
+ * @return true if there was a valid number.  false otherwise.
+ */
+bool CommandLine::nextInteger(const QStringList &arguments, int *index, int *value)
+{
+    QString text;
+    bool ok;
+
+    if (nextValue(arguments, index, &text) == false) {
+        return false;
+    }
+
+    *value = text.toInt(&ok);
+    if (ok == false) {
+        fprintf(stderr, "%s needs a whole number, not '%s'.\n", arguments.at(*index - 1).toLocal8Bit().constData(), text.toLocal8Bit().constData());
+    }
+
+    return ok;
+}
+
+/**
+ * @brief CommandLine::nextLogLevel - Get the log level that follows an option, and start using it.
+ *
+ * @param arguments - The command line arguments.
+ * @param index[in,out] - The index of the option.  Moved on to the value.
+ *
+ * @return true if there was a valid log level.  false otherwise.
+ */
+bool CommandLine::nextLogLevel(const QStringList &arguments, int *index)
+{
+    QString text;
+    int level;
+
+    if (nextValue(arguments, index, &text) == false) {
+        return false;
+    }
+
+    level = Logger::levelFromName(text);
+    if (level < 0) {
+        fprintf(stderr, "%s needs one of trace, debug, info, warning, error or none, not '%s'.\n", arguments.at(*index - 1).toLocal8Bit().constData(), text.toLocal8Bit().constData());
+        return false;
+    }
+
+    logger.setLevel(level);
+
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef COMMANDLINE_H
+#define COMMANDLINE_H
+
+#include <QString>
+#include <QStringList>
+
+class ChangeGCodeFeedRates;
+
+// Runs the G-code tools from the command line, without any GUI.
+class CommandLine
+{
+public:
+    CommandLine();
+
+    static bool wantsCommandLine(int argc, char *argv[]);
+    static void printUsage();
+
+    int run(QStringList arguments);
+
+private:
+    int runFeedRates(const QStringList &arguments);
+    int runBedLeveling(const QStringList &arguments);
+    void writeProfile(qint64 elapsed);
+
+    int estimateFiles(const ChangeGCodeFeedRates &settings, const QStringList &inputs);
+    bool findInputFiles(const QString &input, const QString &outputFile, const QString &outputDir,
+                        QStringList *inputFiles, QStringList *outputFiles);
+    bool checkOutputFiles(const QStringList &inputFiles, const QStringList &outputFiles);
+    QString outputFileFor(const QString &inputFile, const QString &outputDir);
+
+    bool nextValue(const QStringList &arguments, int *index, QString *value);
+    bool nextNumber(const QStringList &arguments, int *index, double *value);
+    bool nextInteger(const QStringList &arguments, int *index, int *value);
+    bool nextLogLevel(const QStringList &arguments, int *index);
+
+    QString mTraceFile;             // Where to write the profiler's trace, or empty.
+};
+
+#endif // COMMANDLINE_H
@@ -2,6 +2,10 @@
 
 #include "logger.h"
 #include "gcodeeditor.h"
+#include "gcodeprogress.h"
+
+#include <math.h>
+#include <string.h>
 
 CreateBedLevelingGCode::CreateBedLevelingGCode()
 {
@@ -13,6 +17,20 @@ CreateBedLevelingGCode::CreateBedLevelingGCode()
     mSpindleSpeed = 0;
     mXYFeedRate = 0;
     mZFeedRate = 0;
+    mProgress = NULL;
+    mTrimTrailingZeros = false;
+    mStrategy = BED_LEVEL_STRATEGY_SQUARES;
+    mMillingDirection = BED_LEVEL_DIRECTION_EITHER;
+    mMaxStepDown = 0;
+    mTileSize = 0;
+    mProbeSpacing = BED_LEVEL_DEFAULT_PROBE_SPACING;
+    mProbeDepth = BED_LEVEL_DEFAULT_PROBE_DEPTH;
+    mCurrentX = 0;
+    mCurrentY = 0;
+    mCurrentZ = 0;
+    mClearedZ = 0;
+
+    memset(&mEstimate, 0, sizeof(mEstimate));
 }
 
 void CreateBedLevelingGCode::setMillSize(double newSize)
@@ -55,9 +73,84 @@ void CreateBedLevelingGCode::setZFeedRate(double newRate)
     mZFeedRate = newRate;
 }
 
+void CreateBedLevelingGCode::setProgress(GCodeProgress *progress)
+{
+    mProgress = progress;
+}
+
+void CreateBedLevelingGCode::setTrimTrailingZeros(bool newval)
+{
+    mTrimTrailingZeros = newval;
+}
+
+void CreateBedLevelingGCode::setStrategy(int strategy)
+{
+    mStrategy = strategy;
+}
+
+void CreateBedLevelingGCode::setMillingDirection(int direction)
+{
+    mMillingDirection = direction;
+}
+
+void CreateBedLevelingGCode::setMaxStepDown(double newDepth)
+{
+    mMaxStepDown = newDepth;
+}
+
+void CreateBedLevelingGCode::setTileSize(double newSize)
+{
+    mTileSize = newSize;
+}
+
+void CreateBedLevelingGCode::setProbeSpacing(double newSpacing)
+{
+    mProbeSpacing = newSpacing;
+}
+
+void CreateBedLevelingGCode::setProbeDepth(double newDepth)
+{
+    mProbeDepth = newDepth;
+}
+
+/**
+ * @brief CreateBedLevelingGCode::getEstimate - Get how long the last file that was created takes to run, and
+ *      how far it cuts.  (Worked out with the default machine limits, and including the spin up dwell.)
+ *
+ * @param estimate - The totals are written here.
+ */
+void CreateBedLevelingGCode::getEstimate(GCodeTimeEstimate *estimate) const
+{
+    *estimate = mEstimate;
+}
+
+/**
+ * @brief CreateBedLevelingGCode::strategyName - Get the name of a strategy, the way it is given on the command line.
+ *
+ * @param strategy - One of the BED_LEVEL_STRATEGY_* values.
+ *
+ * @return QString containing the name.
+ */
+QString CreateBedLevelingGCode::strategyName(int strategy)
+{
+    switch (strategy) {
+    case BED_LEVEL_STRATEGY_ZIGZAG:
+        return "zigzag";
+
+    case BED_LEVEL_STRATEGY_CONCENTRIC:
+        return "concentric";
+
+    default:
+        return "squares";
+    }
+}
+
 /**
  * @brief CreateBedLevelingGCode::createGCodeFile - Go through the steps to create the G-code file for
- *      milling a level bed.
+ *      milling a level bed.  The area is split in to tiles (if a tile size is set), which are milled one at a
+ *      time along each row, and back along the next.  Each tile is milled down to the full depth in as few
+ *      even steps as the maximum step down allows, covering it the way the strategy says each time.  How long
+ *      the file takes to run is worked out as it is written.  (See getEstimate().)
  *
  * @param filename - The file name to use for the newly created G-code for milling a level bed.
  *
@@ -67,9 +160,53 @@ void CreateBedLevelingGCode::setZFeedRate(double newRate)
 QString CreateBedLevelingGCode::createGCodeFile(QString filename)
 {
     GCodeEditor gcode;
+    double stepover = mMillSize - mOverlapSize;
+    int depthPasses = 1;
+    int columns = 1;
+    int rows = 1;
+    int column;
     double left, bottom, right, top;
+    double z;
+    bool finished = true;
+    QString error;
+
+    memset(&mEstimate, 0, sizeof(mEstimate));
 
-    gcode.createNewFile();
+    if (requiredValuesSet(&error) == false) {
+        return error;
+    }
+
+    if (mMaxStepDown > 0) {
+        depthPasses = (int)ceil(fabs(mCutDepth) / mMaxStepDown);
+        if (depthPasses < 1) {
+            depthPasses = 1;
+        }
+    }
+
+    if (mTileSize > 0) {
+        columns = (int)ceil(mLevelWidth / mTileSize);
+        rows = (int)ceil(mLevelHeight / mTileSize);
+        if (columns < 1) {
+            columns = 1;
+        }
+
+        if (rows < 1) {
+            rows = 1;
+        }
+    }
+
+    // Level beds can be big, so write the G-code out as it is created instead of building it all in memory.
+    if (gcode.startStreaming(filename) == false) {
+        return "Unable to write the G-code to a file!";
+    }
+
+    gcode.setTrimTrailingZeros(mTrimTrailingZeros);
+
+    mCurrentX = 0;
+    mCurrentY = 0;
+    mCurrentZ = 0;
+    mClearedZ = 0;
+    mEstimator.reset();
 
     // Start out by configuring things how we want them.
     gcode.setUnitsToMillimeters();
@@ -81,31 +218,195 @@ QString CreateBedLevelingGCode::createGCodeFile(QString filename)
     gcode.setZFeedRate(mZFeedRate);
 
     // Make sure there is room to spin up the head.
-    gcode.setNonContactMove(0, 0, 1);
+    moveZTo(gcode, BED_LEVEL_CLEARANCE_HEIGHT, false);
 
     // Then, spin it up.
     gcode.setStartSpindleClockwise(mSpindleSpeed);
 
     // And, wait for it to be spun up.
-    gcode.setDwellInSeconds(5);
+    gcode.setDwellInSeconds(BED_LEVEL_SPIN_UP_SECONDS);
+
+    for (int row = 0; (row < rows) && (finished == true); row++) {
+        // The edges are worked out from the whole area each time, so that the last tile ends right on the edge.
+        bottom = (mLevelHeight * row) / rows;
+        top = (row == rows - 1) ? mLevelHeight : (mLevelHeight * (row + 1)) / rows;
+
+        for (int i = 0; (i < columns) && (finished == true); i++) {
+            // Go back along every other row, so that the next tile is always next to the last one.
+            column = ((row % 2) == 0) ? i : columns - 1 - i;
+            left = (mLevelWidth * column) / columns;
+            right = (column == columns - 1) ? mLevelWidth : (mLevelWidth * (column + 1)) / columns;
+
+            // A new tile hasn't been milled at all yet.
+            mClearedZ = 0;
+
+            for (int pass = 1; (pass <= depthPasses) && (finished == true); pass++) {
+                z = (pass == depthPasses) ? mCutDepth : (mCutDepth * pass) / depthPasses;
+
+                switch (mStrategy) {
+                case BED_LEVEL_STRATEGY_ZIGZAG:
+                    finished = cutZigZag(gcode, left, bottom, right, top, z, stepover);
+                    break;
+
+                case BED_LEVEL_STRATEGY_CONCENTRIC:
+                    finished = cutConcentric(gcode, left, bottom, right, top, z, stepover);
+                    break;
+
+                default:
+                    finished = cutSquares(gcode, left, bottom, right, top, z);
+                    break;
+                }
+
+                mClearedZ = z;
+            }
+        }
+    }
+
+    if (finished == false) {
+        // Throw away what has been written so far.
+        gcode.abortStreaming();
+        return "Creating the G-code was cancelled.";
+    }
+
+    if (gcode.finishStreaming() == false) {
+        return "Unable to write the G-code to a file!";
+    }
+
+    mEstimator.finish(&mEstimate);
+    mEstimate.seconds += BED_LEVEL_SPIN_UP_SECONDS;
+
+    LOG_INFO("Created a " + strategyName(mStrategy) + " bed leveling file (" + QString::number(columns * rows) + " tiles, " +
+             QString::number(depthPasses) + " passes deep) that cuts " + QString::number(mEstimate.cutLength / 1000, 'f', 2) +
+             " m and takes about " + GCodeTimeEstimator::formatDuration(mEstimate.seconds) + " to run.");
+
+    // Everything is good.
+    return "";
+}
+
+/**
+ * @brief CreateBedLevelingGCode::createProbingFile - Create a G-code file that probes the height of the board
+ *      at the points of an evenly spaced grid over the area, as few as the probe spacing allows.  The points
+ *      are probed along each row, and back along the next.  The X, Y and Z that the probe touched at, for each
+ *      point, can be loaded as a heightmap.  (See GCodeHeightMap.)
+ *
+ * @param filename - The file name to use for the probing G-code.
+ *
+ * @return QString containing an error, if there was an error.  Otherwise, on success, the QString will
+ *      be empty.
+ */
+QString CreateBedLevelingGCode::createProbingFile(QString filename)
+{
+    GCodeEditor gcode;
+    int columns, rows, column;
+    double x, y;
+    double clearance = (mProbeDepth > BED_LEVEL_CLEARANCE_HEIGHT) ? mProbeDepth : BED_LEVEL_CLEARANCE_HEIGHT;
+
+    memset(&mEstimate, 0, sizeof(mEstimate));
+
+    if ((mProbeSpacing <= 0) || (mProbeDepth <= 0)) {
+        return "The probe spacing and depth have to be more than 0!";
+    }
+
+    // A heightmap needs at least two points each way.
+    columns = (int)ceil(mLevelWidth / mProbeSpacing) + 1;
+    rows = (int)ceil(mLevelHeight / mProbeSpacing) + 1;
+    if (columns < 2) {
+        columns = 2;
+    }
+
+    if (rows < 2) {
+        rows = 2;
+    }
+
+    if (gcode.startStreaming(filename) == false) {
+        return "Unable to write the G-code to a file!";
+    }
+
+    gcode.setTrimTrailingZeros(mTrimTrailingZeros);
+
+    mCurrentX = 0;
+    mCurrentY = 0;
+    mCurrentZ = 0;
+    mClearedZ = 0;
+    mEstimator.reset();
+
+    gcode.setComment("Probes a " + QString::number(columns) + " by " + QString::number(rows) + " grid over " + QString::number(mLevelWidth) +
+                     " by " + QString::number(mLevelHeight) + " mm.  Save the X,Y,Z where the probe touches at each point as a heightmap.");
+
+    gcode.setUnitsToMillimeters();
+    gcode.setToAbsolutePositioning();
+    gcode.setFeedRateModeUnitsPerMinute(mZFeedRate);
+
+    gcode.setXYFeedRate(mXYFeedRate);
+    gcode.setZFeedRate(mZFeedRate);
 
-    // Then, move the head to the correct depth.
-    gcode.setContactMove(0, 0, mCutDepth);
+    moveZTo(gcode, clearance, false);
 
-    left = 0;
-    bottom = 0;
+    for (int row = 0; row < rows; row++) {
+        y = (row == rows - 1) ? mLevelHeight : (mLevelHeight * row) / (rows - 1);
 
-    // set our height and width
-    right = mLevelWidth;
-    top = mLevelHeight;
+        for (int i = 0; i < columns; i++) {
+            if (isCancelled() == true) {
+                gcode.abortStreaming();
+                return "Creating the G-code was cancelled.";
+            }
+
+            column = ((row % 2) == 0) ? i : columns - 1 - i;
+            x = (column == columns - 1) ? mLevelWidth : (mLevelWidth * column) / (columns - 1);
+
+            rapidTo(gcode, x, y);
+            gcode.setProbeMove(-mProbeDepth, mZFeedRate);
+
+            // The probe stops when it touches, so estimate it going all the way down.
+            mCurrentZ = -mProbeDepth;
+            mEstimator.addMove(mCurrentX, mCurrentY, mCurrentZ, mZFeedRate, false);
+
+            moveZTo(gcode, clearance, false);
+        }
+    }
+
+    rapidTo(gcode, 0, 0);
+
+    if (gcode.finishStreaming() == false) {
+        return "Unable to write the G-code to a file!";
+    }
+
+    mEstimator.finish(&mEstimate);
+
+    LOG_INFO("Created a probing file for a " + QString::number(columns) + " by " + QString::number(rows) + " grid.");
+
+    return "";
+}
+
+/**
+ * @brief CreateBedLevelingGCode::cutSquares - Mill squares that shrink by the overlap size on every side, until
+ *      they meet in the middle.
+ *
+ * @param gcode - The editor to write the moves to.
+ * @param left - The edges of the region to mill.
+ * @param bottom
+ * @param right
+ * @param top
+ * @param z - The depth to mill it at.
+ *
+ * @return true if the squares were all written.  false if it was cancelled.
+ */
+bool CreateBedLevelingGCode::cutSquares(GCodeEditor &gcode, double left, double bottom, double right, double top, double z)
+{
+    // Move the head to the correct depth.
+    plungeAt(gcode, left, bottom, z);
 
     while ((left < right) && (bottom < top)) {
+        if (isCancelled() == true) {
+            return false;
+        }
+
         // Do one complete square.
-        gcode.setContactMove(left, bottom, 0);
-        gcode.setContactMove(left, top, 0);
-        gcode.setContactMove(right, top, 0);
-        gcode.setContactMove(right, bottom, 0);
-        gcode.setContactMove(left, bottom, 0);
+        cutTo(gcode, left, bottom);
+        cutTo(gcode, left, top);
+        cutTo(gcode, right, top);
+        cutTo(gcode, right, bottom);
+        cutTo(gcode, left, bottom);
 
         // Move one overlap unit in each direction.
         if (left < right) {
@@ -119,54 +420,324 @@ QString CreateBedLevelingGCode::createGCodeFile(QString filename)
         }
     }
 
-    if (gcode.writeFile(filename) == false) {
-        return "Unable to write the G-code to a file!";
+    return true;
+}
+
+/**
+ * @brief CreateBedLevelingGCode::cutZigZag - Mill straight passes along the longer side of a region, which
+ *      needs the fewest turns.  The passes are spread evenly from one edge to the other, as few as the
+ *      stepover allows.  When the milling direction doesn't matter, the passes go back and forth, starting from
+ *      the corner nearest the head.  Otherwise they all cut the same way, and the head lifts and goes back to
+ *      the start between them.
+ *
+ *      With a clockwise spindle, the mill climbs when the material is on the left of the way it is moving.
+ *      The passes move across the region away from the first edge, so the uncut material is always on that side.
+ *
+ * @param gcode - The editor to write the moves to.
+ * @param left - The edges of the region to mill.
+ * @param bottom
+ * @param right
+ * @param top
+ * @param z - The depth to mill it at.
+ * @param stepover - The furthest apart that two passes can be.
+ *
+ * @return true if the passes were all written.  false if it was cancelled.
+ */
+bool CreateBedLevelingGCode::cutZigZag(GCodeEditor &gcode, double left, double bottom, double right, double top, double z,
+                                       double stepover)
+{
+    bool alongX = ((right - left) >= (top - bottom));
+    double start = (alongX == true) ? left : bottom;
+    double end = (alongX == true) ? right : top;
+    double first = (alongX == true) ? bottom : left;
+    double last = (alongX == true) ? top : right;
+    int passes = (int)ceil((last - first) / stepover) + 1;
+    bool forward;
+    double from, to, offset, swap;
+
+    if (mMillingDirection == BED_LEVEL_DIRECTION_EITHER) {
+        // Start in the corner nearest the head, which is where the last pass ended when a tile is milled again
+        // deeper.  The passes can go across the region either way.
+        if (fabs(((alongX == true) ? mCurrentY : mCurrentX) - last) < fabs(((alongX == true) ? mCurrentY : mCurrentX) - first)) {
+            swap = first;
+            first = last;
+            last = swap;
+        }
+
+        forward = (fabs(((alongX == true) ? mCurrentX : mCurrentY) - start) <= fabs(((alongX == true) ? mCurrentX : mCurrentY) - end));
+    } else {
+        // Passes along X go +X to climb as they move up in Y.  Passes along Y move across in X, so they climb going -Y.
+        forward = (alongX == true);
+        if (mMillingDirection == BED_LEVEL_DIRECTION_CONVENTIONAL) {
+            forward = !forward;
+        }
     }
 
-    // Everything is good.
-    return "";
+    for (int i = 0; i < passes; i++) {
+        if (isCancelled() == true) {
+            return false;
+        }
+
+        // The last pass is put right on the edge, instead of where the spacing adds up to.
+        offset = (i == passes - 1) ? last : first + ((last - first) * i) / (passes - 1);
+        from = (forward == true) ? start : end;
+        to = (forward == true) ? end : start;
+
+        if ((i == 0) || (mMillingDirection != BED_LEVEL_DIRECTION_EITHER)) {
+            // Get over the start of the pass, and go down to the cutting depth.  (Every pass goes the same way
+            // unless the direction doesn't matter, so the head goes back to the start above the material.)
+            if (alongX == true) {
+                plungeAt(gcode, from, offset, z);
+            } else {
+                plungeAt(gcode, offset, from, z);
+            }
+        } else {
+            // Step over to the next pass.
+            if (alongX == true) {
+                cutTo(gcode, from, offset);
+            } else {
+                cutTo(gcode, offset, from);
+            }
+        }
+
+        if (alongX == true) {
+            cutTo(gcode, to, offset);
+        } else {
+            cutTo(gcode, offset, to);
+        }
+
+        if (mMillingDirection == BED_LEVEL_DIRECTION_EITHER) {
+            forward = !forward;
+        }
+    }
+
+    return true;
 }
 
 /**
- * @brief CreateBedLevelingGCode::requiredValuesSet - Verify that the values that have been provided
- *      are all set as needed.
+ * @brief CreateBedLevelingGCode::cutConcentric - Mill rectangles from the edge of a region in to the middle,
+ *      each one inset from the last by the same amount (as much as the stepover allows).  Each rectangle
+ *      starts in its bottom left corner, and moves in to the next one diagonally.  The last one is just the
+ *      line (or point) down the middle.
  *
- * @return true if all values look correct.  false otherwise.
+ *      The uncut material is inside the rectangles, so with a clockwise spindle, going around them
+ *      counter-clockwise climbs, and clockwise is conventional.  Climbing is used unless conventional
+ *      milling is asked for.  (The path is the same length both ways.)  When the milling direction doesn't
+ *      matter and the head is nearer the middle (because the last pass ended there), the same path is
+ *      milled backwards, from the middle out.
+ *
+ * @param gcode - The editor to write the moves to.
+ * @param left - The edges of the region to mill.
+ * @param bottom
+ * @param right
+ * @param top
+ * @param z - The depth to mill it at.
+ * @param stepover - The furthest apart that two rectangles can be.
+ *
+ * @return true if the rectangles were all written.  false if it was cancelled.
  */
-bool CreateBedLevelingGCode::requiredValuesSet()
+bool CreateBedLevelingGCode::cutConcentric(GCodeEditor &gcode, double left, double bottom, double right, double top, double z,
+                                           double stepover)
 {
-    // We don't actually use mill size, so don't check it.
+    double width = right - left;
+    double height = top - bottom;
+    double half = ((width < height) ? width : height) / 2;
+    int rings = (half > 0) ? (int)ceil(half / stepover) : 0;
+    bool clockwise = (mMillingDirection == BED_LEVEL_DIRECTION_CONVENTIONAL);
+    bool outward = false;
+    double inset, x1, y1, x2, y2;
+    int ring;
+
+    if (mMillingDirection == BED_LEVEL_DIRECTION_EITHER) {
+        outward = ((fabs(mCurrentX - (right - half)) + fabs(mCurrentY - (top - half))) <
+                   (fabs(mCurrentX - left) + fabs(mCurrentY - bottom)));
+    }
 
-    if (mOverlapSize <= 0) {
-        logger.addLine("No valid overlap size was provided while trying to mill a level bed.");
-        return false;
+    if (outward == true) {
+        // Going around the other way keeps each rectangle the same, just backwards.
+        clockwise = !clockwise;
+        plungeAt(gcode, right - half, top - half, z);
+    } else {
+        plungeAt(gcode, left, bottom, z);
     }
 
-    if (mCutDepth <= 0) {
-        logger.addLine("No valid cut depth was provided while trying to mill a level bed.");
-        return false;
+    for (int i = 0; i <= rings; i++) {
+        if (isCancelled() == true) {
+            return false;
+        }
+
+        ring = (outward == true) ? rings - i : i;
+
+        // The last one is put right in the middle, instead of where the insets add up to.
+        inset = (ring == rings) ? half : (half * ring) / rings;
+
+        x1 = left + inset;
+        y1 = bottom + inset;
+        x2 = right - inset;
+        y2 = top - inset;
+
+        // Move in (or out) from the last rectangle.  (Or do nothing, for the first one.)
+        cutTo(gcode, x1, y1);
+
+        if (ring == rings) {
+            // The rectangle has no width or no height.  (Going outward, it was just milled from the other end.)
+            if (outward == false) {
+                cutTo(gcode, x2, y2);
+            }
+        } else {
+            if (clockwise == true) {
+                cutTo(gcode, x1, y2);
+                cutTo(gcode, x2, y2);
+                cutTo(gcode, x2, y1);
+                cutTo(gcode, x1, y1);
+            } else {
+                cutTo(gcode, x2, y1);
+                cutTo(gcode, x2, y2);
+                cutTo(gcode, x1, y2);
+                cutTo(gcode, x1, y1);
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief CreateBedLevelingGCode::isCancelled - Check if we were asked to stop.
+ *
+ * @return true if the G-code should stop being created.
+ */
+bool CreateBedLevelingGCode::isCancelled()
+{
+    return ((mProgress != NULL) && (mProgress->isCancelled() == true));
+}
+
+/**
+ * @brief CreateBedLevelingGCode::plungeAt - Go down to a new depth at an X/Y location.  If the head is somewhere
+ *      else, it is lifted clear of the material and moved across first.  The depth that has already been
+ *      milled is gone through without cutting.
+ *
+ * @param gcode - The editor to write the moves to.
+ * @param x - Where to go down in the X direction.
+ * @param y - Where to go down in the Y direction.
+ * @param z - The depth to go down to.
+ */
+void CreateBedLevelingGCode::plungeAt(GCodeEditor &gcode, double x, double y, double z)
+{
+    if ((x != mCurrentX) || (y != mCurrentY)) {
+        if (mCurrentZ != BED_LEVEL_CLEARANCE_HEIGHT) {
+            moveZTo(gcode, BED_LEVEL_CLEARANCE_HEIGHT, false);
+        }
+
+        rapidTo(gcode, x, y);
     }
 
-    if (mLevelWidth <= 0) {
-        logger.addLine("No valid width was provided while trying to mill a level bed.");
-        return false;
+    if ((mClearedZ != 0) && (mCurrentZ != mClearedZ)) {
+        moveZTo(gcode, mClearedZ, false);
+    }
+
+    moveZTo(gcode, z, true);
+}
+
+/**
+ * @brief CreateBedLevelingGCode::rapidTo - Move the head across to a new X/Y location without cutting, and add
+ *      the move to the estimate.  Moves that don't go anywhere are left out.
+ *
+ * @param gcode - The editor to write the move to.
+ * @param x - Where to move in the X direction.
+ * @param y - Where to move in the Y direction.
+ */
+void CreateBedLevelingGCode::rapidTo(GCodeEditor &gcode, double x, double y)
+{
+    if ((x == mCurrentX) && (y == mCurrentY)) {
+        return;
     }
 
-    if (mLevelHeight <= 0) {
-        logger.addLine("No valid height was provided while trying to mill a level bed.");
-        return false;
+    gcode.setNonContactMove(x, y, 0);
+
+    mCurrentX = x;
+    mCurrentY = y;
+    mEstimator.addMove(mCurrentX, mCurrentY, mCurrentZ, mXYFeedRate, true);
+}
+
+/**
+ * @brief CreateBedLevelingGCode::cutTo - Cut across to a new X/Y location, and add the move to the estimate.
+ *      Moves that don't go anywhere are left out.
+ *
+ * @param gcode - The editor to write the move to.
+ * @param x - Where to move in the X direction.
+ * @param y - Where to move in the Y direction.
+ */
+void CreateBedLevelingGCode::cutTo(GCodeEditor &gcode, double x, double y)
+{
+    if ((mStrategy != BED_LEVEL_STRATEGY_SQUARES) && (x == mCurrentX) && (y == mCurrentY)) {
+        return;
     }
 
-    if (mSpindleSpeed <= 0) {
-        logger.addLine("No valid spindle speed was provided while trying to mill a level bed.");
-        return false;
+    gcode.setContactMove(x, y, 0);
+
+    mCurrentX = x;
+    mCurrentY = y;
+    mEstimator.addMove(mCurrentX, mCurrentY, mCurrentZ, mXYFeedRate, false);
+}
+
+/**
+ * @brief CreateBedLevelingGCode::moveZTo - Move the head up or down, and add the move to the estimate.  (The
+ *      editor writes moves that only go in Z with the X/Y feed rate, so that is what is estimated.)
+ *
+ * @param gcode - The editor to write the move to.
+ * @param z - Where to move in the Z direction.  (Not 0.)
+ * @param contactMove - true if the move cuts in to the material.
+ */
+void CreateBedLevelingGCode::moveZTo(GCodeEditor &gcode, double z, bool contactMove)
+{
+    if (contactMove == true) {
+        gcode.setContactMove(0, 0, z);
+    } else {
+        gcode.setNonContactMove(0, 0, z);
     }
 
-    if ((mXYFeedRate == 0) && (mZFeedRate == 0)) {
-        logger.addLine("No feed rate was provided while trying to mill a level bed.");
-        return false;
+    mCurrentZ = z;
+    mEstimator.addMove(mCurrentX, mCurrentY, mCurrentZ, mXYFeedRate, (contactMove == false));
+}
+
+/**
+ * @brief CreateBedLevelingGCode::requiredValuesSet - Verify that the values that have been provided
+ *      are all set as needed, so that the G-code can be created, and will finish.
+ *
+ * @param error[out] - Why the values can't be used, if they can't.
+ *
+ * @return true if all values look correct.  false otherwise.
+ */
+bool CreateBedLevelingGCode::requiredValuesSet(QString *error)
+{
+    if (mMillSize <= 0) {
+        *error = "The mill size has to be more than 0!";
+    } else if ((mStrategy == BED_LEVEL_STRATEGY_SQUARES) && (mOverlapSize <= 0)) {
+        // The squares shrink by the overlap each time around, so without one they would never finish.
+        *error = "The overlap has to be more than 0!";
+    } else if ((mStrategy != BED_LEVEL_STRATEGY_SQUARES) && ((mMillSize - mOverlapSize) <= 0)) {
+        // The passes of the other strategies are spaced by the part of the mill that doesn't overlap the last pass.
+        *error = "The overlap has to be smaller than the mill size!";
+    } else if (mCutDepth >= 0) {
+        // The depth is relative to the starting Z, so it is below it.
+        *error = "The cut depth has to be more than 0!";
+    } else if ((mLevelWidth <= 0) || (mLevelHeight <= 0)) {
+        *error = "The width and height have to be more than 0!";
+    } else if (mSpindleSpeed == 0) {
+        *error = "The spindle speed has to be more than 0!";
+    } else if ((mXYFeedRate <= 0) || (mZFeedRate <= 0)) {
+        *error = "The feed rates have to be more than 0!";
+    } else if (mMaxStepDown < 0) {
+        *error = "The step down can't be less than 0!";
+    } else if ((mTileSize < 0) ||
+               ((mTileSize > 0) && ((ceil(mLevelWidth / mTileSize) * ceil(mLevelHeight / mTileSize)) > BED_LEVEL_MAX_TILES))) {
+        *error = "The tile size splits the area in to too many tiles!";
+    } else {
+        return true;
     }
 
-    return true;
+    LOG_WARNING("Unable to mill a level bed : " + *error);
+    return false;
 }
 
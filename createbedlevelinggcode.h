@@ -3,6 +3,34 @@
 
 #include <QString>
 
+#include "gcodetimeestimator.h"
+
+class GCodeEditor;
+class GCodeProgress;
+
+// The ways the area can be covered.  (Values for setStrategy().)
+#define BED_LEVEL_STRATEGY_SQUARES           0       // Squares that shrink by the overlap on every side.
+#define BED_LEVEL_STRATEGY_ZIGZAG            1       // Passes back and forth along the longer side.
+#define BED_LEVEL_STRATEGY_CONCENTRIC        2       // Rectangles from the outside in, evenly spaced.
+
+// Which side of the mill does the cutting.  (Values for setMillingDirection().  For a clockwise spindle.)
+#define BED_LEVEL_DIRECTION_EITHER           0       // Whatever makes the shortest path.
+#define BED_LEVEL_DIRECTION_CLIMB            1
+#define BED_LEVEL_DIRECTION_CONVENTIONAL     2
+
+// How high (in mm) the mill is lifted before it starts, and between passes that all go the same way.
+#define BED_LEVEL_CLEARANCE_HEIGHT           1
+
+// How long (in seconds) the spindle is given to spin up.
+#define BED_LEVEL_SPIN_UP_SECONDS            5
+
+// The most tiles an area can be split in to.  (A tile size much smaller than the area would take forever.)
+#define BED_LEVEL_MAX_TILES                  10000
+
+// The probing grid used when no other is set.  (In mm.  The depth is how far below the starting Z to look for the board.)
+#define BED_LEVEL_DEFAULT_PROBE_SPACING      10
+#define BED_LEVEL_DEFAULT_PROBE_DEPTH        2
+
 class CreateBedLevelingGCode
 {
 public:
@@ -16,11 +44,32 @@ public:
     void setSpindleSpeed(unsigned int newSpeed);
     void setXYFeedRate(double newRate);
     void setZFeedRate(double newRate);
+    void setProgress(GCodeProgress *progress);
+    void setTrimTrailingZeros(bool newval);
+    void setStrategy(int strategy);
+    void setMillingDirection(int direction);
+    void setMaxStepDown(double newDepth);
+    void setTileSize(double newSize);
+    void setProbeSpacing(double newSpacing);
+    void setProbeDepth(double newDepth);
 
     QString createGCodeFile(QString filename);
+    QString createProbingFile(QString filename);
+    void getEstimate(GCodeTimeEstimate *estimate) const;
+
+    static QString strategyName(int strategy);
 
 private:
-    bool requiredValuesSet();
+    bool requiredValuesSet(QString *error);
+    bool cutSquares(GCodeEditor &gcode, double left, double bottom, double right, double top, double z);
+    bool cutZigZag(GCodeEditor &gcode, double left, double bottom, double right, double top, double z, double stepover);
+    bool cutConcentric(GCodeEditor &gcode, double left, double bottom, double right, double top, double z, double stepover);
+    bool isCancelled();
+
+    void plungeAt(GCodeEditor &gcode, double x, double y, double z);
+    void rapidTo(GCodeEditor &gcode, double x, double y);
+    void cutTo(GCodeEditor &gcode, double x, double y);
+    void moveZTo(GCodeEditor &gcode, double z, bool contactMove);
 
     double mMillSize;       // The diameter of the mill in use.
     double mOverlapSize;    // The amount to overlap each mill line.
@@ -30,9 +79,22 @@ private:
     unsigned int mSpindleSpeed;   // How fast should we spin the spindle while leveling the area.
     double mXYFeedRate;     // How fast should we move in the X and Y direction.
     double mZFeedRate;      // How fast should we move in the Z direction.
+    GCodeProgress *mProgress;   // Checked to see if we should stop, or NULL.
+    bool mTrimTrailingZeros;    // Leave the trailing zeros off of the numbers in the G-code.
+    int mStrategy;          // One of the BED_LEVEL_STRATEGY_* values.
+    int mMillingDirection;  // One of the BED_LEVEL_DIRECTION_* values.
+    double mMaxStepDown;    // The deepest each pass can cut, or 0 to cut the full depth in one pass.
+    double mTileSize;       // The largest (square) tile that is milled before moving on, or 0 for one tile.
+    double mProbeSpacing;   // The furthest apart the points of the probing grid can be.
+    double mProbeDepth;     // How far below the starting Z the probe looks for the board.
 
+    // Where the mill is as the G-code is written, and how long it takes to get there.
     double mCurrentX;
     double mCurrentY;
+    double mCurrentZ;
+    double mClearedZ;       // The depth that the current tile has already been milled to.  (0 for none.)
+    GCodeTimeEstimator mEstimator;
+    GCodeTimeEstimate mEstimate;    // The totals for the last file that was created.
 };
 
 #endif // CREATEBEDLEVELINGGCODE_H
@@ -0,0 +1,420 @@
+#include "gcodearcfitter.h"
+
+#include "gcodetokenizer.h"
+#include "gcodenumberformatter.h"
+#include "profiler.h"
+
+#include <math.h>
+#include <string.h>
+
+// The decimal places the arcs are written with.
+#define GCODE_ARC_FITTER_DECIMALS            4
+
+// How far the rounding of the numbers on an arc can move it, in program units.  (Half of the last decimal
+// place, on both axes of the centre.)  This comes off of the tolerance, so the arc that is written is still
+// within it.
+#define GCODE_ARC_FITTER_ROUNDING            0.0001
+
+// Points closer together than this (in mm) are treated as the same point.
+#define GCODE_ARC_FITTER_MIN_LENGTH          1e-9
+
+// The room set aside for each line that is held or rewritten, so that the buffers don't have to grow.
+#define GCODE_ARC_FITTER_LINE_RESERVE        128
+
+GCodeArcFitter::GCodeArcFitter(GCodeOutput *output) :
+    GCodeLineOutput(output, PROFILE_STAGE_OPTIMIZE)
+{
+    mTolerance = GCODE_ARC_FITTER_DEFAULT_TOLERANCE;
+    mMoves = 0;
+    mWindowFeedRate = -1;
+    mFittedMoves = 0;
+    mCentreX = 0;
+    mCentreY = 0;
+    mClockwise = false;
+
+    mWindowUnitScale = 1;
+    mFeedRate = -1;
+    mWrittenMotionMode = -1;
+
+    mHeld.reserve(GCODE_ARC_FITTER_WINDOW * GCODE_ARC_FITTER_LINE_RESERVE);
+    mLineBuffer.reserve(GCODE_ARC_FITTER_LINE_RESERVE);
+
+    memset(&mReport, 0, sizeof(mReport));
+}
+
+/**
+ * @brief GCodeArcFitter::setTolerance - Set how far an arc may be from the moves it replaces.
+ *
+ * @param tolerance - The tolerance.  (mm)
+ */
+void GCodeArcFitter::setTolerance(double tolerance)
+{
+    mTolerance = tolerance;
+}
+
+/**
+ * @brief GCodeArcFitter::finish - Write out everything that is still held in the window.
+ */
+void GCodeArcFitter::finish()
+{
+    PROFILE_SCOPE(PROFILE_STAGE_OPTIMIZE);
+
+    GCodeLineOutput::finish();
+
+    flush();
+}
+
+/**
+ * @brief GCodeArcFitter::getReport - Get what has been changed so far.
+ *
+ * @param report[out] - The totals.
+ */
+void GCodeArcFitter::getReport(GCodeArcFitterReport *report) const
+{
+    *report = mReport;
+}
+
+/**
+ * @brief GCodeArcFitter::processLine - Follow the modal state through a line, and either add it to the window
+ *      or write it out.
+ *
+ *      Moves are added to the window one at a time.  While the window still fits an arc, it keeps growing.
+ *      When it stops fitting, the longest run that did fit is written as an arc, and the window starts again
+ *      from the end of it.  If nothing at the start of the window fits, its first move is written as it is and
+ *      dropped from the window.  Any line that can't be part of an arc empties the window before it is written.
+ *
+ * @param line - The line, with its line ending (if it has one).
+ * @param length - The length of the line.
+ */
+void GCodeArcFitter::processLine(const char *line, size_t length)
+{
+    GCodeTokenizer tokenizer(line, length);
+    GCodeWord word;
+    GCodeArcFitterMove move;
+    GCodeModalLine modal;
+    bool hasMotionWord = false;
+    bool otherWords = false;
+    bool candidate;
+    double centreX, centreY;
+    bool clockwise;
+    int code;
+
+    move.feedStart = -1;
+    move.feedEnd = -1;
+
+    while (tokenizer.nextWord(&word) == true) {
+        switch (word.letter) {
+        case 'G':
+            code = (int)floor((word.value * 10) + 0.5);
+
+            if ((code == 0) || (code == 10) || (code == 20) || (code == 30)) {
+                hasMotionWord = true;
+            } else {
+                otherWords = true;
+            }
+            break;
+
+        case 'F':
+            move.feedStart = word.valueStart - line;
+            move.feedEnd = word.end - line;
+            mFeedRate = word.value;
+            break;
+
+        case 'X':
+        case 'Y':
+        case 'Z':
+            break;
+
+        default:
+            otherWords = true;
+            break;
+        }
+
+        mModalTracker.addWord(word);
+    }
+
+    mModalTracker.endLine(&modal);
+
+    // Only a plain absolute G01 in the XY plane, from somewhere we know, can be part of an arc.  (A comment
+    // would be lost along with the move.)
+    candidate = ((mModalTracker.getMotionMode() == 1) && (otherWords == false) && (modal.isMove == true) &&
+                 (mModalTracker.isAbsolute() == true) && (mModalTracker.isXYPlane() == true) &&
+                 (mModalTracker.isInverseTime() == false) && (modal.startKnown[0] == true) && (modal.startKnown[1] == true) &&
+                 ((modal.given[2] == false) || ((modal.startKnown[2] == true) && (modal.target[2] == modal.start[2]))) &&
+                 (memchr(line, '(', length) == NULL) && (memchr(line, ';', length) == NULL) &&
+                 ((fabs(modal.target[0] - modal.start[0]) > GCODE_ARC_FITTER_MIN_LENGTH) ||
+                  (fabs(modal.target[1] - modal.start[1]) > GCODE_ARC_FITTER_MIN_LENGTH)));
+
+    if ((candidate == true) && (mMoves > 0) && (move.feedStart >= 0) && (mFeedRate != mWindowFeedRate)) {
+        // A move that changes the feed rate can only start a new window.
+        flush();
+    }
+
+    if (candidate == false) {
+        flush();
+        writeLine(line, length, mModalTracker.getMotionMode(), hasMotionWord, modal.isMove);
+    } else {
+        if (mMoves == 0) {
+            mX[0] = modal.start[0];
+            mY[0] = modal.start[1];
+            mWindowFeedRate = mFeedRate;
+            mWindowUnitScale = mModalTracker.getUnitScale();
+        }
+
+        if (mMoves == GCODE_ARC_FITTER_WINDOW) {
+            // The window is full.  (So the whole of it fits an arc.)
+            writeArc(mFittedMoves);
+            dropMoves(mFittedMoves);
+        }
+
+        move.offset = mHeld.size();
+        move.length = (int)length;
+        move.wordsEnd = tokenizer.getWordsEnd() - line;
+        move.hasMotionWord = hasMotionWord;
+        mHeld.append(line, (int)length);
+
+        mMoves++;
+        mX[mMoves] = modal.target[0];
+        mY[mMoves] = modal.target[1];
+        mMoveLines[mMoves] = move;
+
+        while (mMoves >= GCODE_ARC_FITTER_MIN_MOVES) {
+            if (fitWindow(mMoves, &centreX, &centreY, &clockwise) == true) {
+                mFittedMoves = mMoves;
+                mCentreX = centreX;
+                mCentreY = centreY;
+                mClockwise = clockwise;
+                break;
+            }
+
+            if (mFittedMoves >= GCODE_ARC_FITTER_MIN_MOVES) {
+                // The window fitted an arc until this move.
+                writeArc(mFittedMoves);
+                dropMoves(mFittedMoves);
+            } else {
+                writeMoves(1);
+                dropMoves(1);
+            }
+        }
+    }
+}
+
+/**
+ * @brief GCodeArcFitter::fitWindow - Check if the first moves in the window follow a circle.  The circle
+ *      goes through the first, middle and last points, and every move has to be within the tolerance of it,
+ *      going around it the same way.
+ *
+ * @param moves - The number of moves to check.
+ * @param centreX[out] - The centre of the circle.
+ * @param centreY[out] - The centre of the circle.
+ * @param clockwise[out] - true if the moves go clockwise around the circle.
+ *
+ * @return true if the moves fit an arc.
+ */
+bool GCodeArcFitter::fitWindow(int moves, double *centreX, double *centreY, bool *clockwise) const
+{
+    // Work relative to the first point, to keep the sums small.
+    double bx = mX[moves / 2] - mX[0];
+    double by = mY[moves / 2] - mY[0];
+    double cx = mX[moves] - mX[0];
+    double cy = mY[moves] - mY[0];
+    double determinant = 2 * ((bx * cy) - (by * cx));
+    double radius;
+    double sweep = 0;
+    double lastX, lastY, lastError;
+
+    // The rounding is in program units.  (25.4 times as far after a G20.)
+    double tolerance = mTolerance - (GCODE_ARC_FITTER_ROUNDING * mWindowUnitScale);
+
+    if (fabs(determinant) < GCODE_ARC_FITTER_MIN_LENGTH) {
+        // The points are in a straight line.
+        return false;
+    }
+
+    *centreX = ((cy * ((bx * bx) + (by * by))) - (by * ((cx * cx) + (cy * cy)))) / determinant;
+    *centreY = ((bx * ((cx * cx) + (cy * cy))) - (cx * ((bx * bx) + (by * by)))) / determinant;
+    radius = sqrt(((*centreX) * (*centreX)) + ((*centreY) * (*centreY)));
+
+    if (radius > GCODE_ARC_FITTER_MAX_RADIUS) {
+        return false;
+    }
+
+    *clockwise = (determinant < 0);
+    *centreX += mX[0];
+    *centreY += mY[0];
+
+    lastX = mX[0] - *centreX;
+    lastY = mY[0] - *centreY;
+    lastError = 0;
+
+    for (int i = 1; i <= moves; i++) {
+        double pointX = mX[i] - *centreX;
+        double pointY = mY[i] - *centreY;
+        double error = fabs(sqrt((pointX * pointX) + (pointY * pointY)) - radius);
+        double step = atan2((lastX * pointY) - (lastY * pointX), (lastX * pointX) + (lastY * pointY));
+        double chordX = pointX - lastX;
+        double chordY = pointY - lastY;
+        double halfChordSquared = ((chordX * chordX) + (chordY * chordY)) / 4;
+        double sagitta = radius - sqrt(qMax(0.0, (radius * radius) - halfChordSquared));
+
+        // Each move has to go the same way around, and stay close to the arc all along its length.
+        if (((*clockwise == true) && (step >= 0)) || ((*clockwise == false) && (step <= 0))) {
+            return false;
+        }
+
+        if ((qMax(error, lastError) + sagitta) > tolerance) {
+            return false;
+        }
+
+        sweep += fabs(step);
+        lastX = pointX;
+        lastY = pointY;
+        lastError = error;
+    }
+
+    return (sweep <= GCODE_ARC_FITTER_MAX_SWEEP);
+}
+
+/**
+ * @brief GCodeArcFitter::writeArc - Write the arc that was fitted to the first moves in the window, in place
+ *      of them.
+ *
+ * @param moves - The number of moves to replace.
+ */
+void GCodeArcFitter::writeArc(int moves)
+{
+    const GCodeArcFitterMove &first = mMoveLines[1];
+    const GCodeArcFitterMove &last = mMoveLines[moves];
+
+    mLineBuffer.resize(0);
+    mLineBuffer.append((mClockwise == true) ? "G02" : "G03");
+    appendNumber(mLineBuffer, 'X', mX[moves] / mWindowUnitScale);
+    appendNumber(mLineBuffer, 'Y', mY[moves] / mWindowUnitScale);
+    appendNumber(mLineBuffer, 'I', (mCentreX - mX[0]) / mWindowUnitScale);
+    appendNumber(mLineBuffer, 'J', (mCentreY - mY[0]) / mWindowUnitScale);
+
+    // The feed rate might have been set on the first move.
+    if (first.feedStart >= 0) {
+        mLineBuffer.append(" F");
+        mLineBuffer.append(mHeld.constData() + first.offset + first.feedStart, first.feedEnd - first.feedStart);
+    }
+
+    // Keep the line ending of the last move.
+    mLineBuffer.append(mHeld.constData() + last.offset + last.wordsEnd, last.length - last.wordsEnd);
+
+    mOutput->write(mLineBuffer.constData(), mLineBuffer.size());
+    mWrittenMotionMode = (mClockwise == true) ? 2 : 3;
+
+    mReport.arcs++;
+    mReport.movesReplaced += moves;
+    mReport.linesRemoved += moves - 1;
+}
+
+/**
+ * @brief GCodeArcFitter::writeMoves - Write the first moves in the window as they are.
+ *
+ * @param moves - The number of moves to write.
+ */
+void GCodeArcFitter::writeMoves(int moves)
+{
+    for (int i = 1; i <= moves; i++) {
+        writeLine(mHeld.constData() + mMoveLines[i].offset, mMoveLines[i].length, 1, mMoveLines[i].hasMotionWord,
+                  (mMoveLines[i].hasMotionWord == false));
+    }
+}
+
+/**
+ * @brief GCodeArcFitter::writeLine - Write a line that isn't replaced.  An arc that was written before it
+ *      has changed the motion mode, so a move that relies on the one the program set is given it back.
+ *
+ * @param line - The line, with its line ending (if it has one).
+ * @param length - The length of the line.
+ * @param motion - The motion mode the line runs in, in the program.  (0-3, or -1.)
+ * @param hasMotionWord - true if the line has its own G00-G03.
+ * @param needsMotion - true if the line moves with the motion mode it is in.
+ */
+void GCodeArcFitter::writeLine(const char *line, size_t length, int motion, bool hasMotionWord, bool needsMotion)
+{
+    if ((hasMotionWord == false) && (needsMotion == true) && (motion >= 0) && (motion != mWrittenMotionMode)) {
+        mLineBuffer.resize(0);
+        mLineBuffer.append("G0");
+        mLineBuffer.append((char)('0' + motion));
+        mLineBuffer.append(' ');
+        mLineBuffer.append(line, (int)length);
+
+        mOutput->write(mLineBuffer.constData(), mLineBuffer.size());
+    } else {
+        mOutput->write(line, length);
+    }
+
+    if ((hasMotionWord == true) || (needsMotion == true)) {
+        mWrittenMotionMode = motion;
+    }
+}
+
+/**
+ * @brief GCodeArcFitter::dropMoves - Take moves off of the start of the window, once they have been written.
+ *      The end of the last one becomes the start of the window.
+ *
+ * @param moves - The number of moves to take off.
+ */
+void GCodeArcFitter::dropMoves(int moves)
+{
+    int left = mMoves - moves;
+    int heldUsed;
+
+    if (moves <= 0) {
+        return;
+    }
+
+    heldUsed = mMoveLines[moves].offset + mMoveLines[moves].length;
+
+    memmove(&mX[0], &mX[moves], (left + 1) * sizeof(mX[0]));
+    memmove(&mY[0], &mY[moves], (left + 1) * sizeof(mY[0]));
+    memmove(&mMoveLines[0], &mMoveLines[moves], (left + 1) * sizeof(mMoveLines[0]));
+
+    mHeld.remove(0, heldUsed);
+    for (int i = 1; i <= left; i++) {
+        mMoveLines[i].offset -= heldUsed;
+    }
+
+    mMoves = left;
+    mFittedMoves = 0;
+}
+
+/**
+ * @brief GCodeArcFitter::flush - Empty the window, writing out the arc at the start of it if there is one,
+ *      and the moves after that as they are.
+ */
+void GCodeArcFitter::flush()
+{
+    if (mFittedMoves >= GCODE_ARC_FITTER_MIN_MOVES) {
+        writeArc(mFittedMoves);
+        dropMoves(mFittedMoves);
+    }
+
+    writeMoves(mMoves);
+    dropMoves(mMoves);
+
+    mMoves = 0;
+    mFittedMoves = 0;
+}
+
+/**
+ * @brief GCodeArcFitter::appendNumber - Add a word to a line that is being built.
+ *
+ * @param text - The line.
+ * @param letter - The letter of the word.
+ * @param value - The value of the word.
+ */
+void GCodeArcFitter::appendNumber(QByteArray &text, char letter, double value)
+{
+    char number[GCODE_NUMBER_MAX_LENGTH];
+    size_t length;
+
+    length = GCodeNumberFormatter::formatFixed(number, value, GCODE_ARC_FITTER_DECIMALS, true);
+
+    text.append(' ');
+    text.append(letter);
+    text.append(number, length);
+}
@@ -0,0 +1,103 @@
+#ifndef GCODEARCFITTER_H
+#define GCODEARCFITTER_H
+
+#include <QByteArray>
+
+#include "gcodeoutput.h"
+#include "gcodemodaltracker.h"
+
+// How far (in mm) the arc may be from the moves it replaces, when no other tolerance is set.
+#define GCODE_ARC_FITTER_DEFAULT_TOLERANCE   0.01
+
+// The most moves that are looked at (and replaced by one arc) at a time.
+#define GCODE_ARC_FITTER_WINDOW              64
+
+// The fewest moves that are worth replacing with an arc.
+#define GCODE_ARC_FITTER_MIN_MOVES           3
+
+// Circles bigger than this (in mm) are left as straight moves.  (They are nearly straight anyway, and the
+// firmware doesn't handle them well.)
+#define GCODE_ARC_FITTER_MAX_RADIUS          1000
+
+// The most an arc may turn.  (Kept well short of a full circle, so the firmware can never mistake one for a
+// full circle.)
+#define GCODE_ARC_FITTER_MAX_SWEEP           (1.5 * 3.14159265358979323846)
+
+// What an arc fitting pass changed.
+struct GCodeArcFitterReport
+{
+    unsigned long arcs;                 // G02/G03 arcs that were written.
+    unsigned long movesReplaced;        // G01 moves that the arcs replaced.
+    unsigned long linesRemoved;         // Lines that won't be written any more.
+};
+
+// A move that is held in the window.
+struct GCodeArcFitterMove
+{
+    int offset;                         // Where the line is in the held text.
+    int length;
+    int feedStart;                      // Where the number of the F word on the line is, or -1 if there isn't one.
+    int feedEnd;
+    int wordsEnd;                       // One past the last word on the line.
+    bool hasMotionWord;                 // true if the line has its own G01.
+};
+
+// Replaces runs of short G01 moves that follow a circle (as CAM programs write curves) with G02/G03 arcs in
+// the XY plane, as the lines are written.  The moves are held in a window of at most GCODE_ARC_FITTER_WINDOW
+// moves, so the stage keeps streaming, and the work grows in line with the size of the program.  Every point
+// of the moves that are replaced is within the tolerance of the arc, and so is every part of the moves between
+// them.  (The distance of each point from the circle, plus the sagitta of each move, is checked in mm, even
+// after a G20.)  Only absolute G01 moves with nothing else on the line (other
+// than a feed rate that doesn't change part way), that don't move Z, are replaced.
+class GCodeArcFitter : public GCodeLineOutput
+{
+public:
+    GCodeArcFitter(GCodeOutput *output);
+
+    void setTolerance(double tolerance);
+
+    void finish();
+
+    void getReport(GCodeArcFitterReport *report) const;
+
+protected:
+    void processLine(const char *line, size_t length);
+
+private:
+    bool fitWindow(int moves, double *centreX, double *centreY, bool *clockwise) const;
+    void writeArc(int moves);
+    void writeMoves(int moves);
+    void writeLine(const char *line, size_t length, int motion, bool hasMotionWord, bool needsMotion);
+    void dropMoves(int moves);
+    void flush();
+
+    static void appendNumber(QByteArray &text, char letter, double value);
+
+    double mTolerance;
+
+    // The window.  Point 0 is where the first move starts, and point n is where move n ends.  (In mm.)
+    double mX[GCODE_ARC_FITTER_WINDOW + 1];
+    double mY[GCODE_ARC_FITTER_WINDOW + 1];
+    GCodeArcFitterMove mMoveLines[GCODE_ARC_FITTER_WINDOW + 1];    // (mMoveLines[0] isn't used.)
+    QByteArray mHeld;                   // The text of the moves in the window.
+    int mMoves;
+    double mWindowFeedRate;             // The F the moves in the window run at, or -1.
+    double mWindowUnitScale;            // mm per program unit, for the moves in the window.
+
+    // The longest run at the start of the window that fits an arc, and that arc.
+    int mFittedMoves;
+    double mCentreX;
+    double mCentreY;
+    bool mClockwise;
+
+    GCodeModalTracker mModalTracker;    // The modal state of the program, as it has been read so far.
+    double mFeedRate;                   // The last F, or -1.
+
+    int mWrittenMotionMode;             // The motion mode of what has been written, which an arc changes.
+
+    QByteArray mLineBuffer;             // A line as it is rewritten.
+
+    GCodeArcFitterReport mReport;
+};
+
+#endif // GCODEARCFITTER_H
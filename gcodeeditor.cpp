@@ -1,28 +1,91 @@
 #include "gcodeeditor.h"
+#include "gcodenumberformatter.h"
+#include "gcodeoutput.h"
+#include "gcodeprogram.h"
+#include "gcodewriter.h"
 #include "logger.h"
 
-#include <QFile>
-#include <QTextStream>
+#include <QFileInfo>
+
+#include <string.h>
+
+// The longest line that setMove() can build.  ("G01 " followed by three words, each with a letter, number and space.)
+#define GCODE_EDITOR_MAX_MOVE_LENGTH         (4 + (3 * (GCODE_NUMBER_MAX_LENGTH + 2)))
 
 GCodeEditor::GCodeEditor()
 {
     mXYFeedRate = 0;
     mZFeedRate = 0;
     mCursorLocation = 0;
-    mGCodeFile.clear();
+    mInsertMode = false;
+    mTrimTrailingZeros = false;
+
+    mMemoryMapFiles = false;
+    mMappedData = NULL;
+    mMappedSize = 0;
+
+    mStreamWriter = NULL;
+    mStreamedLines = 0;
+    mStreamFailed = false;
+}
+
+GCodeEditor::~GCodeEditor()
+{
+    abortStreaming();
+}
+
+/**
+ * @brief GCodeEditor::setMemoryMapFiles - Select how loadExistingFile() should load a file.  When set, the
+ *      file is memory mapped and only an index of where each line starts is kept in memory.  Lines are
+ *      read straight from the mapping when they are needed, and only the lines that are edited are copied.
+ *
+ * @param newval - true to memory map files that are loaded, false to read them in to memory.
+ */
+void GCodeEditor::setMemoryMapFiles(bool newval)
+{
+    mMemoryMapFiles = newval;
+}
+
+/**
+ * @brief GCodeEditor::setInsertMode - Select what happens to the line under the cursor when a line is written
+ *      somewhere other than the bottom of the file.
+ *
+ * @param newval - true to insert the new line before the line under the cursor, false to replace it.
+ */
+void GCodeEditor::setInsertMode(bool newval)
+{
+    mInsertMode = newval;
 }
 
 /**
- * @brief GCodeEditor::createNewFile - Clear any state, and empty our QStringList so that we
+ * @brief GCodeEditor::setTrimTrailingZeros - Select if the numbers in moves that are added should have
+ *      their trailing zeros left off.  ("X1.5" instead of "X1.5000")  This makes generated files smaller,
+ *      and quicker to send to the printer.
+ *
+ * @param newval - true to leave off trailing zeros, false to always write every decimal place.
+ */
+void GCodeEditor::setTrimTrailingZeros(bool newval)
+{
+    mTrimTrailingZeros = newval;
+}
+
+/**
+ * @brief GCodeEditor::createNewFile - Clear any state, and empty our line list so that we
  *      are prepared to create a new G-code file.
  */
 void GCodeEditor::createNewFile()
 {
-    mGCodeFile.clear();
+    abortStreaming();
+    closeFile();
+    mCursorLocation = 0;
 }
 
 /**
- * @brief GCodeEditor::writeFile - Write the G-code in memory out to the named file.
+ * @brief GCodeEditor::writeFile - Write the G-code in memory out to the named file.  Runs of lines from the
+ *      file that was loaded that haven't been edited are written straight from its data.  The G-code is
+ *      written to a temporary file next to the named one, which only replaces it once it has all been written,
+ *      so a failed write leaves the file (and anything that is loaded from it) as it was.  If the file is the
+ *      one that is currently memory mapped, the new file is mapped in its place.
  *
  * @param filename - The filename to write the G-code to.
  *
@@ -30,29 +93,226 @@ void GCodeEditor::createNewFile()
  */
 bool GCodeEditor::writeFile(QString filename)
 {
-    QFile file(filename);
-    QTextStream stream(&file);
+    GCodeWriter writer;
+    QString writeName = filename + GCODE_EDITOR_PARTIAL_SUFFIX;
+    bool replaceMappedFile = false;
+
+    if (mStreamWriter != NULL) {
+        LOG_ERROR("Attempted to write the G-code to " + filename + " while it is being streamed to " + mStreamFilename + "!");
+        return false;
+    }
+
+    if (getLineCount() == 0) {
+        LOG_ERROR("Attempted to save the G-code when the G-code buffer was empty!");
+        return false;
+    }
+
+    if ((mMappedData != NULL) && (QFileInfo(filename).canonicalFilePath() == QFileInfo(mMappedFile).canonicalFilePath())) {
+        replaceMappedFile = true;
+    }
+
+    if (writer.open(writeName) == false) {
+        LOG_ERROR("Unable to open the file " + writeName + " to write the G-code buffer!");
+        return false;
+    }
+
+    mLines.write(&writer);
+
+    if (writer.close() == false) {
+        LOG_ERROR("Failed while writing the G-code buffer to " + writeName + "!");
+        QFile::remove(writeName);
+        return false;
+    }
+
+    if (replaceMappedFile == true) {
+        // Everything we had is in the new file now, and the old one can't be replaced while it is mapped.
+        closeFile();
+    }
+
+    if (((QFile::exists(filename) == true) && (QFile::remove(filename) == false)) ||
+            (QFile::rename(writeName, filename) == false)) {
+        LOG_ERROR("Unable to replace " + filename + " with the updated G-code!  It has been left in " + writeName + ".");
+
+        if (replaceMappedFile == true) {
+            // Carry on from the new file, so that nothing is lost.
+            loadMappedFile(writeName);
+        }
+        return false;
+    }
+
+    if (replaceMappedFile == true) {
+        if (loadMappedFile(filename) == false) {
+            return false;
+        }
+    }
+
+    LOG_INFO("Wrote the G-code buffer to " + filename + ".");
+
+    return true;
+}
+
+/**
+ * @brief GCodeEditor::getProgram - Parse the G-code in memory (with every edit) in to a program, so that
+ *      changes can be made to the whole file at once.
+ *
+ * @param program[out] - The program to fill in.
+ *
+ * @return true if the program was filled in.  false if the G-code is being streamed, so it isn't in memory.
+ */
+bool GCodeEditor::getProgram(GCodeProgram *program)
+{
+    QByteArray text;
+    GCodeMemoryOutput output(&text);
 
-    if (mGCodeFile.isEmpty() == true) {
-        logger.addLine("[ERROR] Attempted to save the G-code when the G-code buffer was empty!");
+    if (mStreamWriter != NULL) {
+        LOG_ERROR("Attempted to get the G-code program while it is being streamed to " + mStreamFilename + "!");
         return false;
     }
 
-    if (file.open(QIODevice::WriteOnly) == false) {
-        logger.addLine("[ERROR] Unable to open the file " + filename + " to write the G-code buffer!");
+    mLines.write(&output);
+    program->parse(text.constData(), text.size());
+
+    return true;
+}
+
+/**
+ * @brief GCodeEditor::setProgram - Replace the G-code in memory with a program.  The program becomes the
+ *      new original file, so the undo history is cleared, and the cursor goes back to the top.
+ *
+ * @param program - The program to use.
+ */
+void GCodeEditor::setProgram(const GCodeProgram &program)
+{
+    QByteArray text;
+    GCodeMemoryOutput output(&text);
+
+    program.write(&output);
+
+    abortStreaming();
+    closeFile();
+    mCursorLocation = 0;
+
+    mLoadedData = text;
+    mLines.setOriginal(mLoadedData.constData(), mLoadedData.size());
+}
+
+/**
+ * @brief GCodeEditor::startStreaming - Start a new, empty, file that is written out as it is created.  While
+ *      streaming, every line that is added at the bottom of the file goes straight to a large output buffer
+ *      (and from there to the file), instead of being kept in memory until writeFile() is called.  So the
+ *      memory used doesn't grow with the length of the program, and the data is handed to the OS (which
+ *      writes it to disk in the background) while the rest of the program is still being created.
+ *
+ *      Lines that have been streamed can't be edited.  The file is written under a temporary name, and only
+ *      replaces filename once finishStreaming() is called.
+ *
+ * @param filename - The file to create.
+ *
+ * @return true if the file was opened for streaming.  false otherwise.
+ */
+bool GCodeEditor::startStreaming(QString filename)
+{
+    QString partialFile = filename + GCODE_EDITOR_PARTIAL_SUFFIX;
+
+    createNewFile();
+
+    mStreamWriter = new GCodeWriter(GCODE_EDITOR_STREAM_BUFFER_SIZE);
+    if (mStreamWriter->open(partialFile) == false) {
+        LOG_ERROR("Unable to open the file " + partialFile + " to stream the G-code to!");
+        delete mStreamWriter;
+        mStreamWriter = NULL;
         return false;
     }
 
-    for (int i = 0; i < mGCodeFile.size(); i++) {
-        stream << mGCodeFile.at(i) + "\n";
+    mStreamFilename = filename;
+    mStreamedLines = 0;
+    mStreamFailed = false;
+
+    return true;
+}
+
+/**
+ * @brief GCodeEditor::finishStreaming - Write out anything that is still buffered, and move the streamed file
+ *      in to place.  Afterwards, the editor is empty, the same as after createNewFile().
+ *
+ * @return true if the file was completely written.  false otherwise.  (In which case nothing is left behind.)
+ */
+bool GCodeEditor::finishStreaming()
+{
+    QString partialFile = mStreamFilename + GCODE_EDITOR_PARTIAL_SUFFIX;
+    int lines = mStreamedLines;
+    bool written;
+
+    if (mStreamWriter == NULL) {
+        LOG_ERROR("Attempted to finish streaming the G-code when it wasn't being streamed!");
+        return false;
+    }
+
+    if (mStreamedLines == 0) {
+        LOG_ERROR("Attempted to save the G-code when the G-code buffer was empty!");
+        abortStreaming();
+        return false;
     }
 
-    file.close();
-    logger.addLine("Wrote the G-code buffer to " + filename + ".");
+    written = mStreamWriter->close();
+    delete mStreamWriter;
+    mStreamWriter = NULL;
+    mStreamedLines = 0;
+    mCursorLocation = 0;
+
+    if ((written == false) || (mStreamFailed == true)) {
+        LOG_ERROR("Failed while streaming the G-code to " + partialFile + "!");
+        QFile::remove(partialFile);
+        return false;
+    }
+
+    if ((QFile::exists(mStreamFilename) == true) && (QFile::remove(mStreamFilename) == false)) {
+        LOG_ERROR("Unable to replace " + mStreamFilename + " with the streamed G-code!");
+        QFile::remove(partialFile);
+        return false;
+    }
+
+    if (QFile::rename(partialFile, mStreamFilename) == false) {
+        LOG_ERROR("Unable to rename " + partialFile + " to " + mStreamFilename);
+        QFile::remove(partialFile);
+        return false;
+    }
+
+    LOG_INFO("Streamed " + QString::number(lines) + " lines of G-code to " + mStreamFilename + ".");
 
     return true;
 }
 
+/**
+ * @brief GCodeEditor::abortStreaming - Stop streaming (if we are), and delete the partly written file.
+ */
+void GCodeEditor::abortStreaming()
+{
+    if (mStreamWriter == NULL) {
+        return;
+    }
+
+    mStreamWriter->close();
+    delete mStreamWriter;
+    mStreamWriter = NULL;
+
+    QFile::remove(mStreamFilename + GCODE_EDITOR_PARTIAL_SUFFIX);
+
+    mStreamedLines = 0;
+    mStreamFailed = false;
+    mCursorLocation = 0;
+}
+
+/**
+ * @brief GCodeEditor::isStreaming - Returns true if lines are being streamed to a file.
+ *
+ * @return true if we are streaming.  false otherwise.
+ */
+bool GCodeEditor::isStreaming()
+{
+    return (mStreamWriter != NULL);
+}
+
 /**
  * @brief GCodeEditor::moveCursorToTop - Move the internal cursor to the top of the G-code file.
  */
@@ -68,7 +328,7 @@ void GCodeEditor::moveCursorToTop()
  */
 void GCodeEditor::moveCursorToBottom()
 {
-    mCursorLocation = mGCodeFile.size();
+    mCursorLocation = getLineCount();
 }
 
 /**
@@ -80,8 +340,10 @@ void GCodeEditor::moveCursorToBottom()
  */
 void GCodeEditor::moveCursorToLine(int index)
 {
-    if (index > mGCodeFile.size()) {
-        mCursorLocation = mGCodeFile.size();
+    int lineCount = getLineCount();
+
+    if (index > lineCount) {
+        mCursorLocation = lineCount;
     } else {
         mCursorLocation = index;
     }
@@ -95,7 +357,97 @@ void GCodeEditor::moveCursorToLine(int index)
  */
 size_t GCodeEditor::getLineCount()
 {
-    return mGCodeFile.size();
+    return mStreamedLines + mLines.getLineCount();
+}
+
+/**
+ * @brief GCodeEditor::getLine - Get the text of a line in the G-code buffer (without a line ending).  For a
+ *      file that was loaded, the data returned refers to the file's data, and is only valid until a new file
+ *      is loaded or created.  Lines that have been streamed out are no longer available.
+ *
+ * @param index - The line to get.
+ *
+ * @return QByteArray containing the line, or an empty QByteArray if index is out of range.
+ */
+QByteArray GCodeEditor::getLine(int index)
+{
+    if (mStreamWriter != NULL) {
+        return QByteArray();
+    }
+
+    return mLines.getLine(index);
+}
+
+/**
+ * @brief GCodeEditor::deleteLines - Delete lines, starting with the one under the cursor.  The cursor stays
+ *      where it is, so it ends up on the line that followed the deleted ones.
+ *
+ * @param count - The number of lines to delete.
+ */
+void GCodeEditor::deleteLines(int count)
+{
+    if (mStreamWriter != NULL) {
+        LOG_ERROR("Lines can't be deleted from G-code that is being streamed to " + mStreamFilename + "!");
+        mStreamFailed = true;
+        return;
+    }
+
+    mLines.removeLines(mCursorLocation, count);
+}
+
+/**
+ * @brief GCodeEditor::undo - Undo the last change that was made to the G-code, and move the cursor to it.
+ *      (Lines added one after another count as a single change.)
+ *
+ * @return true if a change was undone.  false if there was nothing to undo.
+ */
+bool GCodeEditor::undo()
+{
+    int line;
+
+    if (mLines.undo(&line) == false) {
+        return false;
+    }
+
+    mCursorLocation = line;
+    return true;
+}
+
+/**
+ * @brief GCodeEditor::redo - Make the last change that was undone again, and move the cursor to after it.
+ *
+ * @return true if a change was redone.  false if there was nothing to redo.
+ */
+bool GCodeEditor::redo()
+{
+    int line;
+
+    if (mLines.redo(&line) == false) {
+        return false;
+    }
+
+    mCursorLocation = line;
+    return true;
+}
+
+/**
+ * @brief GCodeEditor::canUndo - Returns true if there is a change that can be undone.
+ *
+ * @return true if undo() will do something.  false otherwise.
+ */
+bool GCodeEditor::canUndo()
+{
+    return mLines.canUndo();
+}
+
+/**
+ * @brief GCodeEditor::canRedo - Returns true if there is an undone change that can be made again.
+ *
+ * @return true if redo() will do something.  false otherwise.
+ */
+bool GCodeEditor::canRedo()
+{
+    return mLines.canRedo();
 }
 
 /**
@@ -124,7 +476,13 @@ void GCodeEditor::setFeedRateModeUnitsPerMinute(double feedrate)
     mZFeedRate = feedrate;
 
     // Then, write our setting.
-    addOrEditGCodeLine("G94 F" + QString::number(feedrate, 'f', 2));
+    char gcode[8 + GCODE_NUMBER_MAX_LENGTH];
+    size_t length = 5;
+
+    memcpy(gcode, "G94 F", length);
+    length += GCodeNumberFormatter::formatFixed(gcode + length, feedrate, 2, mTrimTrailingZeros);
+
+    addOrEditGCodeLine(gcode, length);
 }
 
 /**
@@ -158,7 +516,8 @@ void GCodeEditor::setNonContactMove(double x, double y, double z)
 void GCodeEditor::setMove(double x, double y, double z, bool contactMove)
 {
     double effectiveFeedRate = 0;
-    QString gcode;
+    char gcode[GCODE_EDITOR_MAX_MOVE_LENGTH];
+    size_t length = 4;
 
     if (((x != 0) || (y != 0)) && (z != 0)) {
         // We are moving in all three directions, find the lowest of the two feed rates.
@@ -168,34 +527,42 @@ void GCodeEditor::setMove(double x, double y, double z, bool contactMove)
             effectiveFeedRate = mZFeedRate;
         }
     } else {
-        logger.addLine("Reached an unexpected feed rate setting with parameters (" + QString::number(x, 'f', 4) + "," + QString::number(y, 'f', 4) + "," + QString::number(z, 'f', 4) + ")");
+        LOG_TRACE("Reached an unexpected feed rate setting with parameters (" + QString::number(x, 'f', 4) + "," + QString::number(y, 'f', 4) + "," + QString::number(z, 'f', 4) + ")");
 
         // Just use XY rate.
         effectiveFeedRate = mXYFeedRate;
     }
 
+    // The line is built straight in to a buffer, since generated programs can have millions of moves.
     if (contactMove == false) {
-        gcode = "G00 ";
+        memcpy(gcode, "G00 ", length);
     } else {
-        gcode = "G01 ";
+        memcpy(gcode, "G01 ", length);
     }
 
     if (z == 0) {
-        gcode += "X" + QString::number(x, 'f', 4) + " ";
+        gcode[length++] = 'X';
+        length += GCodeNumberFormatter::formatFixed(gcode + length, x, 4, mTrimTrailingZeros);
+        gcode[length++] = ' ';
 
-        gcode += "Y" + QString::number(y, 'f', 4) + " ";
+        gcode[length++] = 'Y';
+        length += GCodeNumberFormatter::formatFixed(gcode + length, y, 4, mTrimTrailingZeros);
+        gcode[length++] = ' ';
     }
 
     if (z != 0) {
-        gcode += "Z" + QString::number(z, 'f', 4) + " ";
+        gcode[length++] = 'Z';
+        length += GCodeNumberFormatter::formatFixed(gcode + length, z, 4, mTrimTrailingZeros);
+        gcode[length++] = ' ';
     }
 
     if (effectiveFeedRate != 0) {
-        gcode += "F" + QString::number(effectiveFeedRate, 'f', 4);
+        gcode[length++] = 'F';
+        length += GCodeNumberFormatter::formatFixed(gcode + length, effectiveFeedRate, 4, mTrimTrailingZeros);
     }
 
     // Finally, write it to our file.
-    addOrEditGCodeLine(gcode);
+    addOrEditGCodeLine(gcode, length);
 }
 
 /**
@@ -258,20 +625,78 @@ void GCodeEditor::setZFeedRate(double feedrate)
     mZFeedRate = feedrate;
 }
 
+/**
+ * @brief GCodeEditor::setProbeMove - Write the G-code to move the milling head down in Z until the probe
+ *      touches, stopping with an error if it reaches the target without touching.  (G38.2)
+ *
+ * @param z - The lowest that the probe is allowed to go.
+ * @param feedrate - How fast to move while probing.
+ */
+void GCodeEditor::setProbeMove(double z, double feedrate)
+{
+    char gcode[GCODE_EDITOR_MAX_MOVE_LENGTH];
+    size_t length = 6;
+
+    memcpy(gcode, "G38.2 ", length);
+
+    gcode[length++] = 'Z';
+    length += GCodeNumberFormatter::formatFixed(gcode + length, z, 4, mTrimTrailingZeros);
+    gcode[length++] = ' ';
+
+    gcode[length++] = 'F';
+    length += GCodeNumberFormatter::formatFixed(gcode + length, feedrate, 4, mTrimTrailingZeros);
+
+    addOrEditGCodeLine(gcode, length);
+}
+
+/**
+ * @brief GCodeEditor::setComment - Write a line with only a comment on it.
+ *
+ * @param comment - The text of the comment.
+ */
+void GCodeEditor::setComment(QString comment)
+{
+    addOrEditGCodeLine("; " + comment);
+}
+
 /**
  * @brief GCodeEditor::addOrEditGCodeLine - Either edit an existing line, or add a new one (depending
- *      on where the cursor is currently located.)
+ *      on where the cursor is currently located, and if we are in insert mode.)
  *
  * @param line - The line to either add or edit in the G-code.
  */
 void GCodeEditor::addOrEditGCodeLine(QString line)
 {
-    if (mCursorLocation < mGCodeFile.size()) {
-        // We are replacing a line.
-        mGCodeFile.replace(mCursorLocation, line);
-    } else {
+    QByteArray text = line.toLatin1();
+
+    addOrEditGCodeLine(text.constData(), text.size());
+}
+
+/**
+ * @brief GCodeEditor::addOrEditGCodeLine - Either edit an existing line, or add a new one, from text that
+ *      has already been formatted in to a buffer.
+ *
+ * @param line - The text of the line, without a line ending.
+ * @param length - The length of the line.
+ */
+void GCodeEditor::addOrEditGCodeLine(const char *line, size_t length)
+{
+    if (mStreamWriter != NULL) {
+        if (mCursorLocation < mStreamedLines) {
+            LOG_ERROR("Line " + QString::number(mCursorLocation) + " has already been streamed to " + mStreamFilename + ", and can't be changed!");
+            mStreamFailed = true;
+        } else {
+            // We are at the bottom, so the line goes straight out.
+            mStreamWriter->write(line, length);
+            mStreamWriter->write("\n", 1);
+            mStreamedLines++;
+        }
+    } else if ((mInsertMode == true) || (mCursorLocation >= mLines.getLineCount())) {
         // We are adding a new line.
-        mGCodeFile.append(line);
+        mLines.insertLine(mCursorLocation, QByteArray(line, length));
+    } else {
+        // We are replacing a line.
+        mLines.replaceLine(mCursorLocation, QByteArray(line, length));
     }
 
     // Then, move our cursor to the next line.
@@ -280,32 +705,95 @@ void GCodeEditor::addOrEditGCodeLine(QString line)
 
 /**
  * @brief GCodeEditor::loadExistingFile - Attempt to open an existing file, and load it in to
- *      our QStringList.
+ *      our line list.  The file is read in whole, and only an index of where each line starts
+ *      is built.  (Edits are kept separately, so the data that was read is never changed.)
  *
  * @param filename - The filename to load G-code data from.
  *
- * @return true if the file was opened, and loaded in to our QStringList.  false otherwise.
+ * @return true if the file was opened, and loaded in to our line list.  false otherwise.
  */
 bool GCodeEditor::loadExistingFile(QString filename)
 {
     QFile file(filename);
-    QTextStream stream(&file);
 
-    // Clear our string list so that we can populate it with new data.
-    mGCodeFile.clear();
+    // Clear our line list so that we can populate it with new data.
+    abortStreaming();
+    closeFile();
+    mCursorLocation = 0;
+
+    if (mMemoryMapFiles == true) {
+        return loadMappedFile(filename);
+    }
 
     if (file.open(QIODevice::ReadOnly) == false) {
-        logger.addLine("[ERROR] Unable to open the file " + filename + " for reading.");
+        LOG_ERROR("Unable to open the file " + filename + " for reading.");
         return false;
     }
 
     // Read the data.
-    while (stream.atEnd() == false) {
-        mGCodeFile.append(stream.readLine());
+    mLoadedData = file.readAll();
+    if (mLoadedData.size() != file.size()) {
+        LOG_ERROR("Failed while reading the file " + filename + ".");
+        mLoadedData.clear();
+        return false;
     }
 
-    file.close();
-    logger.addLine("Loaded the G-code from file '" + filename + "'.");
+    mLines.setOriginal(mLoadedData.constData(), mLoadedData.size());
+
+    LOG_INFO("Loaded the G-code from file '" + filename + "'.");
     return true;
 }
 
+/**
+ * @brief GCodeEditor::loadMappedFile - Memory map a file, and build the index of where each line starts.
+ *      Nothing else is read in, so this only takes as long as it takes to find the line endings.
+ *
+ * @param filename - The filename to map.
+ *
+ * @return true if the file was mapped.  false otherwise.
+ */
+bool GCodeEditor::loadMappedFile(QString filename)
+{
+    mMappedFile.setFileName(filename);
+    if (mMappedFile.open(QIODevice::ReadOnly) == false) {
+        LOG_ERROR("Unable to open the file " + filename + " for reading.");
+        return false;
+    }
+
+    mMappedSize = mMappedFile.size();
+    if (mMappedSize == 0) {
+        // There is nothing to map, but it is still a valid (empty) file.
+        mMappedFile.close();
+        LOG_INFO("Loaded the G-code from file '" + filename + "'.");
+        return true;
+    }
+
+    mMappedData = (const char *)mMappedFile.map(0, mMappedSize);
+    if (mMappedData == NULL) {
+        LOG_ERROR("Unable to memory map the file " + filename + ".");
+        mMappedFile.close();
+        return false;
+    }
+
+    mLines.setOriginal(mMappedData, mMappedSize);
+
+    LOG_INFO("Memory mapped the G-code from file '" + filename + "' (" + QString::number(mLines.getLineCount()) + " lines).");
+    return true;
+}
+
+/**
+ * @brief GCodeEditor::closeFile - Release the loaded or memory mapped file (if there is one), along with
+ *      every line, edit, and the undo history.
+ */
+void GCodeEditor::closeFile()
+{
+    mLines.clear();
+    mLoadedData.clear();
+
+    if (mMappedFile.isOpen() == true) {
+        mMappedFile.close();
+    }
+
+    mMappedData = NULL;
+    mMappedSize = 0;
+}
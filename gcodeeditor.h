@@ -1,22 +1,55 @@
 #ifndef GCODEEDITOR_H
 #define GCODEEDITOR_H
 
-#include <QStringList>
+#include <QByteArray>
+#include <QString>
+#include <QFile>
+
+#include "gcodepiecetable.h"
+
+// Streamed output is written to a file with this added to its name, which is renamed once it is complete.
+#define GCODE_EDITOR_PARTIAL_SUFFIX          ".part"
+
+// How much streamed output is collected before it is written to the file.
+#define GCODE_EDITOR_STREAM_BUFFER_SIZE      (4 * 1024 * 1024)
+
+class GCodeWriter;
+class GCodeProgram;
 
 class GCodeEditor
 {
 public:
     GCodeEditor();
+    ~GCodeEditor();
+
+    void setMemoryMapFiles(bool newval);
+    void setInsertMode(bool newval);
+    void setTrimTrailingZeros(bool newval);
 
     void createNewFile();
     bool loadExistingFile(QString filename);
     bool writeFile(QString filename);
 
+    bool getProgram(GCodeProgram *program);
+    void setProgram(const GCodeProgram &program);
+
+    bool startStreaming(QString filename);
+    bool finishStreaming();
+    void abortStreaming();
+    bool isStreaming();
+
     void moveCursorToTop();
     void moveCursorToBottom();
     void moveCursorToLine(int index);
 
     size_t getLineCount();
+    QByteArray getLine(int index);
+    void deleteLines(int count);
+
+    bool undo();
+    bool redo();
+    bool canUndo();
+    bool canRedo();
 
     void setUnitsToMillimeters();
     void setToAbsolutePositioning();
@@ -28,15 +61,36 @@ public:
     void setDwellInSeconds(unsigned int seconds);
     void setXYFeedRate(double feedrate);
     void setZFeedRate(double feedrate);
+    void setProbeMove(double z, double feedrate);
+    void setComment(QString comment);
 
 private:
     void addOrEditGCodeLine(QString line);
+    void addOrEditGCodeLine(const char *line, size_t length);
     void setMove(double x, double y, double z, bool contactMove);
 
-    QStringList mGCodeFile;
+    bool loadMappedFile(QString filename);
+    void closeFile();
+
+    GCodePieceTable mLines;             // The lines of the file that was loaded (if any), with every edit.
+    QByteArray mLoadedData;             // The file that was loaded, when it isn't memory mapped.
     int mCursorLocation;
+    bool mInsertMode;
     double mXYFeedRate;
     double mZFeedRate;
+    bool mTrimTrailingZeros;
+
+    // Memory mapped file state.
+    bool mMemoryMapFiles;
+    QFile mMappedFile;
+    const char *mMappedData;
+    qint64 mMappedSize;
+
+    // Streaming state.
+    GCodeWriter *mStreamWriter;         // Where lines added to the bottom go, or NULL if we aren't streaming.
+    QString mStreamFilename;            // The file that the stream will be renamed to once it is finished.
+    int mStreamedLines;                 // The lines that have been handed to the writer.  (They can't be edited.)
+    bool mStreamFailed;
 };
 
 #endif // GCODEEDITOR_H
@@ -0,0 +1,258 @@
+#include "gcodefeedpolicy.h"
+
+#include "gcodetokenizer.h"
+#include "gcodenumberformatter.h"
+#include "profiler.h"
+
+#include <math.h>
+#include <string.h>
+
+// The room set aside for a rewritten line, so that the buffer doesn't have to grow.
+#define GCODE_FEED_POLICY_LINE_RESERVE       128
+
+GCodeFeedPolicy::GCodeFeedPolicy(GCodeOutput *output) :
+    GCodeLineOutput(output, PROFILE_STAGE_FEED_POLICY)
+{
+    mXYFeedRate = 0;
+    mZFeedRate = 0;
+    mPlungeFeedRate = 0;
+    mRetractFeedRate = 0;
+    mShortSegmentLength = GCODE_FEED_POLICY_DEFAULT_SHORT_LENGTH;
+    mShortSegmentScale = GCODE_FEED_POLICY_DEFAULT_SHORT_SCALE;
+
+    mHaveFeedRate = false;
+    mFeedRate = 0;
+
+    mLineBuffer.reserve(GCODE_FEED_POLICY_LINE_RESERVE);
+
+    memset(&mReport, 0, sizeof(mReport));
+}
+
+void GCodeFeedPolicy::setXYFeedRate(double feedrate)
+{
+    mXYFeedRate = feedrate;
+}
+
+void GCodeFeedPolicy::setZFeedRate(double feedrate)
+{
+    mZFeedRate = feedrate;
+}
+
+/**
+ * @brief GCodeFeedPolicy::setPlungeFeedRate - Set the fastest that Z can move down while cutting.
+ *
+ * @param feedrate - The feed rate, in mm/min.  0 to use the Z feed rate.
+ */
+void GCodeFeedPolicy::setPlungeFeedRate(double feedrate)
+{
+    mPlungeFeedRate = feedrate;
+}
+
+/**
+ * @brief GCodeFeedPolicy::setRetractFeedRate - Set the fastest that Z can move up while cutting.
+ *
+ * @param feedrate - The feed rate, in mm/min.  0 to use the Z feed rate.
+ */
+void GCodeFeedPolicy::setRetractFeedRate(double feedrate)
+{
+    mRetractFeedRate = feedrate;
+}
+
+/**
+ * @brief GCodeFeedPolicy::setShortSegmentLength - Set the length that moves start to be slowed down below.
+ *
+ * @param length - The length, in mm.  0 to never slow down short moves.
+ */
+void GCodeFeedPolicy::setShortSegmentLength(double length)
+{
+    mShortSegmentLength = length;
+}
+
+/**
+ * @brief GCodeFeedPolicy::setShortSegmentScale - Set the slowest that a short move is made.
+ *
+ * @param scale - The fraction (0 to 1) of the feed rate the move would otherwise get.
+ */
+void GCodeFeedPolicy::setShortSegmentScale(double scale)
+{
+    mShortSegmentScale = scale;
+}
+
+/**
+ * @brief GCodeFeedPolicy::getReport - Get what has been changed so far.
+ *
+ * @param report[out] - The totals.
+ */
+void GCodeFeedPolicy::getReport(GCodeFeedPolicyReport *report) const
+{
+    *report = mReport;
+}
+
+/**
+ * @brief GCodeFeedPolicy::feedRateFor - Work out the feed rate for a move.
+ *
+ * @param dx - How far the move goes along each axis, in mm.
+ * @param dy
+ * @param dz
+ *
+ * @return double containing the feed rate, in mm/min.  (0 if the move doesn't go anywhere.)
+ */
+double GCodeFeedPolicy::feedRateFor(double dx, double dy, double dz) const
+{
+    double xyLength = sqrt((dx * dx) + (dy * dy));
+    double length = sqrt((xyLength * xyLength) + (dz * dz));
+    double zLimit = mZFeedRate;
+    double feedRate = 0;
+    double scale;
+
+    if (length <= 0) {
+        return 0;
+    }
+
+    if ((dz < 0) && (mPlungeFeedRate > 0)) {
+        zLimit = mPlungeFeedRate;
+    } else if ((dz > 0) && (mRetractFeedRate > 0)) {
+        zLimit = mRetractFeedRate;
+    }
+
+    // The feed rate is along the move, so each limit is stretched by how much of the move is on its axes.
+    if (xyLength > 0) {
+        feedRate = mXYFeedRate * (length / xyLength);
+    }
+
+    if ((dz != 0) && ((feedRate == 0) || ((zLimit * (length / fabs(dz))) < feedRate))) {
+        feedRate = zLimit * (length / fabs(dz));
+    }
+
+    if (length < mShortSegmentLength) {
+        scale = length / mShortSegmentLength;
+        if (scale < mShortSegmentScale) {
+            scale = mShortSegmentScale;
+        }
+
+        feedRate *= scale;
+    }
+
+    return feedRate;
+}
+
+/**
+ * @brief GCodeFeedPolicy::processLine - Follow the modal state through a line, and give it a new feed rate
+ *      if it is a cutting move.
+ *
+ * @param line - The line, with its line ending (if it has one).
+ * @param length - The length of the line.
+ */
+void GCodeFeedPolicy::processLine(const char *line, size_t length)
+{
+    static const double rounding = pow(10.0, GCODE_FEED_POLICY_DECIMALS);
+    GCodeTokenizer tokenizer(line, length);
+    GCodeWord word;
+    GCodeWord feedWord;
+    GCodeModalLine modal;
+    double delta[3];
+    bool haveFeedWord = false;
+    bool moving = false;
+    double feedRate;
+    int motion;
+
+    while (tokenizer.nextWord(&word) == true) {
+        if (word.letter == 'F') {
+            feedWord = word;
+            haveFeedWord = true;
+        }
+
+        mModalTracker.addWord(word);
+    }
+
+    mModalTracker.endLine(&modal);
+    motion = mModalTracker.getMotionMode();
+
+    if (haveFeedWord == true) {
+        mHaveFeedRate = true;
+        mFeedRate = feedWord.value;
+    }
+
+    if (modal.isMove == false) {
+        mOutput->write(line, length);
+        return;
+    }
+
+    // Relative moves say how far they go, absolute moves need to know where they started.
+    for (int i = 0; i < 3; i++) {
+        delta[i] = modal.target[i] - modal.start[i];
+
+        if (delta[i] != 0) {
+            moving = true;
+        }
+    }
+
+    if ((motion <= 0) || (mModalTracker.isInverseTime() == true)) {
+        mOutput->write(line, length);
+        return;
+    }
+
+    if (modal.deltaKnown == false) {
+        mReport.movesSkipped++;
+        mOutput->write(line, length);
+        return;
+    }
+
+    if (moving == false) {
+        mOutput->write(line, length);
+        return;
+    }
+
+    mReport.movesRated++;
+
+    feedRate = feedRateFor(delta[0], delta[1], delta[2]) / mModalTracker.getUnitScale();
+    feedRate = floor((feedRate * rounding) + 0.5) / rounding;
+
+    if ((feedRate <= 0) || ((mHaveFeedRate == true) && (mFeedRate == feedRate))) {
+        // The machine is already going at this rate.  (An F word on the line that set it is left alone.)
+        mOutput->write(line, length);
+        return;
+    }
+
+    writeFeedRate(line, length, feedRate, (haveFeedWord == true) ? &feedWord : NULL, tokenizer.getWordsEnd());
+
+    mHaveFeedRate = true;
+    mFeedRate = feedRate;
+    mReport.feedRatesWritten++;
+}
+
+/**
+ * @brief GCodeFeedPolicy::writeFeedRate - Write a line with a new feed rate.
+ *
+ * @param line - The line, with its line ending (if it has one).
+ * @param length - The length of the line.
+ * @param feedRate - The new feed rate, in program units.
+ * @param feedWord - The F word that is on the line already, or NULL.
+ * @param wordsEnd - One past the last word on the line.  (Where a new F word goes.)
+ */
+void GCodeFeedPolicy::writeFeedRate(const char *line, size_t length, double feedRate, const GCodeWord *feedWord, const char *wordsEnd)
+{
+    char number[GCODE_NUMBER_MAX_LENGTH + 2];
+    size_t numberLength;
+    const char *end = line + length;
+
+    mLineBuffer.resize(0);
+
+    if (feedWord != NULL) {
+        // Only the number is replaced, so the spacing of the line is kept.
+        numberLength = GCodeNumberFormatter::formatFixed(number, feedRate, GCODE_FEED_POLICY_DECIMALS, true);
+        mLineBuffer.append(line, feedWord->valueStart - line);
+        mLineBuffer.append(number, numberLength);
+        mLineBuffer.append(feedWord->end, end - feedWord->end);
+    } else {
+        number[0] = ' ';
+        number[1] = 'F';
+        numberLength = GCodeNumberFormatter::formatFixed(number + 2, feedRate, GCODE_FEED_POLICY_DECIMALS, true) + 2;
+
+        mLineBuffer.append(line, wordsEnd - line);
+        mLineBuffer.append(number, numberLength);
+        mLineBuffer.append(wordsEnd, end - wordsEnd);
+    }
+
+    mOutput->write(mLineBuffer.constData(), mLineBuffer.size());
+}
@@ -0,0 +1,79 @@
+#ifndef GCODEFEEDPOLICY_H
+#define GCODEFEEDPOLICY_H
+
+#include <QByteArray>
+
+#include "gcodeoutput.h"
+#include "gcodemodaltracker.h"
+
+struct GCodeWord;
+
+// Moves shorter than this (in mm) are slowed down, when no other length is set.
+#define GCODE_FEED_POLICY_DEFAULT_SHORT_LENGTH       0.5
+
+// The slowest that a short move is made, as a fraction of the feed rate it would otherwise get, when no other
+// scale is set.
+#define GCODE_FEED_POLICY_DEFAULT_SHORT_SCALE        0.25
+
+// The number of decimal places the feed rates are written with.
+#define GCODE_FEED_POLICY_DECIMALS                   1
+
+// What a feed policy pass changed.
+struct GCodeFeedPolicyReport
+{
+    unsigned long movesRated;           // Feed moves that had a feed rate worked out for them.
+    unsigned long feedRatesWritten;     // F words that were added or changed.
+    unsigned long movesSkipped;         // Feed moves that were left as they are, because where they started wasn't known.
+};
+
+// Works out the feed rate of every cutting move from the direction it goes in, as the lines are written.
+// A move is made as fast as it can go without the X/Y part of it going faster than the X/Y feed rate, or
+// the Z part going faster than the Z feed rate.  (So a shallow ramp runs at nearly the X/Y rate, instead of
+// the slower of the two.)  Moves down use the plunge rate for Z, and moves up use the retract rate, if they
+// are set.  Moves shorter than the short segment length are slowed down in proportion to their length, but
+// never below the short segment scale.
+//
+// Only the position that the last move left the machine at is needed, so this works in a single pass.  An
+// F word is only written when the feed rate changes.  Arcs are measured by their chord, and moves in inverse
+// time mode (G93) are passed on as they are.
+class GCodeFeedPolicy : public GCodeLineOutput
+{
+public:
+    GCodeFeedPolicy(GCodeOutput *output);
+
+    void setXYFeedRate(double feedrate);
+    void setZFeedRate(double feedrate);
+    void setPlungeFeedRate(double feedrate);
+    void setRetractFeedRate(double feedrate);
+    void setShortSegmentLength(double length);
+    void setShortSegmentScale(double scale);
+
+    double feedRateFor(double dx, double dy, double dz) const;
+
+    void getReport(GCodeFeedPolicyReport *report) const;
+
+protected:
+    void processLine(const char *line, size_t length);
+
+private:
+    void writeFeedRate(const char *line, size_t length, double feedRate, const GCodeWord *feedWord, const char *wordsEnd);
+
+
+    // mm/min
+    double mXYFeedRate;
+    double mZFeedRate;
+    double mPlungeFeedRate;             // 0 to use the Z feed rate.
+    double mRetractFeedRate;            // 0 to use the Z feed rate.
+    double mShortSegmentLength;         // mm
+    double mShortSegmentScale;
+
+    QByteArray mLineBuffer;             // A line as it is rewritten.
+
+    GCodeModalTracker mModalTracker;    // The modal state of the program, as it has been written so far.
+    bool mHaveFeedRate;
+    double mFeedRate;                   // The last F written, in program units.
+
+    GCodeFeedPolicyReport mReport;
+};
+
+#endif // GCODEFEEDPOLICY_H
@@ -0,0 +1,423 @@
+#include "gcodeheightmap.h"
+
+#include "logger.h"
+
+#include <QFile>
+#include <QByteArray>
+
+#include <math.h>
+#include <algorithm>
+
+/**
+ * @brief findGridLines - Find the evenly spaced positions that a set of coordinates fall on.
+ *
+ * @param values - The coordinates.  (Sorted on return.)
+ * @param origin[out] - The first position.
+ * @param spacing[out] - The distance between the positions.
+ * @param count[out] - The number of positions.
+ *
+ * @return true if the coordinates are on evenly spaced positions.
+ */
+static bool findGridLines(QVector<double> &values, double *origin, double *spacing, int *count)
+{
+    QVector<double> lines;
+
+    std::sort(values.begin(), values.end());
+
+    for (int i = 0; i < values.size(); i++) {
+        if ((lines.isEmpty() == true) || ((values.at(i) - lines.last()) > HEIGHT_MAP_POSITION_TOLERANCE)) {
+            lines.append(values.at(i));
+        }
+    }
+
+    if (lines.size() < 2) {
+        return false;
+    }
+
+    *origin = lines.first();
+    *spacing = (lines.last() - lines.first()) / (lines.size() - 1);
+    *count = lines.size();
+
+    for (int i = 0; i < lines.size(); i++) {
+        if (fabs(lines.at(i) - (*origin + (*spacing * i))) > HEIGHT_MAP_POSITION_TOLERANCE) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+GCodeHeightMap::GCodeHeightMap()
+{
+    mInterpolation = HEIGHT_MAP_BILINEAR;
+    clear();
+}
+
+/**
+ * @brief GCodeHeightMap::load - Load the points of the grid from a text file.  (See the header for the format.)
+ *
+ * @param filename - The file to load.
+ *
+ * @return QString containing an error, if there was an error.  Otherwise, on success, the QString will
+ *      be empty.
+ */
+QString GCodeHeightMap::load(QString filename)
+{
+    QFile file(filename);
+    QByteArray data;
+    QVector<double> points;
+    const char *cursor;
+    const char *end;
+    const char *lineEnd;
+    const char *fieldStart;
+    double values[3];
+    int fields;
+    int lineNumber = 0;
+    bool ok;
+    QString error;
+
+    clear();
+
+    if (file.open(QIODevice::ReadOnly) == false) {
+        return "Unable to open the heightmap " + filename + "!";
+    }
+
+    data = file.readAll();
+    file.close();
+
+    cursor = data.constData();
+    end = cursor + data.size();
+
+    while (cursor < end) {
+        lineEnd = cursor;
+        while ((lineEnd < end) && (*lineEnd != '\n')) {
+            lineEnd++;
+        }
+
+        lineNumber++;
+        fields = 0;
+        ok = true;
+
+        while ((cursor < lineEnd) && ((*cursor == ' ') || (*cursor == '\t'))) {
+            cursor++;
+        }
+
+        if ((cursor < lineEnd) && ((*cursor == '#') || (*cursor == ';'))) {
+            // A comment.
+            cursor = lineEnd;
+        }
+
+        while ((cursor < lineEnd) && (ok == true)) {
+            // Skip the separators.
+            while ((cursor < lineEnd) && ((*cursor == ',') || (*cursor == ';') || (*cursor == ' ') || (*cursor == '\t') || (*cursor == '\r'))) {
+                cursor++;
+            }
+
+            if (cursor >= lineEnd) {
+                break;
+            }
+
+            fieldStart = cursor;
+            while ((cursor < lineEnd) && (*cursor != ',') && (*cursor != ';') && (*cursor != ' ') && (*cursor != '\t') && (*cursor != '\r')) {
+                cursor++;
+            }
+
+            if (fields < 3) {
+                values[fields] = QByteArray(fieldStart, cursor - fieldStart).toDouble(&ok);
+            }
+
+            fields++;
+        }
+
+        if ((ok == false) && (lineNumber == 1) && (fields == 1)) {
+            // A heading.
+            fields = 0;
+            ok = true;
+        }
+
+        if ((ok == false) || ((fields != 0) && (fields != 3))) {
+            return "Line " + QString::number(lineNumber) + " of the heightmap " + filename + " isn't an X,Y,Z point!";
+        }
+
+        if (fields == 3) {
+            points.append(values[0]);
+            points.append(values[1]);
+            points.append(values[2]);
+        }
+
+        cursor = lineEnd + 1;
+    }
+
+    error = setPoints(points);
+    if (error.isEmpty() == false) {
+        return "The heightmap " + filename + " can't be used.  " + error;
+    }
+
+    LOG_INFO("Loaded a " + QString::number(mColumns) + " by " + QString::number(mRows) + " heightmap from " + filename + " (" +
+             QString::number(mSpacingX, 'f', 2) + " by " + QString::number(mSpacingY, 'f', 2) + " mm apart, heights from " +
+             QString::number(mLowest, 'f', 3) + " to " + QString::number(mHighest, 'f', 3) + " mm).");
+
+    return "";
+}
+
+/**
+ * @brief GCodeHeightMap::setPoints - Set up the grid from a list of points.
+ *
+ * @param points - X, Y and Z for each point, in any order.  They need to make up a complete grid, evenly
+ *      spaced in each direction, at least two points wide and high.
+ *
+ * @return QString containing an error, if there was an error.  Otherwise, on success, the QString will
+ *      be empty.
+ */
+QString GCodeHeightMap::setPoints(const QVector<double> &points)
+{
+    QVector<double> xs;
+    QVector<double> ys;
+    QVector<bool> filled;
+    int count = points.size() / 3;
+    int column;
+    int row;
+
+    clear();
+
+    for (int i = 0; i < count; i++) {
+        xs.append(points.at(i * 3));
+        ys.append(points.at((i * 3) + 1));
+    }
+
+    if ((findGridLines(xs, &mOriginX, &mSpacingX, &mColumns) == false) ||
+            (findGridLines(ys, &mOriginY, &mSpacingY, &mRows) == false)) {
+        clear();
+        return "The points need to be evenly spaced, in a grid at least two points wide and high.";
+    }
+
+    if ((mColumns * mRows) != count) {
+        clear();
+        return "There should be " + QString::number(mColumns * mRows) + " points in a " + QString::number(mColumns) + " by " +
+                QString::number(mRows) + " grid, but there are " + QString::number(count) + ".";
+    }
+
+    mInverseSpacingX = 1.0 / mSpacingX;
+    mInverseSpacingY = 1.0 / mSpacingY;
+    mHeights.fill(0, count);
+    filled.fill(false, count);
+
+    for (int i = 0; i < count; i++) {
+        column = (int)floor(((points.at(i * 3) - mOriginX) * mInverseSpacingX) + 0.5);
+        row = (int)floor(((points.at((i * 3) + 1) - mOriginY) * mInverseSpacingY) + 0.5);
+
+        if (filled.at((row * mColumns) + column) == true) {
+            clear();
+            return "The grid has more than one point at " + QString::number(points.at(i * 3), 'f', 3) + "," +
+                    QString::number(points.at((i * 3) + 1), 'f', 3) + ".";
+        }
+
+        mHeights[(row * mColumns) + column] = points.at((i * 3) + 2);
+        filled[(row * mColumns) + column] = true;
+
+        if ((i == 0) || (points.at((i * 3) + 2) < mLowest)) {
+            mLowest = points.at((i * 3) + 2);
+        }
+
+        if ((i == 0) || (points.at((i * 3) + 2) > mHighest)) {
+            mHighest = points.at((i * 3) + 2);
+        }
+    }
+
+    return "";
+}
+
+/**
+ * @brief GCodeHeightMap::clear - Throw away the grid.  (An empty heightmap is flat.)
+ */
+void GCodeHeightMap::clear()
+{
+    mOriginX = 0;
+    mOriginY = 0;
+    mSpacingX = 0;
+    mSpacingY = 0;
+    mInverseSpacingX = 0;
+    mInverseSpacingY = 0;
+    mColumns = 0;
+    mRows = 0;
+    mHeights.clear();
+    mLowest = 0;
+    mHighest = 0;
+}
+
+void GCodeHeightMap::setInterpolation(int interpolation)
+{
+    mInterpolation = interpolation;
+}
+
+bool GCodeHeightMap::isEmpty() const
+{
+    return mHeights.isEmpty();
+}
+
+int GCodeHeightMap::getColumns() const
+{
+    return mColumns;
+}
+
+int GCodeHeightMap::getRows() const
+{
+    return mRows;
+}
+
+double GCodeHeightMap::getSpacingX() const
+{
+    return mSpacingX;
+}
+
+double GCodeHeightMap::getSpacingY() const
+{
+    return mSpacingY;
+}
+
+double GCodeHeightMap::getLowest() const
+{
+    return mLowest;
+}
+
+double GCodeHeightMap::getHighest() const
+{
+    return mHighest;
+}
+
+/**
+ * @brief GCodeHeightMap::heightAt - Get the height of the board at a point.
+ *
+ * @param x - The position of the point, in mm.
+ * @param y
+ *
+ * @return double containing the height, in mm.  (0 if the heightmap is empty.)
+ */
+double GCodeHeightMap::heightAt(double x, double y) const
+{
+    double u, v;
+    int column, row;
+
+    if (mHeights.isEmpty() == true) {
+        return 0;
+    }
+
+    // Where the point is, in grid cells, kept on the grid.
+    u = (x - mOriginX) * mInverseSpacingX;
+    v = (y - mOriginY) * mInverseSpacingY;
+
+    if (u < 0) {
+        u = 0;
+    } else if (u > (mColumns - 1)) {
+        u = mColumns - 1;
+    }
+
+    if (v < 0) {
+        v = 0;
+    } else if (v > (mRows - 1)) {
+        v = mRows - 1;
+    }
+
+    // The cell the point is in.  (Points on the far edges are in the last cell.)
+    column = (int)u;
+    row = (int)v;
+
+    if (column > (mColumns - 2)) {
+        column = mColumns - 2;
+    }
+
+    if (row > (mRows - 2)) {
+        row = mRows - 2;
+    }
+
+    if (mInterpolation == HEIGHT_MAP_BICUBIC) {
+        return bicubicAt(column, row, u - column, v - row);
+    }
+
+    return bilinearAt(column, row, u - column, v - row);
+}
+
+/**
+ * @brief GCodeHeightMap::bilinearAt - Blend the heights at the four corners of a cell.
+ *
+ * @param column - The bottom left corner of the cell.
+ * @param row
+ * @param fx - How far across the cell the point is.  (0 to 1)
+ * @param fy - How far up the cell the point is.  (0 to 1)
+ *
+ * @return double containing the height.
+ */
+double GCodeHeightMap::bilinearAt(int column, int row, double fx, double fy) const
+{
+    const double *bottom = mHeights.constData() + (row * mColumns) + column;
+    const double *top = bottom + mColumns;
+    double lower = bottom[0] + ((bottom[1] - bottom[0]) * fx);
+    double upper = top[0] + ((top[1] - top[0]) * fx);
+
+    return lower + ((upper - lower) * fy);
+}
+
+/**
+ * @brief catmullRom - Interpolate between the middle two of four evenly spaced values.
+ *
+ * @param p0 - The values.
+ * @param p1
+ * @param p2
+ * @param p3
+ * @param t - How far from p1 to p2.  (0 to 1)
+ *
+ * @return double containing the interpolated value.
+ */
+static inline double catmullRom(double p0, double p1, double p2, double p3, double t)
+{
+    return p1 + (0.5 * t * ((p2 - p0) + (t * (((2 * p0) - (5 * p1) + (4 * p2) - p3) + (t * ((3 * (p1 - p2)) + p3 - p0))))));
+}
+
+/**
+ * @brief GCodeHeightMap::bicubicAt - Fit a smooth curve through the heights at the sixteen points around a cell.
+ *      (Points past the edge of the grid are taken to be the same as the ones on the edge.)
+ *
+ * @param column - The bottom left corner of the cell.
+ * @param row
+ * @param fx - How far across the cell the point is.  (0 to 1)
+ * @param fy - How far up the cell the point is.  (0 to 1)
+ *
+ * @return double containing the height.
+ */
+double GCodeHeightMap::bicubicAt(int column, int row, double fx, double fy) const
+{
+    double across[4];
+
+    for (int i = 0; i < 4; i++) {
+        across[i] = catmullRom(pointAt(column - 1, row - 1 + i), pointAt(column, row - 1 + i), pointAt(column + 1, row - 1 + i),
+                               pointAt(column + 2, row - 1 + i), fx);
+    }
+
+    return catmullRom(across[0], across[1], across[2], across[3], fy);
+}
+
+/**
+ * @brief GCodeHeightMap::pointAt - Get the height at a point of the grid, using the nearest edge for points
+ *      past it.
+ *
+ * @param column - The point.
+ * @param row
+ *
+ * @return double containing the height.
+ */
+double GCodeHeightMap::pointAt(int column, int row) const
+{
+    if (column < 0) {
+        column = 0;
+    } else if (column >= mColumns) {
+        column = mColumns - 1;
+    }
+
+    if (row < 0) {
+        row = 0;
+    } else if (row >= mRows) {
+        row = mRows - 1;
+    }
+
+    return mHeights.at((row * mColumns) + column);
+}
@@ -0,0 +1,63 @@
+#ifndef GCODEHEIGHTMAP_H
+#define GCODEHEIGHTMAP_H
+
+#include <QString>
+#include <QVector>
+
+// How heights between the points of the grid are worked out.  (Values for setInterpolation().)
+#define HEIGHT_MAP_BILINEAR                  0       // From the four points around it.
+#define HEIGHT_MAP_BICUBIC                   1       // From the sixteen points around it.  (A Catmull-Rom spline, which passes through every point.)
+
+// Two points closer than this (in mm) are taken to be in the same row or column of the grid.
+#define HEIGHT_MAP_POSITION_TOLERANCE        0.01
+
+// The height of the board measured at the points of an evenly spaced grid, so that the height anywhere on it
+// can be looked up.  Lookups work out which cell of the grid a point is in straight from its position, so
+// they take the same (short) time however big the grid is.  Points outside of the grid get the height of the
+// nearest edge.
+//
+// Heightmaps are loaded from text files with an "X,Y,Z" line for each point, in any order.  (Commas, spaces,
+// tabs or semicolons can separate the numbers.  Blank lines, lines starting with '#' or ';', and a first line
+// that doesn't start with a number are skipped.)  Heights are in mm, relative to the Z zero the job is run with.
+class GCodeHeightMap
+{
+public:
+    GCodeHeightMap();
+
+    QString load(QString filename);
+    QString setPoints(const QVector<double> &points);
+    void clear();
+
+    void setInterpolation(int interpolation);
+
+    bool isEmpty() const;
+    int getColumns() const;
+    int getRows() const;
+    double getSpacingX() const;
+    double getSpacingY() const;
+    double getLowest() const;
+    double getHighest() const;
+
+    double heightAt(double x, double y) const;
+
+private:
+    double bilinearAt(int column, int row, double fx, double fy) const;
+    double bicubicAt(int column, int row, double fx, double fy) const;
+    double pointAt(int column, int row) const;
+
+    int mInterpolation;
+
+    double mOriginX;                // The position of the first column and row.
+    double mOriginY;
+    double mSpacingX;
+    double mSpacingY;
+    double mInverseSpacingX;        // So that finding the cell is a multiply, not a divide.
+    double mInverseSpacingY;
+    int mColumns;
+    int mRows;
+    QVector<double> mHeights;       // A row at a time, starting with the lowest Y.
+    double mLowest;
+    double mHighest;
+};
+
+#endif // GCODEHEIGHTMAP_H
@@ -0,0 +1,180 @@
+#include "gcodelinereader.h"
+#include "gcodescanner.h"
+#include "profiler.h"
+
+#include <QFile>
+
+#include <string.h>
+
+GCodeLineReader::GCodeLineReader(size_t blockSize)
+{
+    mFile = NULL;
+    mBlockSize = blockSize;
+    mBuffer.resize(blockSize);
+    mStart = 0;
+    mEnd = 0;
+    mBytesRead = 0;
+    mAtEof = false;
+    mError = false;
+}
+
+GCodeLineReader::~GCodeLineReader()
+{
+    close();
+}
+
+/**
+ * @brief GCodeLineReader::open - Open the file that lines should be read from.
+ *
+ * @param filename - The file to read.
+ *
+ * @return true if the file was opened.  false otherwise.
+ */
+bool GCodeLineReader::open(QString filename)
+{
+    close();
+
+    mStart = 0;
+    mEnd = 0;
+    mBytesRead = 0;
+    mAtEof = false;
+    mError = false;
+
+    mFile = fopen(QFile::encodeName(filename).constData(), "rb");
+    if (mFile == NULL) {
+        mError = true;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief GCodeLineReader::close - Close the input file, if it is open.
+ */
+void GCodeLineReader::close()
+{
+    if (mFile != NULL) {
+        fclose(mFile);
+        mFile = NULL;
+    }
+
+    // If a very long line forced the buffer to grow, go back to the normal block size.
+    if ((size_t)mBuffer.size() != mBlockSize) {
+        mBuffer.resize(mBlockSize);
+        mBuffer.squeeze();
+    }
+}
+
+/**
+ * @brief GCodeLineReader::readLine - Return the next line of the file.  The data returned points in to
+ *      our internal buffer, and is only valid until the next call to readLine().  Lines of any length
+ *      are returned whole, the buffer will grow to fit a line that is longer than the block size.
+ *
+ * @param line[out] - Will point to the first byte of the line.
+ * @param length[out] - The length of the line, including the line ending (if there was one).
+ *
+ * @return true if a line was returned.  false at the end of the file, or if there was an error.
+ */
+bool GCodeLineReader::readLine(const char **line, size_t *length)
+{
+    const char *newline;
+    size_t searchFrom = mStart;
+
+    while (true) {
+        newline = GCodeScanner::findNewline(mBuffer.constData() + searchFrom, mBuffer.constData() + mEnd);
+        if (newline != mBuffer.constData() + mEnd) {
+            *line = mBuffer.constData() + mStart;
+            *length = (newline - *line) + 1;
+            mStart += *length;
+            return true;
+        }
+
+        // Everything we have has been searched, so there is no need to look at it again.
+        searchFrom = mEnd;
+
+        if (mAtEof == true) {
+            if (mStart == mEnd) {
+                return false;
+            }
+
+            // The last line of the file doesn't have a line ending.
+            *line = mBuffer.constData() + mStart;
+            *length = mEnd - mStart;
+            mStart = mEnd;
+            return true;
+        }
+
+        searchFrom -= mStart;
+        if (fillBuffer() == false) {
+            return false;
+        }
+    }
+}
+
+/**
+ * @brief GCodeLineReader::getBytesRead - Returns the number of bytes that have been read from the file.
+ *
+ * @return quint64 containing the number of bytes read.
+ */
+quint64 GCodeLineReader::getBytesRead()
+{
+    return mBytesRead;
+}
+
+/**
+ * @brief GCodeLineReader::hasError - Returns true if reading from the input file failed.
+ *
+ * @return true if there was an error.  false otherwise.
+ */
+bool GCodeLineReader::hasError()
+{
+    return mError;
+}
+
+/**
+ * @brief GCodeLineReader::fillBuffer - Move any partial line to the front of the buffer, and read
+ *      the next block of the file after it.  If the partial line already fills the buffer, the buffer
+ *      is grown so that the line can be completed.
+ *
+ * @return true if the buffer was refilled (or we reached the end of the file).  false on error.
+ */
+bool GCodeLineReader::fillBuffer()
+{
+    size_t remaining = mEnd - mStart;
+    size_t readSize;
+
+    PROFILE_SCOPE(PROFILE_STAGE_READ);
+
+    if (mFile == NULL) {
+        mError = true;
+        return false;
+    }
+
+    if ((remaining > 0) && (mStart > 0)) {
+        memmove(mBuffer.data(), mBuffer.constData() + mStart, remaining);
+    }
+
+    mStart = 0;
+    mEnd = remaining;
+
+    if ((mBuffer.size() - mEnd) < (mBlockSize / 2)) {
+        mBuffer.resize(mBuffer.size() * 2);
+    }
+
+    readSize = fread(mBuffer.data() + mEnd, 1, mBuffer.size() - mEnd, mFile);
+    if (readSize == 0) {
+        if (ferror(mFile) != 0) {
+            mError = true;
+            return false;
+        }
+
+        mAtEof = true;
+    }
+
+    mEnd += readSize;
+    mBytesRead += readSize;
+    PROFILE_COUNT(PROFILE_STAGE_READ, PROFILE_COUNTER_BYTES_IN, readSize);
+
+    return true;
+}
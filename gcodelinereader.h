@@ -0,0 +1,39 @@
+#ifndef GCODELINEREADER_H
+#define GCODELINEREADER_H
+
+#include <QString>
+#include <QByteArray>
+
+#include <stdio.h>
+
+// The size of the blocks read from the input file when no other size is requested.
+#define GCODE_READER_DEFAULT_BLOCK_SIZE      (1024 * 1024)
+
+class GCodeLineReader
+{
+public:
+    GCodeLineReader(size_t blockSize = GCODE_READER_DEFAULT_BLOCK_SIZE);
+    ~GCodeLineReader();
+
+    bool open(QString filename);
+    void close();
+
+    bool readLine(const char **line, size_t *length);
+
+    quint64 getBytesRead();
+    bool hasError();
+
+private:
+    bool fillBuffer();
+
+    FILE *mFile;
+    QByteArray mBuffer;
+    size_t mBlockSize;
+    size_t mStart;          // Offset of the first unconsumed byte in mBuffer.
+    size_t mEnd;            // Offset one past the last valid byte in mBuffer.
+    quint64 mBytesRead;
+    bool mAtEof;
+    bool mError;
+};
+
+#endif // GCODELINEREADER_H
@@ -0,0 +1,379 @@
+#include "gcodelookaheadplanner.h"
+
+#include "gcodetokenizer.h"
+#include "gcodenumberformatter.h"
+#include "profiler.h"
+
+#include <math.h>
+#include <string.h>
+
+// The room set aside for a rewritten line, so that the buffer doesn't have to grow.
+#define GCODE_PLANNER_LINE_RESERVE           128
+
+GCodeLookAheadPlanner::GCodeLookAheadPlanner(GCodeOutput *output) :
+    GCodeLineOutput(output, PROFILE_STAGE_LOOK_AHEAD)
+{
+    mXYAcceleration = GCODE_PLANNER_DEFAULT_ACCELERATION;
+    mZAcceleration = GCODE_PLANNER_DEFAULT_Z_ACCELERATION;
+    mJunctionDeviation = GCODE_PLANNER_DEFAULT_JUNCTION_DEVIATION;
+    mWindow = GCODE_PLANNER_DEFAULT_WINDOW;
+
+    mFeedRate = -1;
+
+    for (int i = 0; i < 3; i++) {
+        mLastDirection[i] = 0;
+    }
+
+    mHaveLastSegment = false;
+    mLastAcceleration = 0;
+    mLastNominalSpeed = 0;
+    mWrittenFeedRate = -1;
+
+    mLineBuffer.reserve(GCODE_PLANNER_LINE_RESERVE);
+
+    memset(&mReport, 0, sizeof(mReport));
+}
+
+/**
+ * @brief GCodeLookAheadPlanner::setAcceleration - Set how quickly the machine can change speed.
+ *
+ * @param xy - The acceleration along X and Y, in mm/s^2.
+ * @param z - The acceleration along Z, in mm/s^2.
+ */
+void GCodeLookAheadPlanner::setAcceleration(double xy, double z)
+{
+    mXYAcceleration = xy;
+    mZAcceleration = z;
+}
+
+/**
+ * @brief GCodeLookAheadPlanner::setJunctionDeviation - Set how far the path may be rounded off at a corner.
+ *
+ * @param deviation - The distance, in mm.  Larger values let corners be taken faster.
+ */
+void GCodeLookAheadPlanner::setJunctionDeviation(double deviation)
+{
+    mJunctionDeviation = deviation;
+}
+
+/**
+ * @brief GCodeLookAheadPlanner::setWindow - Set how many lines are planned at once.
+ *
+ * @param lines - The number of lines.  (At least GCODE_PLANNER_MIN_WINDOW.)
+ */
+void GCodeLookAheadPlanner::setWindow(int lines)
+{
+    if (lines < GCODE_PLANNER_MIN_WINDOW) {
+        lines = GCODE_PLANNER_MIN_WINDOW;
+    }
+
+    mWindow = lines;
+}
+
+/**
+ * @brief GCodeLookAheadPlanner::finish - Plan and write everything that is still held, with the machine
+ *      stopping at the end of the program.
+ */
+void GCodeLookAheadPlanner::finish()
+{
+    PROFILE_SCOPE(PROFILE_STAGE_LOOK_AHEAD);
+
+    GCodeLineOutput::finish();
+
+    plan();
+    writeLines(mLines.size());
+}
+
+/**
+ * @brief GCodeLookAheadPlanner::getReport - Get what has been changed so far.
+ *
+ * @param report[out] - The totals.
+ */
+void GCodeLookAheadPlanner::getReport(GCodePlannerReport *report) const
+{
+    *report = mReport;
+}
+
+/**
+ * @brief GCodeLookAheadPlanner::processLine - Follow the modal state through a line, and add it to the window.
+ *      Once the window is full, it is planned and the first half of it is written.
+ *
+ * @param line - The line, with its line ending (if it has one).
+ * @param length - The length of the line.
+ */
+void GCodeLookAheadPlanner::processLine(const char *line, size_t length)
+{
+    GCodeTokenizer tokenizer(line, length);
+    GCodeWord word;
+    GCodePlannerLine held;
+    GCodeModalLine modal;
+    double delta[3];
+    double direction[3];
+    double xyLength;
+    double cosTheta;
+    double sinHalfTheta;
+    double junctionSpeed;
+    double unitScale;
+    bool onlyFeedRate = true;
+    bool haveWords = false;
+    int motion;
+
+    held.feedStart = -1;
+    held.feedEnd = -1;
+    held.distance = 0;
+
+    while (tokenizer.nextWord(&word) == true) {
+        haveWords = true;
+
+        if (word.letter != 'F') {
+            onlyFeedRate = false;
+        } else {
+            held.feedStart = word.valueStart - line;
+            held.feedEnd = word.end - line;
+            mFeedRate = word.value;
+        }
+
+        mModalTracker.addWord(word);
+    }
+
+    mModalTracker.endLine(&modal);
+    motion = mModalTracker.getMotionMode();
+    unitScale = mModalTracker.getUnitScale();
+
+    held.offset = mHeld.size();
+    held.length = (int)length;
+    held.wordsEnd = tokenizer.getWordsEnd() - line;
+    held.feedRate = mFeedRate;
+    held.unitScale = unitScale;
+    held.kind = GCODE_PLANNER_LINE_OTHER;
+
+    if ((haveWords == true) && (onlyFeedRate == false)) {
+        // Anything other than a feed rate (a spindle command, a dwell...) is taken to stop the machine, until we
+        // find out otherwise.
+        held.kind = GCODE_PLANNER_LINE_STOP;
+    }
+
+    if (modal.isMove == true) {
+        for (int i = 0; i < 3; i++) {
+            delta[i] = modal.target[i] - modal.start[i];
+        }
+
+        held.distance = sqrt((delta[0] * delta[0]) + (delta[1] * delta[1]) + (delta[2] * delta[2]));
+
+        if ((motion == 1) && (mModalTracker.isInverseTime() == false) && (modal.deltaKnown == true) && (mFeedRate > 0) &&
+                (held.distance > 0)) {
+            held.kind = GCODE_PLANNER_LINE_SEGMENT;
+        } else if ((held.distance == 0) && (modal.deltaKnown == true) && (motion >= 0)) {
+            // Doesn't go anywhere.
+            held.kind = GCODE_PLANNER_LINE_OTHER;
+        } else {
+            held.kind = GCODE_PLANNER_LINE_MOVE;
+        }
+    }
+
+    if (held.kind == GCODE_PLANNER_LINE_SEGMENT) {
+        for (int i = 0; i < 3; i++) {
+            direction[i] = delta[i] / held.distance;
+        }
+
+        held.nominalSpeed = (mFeedRate * unitScale) / 60;
+
+        // Each axis can only change speed so quickly, so a move can only accelerate as fast as the slowest
+        // axis it uses lets it.
+        held.acceleration = 0;
+        xyLength = sqrt((direction[0] * direction[0]) + (direction[1] * direction[1]));
+        if (xyLength > 0) {
+            held.acceleration = mXYAcceleration / xyLength;
+        }
+
+        if ((direction[2] != 0) && ((held.acceleration == 0) || ((mZAcceleration / fabs(direction[2])) < held.acceleration))) {
+            held.acceleration = mZAcceleration / fabs(direction[2]);
+        }
+
+        held.maxEntrySpeed = 0;
+        if (mHaveLastSegment == true) {
+            cosTheta = -((mLastDirection[0] * direction[0]) + (mLastDirection[1] * direction[1]) + (mLastDirection[2] * direction[2]));
+
+            if (cosTheta < -0.999999) {
+                // Carrying on in a straight line.
+                junctionSpeed = held.nominalSpeed;
+            } else if (cosTheta > 0.999999) {
+                // Turning right around.
+                junctionSpeed = 0;
+            } else {
+                sinHalfTheta = sqrt(0.5 * (1 - cosTheta));
+                junctionSpeed = sqrt(qMin(held.acceleration, mLastAcceleration) * mJunctionDeviation * sinHalfTheta / (1 - sinHalfTheta));
+            }
+
+            held.maxEntrySpeed = qMin(junctionSpeed, qMin(held.nominalSpeed, mLastNominalSpeed));
+        }
+
+        held.entrySpeed = 0;
+        held.exitSpeed = 0;
+
+        mHaveLastSegment = true;
+        mLastAcceleration = held.acceleration;
+        mLastNominalSpeed = held.nominalSpeed;
+        for (int i = 0; i < 3; i++) {
+            mLastDirection[i] = direction[i];
+        }
+    } else if ((held.kind == GCODE_PLANNER_LINE_STOP) || (held.kind == GCODE_PLANNER_LINE_MOVE)) {
+        mHaveLastSegment = false;
+    }
+
+    mHeld.append(line, (int)length);
+    mLines.append(held);
+
+    if (mLines.size() >= mWindow) {
+        plan();
+        writeLines(mLines.size() / 2);
+    }
+}
+
+/**
+ * @brief GCodeLookAheadPlanner::plan - Work out the speed at the start and end of every segment in the window,
+ *      with the machine stopping at the end of it.
+ */
+void GCodeLookAheadPlanner::plan()
+{
+    GCodePlannerLine *lines = mLines.data();
+    double nextEntry = 0;
+    double reachable;
+    int previous = -1;
+
+    // Backward, so that there is always room to brake for what comes next.
+    for (int i = mLines.size() - 1; i >= 0; i--) {
+        if (lines[i].kind != GCODE_PLANNER_LINE_SEGMENT) {
+            continue;
+        }
+
+        lines[i].exitSpeed = nextEntry;
+        lines[i].entrySpeed = qMin(lines[i].maxEntrySpeed, sqrt((nextEntry * nextEntry) + (2 * lines[i].acceleration * lines[i].distance)));
+        nextEntry = lines[i].entrySpeed;
+    }
+
+    // Then forward, so that no segment starts faster than the one before it could get to.
+    for (int i = 0; i < mLines.size(); i++) {
+        if (lines[i].kind != GCODE_PLANNER_LINE_SEGMENT) {
+            continue;
+        }
+
+        if (previous >= 0) {
+            reachable = sqrt((lines[previous].entrySpeed * lines[previous].entrySpeed) + (2 * lines[previous].acceleration * lines[previous].distance));
+            if (lines[i].entrySpeed > reachable) {
+                lines[i].entrySpeed = reachable;
+            }
+
+            lines[previous].exitSpeed = lines[i].entrySpeed;
+        }
+
+        previous = i;
+    }
+}
+
+/**
+ * @brief GCodeLookAheadPlanner::writeLines - Write the first lines of the window, with the feed rates that
+ *      were planned for them, and drop them from the window.
+ *
+ * @param count - The number of lines to write.
+ */
+void GCodeLookAheadPlanner::writeLines(int count)
+{
+    static const double rounding = pow(10.0, GCODE_PLANNER_DECIMALS);
+    GCodePlannerLine *lines = mLines.data();
+    double peakSpeed;
+    double feedRate;
+    int heldUsed = 0;
+    int remaining;
+
+    for (int i = 0; i < count; i++) {
+        feedRate = lines[i].feedRate;
+
+        if (lines[i].kind == GCODE_PLANNER_LINE_SEGMENT) {
+            mReport.segmentsPlanned++;
+
+            // The fastest the segment can get to between its entry and exit speeds.
+            peakSpeed = sqrt((lines[i].acceleration * lines[i].distance) +
+                             (((lines[i].entrySpeed * lines[i].entrySpeed) + (lines[i].exitSpeed * lines[i].exitSpeed)) / 2));
+
+            if (peakSpeed < lines[i].nominalSpeed) {
+                // Rounded up, so that it is never slower than it could be.
+                feedRate = ceil(((peakSpeed * 60) / lines[i].unitScale) * rounding) / rounding;
+                if (feedRate >= lines[i].feedRate) {
+                    feedRate = lines[i].feedRate;
+                } else {
+                    mReport.segmentsSlowed++;
+                }
+            }
+        }
+
+        writeLine(lines[i], feedRate);
+        heldUsed = lines[i].offset + lines[i].length;
+    }
+
+    // Keep the rest, with the speed the last written segment left at as the fastest the next one can start.
+    remaining = mLines.size() - count;
+    mLines.remove(0, count);
+    mHeld.remove(0, heldUsed);
+
+    lines = mLines.data();
+    for (int i = 0; i < remaining; i++) {
+        lines[i].offset -= heldUsed;
+    }
+
+    for (int i = 0; i < remaining; i++) {
+        if (lines[i].kind == GCODE_PLANNER_LINE_SEGMENT) {
+            if (lines[i].entrySpeed < lines[i].maxEntrySpeed) {
+                lines[i].maxEntrySpeed = lines[i].entrySpeed;
+            }
+            break;
+        }
+    }
+}
+
+/**
+ * @brief GCodeLookAheadPlanner::writeLine - Write a held line, making sure that the machine runs it at a feed
+ *      rate.
+ *
+ * @param held - The line.
+ * @param feedRate - The feed rate it should run at, in program units.  (-1 if the program hadn't set one.)
+ */
+void GCodeLookAheadPlanner::writeLine(const GCodePlannerLine &held, double feedRate)
+{
+    const char *line = mHeld.constData() + held.offset;
+    const char *end = line + held.length;
+    char number[GCODE_NUMBER_MAX_LENGTH + 2];
+    size_t numberLength;
+    bool moves = ((held.kind == GCODE_PLANNER_LINE_MOVE) || (held.kind == GCODE_PLANNER_LINE_SEGMENT));
+
+    if ((feedRate < 0) || ((held.feedStart < 0) && ((moves == false) || (feedRate == mWrittenFeedRate))) ||
+            ((held.feedStart >= 0) && (feedRate == held.feedRate))) {
+        // Nothing needs to change.  (A line that doesn't move, and doesn't set the feed rate, is left alone.)
+        mOutput->write(line, held.length);
+
+        if (held.feedStart >= 0) {
+            mWrittenFeedRate = held.feedRate;
+        }
+        return;
+    }
+
+    mLineBuffer.resize(0);
+
+    if (held.feedStart >= 0) {
+        numberLength = GCodeNumberFormatter::formatFixed(number, feedRate, GCODE_PLANNER_DECIMALS, true);
+        mLineBuffer.append(line, held.feedStart);
+        mLineBuffer.append(number, (int)numberLength);
+        mLineBuffer.append(line + held.feedEnd, held.length - held.feedEnd);
+    } else {
+        number[0] = ' ';
+        number[1] = 'F';
+        numberLength = GCodeNumberFormatter::formatFixed(number + 2, feedRate, GCODE_PLANNER_DECIMALS, true) + 2;
+        mLineBuffer.append(line, held.wordsEnd);
+        mLineBuffer.append(number, (int)numberLength);
+        mLineBuffer.append(line + held.wordsEnd, (int)(end - (line + held.wordsEnd)));
+    }
+
+    mOutput->write(mLineBuffer.constData(), mLineBuffer.size());
+    mWrittenFeedRate = feedRate;
+    mReport.feedRatesWritten++;
+}
@@ -0,0 +1,121 @@
+#ifndef GCODELOOKAHEADPLANNER_H
+#define GCODELOOKAHEADPLANNER_H
+
+#include <QByteArray>
+#include <QVector>
+
+#include "gcodeoutput.h"
+#include "gcodemodaltracker.h"
+
+// The acceleration (in mm/s^2) along X/Y and along Z, when no others are set.
+#define GCODE_PLANNER_DEFAULT_ACCELERATION           500
+#define GCODE_PLANNER_DEFAULT_Z_ACCELERATION         100
+
+// How far (in mm) the path may be rounded off at a corner, which sets how fast a corner can be taken.  (The
+// same "junction deviation" that grbl style planners use.)
+#define GCODE_PLANNER_DEFAULT_JUNCTION_DEVIATION     0.02
+
+// The number of lines held at once, when no other window is set.
+#define GCODE_PLANNER_DEFAULT_WINDOW                 8192
+
+// The smallest window that can be used.
+#define GCODE_PLANNER_MIN_WINDOW                     16
+
+// The number of decimal places the feed rates are written with.
+#define GCODE_PLANNER_DECIMALS                       1
+
+// What kind of line a held line is.
+#define GCODE_PLANNER_LINE_OTHER                     0   // Doesn't move, and doesn't make the machine stop.
+#define GCODE_PLANNER_LINE_STOP                      1   // Some other command, which is taken to make the machine stop.
+#define GCODE_PLANNER_LINE_MOVE                      2   // A move that isn't planned.  (The machine stops before it.)
+#define GCODE_PLANNER_LINE_SEGMENT                   3   // A G01 move that is planned.
+
+// A line that is held in the window.
+struct GCodePlannerLine
+{
+    int offset;                     // Where the line is in the held text.
+    int length;
+    int kind;                       // GCODE_PLANNER_LINE_*
+    int feedStart;                  // Where the number of the F word on the line is, or -1 if there isn't one.
+    int feedEnd;
+    int wordsEnd;                   // One past the last word on the line.
+    double feedRate;                // The F that the line runs at in the original program (in program units), or -1 if there isn't one.
+    double unitScale;               // mm per program unit.
+
+    // Segments only.  (mm and mm/s.)
+    double distance;
+    double acceleration;
+    double nominalSpeed;            // What the original F asks for.
+    double maxEntrySpeed;           // The fastest the corner in to the segment can be taken.
+    double entrySpeed;
+    double exitSpeed;
+};
+
+// What a look-ahead pass changed.
+struct GCodePlannerReport
+{
+    unsigned long segmentsPlanned;
+    unsigned long segmentsSlowed;       // Segments that can't reach their feed rate, so were given a lower one.
+    unsigned long feedRatesWritten;     // F words that were added or changed.
+};
+
+// Plans the speed of the machine over a window of the program, and writes the speed that each G01 move can
+// actually reach as its feed rate.  Firmware with a short planner buffer has to be ready to stop at the end of
+// what it can see, so on paths made of many tiny moves it never gets up to speed, and then brakes for corners
+// it could have taken faster.  Here thousands of moves are looked at at once: a backward pass limits how fast
+// each corner can be taken by the braking distance to the ones after it, and a forward pass by how quickly the
+// machine can get up to speed from the ones before it.  Corners are limited by the junction deviation.
+//
+// The window is bounded, so the pass keeps streaming.  When it is full the whole window is planned (as if
+// the machine stops at the end of it) and the first half of it is written.  The rest is planned again with
+// what comes after it.
+//
+// Feed rates are only ever lowered.  Rapid moves, arcs, and any moves after them that run at the feed rate the
+// program set are given the feed rate back that they had in the original program.
+class GCodeLookAheadPlanner : public GCodeLineOutput
+{
+public:
+    GCodeLookAheadPlanner(GCodeOutput *output);
+
+    void setAcceleration(double xy, double z);
+    void setJunctionDeviation(double deviation);
+    void setWindow(int lines);
+
+    void finish();
+
+    void getReport(GCodePlannerReport *report) const;
+
+protected:
+    void processLine(const char *line, size_t length);
+
+private:
+    void plan();
+    void writeLines(int count);
+    void writeLine(const GCodePlannerLine &held, double feedRate);
+
+
+    double mXYAcceleration;             // mm/s^2
+    double mZAcceleration;              // mm/s^2
+    double mJunctionDeviation;          // mm
+    int mWindow;                        // lines
+
+    QByteArray mHeld;                   // The text of the lines in the window.
+    QVector<GCodePlannerLine> mLines;
+    QByteArray mLineBuffer;             // A line as it is rewritten.
+
+    GCodeModalTracker mModalTracker;    // The modal state of the program, as it has been read so far.
+    double mFeedRate;                   // The F in the original program, in program units, or -1.
+
+    // The last segment, if nothing has stopped the machine since it.
+    bool mHaveLastSegment;
+    double mLastDirection[3];
+    double mLastAcceleration;
+    double mLastNominalSpeed;
+
+    // The F that has been written to the output, in program units, or -1.
+    double mWrittenFeedRate;
+
+    GCodePlannerReport mReport;
+};
+
+#endif // GCODELOOKAHEADPLANNER_H
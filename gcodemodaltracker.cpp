@@ -0,0 +1,138 @@
+#include "gcodemodaltracker.h"
+
+#include "gcodetokenizer.h"
+
+#include <math.h>
+
+GCodeModalTracker::GCodeModalTracker()
+{
+    mMotionMode = -1;
+    mAbsolutePositioning = true;
+    mInverseTime = false;
+    mXYPlane = true;
+    mUnitScale = 1;
+
+    for (int i = 0; i < 3; i++) {
+        mPosition[i] = 0;
+        mKnown[i] = false;
+        mValue[i] = 0;
+        mGiven[i] = false;
+    }
+
+    mSetPosition = false;
+    mLoseKnown = false;
+}
+
+/**
+ * @brief GCodeModalTracker::addWord - Follow one word of the line.  Modal commands take effect straight away,
+ *      and the axis words are held until endLine().  Words that don't change the modal state are ignored.
+ *
+ * @param word - The word.
+ */
+void GCodeModalTracker::addWord(const GCodeWord &word)
+{
+    int code;
+    int axis = -1;
+
+    switch (word.letter) {
+    case 'G':
+        // Tenths, so that G38.2 can be told apart from G38.
+        code = (int)floor((word.value * 10) + 0.5);
+
+        if ((code == 0) || (code == 10) || (code == 20) || (code == 30)) {
+            mMotionMode = code / 10;
+        } else if (code == 170) {
+            mXYPlane = true;
+        } else if ((code == 180) || (code == 190)) {
+            mXYPlane = false;
+        } else if (code == 200) {
+            mUnitScale = 25.4;
+        } else if (code == 210) {
+            mUnitScale = 1;
+        } else if (code == 900) {
+            mAbsolutePositioning = true;
+        } else if (code == 910) {
+            mAbsolutePositioning = false;
+        } else if (code == 920) {
+            mSetPosition = true;
+        } else if (code == 930) {
+            mInverseTime = true;
+        } else if (code == 940) {
+            mInverseTime = false;
+        } else if ((code == 100) || (code == 280) || (code == 300) || (code == 530) || ((code >= 380) && (code < 390))) {
+            // Homing, probing and machine coordinates leave the machine somewhere that we can't follow.
+            mLoseKnown = true;
+        }
+        break;
+
+    case 'X':
+        axis = 0;
+        break;
+
+    case 'Y':
+        axis = 1;
+        break;
+
+    case 'Z':
+        axis = 2;
+        break;
+    }
+
+    if (axis >= 0) {
+        mGiven[axis] = true;
+        mValue[axis] = word.value;
+    }
+}
+
+/**
+ * @brief GCodeModalTracker::endLine - Work out where the line that was just followed left the machine, and get
+ *      ready for the next one.
+ *
+ * @param line[out] - What the line did.
+ */
+void GCodeModalTracker::endLine(GCodeModalLine *line)
+{
+    bool anyGiven = ((mGiven[0] == true) || (mGiven[1] == true) || (mGiven[2] == true));
+    double value;
+
+    line->isMove = false;
+    line->deltaKnown = true;
+    line->setPosition = mSetPosition;
+    line->loseKnown = mLoseKnown;
+
+    for (int i = 0; i < 3; i++) {
+        line->given[i] = mGiven[i];
+        line->start[i] = mPosition[i];
+        line->startKnown[i] = mKnown[i];
+
+        if (mGiven[i] == true) {
+            // Kept in mm, so that positions still make sense after the units change.
+            value = mValue[i] * mUnitScale;
+
+            if ((mSetPosition == true) || (mLoseKnown == true)) {
+                mPosition[i] = value;
+                mKnown[i] = mSetPosition;
+            } else if (mAbsolutePositioning == false) {
+                mPosition[i] += value;
+            } else {
+                if (mKnown[i] == false) {
+                    line->deltaKnown = false;
+                }
+
+                mPosition[i] = value;
+                mKnown[i] = true;
+            }
+        } else if ((anyGiven == false) && (mLoseKnown == true)) {
+            mKnown[i] = false;
+        }
+
+        line->target[i] = mPosition[i];
+
+        mGiven[i] = false;
+    }
+
+    line->isMove = ((anyGiven == true) && (mSetPosition == false) && (mLoseKnown == false));
+
+    mSetPosition = false;
+    mLoseKnown = false;
+}
@@ -0,0 +1,59 @@
+#ifndef GCODEMODALTRACKER_H
+#define GCODEMODALTRACKER_H
+
+struct GCodeWord;
+
+// What one line did to the position, once GCodeModalTracker has followed it.  (Positions are in mm.)
+struct GCodeModalLine
+{
+    bool given[3];                      // The axes that had a word on the line.
+    double start[3];                    // Where the machine was before the line.
+    bool startKnown[3];
+    double target[3];                   // Where the machine is after the line.
+    bool isMove;                        // true if the line has X, Y or Z words that move the machine.
+    bool deltaKnown;                    // true if how far a move goes is known on every axis it was given.
+    bool setPosition;                   // true for a G92.
+    bool loseKnown;                     // true for a homing, probing or machine coordinate move.
+};
+
+// Follows the modal state of a program (motion mode, units, positioning, plane and inverse time) and where
+// it has asked the machine to be, a line at a time.  Used by the stages that change the lines as they are
+// written, so that they all agree on what each line does.  Each word of a line is passed to addWord(), then
+// endLine() works out where the line left the machine.
+//
+// Moves in relative positioning keep the position known if it was.  Homing (G28, G30), probing (G38.x),
+// G10 and moves in machine coordinates (G53) leave the machine somewhere that can't be followed, so the
+// axes they name (or all of them, if they don't name any) are unknown until they are set again.
+class GCodeModalTracker
+{
+public:
+    GCodeModalTracker();
+
+    void addWord(const GCodeWord &word);
+    void endLine(GCodeModalLine *line);
+
+    int getMotionMode() const { return mMotionMode; }
+    bool isAbsolute() const { return mAbsolutePositioning; }
+    bool isInverseTime() const { return mInverseTime; }
+    bool isXYPlane() const { return mXYPlane; }
+    double getUnitScale() const { return mUnitScale; }
+    double getPosition(int axis) const { return mPosition[axis]; }
+    bool isKnown(int axis) const { return mKnown[axis]; }
+
+private:
+    int mMotionMode;                    // 0-3 for the last G00-G03, or -1.
+    bool mAbsolutePositioning;
+    bool mInverseTime;                  // true after a G93.
+    bool mXYPlane;                      // false after a G18 or G19.
+    double mUnitScale;                  // mm per program unit.  (25.4 after a G20.)
+    double mPosition[3];                // Where the program has asked the machine to be, in mm.
+    bool mKnown[3];
+
+    // The line that is being followed.
+    double mValue[3];                   // Program units.
+    bool mGiven[3];
+    bool mSetPosition;
+    bool mLoseKnown;
+};
+
+#endif // GCODEMODALTRACKER_H
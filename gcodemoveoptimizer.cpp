@@ -0,0 +1,265 @@
+#include "gcodemoveoptimizer.h"
+#include "gcodeprogram.h"
+
+#include <math.h>
+
+// The flags of a line that has to stay where it is.  (Its other words, comments or mode would be lost.)
+#define GCODE_OPTIMIZER_KEEP_FLAGS           (GCODE_LINE_OTHER_WORDS | GCODE_LINE_FIXED | GCODE_LINE_ABSOLUTE | \
+                                              GCODE_LINE_RELATIVE | GCODE_LINE_SPINDLE_STOP)
+
+/**
+ * @brief canDelete - Check if a line could be left out without losing anything other than its move.
+ *
+ * @param flags - The flags of the line.
+ *
+ * @return true if the line can be deleted.
+ */
+static inline bool canDelete(quint32 flags)
+{
+    if ((flags & GCODE_OPTIMIZER_KEEP_FLAGS) != 0) {
+        return false;
+    }
+
+    return ((flags & (GCODE_LINE_COMMENT | GCODE_LINE_COMMENTS_STRIPPED)) != GCODE_LINE_COMMENT);
+}
+
+GCodeMoveOptimizer::GCodeMoveOptimizer()
+{
+    mTolerance = GCODE_OPTIMIZER_DEFAULT_TOLERANCE;
+}
+
+/**
+ * @brief GCodeMoveOptimizer::setTolerance - Set how far a point that is merged away may be from the move
+ *      that replaces it.
+ *
+ * @param tolerance - The tolerance.  (mm)
+ */
+void GCodeMoveOptimizer::setTolerance(double tolerance)
+{
+    mTolerance = tolerance;
+}
+
+/**
+ * @brief GCodeMoveOptimizer::optimize - Take the lines that aren't needed out of a program.  Lines are
+ *      deleted (and F words removed) through the program, so nothing changes until it is written.  Lines
+ *      that have already been deleted are skipped, and changed feed rates are used, so this can be run after
+ *      the feed rates have been changed.
+ *
+ *      Each run of moves is merged in one pass.  Rather than check every point that has been merged away
+ *      against the new move each time the run grows, the furthest any of them could be is kept.  (A point
+ *      that was within maxDeviation of the old move is within maxDeviation plus the distance of the new end
+ *      point from the old move, of the new one.)  That can stop a run a little early, but never lets a point
+ *      stray more than the tolerance.
+ *
+ * @param program - The program to optimize.
+ * @param report[out] - What was changed.
+ */
+void GCodeMoveOptimizer::optimize(GCodeProgram &program, GCodeOptimizerReport *report)
+{
+    int lineCount = program.getLineCount();
+    const quint8 *commands = program.commands();
+    const quint32 *flags = program.flags();
+    const double *x = program.xValues();
+    const double *y = program.yValues();
+    const double *z = program.zValues();
+    const double *feedRates = program.feedRates();
+    static const quint16 axisFlags[3] = { GCODE_LINE_HAS_X, GCODE_LINE_HAS_Y, GCODE_LINE_HAS_Z };
+    const double *values[3] = { x, y, z };
+    double position[3] = { 0, 0, 0 };
+    bool known[3] = { false, false, false };
+    double target[3];
+    bool targetKnown;
+    bool moved;
+    bool changesMode;
+    bool absolute = true;
+    int positioningMode = -1;           // 90 or 91 once a G90 or G91 has been seen.
+    int motionMode = -1;
+    bool haveFeedRate = false;
+    double feedRate = 0;
+
+    // The run of moves being merged.  The pending line is the last move of the run, which is deleted if the
+    // next move carries on in the same direction.
+    int pendingLine = -1;
+    double runStart[3] = { 0, 0, 0 };
+    double runUnit[3] = { 0, 0, 0 };
+    double runLength = 0;
+    double runFeedRate = 0;
+    double maxDeviation = 0;
+
+    report->mergedMoves = 0;
+    report->zeroLengthMoves = 0;
+    report->redundantFeedRates = 0;
+    report->redundantModes = 0;
+    report->linesRemoved = 0;
+
+    for (int i = 0; i < lineCount; i++) {
+        if ((flags[i] & GCODE_LINE_DELETED) != 0) {
+            continue;
+        }
+
+        // A line that does nothing but set the mode that is already in use.
+        if ((commands[i] == GCODE_COMMAND_OTHER) &&
+                ((flags[i] & ~(GCODE_LINE_COMMENT | GCODE_LINE_COMMENTS_STRIPPED)) == GCODE_LINE_ABSOLUTE) &&
+                (canDelete(flags[i] & ~GCODE_LINE_ABSOLUTE) == true) && (positioningMode == 90)) {
+            program.deleteLine(i);
+            report->redundantModes++;
+            report->linesRemoved++;
+            continue;
+        }
+
+        if ((commands[i] == GCODE_COMMAND_OTHER) &&
+                ((flags[i] & ~(GCODE_LINE_COMMENT | GCODE_LINE_COMMENTS_STRIPPED)) == GCODE_LINE_RELATIVE) &&
+                (canDelete(flags[i] & ~GCODE_LINE_RELATIVE) == true) && (positioningMode == 91)) {
+            program.deleteLine(i);
+            report->redundantModes++;
+            report->linesRemoved++;
+            continue;
+        }
+
+        if ((flags[i] & GCODE_LINE_ABSOLUTE) != 0) {
+            absolute = true;
+            positioningMode = 90;
+        } else if ((flags[i] & GCODE_LINE_RELATIVE) != 0) {
+            absolute = false;
+            positioningMode = 91;
+        }
+
+        // An F word that sets the feed rate that is already in use.
+        if (program.setsFeedRate(i) == true) {
+            if ((haveFeedRate == true) && (feedRates[i] == feedRate) && (program.removeFeedRate(i) == true)) {
+                report->redundantFeedRates++;
+
+                if ((flags[i] & GCODE_LINE_DELETED) != 0) {
+                    report->linesRemoved++;
+                    continue;
+                }
+            } else {
+                haveFeedRate = true;
+                feedRate = feedRates[i];
+            }
+        }
+
+        changesMode = false;
+        if ((commands[i] >= GCODE_COMMAND_G0) && (commands[i] <= GCODE_COMMAND_G3)) {
+            changesMode = (motionMode != (commands[i] - GCODE_COMMAND_G0));
+            motionMode = commands[i] - GCODE_COMMAND_G0;
+        }
+
+        if (((flags[i] & (GCODE_LINE_HAS_X | GCODE_LINE_HAS_Y | GCODE_LINE_HAS_Z)) == 0) || (motionMode < 0)) {
+            if ((commands[i] == GCODE_COMMAND_OTHER) && ((flags[i] & GCODE_LINE_OTHER_WORDS) != 0)) {
+                // Something like a G28 or G92 might have moved the machine somewhere we don't know about.
+                known[0] = false;
+                known[1] = false;
+                known[2] = false;
+            }
+
+            // A feed rate only line doesn't end the run.  (If it changes the feed rate, the next move won't be
+            // merged anyway.)
+            if ((flags[i] & GCODE_LINE_FEED_ONLY) == 0) {
+                pendingLine = -1;
+            }
+            continue;
+        }
+
+        // Work out where the move goes.
+        targetKnown = true;
+        moved = false;
+        for (int axis = 0; axis < 3; axis++) {
+            if ((flags[i] & axisFlags[axis]) == 0) {
+                target[axis] = position[axis];
+            } else if (absolute == true) {
+                target[axis] = values[axis][i];
+                targetKnown = targetKnown && known[axis];
+            } else {
+                target[axis] = position[axis] + values[axis][i];
+                targetKnown = targetKnown && known[axis];
+            }
+
+            if (fabs(target[axis] - position[axis]) > GCODE_OPTIMIZER_MIN_LENGTH) {
+                moved = true;
+            }
+        }
+
+        if ((motionMode <= 1) && (targetKnown == true) && (moved == false) && (changesMode == false) &&
+                (canDelete(flags[i]) == true) && (program.setsFeedRate(i) == false)) {
+            // The move doesn't go anywhere.  (Arcs are left alone, as they might be whole circles, and a G00 or
+            // G01 that changes the motion mode is kept, as the moves after it depend on it.)
+            program.deleteLine(i);
+            report->zeroLengthMoves++;
+            report->linesRemoved++;
+            continue;
+        }
+
+        if ((motionMode == 1) && (absolute == true) && (targetKnown == true) && (moved == true) &&
+                ((flags[i] & GCODE_LINE_OTHER_WORDS) == 0)) {
+            double along[3];
+            double distance = 0;
+            double forward = 0;
+            double deviation = 0;
+            bool merged = false;
+
+            // The pending line can only go if this move gives every axis it gave.  (Otherwise the machine would
+            // never get to the pending line's value of the axis this move leaves out.)
+            if ((pendingLine >= 0) && (runFeedRate == feedRate) &&
+                    ((commands[i] == GCODE_COMMAND_G1) || (commands[pendingLine] == GCODE_COMMAND_NONE)) &&
+                    ((flags[pendingLine] & ~flags[i] & (GCODE_LINE_HAS_X | GCODE_LINE_HAS_Y | GCODE_LINE_HAS_Z)) == 0)) {
+                // How far the new end point is from the line the run is on, and whether it is further along it.
+                for (int axis = 0; axis < 3; axis++) {
+                    along[axis] = target[axis] - runStart[axis];
+                    forward += along[axis] * runUnit[axis];
+                }
+                for (int axis = 0; axis < 3; axis++) {
+                    double offset = along[axis] - (forward * runUnit[axis]);
+                    deviation += offset * offset;
+                }
+                deviation = sqrt(deviation);
+
+                if ((forward > runLength) && ((maxDeviation + deviation) <= mTolerance)) {
+                    if ((program.setsFeedRate(pendingLine) == true) && (program.setsFeedRate(i) == false)) {
+                        // The feed rate was set on the line being deleted, so it has to move to this one.
+                        if ((flags[i] & GCODE_LINE_FIXED) == 0) {
+                            program.setFeedRate(i, program.getFeedRateText(pendingLine));
+                            merged = true;
+                        }
+                    } else {
+                        merged = true;
+                    }
+                }
+            }
+
+            if (merged == true) {
+                program.deleteLine(pendingLine);
+                report->mergedMoves++;
+                report->linesRemoved++;
+                maxDeviation += deviation;
+            } else {
+                for (int axis = 0; axis < 3; axis++) {
+                    runStart[axis] = position[axis];
+                }
+                maxDeviation = 0;
+                runFeedRate = feedRate;
+            }
+
+            // Point the run at the new end point.
+            for (int axis = 0; axis < 3; axis++) {
+                along[axis] = target[axis] - runStart[axis];
+                distance += along[axis] * along[axis];
+            }
+            runLength = sqrt(distance);
+            for (int axis = 0; axis < 3; axis++) {
+                runUnit[axis] = along[axis] / runLength;
+            }
+
+            pendingLine = (canDelete(flags[i]) == true) ? i : -1;
+        } else {
+            pendingLine = -1;
+        }
+
+        for (int axis = 0; axis < 3; axis++) {
+            position[axis] = target[axis];
+            if ((flags[i] & axisFlags[axis]) != 0) {
+                known[axis] = (absolute == true) || known[axis];
+            }
+        }
+    }
+}
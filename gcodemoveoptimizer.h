@@ -0,0 +1,43 @@
+#ifndef GCODEMOVEOPTIMIZER_H
+#define GCODEMOVEOPTIMIZER_H
+
+class GCodeProgram;
+
+// How far (in mm) a point that is merged away may be from the move that replaces it, when no other tolerance
+// is set.
+#define GCODE_OPTIMIZER_DEFAULT_TOLERANCE    0.01
+
+// Moves shorter than this (in mm) don't move the machine at all.
+#define GCODE_OPTIMIZER_MIN_LENGTH           1e-9
+
+// What an optimization pass changed.
+struct GCodeOptimizerReport
+{
+    unsigned long mergedMoves;          // G01 moves that were merged in to the move after them.
+    unsigned long zeroLengthMoves;      // G00/G01 moves that didn't go anywhere.
+    unsigned long redundantFeedRates;   // F words that set the feed rate that was already in use.
+    unsigned long redundantModes;       // G90/G91 lines that set the mode that was already in use.
+    unsigned long linesRemoved;         // Lines that won't be written any more.
+};
+
+// Cuts down the number of commands in a program, so that the firmware spends less time reading them.  Runs
+// of G01 moves that go in the same direction at the same feed rate are merged in to one move (as long as no
+// point that is merged away is further than the tolerance from the new move, and the later move gives every
+// axis the earlier one did), moves that don't go anywhere (and don't change the motion mode) are deleted,
+// and F words and G90/G91 lines that don't change anything are taken out.  Lines that have comments, other
+// words (like M or E words), or relative moves are never merged away, and the G00/G01 words are left alone,
+// since the firmware expects one on every move.
+class GCodeMoveOptimizer
+{
+public:
+    GCodeMoveOptimizer();
+
+    void setTolerance(double tolerance);
+
+    void optimize(GCodeProgram &program, GCodeOptimizerReport *report);
+
+private:
+    double mTolerance;
+};
+
+#endif // GCODEMOVEOPTIMIZER_H
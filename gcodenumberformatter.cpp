@@ -0,0 +1,175 @@
+#include "gcodenumberformatter.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// Anything that scales to more than this won't fit in 64 bits, and is sent to snprintf().
+#define GCODE_NUMBER_MAX_SCALED              9.0e18
+
+static const unsigned long long powersOfTen[GCODE_NUMBER_MAX_FAST_DECIMALS + 1] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL
+};
+
+/**
+ * @brief GCodeNumberFormatter::formatFixed - Write a number with a fixed number of decimal places.  The
+ *      value is scaled up and rounded to an integer, and the digits are written from that, so no strings
+ *      are allocated.  The rounding is decided on the exact value of the double (the rounding error of the
+ *      scaling is recovered with fma()), so the digits are the same ones QString::number() writes.  Values
+ *      that are exactly half way between two outputs round away from zero, the way QString::number() does.
+ *      (glibc's printf() rounds those to even instead, so "%.2f" writes 0.125 as "0.12", where this
+ *      writes "0.13".)
+ *
+ * @param buffer - Where to write the number.  Must have room for GCODE_NUMBER_MAX_LENGTH characters.  The
+ *      number is not nul terminated.
+ * @param value - The number to write.
+ * @param decimals - The number of decimal places to write.
+ * @param trimZeros - If true, trailing zeros after the decimal point are left off, along with the decimal
+ *      point itself if nothing is left after it.  ("1.5000" becomes "1.5", and "2.0000" becomes "2".)
+ *
+ * @return size_t containing the number of characters written.
+ */
+size_t GCodeNumberFormatter::formatFixed(char *buffer, double value, int decimals, bool trimZeros)
+{
+    unsigned long long scaled;
+    unsigned long long integerPart;
+    unsigned long long fractionPart;
+    char digits[24];
+    double scaledValue;
+    double scaleError;
+    double wholeValue;
+    double roundDirection;
+    size_t length = 0;
+    int digitCount = 0;
+
+    if (decimals < 0) {
+        decimals = 0;
+    }
+
+    if (decimals > GCODE_NUMBER_MAX_FAST_DECIMALS) {
+        return formatSlow(buffer, value, decimals, trimZeros);
+    }
+
+    scaledValue = fabs(value) * (double)powersOfTen[decimals];
+
+    // This also catches NaN, since the comparison is false for it.
+    if ((scaledValue < GCODE_NUMBER_MAX_SCALED) == false) {
+        return formatSlow(buffer, value, decimals, trimZeros);
+    }
+
+    // scaledValue + scaleError is exactly |value| * 10^decimals, so the rounding doesn't depend on which way
+    // the multiply happened to round.  (Adding 0.5 to scaledValue would round 1.0005 up to 1.001, say,
+    // when the double is really 1.000499999...)
+    scaleError = fma(fabs(value), (double)powersOfTen[decimals], -scaledValue);
+    wholeValue = floor(scaledValue);
+
+    // Both parts of this are exact, and the sign of a sum is always right, even when it is rounded.
+    roundDirection = ((scaledValue - wholeValue) - 0.5) + scaleError;
+
+    scaled = (unsigned long long)wholeValue;
+    if (roundDirection >= 0) {
+        scaled++;
+    }
+    integerPart = scaled / powersOfTen[decimals];
+    fractionPart = scaled % powersOfTen[decimals];
+
+    // Don't write "-0.0000" for something that rounded to zero.
+    if ((value < 0) && (scaled != 0)) {
+        buffer[length++] = '-';
+    }
+
+    do {
+        digits[digitCount++] = '0' + (char)(integerPart % 10);
+        integerPart /= 10;
+    } while (integerPart != 0);
+
+    while (digitCount > 0) {
+        buffer[length++] = digits[--digitCount];
+    }
+
+    if (decimals == 0) {
+        return length;
+    }
+
+    if (trimZeros == true) {
+        if (fractionPart == 0) {
+            return length;
+        }
+
+        while ((fractionPart % 10) == 0) {
+            fractionPart /= 10;
+            decimals--;
+        }
+    }
+
+    buffer[length++] = '.';
+
+    // Fill the fraction in from the right, so that leading zeros come out as well.
+    for (int i = decimals - 1; i >= 0; i--) {
+        buffer[length + i] = '0' + (char)(fractionPart % 10);
+        fractionPart /= 10;
+    }
+
+    return length + decimals;
+}
+
+/**
+ * @brief GCodeNumberFormatter::formatSlow - Format a number with snprintf(), for the values that
+ *      formatFixed() can't handle with integer arithmetic.
+ *
+ * @param buffer - Where to write the number.  Must have room for GCODE_NUMBER_MAX_LENGTH characters.
+ * @param value - The number to write.
+ * @param decimals - The number of decimal places to write.
+ * @param trimZeros - If true, trailing zeros after the decimal point are left off.
+ *
+ * @return size_t containing the number of characters written.
+ */
+size_t GCodeNumberFormatter::formatSlow(char *buffer, double value, int decimals, bool trimZeros)
+{
+    char text[512];
+    int length;
+
+    length = snprintf(text, sizeof(text), "%.*f", decimals, value);
+    if (length < 0) {
+        return 0;
+    }
+
+    // Numbers this big (or this precise) can't be useful in G-code, so just keep the start of it.
+    if (length > GCODE_NUMBER_MAX_LENGTH) {
+        length = GCODE_NUMBER_MAX_LENGTH;
+    }
+
+    memcpy(buffer, text, length);
+
+    if (trimZeros == true) {
+        return trimTrailingZeros(buffer, length);
+    }
+
+    return length;
+}
+
+/**
+ * @brief GCodeNumberFormatter::trimTrailingZeros - Drop the zeros from the end of a formatted number (and
+ *      the decimal point, if that is all that is left after it.)
+ *
+ * @param buffer - The formatted number.
+ * @param length - The length of the formatted number.
+ *
+ * @return size_t containing the new length.
+ */
+size_t GCodeNumberFormatter::trimTrailingZeros(char *buffer, size_t length)
+{
+    if (memchr(buffer, '.', length) == NULL) {
+        return length;
+    }
+
+    while ((length > 0) && (buffer[length - 1] == '0')) {
+        length--;
+    }
+
+    if ((length > 0) && (buffer[length - 1] == '.')) {
+        length--;
+    }
+
+    return length;
+}
@@ -0,0 +1,24 @@
+#ifndef GCODENUMBERFORMATTER_H
+#define GCODENUMBERFORMATTER_H
+
+#include <stddef.h>
+
+// The most characters formatFixed() will write.  (Including the sign and decimal point, but not a terminator.)
+#define GCODE_NUMBER_MAX_LENGTH              32
+
+// The most decimal places that are formatted with integer arithmetic.  More than this falls back to snprintf().
+#define GCODE_NUMBER_MAX_FAST_DECIMALS       9
+
+// Writes fixed point numbers (the way QString::number(value, 'f', decimals) does) straight in to a
+// byte buffer, without building any strings along the way.
+class GCodeNumberFormatter
+{
+public:
+    static size_t formatFixed(char *buffer, double value, int decimals, bool trimZeros);
+
+private:
+    static size_t formatSlow(char *buffer, double value, int decimals, bool trimZeros);
+    static size_t trimTrailingZeros(char *buffer, size_t length);
+};
+
+#endif // GCODENUMBERFORMATTER_H
@@ -0,0 +1,107 @@
+#include "gcodeoutput.h"
+#include "gcodescanner.h"
+#include "profiler.h"
+
+GCodeMemoryOutput::GCodeMemoryOutput(QByteArray *buffer)
+{
+    mBuffer = buffer;
+}
+
+/**
+ * @brief GCodeMemoryOutput::write - Append data to the end of the buffer.
+ *
+ * @param data - The data to append.
+ * @param length - The number of bytes in data.
+ */
+void GCodeMemoryOutput::write(const char *data, size_t length)
+{
+    mBuffer->append(data, (int)length);
+}
+
+/**
+ * @brief GCodeNullOutput::write - Ignore the data.
+ */
+void GCodeNullOutput::write(const char *, size_t)
+{
+}
+
+GCodeLineOutput::GCodeLineOutput(GCodeOutput *output, int profileStage)
+{
+    mOutput = output;
+    mProfileStage = profileStage;
+    mBytesIn = 0;
+    mLinesIn = 0;
+}
+
+/**
+ * @brief GCodeLineOutput::setOutput - Set where the lines go once they have been processed.
+ *
+ * @param output - The next output.
+ */
+void GCodeLineOutput::setOutput(GCodeOutput *output)
+{
+    mOutput = output;
+}
+
+/**
+ * @brief GCodeLineOutput::write - Take some more of the program.  Each line is passed to processLine() as
+ *      soon as it is complete.  (The rest is held on to until the next write(), or finish().)
+ *
+ * @param data - The text to add.
+ * @param length - The length of the text.
+ */
+void GCodeLineOutput::write(const char *data, size_t length)
+{
+    const char *end = data + length;
+    const char *lineEnd;
+
+    PROFILE_SCOPE(mProfileStage);
+
+    mBytesIn += length;
+
+    if (mPartialLine.isEmpty() == false) {
+        // Finish off the line that was started in the last write.
+        lineEnd = GCodeScanner::findNewline(data, end);
+        if (lineEnd == end) {
+            mPartialLine.append(data, length);
+            return;
+        }
+
+        mPartialLine.append(data, (lineEnd - data) + 1);
+        processLine(mPartialLine.constData(), mPartialLine.size());
+        mPartialLine.clear();
+        mLinesIn++;
+        data = lineEnd + 1;
+    }
+
+    while (data < end) {
+        lineEnd = GCodeScanner::findNewline(data, end);
+        if (lineEnd == end) {
+            mPartialLine.append(data, end - data);
+            return;
+        }
+
+        processLine(data, (lineEnd - data) + 1);
+        mLinesIn++;
+        data = lineEnd + 1;
+    }
+}
+
+/**
+ * @brief GCodeLineOutput::finish - Pass on the last line, if it didn't have a line ending.
+ */
+void GCodeLineOutput::finish()
+{
+    PROFILE_SCOPE(mProfileStage);
+
+    if (mPartialLine.isEmpty() == false) {
+        processLine(mPartialLine.constData(), mPartialLine.size());
+        mPartialLine.clear();
+        mLinesIn++;
+    }
+
+    PROFILE_COUNT(mProfileStage, PROFILE_COUNTER_BYTES_IN, mBytesIn);
+    PROFILE_COUNT(mProfileStage, PROFILE_COUNTER_LINES, mLinesIn);
+    mBytesIn = 0;
+    mLinesIn = 0;
+}
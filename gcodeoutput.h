@@ -0,0 +1,63 @@
+#ifndef GCODEOUTPUT_H
+#define GCODEOUTPUT_H
+
+#include <QByteArray>
+
+#include <stddef.h>
+
+// Somewhere that processed G-code can be written to.
+class GCodeOutput
+{
+public:
+    virtual ~GCodeOutput() {}
+
+    virtual void write(const char *data, size_t length) = 0;
+};
+
+// Collects the output in memory.  (Used for the chunks of a file that are processed in parallel.)
+class GCodeMemoryOutput : public GCodeOutput
+{
+public:
+    GCodeMemoryOutput(QByteArray *buffer);
+
+    void write(const char *data, size_t length);
+
+private:
+    QByteArray *mBuffer;
+};
+
+// Throws the output away.
+class GCodeNullOutput : public GCodeOutput
+{
+public:
+    void write(const char *data, size_t length);
+};
+
+// Splits what is written to it in to lines, and hands each one to processLine() as soon as it is complete.
+// (Used by the stages that change the program as it is written.)  The time spent in the stage, and the
+// lines and bytes that went through it, are added to the profiler.
+class GCodeLineOutput : public GCodeOutput
+{
+public:
+    GCodeLineOutput(GCodeOutput *output, int profileStage);
+
+    void setOutput(GCodeOutput *output);
+
+    void write(const char *data, size_t length);
+    virtual void finish();
+
+protected:
+    // line includes its line ending, if it has one.  (Only the last line of a program can be without one.)
+    virtual void processLine(const char *line, size_t length) = 0;
+
+    GCodeOutput *mOutput;           // Where the lines go once they have been processed.
+
+private:
+    QByteArray mPartialLine;        // The start of a line that hasn't been finished yet.
+
+    int mProfileStage;              // PROFILE_STAGE_*
+    quint64 mBytesIn;               // Since they were last added to the profiler.
+    quint64 mLinesIn;
+};
+
+#endif // GCODEOUTPUT_H
@@ -0,0 +1,607 @@
+#include "gcodepiecetable.h"
+#include "gcodeoutput.h"
+#include "gcodescanner.h"
+
+GCodePieceTable::GCodePieceTable()
+{
+    clear();
+}
+
+/**
+ * @brief GCodePieceTable::clear - Forget the original file, every line that was added, and the undo history.
+ */
+void GCodePieceTable::clear()
+{
+    mOriginalData = NULL;
+    mOriginalOffsets.clear();
+    mAddedLines.clear();
+
+    // There is always at least one block, even if it is empty.
+    mBlocks.clear();
+    mBlocks.append(GCodePieceBlock());
+    mBlocks[0].lineCount = 0;
+    mLineCount = 0;
+
+    mCachedBlock = 0;
+    mCachedBlockStart = 0;
+
+    clearHistory();
+}
+
+/**
+ * @brief GCodePieceTable::setOriginal - Start over with a new original file.  Only an index of where each
+ *      line starts is built, the data itself isn't copied.
+ *
+ * @param data - The contents of the file.  It must stay valid (and unchanged) until clear() or setOriginal()
+ *      is called again.
+ * @param size - The size of the file.
+ */
+void GCodePieceTable::setOriginal(const char *data, qint64 size)
+{
+    const char *cursor = data;
+    const char *end = data + size;
+    GCodePiece piece;
+    int lineCount;
+    int line = 0;
+
+    clear();
+
+    if (size <= 0) {
+        return;
+    }
+
+    mOriginalData = data;
+
+    // Count the lines first so the index is only allocated once.
+    lineCount = GCodeScanner::countNewlines(cursor, end);
+    if (end[-1] != '\n') {
+        lineCount++;
+    }
+
+    mOriginalOffsets.resize(lineCount + 1);
+
+    while (cursor < end) {
+        mOriginalOffsets[line++] = cursor - data;
+        cursor = GCodeScanner::findNewline(cursor, end) + 1;
+    }
+
+    mOriginalOffsets[line] = size;
+
+    piece.added = false;
+    piece.start = 0;
+    piece.count = lineCount;
+
+    mBlocks[0].pieces.append(piece);
+    mBlocks[0].lineCount = lineCount;
+    mLineCount = lineCount;
+}
+
+/**
+ * @brief GCodePieceTable::getLineCount - Returns the number of lines in the file, with all of the edits.
+ *
+ * @return int containing the number of lines.
+ */
+int GCodePieceTable::getLineCount()
+{
+    return mLineCount;
+}
+
+/**
+ * @brief GCodePieceTable::getLine - Get the text of a line (without a line ending).  Lines from the original
+ *      file refer to its data, and are only valid until the original is changed.
+ *
+ * @param index - The line to get.
+ *
+ * @return QByteArray containing the line, or an empty QByteArray if index is out of range.
+ */
+QByteArray GCodePieceTable::getLine(int index)
+{
+    int block, piece, offset;
+    const char *start;
+    const char *end;
+    int line;
+
+    if ((index < 0) || (index >= mLineCount)) {
+        return QByteArray();
+    }
+
+    locate(index, &block, &piece, &offset);
+
+    const GCodePiece &found = mBlocks.at(block).pieces.at(piece);
+    line = found.start + offset;
+
+    if (found.added == true) {
+        return mAddedLines.at(line);
+    }
+
+    start = mOriginalData + mOriginalOffsets.at(line);
+    end = mOriginalData + mOriginalOffsets.at(line + 1);
+
+    if ((end > start) && (end[-1] == '\n')) {
+        end--;
+    }
+
+    if ((end > start) && (end[-1] == '\r')) {
+        end--;
+    }
+
+    return QByteArray::fromRawData(start, end - start);
+}
+
+/**
+ * @brief GCodePieceTable::insertLine - Insert a new line before an existing one.
+ *
+ * @param index - The line to insert before.  (Or the line count, to add to the end of the file.)
+ * @param line - The text of the new line, without a line ending.
+ */
+void GCodePieceTable::insertLine(int index, const QByteArray &line)
+{
+    QVector<GCodePiece> inserted;
+    GCodePiece piece;
+
+    if ((index < 0) || (index > mLineCount)) {
+        return;
+    }
+
+    mAddedLines.append(line);
+
+    piece.added = true;
+    piece.start = mAddedLines.size() - 1;
+    piece.count = 1;
+    inserted.append(piece);
+
+    putPieces(index, inserted);
+    recordEdit(index, QVector<GCodePiece>(), inserted);
+}
+
+/**
+ * @brief GCodePieceTable::replaceLine - Replace the text of an existing line.
+ *
+ * @param index - The line to replace.
+ * @param line - The new text of the line, without a line ending.
+ */
+void GCodePieceTable::replaceLine(int index, const QByteArray &line)
+{
+    QVector<GCodePiece> removed;
+    QVector<GCodePiece> inserted;
+    GCodePiece piece;
+
+    if ((index < 0) || (index >= mLineCount)) {
+        return;
+    }
+
+    removed = takePieces(index, 1);
+
+    mAddedLines.append(line);
+
+    piece.added = true;
+    piece.start = mAddedLines.size() - 1;
+    piece.count = 1;
+    inserted.append(piece);
+
+    putPieces(index, inserted);
+    recordEdit(index, removed, inserted);
+}
+
+/**
+ * @brief GCodePieceTable::removeLines - Delete a range of lines.
+ *
+ * @param index - The first line to delete.
+ * @param count - The number of lines to delete.  (Anything past the end of the file is ignored.)
+ */
+void GCodePieceTable::removeLines(int index, int count)
+{
+    QVector<GCodePiece> removed;
+
+    if ((index < 0) || (index >= mLineCount)) {
+        return;
+    }
+
+    if (count > (mLineCount - index)) {
+        count = mLineCount - index;
+    }
+
+    if (count <= 0) {
+        return;
+    }
+
+    removed = takePieces(index, count);
+    recordEdit(index, removed, QVector<GCodePiece>());
+}
+
+/**
+ * @brief GCodePieceTable::canUndo - Returns true if there is an edit that can be undone.
+ *
+ * @return true if undo() will do something.  false otherwise.
+ */
+bool GCodePieceTable::canUndo()
+{
+    return (mUndo.isEmpty() == false);
+}
+
+/**
+ * @brief GCodePieceTable::canRedo - Returns true if there is an undone edit that can be redone.
+ *
+ * @return true if redo() will do something.  false otherwise.
+ */
+bool GCodePieceTable::canRedo()
+{
+    return (mRedo.isEmpty() == false);
+}
+
+/**
+ * @brief GCodePieceTable::undo - Undo the last edit, by swapping the pieces it inserted for the ones it removed.
+ *
+ * @param line[out] - The line that the edit started at.
+ *
+ * @return true if an edit was undone.  false if there was nothing to undo.
+ */
+bool GCodePieceTable::undo(int *line)
+{
+    GCodePieceEdit edit;
+
+    if (mUndo.isEmpty() == true) {
+        return false;
+    }
+
+    edit = mUndo.last();
+    mUndo.removeLast();
+
+    takePieces(edit.line, countLines(edit.inserted));
+    putPieces(edit.line, edit.removed);
+
+    *line = edit.line;
+    mRedo.append(edit);
+
+    return true;
+}
+
+/**
+ * @brief GCodePieceTable::redo - Apply the last edit that was undone again.
+ *
+ * @param line[out] - The line after the last one that the edit inserted.
+ *
+ * @return true if an edit was redone.  false if there was nothing to redo.
+ */
+bool GCodePieceTable::redo(int *line)
+{
+    GCodePieceEdit edit;
+
+    if (mRedo.isEmpty() == true) {
+        return false;
+    }
+
+    edit = mRedo.last();
+    mRedo.removeLast();
+
+    takePieces(edit.line, countLines(edit.removed));
+    putPieces(edit.line, edit.inserted);
+
+    *line = edit.line + countLines(edit.inserted);
+    mUndo.append(edit);
+
+    return true;
+}
+
+/**
+ * @brief GCodePieceTable::clearHistory - Forget every edit, so none of them can be undone.
+ */
+void GCodePieceTable::clearHistory()
+{
+    mUndo.clear();
+    mRedo.clear();
+}
+
+/**
+ * @brief GCodePieceTable::write - Write every line out.  Runs of lines from the original file are written
+ *      in one go, straight from its data.
+ *
+ * @param output - Where to write the lines.
+ */
+void GCodePieceTable::write(GCodeOutput *output)
+{
+    qint64 start;
+    qint64 end;
+
+    for (int b = 0; b < mBlocks.size(); b++) {
+        const QVector<GCodePiece> &pieces = mBlocks.at(b).pieces;
+
+        for (int p = 0; p < pieces.size(); p++) {
+            const GCodePiece &piece = pieces.at(p);
+
+            if (piece.added == true) {
+                for (int i = piece.start; i < (piece.start + piece.count); i++) {
+                    output->write(mAddedLines.at(i).constData(), mAddedLines.at(i).size());
+                    output->write("\n", 1);
+                }
+                continue;
+            }
+
+            start = mOriginalOffsets.at(piece.start);
+            end = mOriginalOffsets.at(piece.start + piece.count);
+            output->write(mOriginalData + start, end - start);
+
+            // The last line of the file might not have had a line ending.
+            if (mOriginalData[end - 1] != '\n') {
+                output->write("\n", 1);
+            }
+        }
+    }
+}
+
+/**
+ * @brief GCodePieceTable::countLines - Add up the lines in a list of pieces.
+ *
+ * @param pieces - The pieces to count.
+ *
+ * @return int containing the number of lines.
+ */
+int GCodePieceTable::countLines(const QVector<GCodePiece> &pieces)
+{
+    int count = 0;
+
+    for (int i = 0; i < pieces.size(); i++) {
+        count += pieces.at(i).count;
+    }
+
+    return count;
+}
+
+/**
+ * @brief GCodePieceTable::locate - Find the piece that holds a line.
+ *
+ * @param index - The line to find.  Must be less than the line count.
+ * @param block[out] - The block the piece is in.
+ * @param piece[out] - The piece in the block.
+ * @param offset[out] - How far in to the piece the line is.
+ */
+void GCodePieceTable::locate(int index, int *block, int *piece, int *offset)
+{
+    int b = 0;
+    int blockStart = 0;
+    int p = 0;
+
+    // Start from the last block we found if we can, since lines tend to be looked at in order.
+    if ((mCachedBlock < mBlocks.size()) && (index >= mCachedBlockStart)) {
+        b = mCachedBlock;
+        blockStart = mCachedBlockStart;
+    }
+
+    while (index >= (blockStart + mBlocks.at(b).lineCount)) {
+        blockStart += mBlocks.at(b).lineCount;
+        b++;
+    }
+
+    mCachedBlock = b;
+    mCachedBlockStart = blockStart;
+
+    const QVector<GCodePiece> &pieces = mBlocks.at(b).pieces;
+
+    index -= blockStart;
+    while (index >= pieces.at(p).count) {
+        index -= pieces.at(p).count;
+        p++;
+    }
+
+    *block = b;
+    *piece = p;
+    *offset = index;
+}
+
+/**
+ * @brief GCodePieceTable::splitAt - Make sure that a piece starts at a line, splitting the piece that holds
+ *      it if needed.
+ *
+ * @param index - The line that a piece should start at.  (Or the line count, for the end of the file.)
+ * @param block[out] - The block that the piece starting at index is in.
+ * @param piece[out] - The piece starting at index.  (This is one past the last piece in the last block, if
+ *      index is the end of the file.)
+ */
+void GCodePieceTable::splitAt(int index, int *block, int *piece)
+{
+    GCodePiece tail;
+    int offset;
+
+    if (index >= mLineCount) {
+        *block = mBlocks.size() - 1;
+        *piece = mBlocks.last().pieces.size();
+        return;
+    }
+
+    locate(index, block, piece, &offset);
+    if (offset == 0) {
+        return;
+    }
+
+    GCodePiece &head = mBlocks[*block].pieces[*piece];
+
+    tail = head;
+    tail.start += offset;
+    tail.count -= offset;
+    head.count = offset;
+
+    (*piece)++;
+    mBlocks[*block].pieces.insert(*piece, tail);
+}
+
+/**
+ * @brief GCodePieceTable::takePieces - Take a range of lines out of the file.
+ *
+ * @param index - The first line to take.
+ * @param count - The number of lines to take.
+ *
+ * @return QVector<GCodePiece> containing the pieces that were taken out, in order.
+ */
+QVector<GCodePiece> GCodePieceTable::takePieces(int index, int count)
+{
+    QVector<GCodePiece> taken;
+    GCodePiece piece;
+    int block;
+    int p;
+
+    if (count <= 0) {
+        return taken;
+    }
+
+    // Split at the end first, so that splitting at the start can't move it.
+    splitAt(index + count, &block, &p);
+    splitAt(index, &block, &p);
+
+    while (count > 0) {
+        GCodePieceBlock &current = mBlocks[block];
+
+        if (p >= current.pieces.size()) {
+            block++;
+            p = 0;
+            continue;
+        }
+
+        piece = current.pieces.at(p);
+        current.pieces.remove(p);
+        current.lineCount -= piece.count;
+
+        taken.append(piece);
+        count -= piece.count;
+        mLineCount -= piece.count;
+    }
+
+    for (int b = mBlocks.size() - 1; (b >= 0) && (mBlocks.size() > 1); b--) {
+        if (mBlocks.at(b).pieces.isEmpty() == true) {
+            mBlocks.removeAt(b);
+        }
+    }
+
+    mCachedBlock = 0;
+    mCachedBlockStart = 0;
+
+    return taken;
+}
+
+/**
+ * @brief GCodePieceTable::putPieces - Put a list of pieces in to the file.  Pieces that carry straight on
+ *      from the piece before them (or in to the piece after them) are merged with it, so that a run of lines
+ *      added one at a time only takes up one piece, and undoing a delete puts the original piece back whole.
+ *
+ * @param index - The line to insert the pieces before.
+ * @param pieces - The pieces to insert.
+ */
+void GCodePieceTable::putPieces(int index, const QVector<GCodePiece> &pieces)
+{
+    GCodePiece *previous;
+    int previousBlock;
+    int block;
+    int p;
+
+    if (pieces.isEmpty() == true) {
+        return;
+    }
+
+    splitAt(index, &block, &p);
+
+    for (int i = 0; i <= pieces.size(); i++) {
+        previous = NULL;
+        previousBlock = block;
+
+        if (p > 0) {
+            previous = &mBlocks[block].pieces[p - 1];
+        } else if ((block > 0) && (mBlocks.at(block - 1).pieces.isEmpty() == false)) {
+            previousBlock = block - 1;
+            previous = &mBlocks[previousBlock].pieces.last();
+        }
+
+        if (i == pieces.size()) {
+            // Everything is in, see if the last piece joins up with the one that follows it.
+            if ((previous != NULL) && (p < mBlocks.at(block).pieces.size())) {
+                const GCodePiece next = mBlocks.at(block).pieces.at(p);
+
+                if ((previous->added == next.added) && ((previous->start + previous->count) == next.start)) {
+                    previous->count += next.count;
+                    mBlocks[previousBlock].lineCount += next.count;
+                    mBlocks[block].pieces.remove(p);
+                    mBlocks[block].lineCount -= next.count;
+                }
+            }
+            break;
+        }
+
+        const GCodePiece &piece = pieces.at(i);
+
+        if ((previous != NULL) && (previous->added == piece.added) && ((previous->start + previous->count) == piece.start)) {
+            previous->count += piece.count;
+            mBlocks[previousBlock].lineCount += piece.count;
+        } else {
+            mBlocks[block].pieces.insert(p, piece);
+            mBlocks[block].lineCount += piece.count;
+            p++;
+        }
+
+        mLineCount += piece.count;
+    }
+
+    splitLargeBlock(block);
+
+    mCachedBlock = 0;
+    mCachedBlockStart = 0;
+}
+
+/**
+ * @brief GCodePieceTable::splitLargeBlock - Split a block that has grown past GCODE_PIECE_BLOCK_SIZE pieces
+ *      in to smaller blocks.
+ *
+ * @param block - The block to check.
+ */
+void GCodePieceTable::splitLargeBlock(int block)
+{
+    GCodePieceBlock tail;
+    int keep = GCODE_PIECE_BLOCK_SIZE / 2;
+
+    while (mBlocks.at(block).pieces.size() > GCODE_PIECE_BLOCK_SIZE) {
+        GCodePieceBlock &head = mBlocks[block];
+
+        tail.pieces = head.pieces.mid(keep);
+        tail.lineCount = countLines(tail.pieces);
+
+        head.pieces.resize(keep);
+        head.lineCount -= tail.lineCount;
+
+        mBlocks.insert(block + 1, tail);
+        block++;
+    }
+}
+
+/**
+ * @brief GCodePieceTable::recordEdit - Add an edit to the undo history.  Lines inserted one after another
+ *      (like a program being generated) are kept as a single edit, so they don't fill up the history.
+ *
+ * @param line - The line the edit started at.
+ * @param removed - The pieces that the edit removed.
+ * @param inserted - The pieces that the edit inserted.
+ */
+void GCodePieceTable::recordEdit(int line, const QVector<GCodePiece> &removed, const QVector<GCodePiece> &inserted)
+{
+    GCodePieceEdit edit;
+
+    mRedo.clear();
+
+    if ((removed.isEmpty() == true) && (mUndo.isEmpty() == false)) {
+        GCodePieceEdit &last = mUndo.last();
+
+        if ((last.removed.isEmpty() == true) && (line == (last.line + countLines(last.inserted)))) {
+            for (int i = 0; i < inserted.size(); i++) {
+                GCodePiece &end = last.inserted.last();
+
+                if ((end.added == inserted.at(i).added) && ((end.start + end.count) == inserted.at(i).start)) {
+                    end.count += inserted.at(i).count;
+                } else {
+                    last.inserted.append(inserted.at(i));
+                }
+            }
+            return;
+        }
+    }
+
+    edit.line = line;
+    edit.removed = removed;
+    edit.inserted = inserted;
+    mUndo.append(edit);
+}
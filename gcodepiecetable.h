@@ -0,0 +1,88 @@
+#ifndef GCODEPIECETABLE_H
+#define GCODEPIECETABLE_H
+
+#include <QList>
+#include <QVector>
+#include <QByteArray>
+
+class GCodeOutput;
+
+// The most pieces kept in one block before it is split in two.
+#define GCODE_PIECE_BLOCK_SIZE               512
+
+// A run of consecutive lines from either the original file, or the lines that have been added since.
+struct GCodePiece
+{
+    bool added;         // true if the lines are in the added lines, false if they are in the original file.
+    int start;          // The first line of the run.
+    int count;          // The number of lines in the run.
+};
+
+// A group of pieces, so that an insert only has to move the pieces in one block.
+struct GCodePieceBlock
+{
+    QVector<GCodePiece> pieces;
+    int lineCount;
+};
+
+// One edit, with what it removed and what it inserted, so that it can be undone (and redone).
+struct GCodePieceEdit
+{
+    int line;
+    QVector<GCodePiece> removed;
+    QVector<GCodePiece> inserted;
+};
+
+// The lines of a G-code file, kept as a piece table.  The original file is never changed, and lines that
+// are added are only ever appended to a second list.  The file is described by a list of pieces that
+// point in to one or the other, so inserting, deleting, or replacing lines anywhere in a large file only
+// changes a few pieces.  Since nothing is ever thrown away, undoing an edit just means putting the old
+// pieces back.
+class GCodePieceTable
+{
+public:
+    GCodePieceTable();
+
+    void clear();
+    void setOriginal(const char *data, qint64 size);
+
+    int getLineCount();
+    QByteArray getLine(int index);
+
+    void insertLine(int index, const QByteArray &line);
+    void replaceLine(int index, const QByteArray &line);
+    void removeLines(int index, int count);
+
+    bool canUndo();
+    bool canRedo();
+    bool undo(int *line);
+    bool redo(int *line);
+    void clearHistory();
+
+    void write(GCodeOutput *output);
+
+private:
+    int countLines(const QVector<GCodePiece> &pieces);
+    void locate(int index, int *block, int *piece, int *offset);
+    void splitAt(int index, int *block, int *piece);
+    QVector<GCodePiece> takePieces(int index, int count);
+    void putPieces(int index, const QVector<GCodePiece> &pieces);
+    void splitLargeBlock(int block);
+    void recordEdit(int line, const QVector<GCodePiece> &removed, const QVector<GCodePiece> &inserted);
+
+    const char *mOriginalData;          // The original file.  (Not owned by us.)
+    QVector<qint64> mOriginalOffsets;   // Where each original line starts, plus one entry for the end of the data.
+    QList<QByteArray> mAddedLines;      // Every line that has been added, in the order they were added.
+
+    QList<GCodePieceBlock> mBlocks;
+    int mLineCount;
+
+    // The block that was last found, so that walking through the lines doesn't search from the start each time.
+    int mCachedBlock;
+    int mCachedBlockStart;
+
+    QVector<GCodePieceEdit> mUndo;
+    QVector<GCodePieceEdit> mRedo;
+};
+
+#endif // GCODEPIECETABLE_H
@@ -0,0 +1,924 @@
+#include "gcodeprogram.h"
+#include "gcodeoutput.h"
+#include "gcodescanner.h"
+#include "gcodetokenizer.h"
+#include "gcodenumberformatter.h"
+#include "profiler.h"
+
+#include <string.h>
+
+// A change to make to a line while it is written.
+struct GCodeProgramEdit
+{
+    size_t start;                   // Relative to the start of the line.
+    size_t end;
+    const char *prefix;             // Written before the replacement.
+    const QByteArray *replacement;  // Or NULL if there is only the prefix.
+};
+
+// Flags for the lines that can't be written straight from the text.
+#define GCODE_LINE_EDITED                    (GCODE_LINE_FEED_CHANGED | GCODE_LINE_SPINDLE_STOP_REPLACED | \
+                                              GCODE_LINE_COMMENTS_STRIPPED | GCODE_LINE_DELETED | GCODE_LINE_FEED_REMOVED | \
+                                              GCODE_LINE_REPLACED)
+
+/**
+ * @brief isBlank - Check if a character is a space or a tab.
+ *
+ * @param character - The character to check.
+ *
+ * @return true if it is a space or a tab.
+ */
+static inline bool isBlank(char character)
+{
+    return ((character == ' ') || (character == '\t'));
+}
+
+GCodeProgram::GCodeProgram()
+{
+    clear();
+}
+
+/**
+ * @brief GCodeProgram::clear - Throw away every line.
+ */
+void GCodeProgram::clear()
+{
+    mCommand.clear();
+    mFlags.clear();
+    mX.clear();
+    mY.clear();
+    mZ.clear();
+    mF.clear();
+    mFeedStart.clear();
+    mFeedEnd.clear();
+    mSpindleStopStart.clear();
+    mSpindleStopEnd.clear();
+    mWordsEnd.clear();
+    mFeedText.clear();
+
+    mText.clear();
+    mLineStart.clear();
+    mLineStart.append(0);
+
+    mComments.clear();
+    mFeedTexts.clear();
+    mFeedTextIndex.clear();
+    mArcCentres.clear();
+    mReplacements.clear();
+    mOrder.clear();
+}
+
+/**
+ * @brief GCodeProgram::parse - Replace the program with the G-code in a block of text.
+ *
+ * @param data - The G-code.  (It is copied, so it doesn't need to stay around.)
+ * @param size - The size of the G-code.
+ */
+void GCodeProgram::parse(const char *data, qint64 size)
+{
+    const char *cursor;
+    const char *end;
+    int lineCount;
+
+    PROFILE_SCOPE(PROFILE_STAGE_PARSE);
+
+    clear();
+
+    if (size <= 0) {
+        return;
+    }
+
+    mText = QByteArray(data, size);
+    cursor = mText.constData();
+    end = cursor + size;
+
+    // Size every array once, up front.
+    lineCount = GCodeScanner::countNewlines(cursor, end);
+    if (end[-1] != '\n') {
+        lineCount++;
+    }
+
+    mCommand.reserve(lineCount);
+    mFlags.reserve(lineCount);
+    mX.reserve(lineCount);
+    mY.reserve(lineCount);
+    mZ.reserve(lineCount);
+    mF.reserve(lineCount);
+    mFeedStart.reserve(lineCount);
+    mFeedEnd.reserve(lineCount);
+    mSpindleStopStart.reserve(lineCount);
+    mSpindleStopEnd.reserve(lineCount);
+    mWordsEnd.reserve(lineCount);
+    mFeedText.reserve(lineCount);
+    mLineStart.reserve(lineCount + 1);
+
+    PROFILE_COUNT(PROFILE_STAGE_PARSE, PROFILE_COUNTER_BYTES_IN, size);
+    PROFILE_COUNT(PROFILE_STAGE_PARSE, PROFILE_COUNTER_LINES, lineCount);
+
+    while (cursor < end) {
+        const char *lineEnd = GCodeScanner::findNewline(cursor, end);
+
+        if (lineEnd < end) {
+            lineEnd++;
+        }
+
+        parseLine(cursor - mText.constData(), lineEnd - mText.constData());
+        cursor = lineEnd;
+    }
+}
+
+/**
+ * @brief GCodeProgram::appendLine - Add a line to the end of the program.
+ *
+ * @param line - The text of the line.  A line ending is added if it doesn't have one.
+ * @param length - The length of the line.
+ */
+void GCodeProgram::appendLine(const char *line, size_t length)
+{
+    qint64 start;
+
+    // Don't let the new line run on from a last line that didn't have a line ending.
+    if ((mText.isEmpty() == false) && (mText.at(mText.size() - 1) != '\n')) {
+        mText.append('\n');
+        mLineStart.last() = mText.size();
+    }
+
+    start = mText.size();
+    mText.append(line, length);
+
+    if ((length == 0) || (line[length - 1] != '\n')) {
+        mText.append('\n');
+    }
+
+    parseLine(start, mText.size());
+}
+
+/**
+ * @brief GCodeProgram::write - Write the program out as text, in the order set by setLineOrder() if there is
+ *      one.  Runs of lines that haven't been changed, and that are still one after the other, are written in
+ *      one go, straight from the text that was parsed.
+ *
+ * @param output - Where to write the G-code.
+ */
+void GCodeProgram::write(GCodeOutput *output) const
+{
+    const quint32 *flags = mFlags.constData();
+    const char *text = mText.constData();
+    int lineCount = mFlags.size();
+    bool endsWithNewline = ((mText.isEmpty() == true) || (mText.at(mText.size() - 1) == '\n'));
+    QByteArray editBuffer;
+    QByteArray stripBuffer;
+    int runStart = 0;
+    int runEnd = 0;
+    int line;
+
+    for (int i = 0; i <= lineCount; i++) {
+        line = (i < lineCount) ? lineAt(i) : -1;
+
+        if ((line == runEnd) && ((flags[line] & GCODE_LINE_EDITED) == 0)) {
+            runEnd++;
+            continue;
+        }
+
+        // Lines runStart to runEnd - 1 are unchanged.
+        if (runEnd > runStart) {
+            output->write(text + mLineStart.at(runStart), mLineStart.at(runEnd) - mLineStart.at(runStart));
+
+            // The last line read might not have had a line ending, but it needs one if it has been moved.
+            if ((runEnd == lineCount) && (endsWithNewline == false) && (i < lineCount)) {
+                output->write("\n", 1);
+            }
+        }
+
+        if (line < 0) {
+            break;
+        }
+
+        if ((flags[line] & GCODE_LINE_EDITED) != 0) {
+            writeLine(line, output, editBuffer, stripBuffer);
+
+            if ((line == (lineCount - 1)) && (endsWithNewline == false) && (i < (lineCount - 1))) {
+                output->write("\n", 1);
+            }
+
+            runStart = line + 1;
+            runEnd = line + 1;
+        } else {
+            runStart = line;
+            runEnd = line + 1;
+        }
+    }
+}
+
+/**
+ * @brief GCodeProgram::getLineText - Get the text of a line, as it was parsed.  (Without any of the changes
+ *      that have been made to it, and without a line ending.)
+ *
+ * @param line - The line to get.
+ *
+ * @return QByteArray containing the text.
+ */
+QByteArray GCodeProgram::getLineText(int line) const
+{
+    const char *start = mText.constData() + mLineStart.at(line);
+    const char *end = mText.constData() + mLineStart.at(line + 1);
+
+    if ((end > start) && (end[-1] == '\n')) {
+        end--;
+    }
+
+    if ((end > start) && (end[-1] == '\r')) {
+        end--;
+    }
+
+    return QByteArray(start, end - start);
+}
+
+/**
+ * @brief GCodeProgram::getFeedRateText - Get the text of the value of the F word on a line.  (The new value,
+ *      if it has been changed.)
+ *
+ * @param line - The line to get the feed rate from.
+ *
+ * @return QByteArray containing the feed rate, or an empty QByteArray if the line doesn't have one.
+ */
+QByteArray GCodeProgram::getFeedRateText(int line) const
+{
+    const char *start;
+
+    if ((mFlags.at(line) & GCODE_LINE_FEED_REMOVED) != 0) {
+        return QByteArray();
+    }
+
+    if ((mFlags.at(line) & GCODE_LINE_FEED_CHANGED) != 0) {
+        return mFeedTexts.at(mFeedText.at(line));
+    }
+
+    if ((mFlags.at(line) & GCODE_LINE_HAS_F) == 0) {
+        return QByteArray();
+    }
+
+    if ((mFlags.at(line) & GCODE_LINE_REPLACED) != 0) {
+        const QByteArray &text = mReplacements[line];
+        GCodeTokenizer tokenizer(text.constData(), text.size());
+        GCodeWord word;
+
+        while (tokenizer.nextWord(&word) == true) {
+            if (word.letter == 'F') {
+                return QByteArray(word.valueStart, word.end - word.valueStart);
+            }
+        }
+        return QByteArray();
+    }
+
+    start = mText.constData() + mLineStart.at(line);
+    return QByteArray(start + mFeedStart.at(line), mFeedEnd.at(line) - mFeedStart.at(line));
+}
+
+/**
+ * @brief GCodeProgram::getComments - Get the comments on a line.
+ *
+ * @param line - The line to get the comments from.
+ *
+ * @return QList<QByteArray> containing each comment, including the "()" or ';'.
+ */
+QList<QByteArray> GCodeProgram::getComments(int line) const
+{
+    QList<QByteArray> comments;
+    const char *start = mText.constData() + mLineStart.at(line);
+    int first = 0;
+    int last = mComments.size();
+    int middle;
+
+    if ((mFlags.at(line) & GCODE_LINE_COMMENT) == 0) {
+        return comments;
+    }
+
+    // Find the first comment for the line.
+    while (first < last) {
+        middle = (first + last) / 2;
+        if (mComments.at(middle).line < line) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+
+    for (int i = first; (i < mComments.size()) && (mComments.at(i).line == line); i++) {
+        comments.append(QByteArray(start + mComments.at(i).start, mComments.at(i).end - mComments.at(i).start));
+    }
+
+    return comments;
+}
+
+/**
+ * @brief GCodeProgram::getArcCentre - Get the centre of the arc on a line.
+ *
+ * @param line - The line to get the centre from.
+ * @param centre[out] - The centre, relative to where the arc starts.
+ *
+ * @return true if the line is a G02/G03 with an I or J word.  false otherwise.
+ */
+bool GCodeProgram::getArcCentre(int line, GCodeArcCentre *centre) const
+{
+    QHash<int, GCodeArcCentre>::const_iterator found;
+
+    if ((mCommand.at(line) != GCODE_COMMAND_G2) && (mCommand.at(line) != GCODE_COMMAND_G3)) {
+        return false;
+    }
+
+    found = mArcCentres.constFind(line);
+    if (found == mArcCentres.constEnd()) {
+        return false;
+    }
+
+    *centre = found.value();
+    return true;
+}
+
+/**
+ * @brief GCodeProgram::setFeedRate - Change the feed rate on a line.  If the line doesn't have an F word, one
+ *      is added after the last word.
+ *
+ * @param line - The line to change.
+ * @param text - The new value of the F word, as it should be written.
+ */
+void GCodeProgram::setFeedRate(int line, const QByteArray &text)
+{
+    int index;
+
+    if ((mFlags.at(line) & GCODE_LINE_FIXED) != 0) {
+        return;
+    }
+
+    index = mFeedTextIndex.value(text, -1);
+    if (index < 0) {
+        index = mFeedTexts.size();
+        mFeedTexts.append(text);
+        mFeedTextIndex.insert(text, index);
+    }
+
+    mFeedText[line] = index;
+    mF[line] = GCodeTokenizer::parseNumber(text.constData(), text.constData() + text.size());
+    mFlags[line] = (mFlags.at(line) & ~GCODE_LINE_FEED_REMOVED) | GCODE_LINE_FEED_CHANGED;
+}
+
+/**
+ * @brief GCodeProgram::setFeedRate - Change the feed rate on a line.
+ *
+ * @param line - The line to change.
+ * @param feedRate - The new feed rate.  (Written with up to four decimal places.)
+ */
+void GCodeProgram::setFeedRate(int line, double feedRate)
+{
+    char text[GCODE_NUMBER_MAX_LENGTH];
+    size_t length;
+
+    length = GCodeNumberFormatter::formatFixed(text, feedRate, 4, true);
+    setFeedRate(line, QByteArray(text, length));
+}
+
+/**
+ * @brief GCodeProgram::removeFeedRate - Write a line without its F word.  A line that is nothing but the F
+ *      word is deleted, unless it has a comment that is being kept.  (Then the comment is left on a line of
+ *      its own.)
+ *
+ * @param line - The line to change.
+ *
+ * @return true if the F word will be left out.  false if the line doesn't have one, or can't be edited.
+ */
+bool GCodeProgram::removeFeedRate(int line)
+{
+    quint32 flags = mFlags.at(line);
+
+    if ((flags & GCODE_LINE_FIXED) != 0) {
+        return false;
+    }
+
+    if ((flags & GCODE_LINE_HAS_F) == 0) {
+        // The only F word is one that was going to be added.
+        if ((flags & GCODE_LINE_FEED_CHANGED) == 0) {
+            return false;
+        }
+
+        mFlags[line] = flags & ~GCODE_LINE_FEED_CHANGED;
+        return true;
+    }
+
+    if (((flags & GCODE_LINE_FEED_ONLY) != 0) &&
+            ((flags & (GCODE_LINE_COMMENT | GCODE_LINE_COMMENTS_STRIPPED)) != GCODE_LINE_COMMENT)) {
+        deleteLine(line);
+        return true;
+    }
+
+    mFlags[line] = (flags & ~GCODE_LINE_FEED_CHANGED) | GCODE_LINE_FEED_REMOVED;
+    return true;
+}
+
+/**
+ * @brief GCodeProgram::replaceSpindleStop - Write the M05 on a line as GCODE_SPINDLE_STOP_REPLACEMENT instead.
+ *
+ * @param line - The line to change.
+ */
+void GCodeProgram::replaceSpindleStop(int line)
+{
+    if ((mFlags.at(line) & (GCODE_LINE_SPINDLE_STOP | GCODE_LINE_FIXED)) != GCODE_LINE_SPINDLE_STOP) {
+        return;
+    }
+
+    mFlags[line] |= GCODE_LINE_SPINDLE_STOP_REPLACED;
+}
+
+/**
+ * @brief GCodeProgram::stripComments - Write a line without its comments.  A line that is nothing but
+ *      comments is deleted.
+ *
+ * @param line - The line to change.
+ *
+ * @return true if there is something left on the line.  false if it was deleted.
+ */
+bool GCodeProgram::stripComments(int line)
+{
+    QByteArray lineBuffer;
+    const char *result;
+    size_t resultLength;
+
+    if ((mFlags.at(line) & (GCODE_LINE_COMMENT | GCODE_LINE_FIXED)) != GCODE_LINE_COMMENT) {
+        return true;
+    }
+
+    if (stripComments(lineBuffer, mText.constData() + mLineStart.at(line), mLineStart.at(line + 1) - mLineStart.at(line),
+                      &result, &resultLength) == false) {
+        deleteLine(line);
+        return false;
+    }
+
+    mFlags[line] |= GCODE_LINE_COMMENTS_STRIPPED;
+    return true;
+}
+
+/**
+ * @brief GCodeProgram::deleteLine - Leave a line out when the program is written.  (It stays in the arrays,
+ *      so that line numbers don't change.)
+ *
+ * @param line - The line to delete.
+ */
+void GCodeProgram::deleteLine(int line)
+{
+    mFlags[line] |= GCODE_LINE_DELETED;
+}
+
+/**
+ * @brief GCodeProgram::replaceLine - Write a line as some new text.  The command and values of the line are
+ *      taken from the new text, so everything that looks at the program afterwards sees the new line.  A line
+ *      that has been replaced can't be edited any more, other than being deleted.
+ *
+ * @param line - The line to replace.
+ * @param text - The new text of the line, without a line ending.  (The line keeps the one it had.)
+ *
+ * @return true if the line was replaced.  false if it is too long to edit.
+ */
+bool GCodeProgram::replaceLine(int line, const QByteArray &text)
+{
+    GCodeTokenizer tokenizer(text.constData(), text.size());
+    GCodeArcCentre centre = { 0, 0 };
+    bool haveCentre = false;
+    GCodeWord word;
+    quint8 command = GCODE_COMMAND_NONE;
+    quint32 flags = GCODE_LINE_REPLACED | (mFlags.at(line) & GCODE_LINE_DELETED);
+    int wordCount = 0;
+
+    if ((mFlags.at(line) & GCODE_LINE_RAW) != 0) {
+        return false;
+    }
+
+    mX[line] = 0;
+    mY[line] = 0;
+    mZ[line] = 0;
+    mF[line] = 0;
+
+    while (tokenizer.nextWord(&word) == true) {
+        wordCount++;
+
+        if ((word.letter == 'G') && ((word.value == 0) || (word.value == 1) || (word.value == 2) || (word.value == 3))) {
+            command = GCODE_COMMAND_G0 + (int)word.value;
+        } else if ((word.letter == 'G') && (word.value == 90)) {
+            flags |= GCODE_LINE_ABSOLUTE;
+        } else if ((word.letter == 'G') && (word.value == 91)) {
+            flags |= GCODE_LINE_RELATIVE;
+        } else if (word.letter == 'X') {
+            flags |= GCODE_LINE_HAS_X;
+            mX[line] = word.value;
+        } else if (word.letter == 'Y') {
+            flags |= GCODE_LINE_HAS_Y;
+            mY[line] = word.value;
+        } else if (word.letter == 'Z') {
+            flags |= GCODE_LINE_HAS_Z;
+            mZ[line] = word.value;
+        } else if (word.letter == 'F') {
+            flags |= GCODE_LINE_HAS_F;
+            mF[line] = word.value;
+        } else {
+            if ((word.letter == 'I') || (word.letter == 'J')) {
+                if (word.letter == 'I') {
+                    centre.i = word.value;
+                } else {
+                    centre.j = word.value;
+                }
+                haveCentre = true;
+            }
+
+            flags |= GCODE_LINE_OTHER_WORDS;
+            if ((command == GCODE_COMMAND_NONE) && ((word.letter == 'G') || (word.letter == 'M'))) {
+                command = GCODE_COMMAND_OTHER;
+            }
+        }
+    }
+
+    if (((flags & GCODE_LINE_HAS_F) != 0) && (wordCount == 1)) {
+        flags |= GCODE_LINE_FEED_ONLY;
+    }
+
+    mCommand[line] = command;
+    mFlags[line] = flags;
+    mFeedText[line] = -1;
+    mReplacements.insert(line, text);
+
+    mArcCentres.remove(line);
+    if ((haveCentre == true) && ((command == GCODE_COMMAND_G2) || (command == GCODE_COMMAND_G3))) {
+        mArcCentres.insert(line, centre);
+    }
+
+    return true;
+}
+
+/**
+ * @brief GCodeProgram::setLineOrder - Set the order the lines are written (and estimated) in.  This should be
+ *      the last change made to a program, since the passes that change lines walk them in the order they were
+ *      read.
+ *
+ * @param order - The line to write at each position.  Every line has to be in it exactly once.
+ */
+void GCodeProgram::setLineOrder(const QVector<int> &order)
+{
+    mOrder = order;
+}
+
+/**
+ * @brief GCodeProgram::stripComments - Remove any comments (both "(...)" and "; ...") from a line,
+ *      along with any whitespace left at the end of the line.  Most lines don't have a comment on them, so
+ *      the line is scanned for one first, and only copied if there is something to remove.
+ *
+ * @param lineBuffer - A buffer that the stripped line can be built in.
+ * @param line - The line to strip, including its line ending.
+ * @param length - The number of bytes in line.
+ * @param result[out] - Will point to the stripped line.  (Either line itself, or lineBuffer.)
+ * @param resultLength[out] - The length of the stripped line, including its line ending.
+ *
+ * @return true if there is anything left on the line.  false if the line was only a comment.
+ */
+bool GCodeProgram::stripComments(QByteArray &lineBuffer, const char *line, size_t length, const char **result, size_t *resultLength)
+{
+    const char *end = line + length;
+    const char *bodyEnd = end;
+    const char *cursor;
+    const char *comment;
+    char *output;
+    const char *outputEnd;
+
+    *result = line;
+    *resultLength = length;
+
+    comment = GCodeScanner::findCommentOrNewline(line, end);
+    if ((comment == end) || (*comment == '\n')) {
+        // Nothing to strip.
+        return true;
+    }
+
+    while ((bodyEnd > line) && ((bodyEnd[-1] == '\n') || (bodyEnd[-1] == '\r'))) {
+        bodyEnd--;
+    }
+
+    if ((size_t)lineBuffer.size() < length) {
+        lineBuffer.resize(length);
+    }
+
+    output = lineBuffer.data();
+    cursor = line;
+
+    while (cursor < bodyEnd) {
+        comment = GCodeScanner::findCommentOrNewline(cursor, bodyEnd);
+        memcpy(output, cursor, comment - cursor);
+        output += comment - cursor;
+
+        if ((comment == bodyEnd) || (*comment == ';')) {
+            break;
+        }
+
+        // Skip the "(...)" comment.
+        cursor = GCodeScanner::findByte(comment, bodyEnd, ')');
+        if (cursor < bodyEnd) {
+            cursor++;
+        }
+
+        // Don't leave two spaces where the comment was.
+        if ((output > lineBuffer.constData()) && (output[-1] == ' ') && (cursor < bodyEnd) && (*cursor == ' ')) {
+            cursor++;
+        }
+    }
+
+    outputEnd = GCodeScanner::trimTrailingWhitespace(lineBuffer.constData(), output);
+    if (GCodeScanner::skipWhitespace(lineBuffer.constData(), outputEnd) == outputEnd) {
+        // The line was only a comment.
+        return false;
+    }
+
+    output = lineBuffer.data() + (outputEnd - lineBuffer.constData());
+    memcpy(output, bodyEnd, end - bodyEnd);
+    output += end - bodyEnd;
+
+    *result = lineBuffer.constData();
+    *resultLength = output - lineBuffer.constData();
+
+    return true;
+}
+
+/**
+ * @brief GCodeProgram::parseLine - Add a line of text (that is already in mText) to the arrays.
+ *
+ * @param start - Where the line starts in mText.
+ * @param end - One past the end of the line (including its line ending) in mText.
+ */
+void GCodeProgram::parseLine(qint64 start, qint64 end)
+{
+    const char *line = mText.constData() + start;
+    const char *lineEnd = mText.constData() + end;
+    GCodeTokenizer tokenizer(line, end - start);
+    GCodeProgramComment comment;
+    GCodeWord word;
+    quint8 command = GCODE_COMMAND_NONE;
+    quint32 flags = 0;
+    double x = 0, y = 0, z = 0, f = 0;
+    GCodeArcCentre centre = { 0, 0 };
+    bool haveCentre = false;
+    quint16 feedStart = 0, feedEnd = 0;
+    quint16 spindleStopStart = 0, spindleStopEnd = 0;
+    const char *cursor;
+    int wordCount = 0;
+
+    while (tokenizer.nextWord(&word) == true) {
+        wordCount++;
+
+        switch (word.letter) {
+        case 'G':
+            if ((word.value == 0) || (word.value == 1) || (word.value == 2) || (word.value == 3)) {
+                command = GCODE_COMMAND_G0 + (int)word.value;
+            } else {
+                if (word.value == 90) {
+                    flags |= GCODE_LINE_ABSOLUTE;
+                } else if (word.value == 91) {
+                    flags |= GCODE_LINE_RELATIVE;
+                } else {
+                    flags |= GCODE_LINE_OTHER_WORDS;
+                }
+
+                if (command == GCODE_COMMAND_NONE) {
+                    command = GCODE_COMMAND_OTHER;
+                }
+            }
+            break;
+
+        case 'M':
+            if (word.value == 5) {
+                flags |= GCODE_LINE_SPINDLE_STOP;
+                spindleStopStart = word.start - line;
+                spindleStopEnd = word.end - line;
+            }
+
+            if (command == GCODE_COMMAND_NONE) {
+                command = GCODE_COMMAND_OTHER;
+            }
+            flags |= GCODE_LINE_OTHER_WORDS;
+            break;
+
+        case 'X':
+            flags |= GCODE_LINE_HAS_X;
+            x = word.value;
+            break;
+
+        case 'Y':
+            flags |= GCODE_LINE_HAS_Y;
+            y = word.value;
+            break;
+
+        case 'Z':
+            flags |= GCODE_LINE_HAS_Z;
+            z = word.value;
+            break;
+
+        case 'F':
+            flags |= GCODE_LINE_HAS_F;
+            f = word.value;
+            feedStart = word.valueStart - line;
+            feedEnd = word.end - line;
+            break;
+
+        case 'I':
+        case 'J':
+            if (word.letter == 'I') {
+                centre.i = word.value;
+            } else {
+                centre.j = word.value;
+            }
+            haveCentre = true;
+            flags |= GCODE_LINE_OTHER_WORDS;
+            break;
+
+        default:
+            flags |= GCODE_LINE_OTHER_WORDS;
+            break;
+        }
+    }
+
+    if ((haveCentre == true) && ((command == GCODE_COMMAND_G2) || (command == GCODE_COMMAND_G3))) {
+        mArcCentres.insert(mCommand.size(), centre);
+    }
+
+    if (((flags & GCODE_LINE_HAS_F) != 0) && (wordCount == 1)) {
+        flags |= GCODE_LINE_FEED_ONLY;
+    }
+
+    // Note where the comments are.  (The same way the tokenizer skips them.)
+    if ((end - start) <= GCODE_PROGRAM_MAX_EDIT_LENGTH) {
+        cursor = GCodeScanner::findCommentOrNewline(line, lineEnd);
+        while ((cursor < lineEnd) && (*cursor != '\n')) {
+            comment.line = mCommand.size();
+            comment.start = cursor - line;
+
+            if (*cursor == ';') {
+                cursor = GCodeScanner::trimTrailingWhitespace(cursor, GCodeScanner::findNewline(cursor, lineEnd));
+                if ((cursor > line) && (cursor[-1] == '\r')) {
+                    cursor--;
+                }
+                comment.end = cursor - line;
+                mComments.append(comment);
+                break;
+            }
+
+            cursor = GCodeScanner::findByte(cursor, lineEnd, ')');
+            if (cursor < lineEnd) {
+                cursor++;
+            }
+
+            comment.end = cursor - line;
+            mComments.append(comment);
+
+            cursor = GCodeScanner::findCommentOrNewline(cursor, lineEnd);
+        }
+
+        if ((mComments.isEmpty() == false) && (mComments.last().line == mCommand.size())) {
+            flags |= GCODE_LINE_COMMENT;
+        }
+    } else {
+        // The positions on the line won't fit in 16 bits, so this line can only ever be written as it is.
+        flags |= GCODE_LINE_RAW;
+        feedStart = 0;
+        feedEnd = 0;
+        spindleStopStart = 0;
+        spindleStopEnd = 0;
+    }
+
+    mCommand.append(command);
+    mFlags.append(flags);
+    mX.append(x);
+    mY.append(y);
+    mZ.append(z);
+    mF.append(f);
+    mFeedStart.append(feedStart);
+    mFeedEnd.append(feedEnd);
+    mSpindleStopStart.append(spindleStopStart);
+    mSpindleStopEnd.append(spindleStopEnd);
+    mWordsEnd.append(((flags & GCODE_LINE_RAW) != 0) ? 0 : (quint16)(tokenizer.getWordsEnd() - line));
+    mFeedText.append(-1);
+
+    mLineStart.last() = start;
+    mLineStart.append(end);
+}
+
+/**
+ * @brief GCodeProgram::writeLine - Write a line that has been changed.
+ *
+ * @param line - The line to write.
+ * @param output - Where to write it.
+ * @param editBuffer - Somewhere to build the line with its changed words.
+ * @param stripBuffer - Somewhere to build the line without its comments.
+ */
+void GCodeProgram::writeLine(int line, GCodeOutput *output, QByteArray &editBuffer, QByteArray &stripBuffer) const
+{
+    quint32 flags = mFlags.at(line);
+    const char *text = mText.constData() + mLineStart.at(line);
+    size_t length = mLineStart.at(line + 1) - mLineStart.at(line);
+    const char *result;
+    size_t resultLength;
+    size_t copyFrom = 0;
+    GCodeProgramEdit edits[2];
+    int editCount = 0;
+
+    if ((flags & GCODE_LINE_DELETED) != 0) {
+        return;
+    }
+
+    if ((flags & GCODE_LINE_REPLACED) != 0) {
+        // Write the new text with the line ending the line had.
+        copyFrom = length;
+        if ((copyFrom > 0) && (text[copyFrom - 1] == '\n')) {
+            copyFrom--;
+            if ((copyFrom > 0) && (text[copyFrom - 1] == '\r')) {
+                copyFrom--;
+            }
+        }
+
+        const QByteArray &replacement = mReplacements[line];
+
+        output->write(replacement.constData(), replacement.size());
+        output->write(text + copyFrom, length - copyFrom);
+        return;
+    }
+
+    if ((flags & GCODE_LINE_FEED_CHANGED) != 0) {
+        if ((flags & GCODE_LINE_HAS_F) != 0) {
+            edits[editCount].start = mFeedStart.at(line);
+            edits[editCount].end = mFeedEnd.at(line);
+            edits[editCount].prefix = "";
+        } else {
+            edits[editCount].start = mWordsEnd.at(line);
+            edits[editCount].end = mWordsEnd.at(line);
+            edits[editCount].prefix = " F";
+        }
+        edits[editCount].replacement = &mFeedTexts.at(mFeedText.at(line));
+        editCount++;
+    } else if ((flags & GCODE_LINE_FEED_REMOVED) != 0) {
+        // Take out the 'F', its value, and the space in front of it.  (Or after it, if it is the first word.)
+        edits[editCount].start = mFeedStart.at(line);
+        edits[editCount].end = mFeedEnd.at(line);
+        while ((edits[editCount].start > 0) && (isBlank(text[edits[editCount].start - 1]) == true)) {
+            edits[editCount].start--;
+        }
+        if (edits[editCount].start > 0) {
+            edits[editCount].start--;
+        }
+        while ((edits[editCount].start > 0) && (isBlank(text[edits[editCount].start - 1]) == true)) {
+            edits[editCount].start--;
+        }
+        if (edits[editCount].start == 0) {
+            while ((edits[editCount].end < length) && (isBlank(text[edits[editCount].end]) == true)) {
+                edits[editCount].end++;
+            }
+        }
+        edits[editCount].prefix = "";
+        edits[editCount].replacement = NULL;
+        editCount++;
+    }
+
+    if ((flags & GCODE_LINE_SPINDLE_STOP_REPLACED) != 0) {
+        edits[editCount].start = mSpindleStopStart.at(line);
+        edits[editCount].end = mSpindleStopEnd.at(line);
+        edits[editCount].prefix = GCODE_SPINDLE_STOP_REPLACEMENT;
+        edits[editCount].replacement = NULL;
+        editCount++;
+    }
+
+    if (editCount > 0) {
+        // The edits need to be applied in the order they appear on the line.
+        if ((editCount == 2) && (edits[1].start < edits[0].start)) {
+            GCodeProgramEdit swap = edits[0];
+            edits[0] = edits[1];
+            edits[1] = swap;
+        }
+
+        editBuffer.clear();
+        for (int i = 0; i < editCount; i++) {
+            editBuffer.append(text + copyFrom, edits[i].start - copyFrom);
+            editBuffer.append(edits[i].prefix);
+            if (edits[i].replacement != NULL) {
+                editBuffer.append(*edits[i].replacement);
+            }
+            copyFrom = edits[i].end;
+        }
+        editBuffer.append(text + copyFrom, length - copyFrom);
+
+        text = editBuffer.constData();
+        length = editBuffer.size();
+    }
+
+    if ((flags & GCODE_LINE_COMMENTS_STRIPPED) != 0) {
+        if (stripComments(stripBuffer, text, length, &result, &resultLength) == false) {
+            return;
+        }
+
+        text = result;
+        length = resultLength;
+    }
+
+    output->write(text, length);
+}
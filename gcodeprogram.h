@@ -0,0 +1,145 @@
+#ifndef GCODEPROGRAM_H
+#define GCODEPROGRAM_H
+
+#include <QList>
+#include <QHash>
+#include <QVector>
+#include <QByteArray>
+
+class GCodeOutput;
+
+// The command on a line.  (Only one is kept, motion commands take priority.)
+#define GCODE_COMMAND_NONE                   0       // Only words like X, Y, Z or F, or an empty line.
+#define GCODE_COMMAND_G0                     1
+#define GCODE_COMMAND_G1                     2
+#define GCODE_COMMAND_G2                     3
+#define GCODE_COMMAND_G3                     4
+#define GCODE_COMMAND_OTHER                  5       // Some other G or M command.
+
+// Flags for each line.
+#define GCODE_LINE_HAS_X                     0x0001
+#define GCODE_LINE_HAS_Y                     0x0002
+#define GCODE_LINE_HAS_Z                     0x0004
+#define GCODE_LINE_HAS_F                     0x0008
+#define GCODE_LINE_FEED_ONLY                 0x0010  // The F word is the only word on the line.
+#define GCODE_LINE_ABSOLUTE                  0x0020  // The line has a G90.
+#define GCODE_LINE_RELATIVE                  0x0040  // The line has a G91.
+#define GCODE_LINE_SPINDLE_STOP              0x0080  // The line has an M05.
+#define GCODE_LINE_COMMENT                   0x0100  // The line has a comment.  (See getComments().)
+#define GCODE_LINE_RAW                       0x0200  // The line is too long to edit.  It is always written as it was read.
+#define GCODE_LINE_FEED_CHANGED              0x0400  // The line should be written with a new feed rate.
+#define GCODE_LINE_SPINDLE_STOP_REPLACED     0x0800  // The M05 should be written as the replacement text.
+#define GCODE_LINE_COMMENTS_STRIPPED         0x1000  // The line should be written without its comments.
+#define GCODE_LINE_DELETED                   0x2000  // The line shouldn't be written at all.
+#define GCODE_LINE_OTHER_WORDS               0x4000  // The line has words other than G00-G03, G90, G91, X, Y, Z and F.
+#define GCODE_LINE_FEED_REMOVED              0x8000  // The line should be written without its F word.
+#define GCODE_LINE_REPLACED                  0x10000 // The line should be written as the text given to replaceLine().
+
+// The flags of the lines whose words can't be edited.
+#define GCODE_LINE_FIXED                     (GCODE_LINE_RAW | GCODE_LINE_REPLACED)
+
+// The longest line that can be edited.  (Positions within a line are kept in 16 bits.)
+#define GCODE_PROGRAM_MAX_EDIT_LENGTH        0xfffe
+
+// What the last M05 of a program is written as, when the "replace M05" clean up option is selected.  M03 S0
+// stops the spindle by setting its speed to zero, but leaves it switched on, for controllers that do more than
+// stop the spindle at an M05 (like switching the spindle controller off, or waiting for it to spin down).
+#define GCODE_SPINDLE_STOP_REPLACEMENT       "M03 S0"
+
+// A comment, found while parsing.
+struct GCodeProgramComment
+{
+    int line;
+    quint16 start;              // The '(' or ';', relative to the start of the line.
+    quint16 end;                // One past the ')' (or the end of the line, for a ';' comment.)
+};
+
+// The centre of a G02/G03 arc, relative to where it starts.  (Its I and J words.)
+struct GCodeArcCentre
+{
+    double i;
+    double j;
+};
+
+// A G-code program in memory, kept as a structure of arrays.  Each line has a command code, flags, its X,
+// Y, Z and F values, and the positions of the words that might be edited.  The text that was parsed is
+// kept too, so that lines that aren't changed are written back exactly as they were read, and lines that
+// are changed only have the edited words rewritten.  (So any file round trips.)
+class GCodeProgram
+{
+public:
+    GCodeProgram();
+
+    void clear();
+    void parse(const char *data, qint64 size);
+    void appendLine(const char *line, size_t length);
+    void write(GCodeOutput *output) const;
+
+    int getLineCount() const { return mCommand.size(); }
+    int lineAt(int position) const { return (mOrder.isEmpty() == true) ? position : mOrder.at(position); }
+    quint8 getCommand(int line) const { return mCommand.at(line); }
+    quint32 getFlags(int line) const { return mFlags.at(line); }
+    double getX(int line) const { return mX.at(line); }
+    double getY(int line) const { return mY.at(line); }
+    double getZ(int line) const { return mZ.at(line); }
+    double getF(int line) const { return mF.at(line); }
+
+    // Direct access to the arrays, for loops that work over the whole program.
+    const quint8 *commands() const { return mCommand.constData(); }
+    const quint32 *flags() const { return mFlags.constData(); }
+    const double *xValues() const { return mX.constData(); }
+    const double *yValues() const { return mY.constData(); }
+    const double *zValues() const { return mZ.constData(); }
+    const double *feedRates() const { return mF.constData(); }
+
+    QByteArray getLineText(int line) const;
+    QByteArray getFeedRateText(int line) const;
+    bool setsFeedRate(int line) const { return (((mFlags.at(line) & (GCODE_LINE_HAS_F | GCODE_LINE_FEED_CHANGED)) != 0) &&
+                                                ((mFlags.at(line) & GCODE_LINE_FEED_REMOVED) == 0)); }
+    QList<QByteArray> getComments(int line) const;
+    bool getArcCentre(int line, GCodeArcCentre *centre) const;
+
+    void setFeedRate(int line, const QByteArray &text);
+    void setFeedRate(int line, double feedRate);
+    bool removeFeedRate(int line);
+    void replaceSpindleStop(int line);
+    bool stripComments(int line);
+    void deleteLine(int line);
+    bool replaceLine(int line, const QByteArray &text);
+    void setLineOrder(const QVector<int> &order);
+
+    static bool stripComments(QByteArray &lineBuffer, const char *line, size_t length, const char **result, size_t *resultLength);
+
+private:
+    friend class GCodeProgramCache;
+
+    void parseLine(qint64 start, qint64 end);
+    void writeLine(int line, GCodeOutput *output, QByteArray &editBuffer, QByteArray &stripBuffer) const;
+
+    // One entry per line.
+    QVector<quint8> mCommand;
+    QVector<quint32> mFlags;
+    QVector<double> mX;
+    QVector<double> mY;
+    QVector<double> mZ;
+    QVector<double> mF;                 // The feed rate on the line, or the new one if it was changed.
+    QVector<quint16> mFeedStart;        // The value of the F word, relative to the start of the line.
+    QVector<quint16> mFeedEnd;
+    QVector<quint16> mSpindleStopStart; // The M05 word, relative to the start of the line.
+    QVector<quint16> mSpindleStopEnd;
+    QVector<quint16> mWordsEnd;         // Where a new word can be added.
+    QVector<int> mFeedText;             // The index in mFeedTexts of a changed feed rate.
+
+    QByteArray mText;                   // The text of every line, one after the other.
+    QVector<qint64> mLineStart;         // Where each line starts in mText, plus one entry for the end of it.
+
+    // Side tables.
+    QVector<GCodeProgramComment> mComments;     // Sorted by line.
+    QList<QByteArray> mFeedTexts;               // The text of each different feed rate that has been set.
+    QHash<QByteArray, int> mFeedTextIndex;
+    QHash<int, GCodeArcCentre> mArcCentres;     // For the G02/G03 lines that have an I or J word.
+    QHash<int, QByteArray> mReplacements;       // The text of each line that has been replaced.
+    QVector<int> mOrder;                        // The line written at each position, or empty to write them in order.
+};
+
+#endif // GCODEPROGRAM_H
@@ -0,0 +1,487 @@
+#include "gcodeprogramcache.h"
+#include "gcodeprogram.h"
+#include "gcodewriter.h"
+#include "logger.h"
+#include "profiler.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+
+#include <string.h>
+
+// Written in the header, so that a cache from a machine with the other byte order is ignored.
+#define GCODE_CACHE_BYTE_ORDER               0x01020304
+
+// The multiplier used to mix each word in to the hash.  (The 64 bit golden ratio.)
+#define GCODE_CACHE_HASH_MULTIPLIER          0x9e3779b97f4a7c15ULL
+
+// The flags that parse() sets.  (The rest are only ever set by edits, which aren't cached.)
+#define GCODE_CACHE_PARSED_FLAGS             (GCODE_LINE_HAS_X | GCODE_LINE_HAS_Y | GCODE_LINE_HAS_Z | GCODE_LINE_HAS_F | \
+                                              GCODE_LINE_FEED_ONLY | GCODE_LINE_ABSOLUTE | GCODE_LINE_RELATIVE | \
+                                              GCODE_LINE_SPINDLE_STOP | GCODE_LINE_COMMENT | GCODE_LINE_RAW | \
+                                              GCODE_LINE_OTHER_WORDS)
+
+// The smallest each record can be.  (A line with no values is its command, flags, length and words end.  A
+// comment is its line, start and end, and an arc centre is its line, I and J.)
+#define GCODE_CACHE_MIN_LINE_RECORD          (sizeof(quint8) + sizeof(quint16) + sizeof(quint32) + sizeof(quint16))
+#define GCODE_CACHE_COMMENT_RECORD           (sizeof(qint32) + sizeof(quint16) + sizeof(quint16))
+#define GCODE_CACHE_ARC_RECORD               (sizeof(qint32) + sizeof(double) + sizeof(double))
+
+/**
+ * @brief appendValue - Add a value to the end of a cache that is being built.
+ *
+ * @param buffer - The cache.
+ * @param value - The value to add.
+ */
+template <typename T>
+static inline void appendValue(QByteArray &buffer, T value)
+{
+    buffer.append((const char *)&value, sizeof(value));
+}
+
+/**
+ * @brief readValue - Read the next value from a cache.
+ *
+ * @param cursor[in/out] - Where to read from.  Moved past the value.
+ * @param end - One past the end of the cache.
+ * @param value[out] - The value that was read.
+ *
+ * @return true if the value was read.  false if the cache ended first.
+ */
+template <typename T>
+static inline bool readValue(const char **cursor, const char *end, T *value)
+{
+    if ((size_t)(end - *cursor) < sizeof(T)) {
+        return false;
+    }
+
+    memcpy(value, *cursor, sizeof(T));
+    *cursor += sizeof(T);
+
+    return true;
+}
+
+/**
+ * @brief GCodeProgramCache::cacheFilename - Get the name of the cache file for a G-code file.
+ *
+ * @param filename - The G-code file.
+ *
+ * @return QString containing the name of the cache file.
+ */
+QString GCodeProgramCache::cacheFilename(QString filename)
+{
+    return filename + GCODE_CACHE_SUFFIX;
+}
+
+/**
+ * @brief GCodeProgramCache::load - Fill in a program from the cache for a G-code file, if there is one,
+ *      and it was made from exactly the same file.
+ *
+ * @param filename - The G-code file.
+ * @param data - The contents of the G-code file.
+ * @param size - The size of the G-code file.
+ * @param program[out] - The program to fill in.
+ *
+ * @return true if the program was loaded from the cache.  false if there isn't a usable cache, in which
+ *      case the G-code will need to be parsed.
+ */
+bool GCodeProgramCache::load(QString filename, const char *data, qint64 size, GCodeProgram *program)
+{
+    QFile file(cacheFilename(filename));
+    QByteArray header;
+    const char *cache;
+    const char *cursor;
+    const char *end;
+    qint64 cacheSize;
+    quint64 hash;
+    qint32 lineCount;
+    qint32 commentCount;
+    qint32 arcCount;
+
+    PROFILE_SCOPE(PROFILE_STAGE_PARSE);
+
+    if (file.exists() == false) {
+        LOG_DEBUG("There is no cache for " + filename + ".");
+        return false;
+    }
+
+    if (file.open(QIODevice::ReadOnly) == false) {
+        LOG_WARNING("Unable to open the cache file " + file.fileName() + ".");
+        return false;
+    }
+
+    // The cache is mapped (rather than read) since most of it is only looked at once.  (It is unmapped
+    // when file goes away.)
+    cacheSize = file.size();
+    header = buildHeader(filename, size);
+    if (cacheSize < header.size()) {
+        LOG_DEBUG("The cache for " + filename + " is out of date.");
+        return false;
+    }
+
+    cache = (const char *)file.map(0, cacheSize);
+    if (cache == NULL) {
+        LOG_WARNING("Unable to memory map the cache file " + file.fileName() + ".");
+        return false;
+    }
+
+    // Check the cheap parts of the key before the contents are hashed.
+    if (memcmp(cache, header.constData(), header.size()) != 0) {
+        LOG_DEBUG("The cache for " + filename + " is out of date.");
+        return false;
+    }
+
+    cursor = cache + header.size();
+    end = cache + cacheSize;
+
+    if ((readValue(&cursor, end, &hash) == false) || (hash != hashData(data, size))) {
+        LOG_DEBUG("The cache for " + filename + " was made from different contents.");
+        return false;
+    }
+
+    if ((readValue(&cursor, end, &lineCount) == false) || (readValue(&cursor, end, &commentCount) == false) ||
+            (readValue(&cursor, end, &arcCount) == false) ||
+            (readRecords(cursor, end, data, size, lineCount, commentCount, arcCount, program) == false)) {
+        LOG_WARNING("The cache file " + file.fileName() + " is damaged.  It will be written again.");
+        program->clear();
+        return false;
+    }
+
+    LOG_DEBUG("Loaded " + QString::number(lineCount) + " lines for " + filename + " from its cache.");
+    return true;
+}
+
+/**
+ * @brief GCodeProgramCache::save - Write the cache for a G-code file.  The cache is written under a temporary
+ *      name, and only replaces the old one once it is complete.
+ *
+ * @param filename - The G-code file.
+ * @param data - The contents of the G-code file.
+ * @param size - The size of the G-code file.
+ * @param program - The program that was parsed from data, before any changes were made to it.
+ *
+ * @return true if the cache was written.  false otherwise.
+ */
+bool GCodeProgramCache::save(QString filename, const char *data, qint64 size, const GCodeProgram &program)
+{
+    QString cacheFile = cacheFilename(filename);
+    QString partialFile = cacheFile + ".part";
+    GCodeWriter writer;
+    QByteArray cache;
+    int lineCount = program.getLineCount();
+    quint16 flags;
+    QHash<int, GCodeArcCentre>::const_iterator arc;
+
+    cache = buildHeader(filename, size);
+    appendValue<quint64>(cache, hashData(data, size));
+    appendValue<qint32>(cache, lineCount);
+    appendValue<qint32>(cache, program.mComments.size());
+    appendValue<qint32>(cache, program.mArcCentres.size());
+
+    // A G1 with X and Y takes about the same room as its text.
+    cache.reserve(cache.size() + (lineCount * 25) + (program.mComments.size() * 8));
+
+    for (int i = 0; i < lineCount; i++) {
+        flags = (quint16)(program.mFlags.at(i) & GCODE_CACHE_PARSED_FLAGS);
+
+        appendValue<quint8>(cache, program.mCommand.at(i));
+        appendValue<quint16>(cache, flags);
+        appendValue<quint32>(cache, (quint32)(program.mLineStart.at(i + 1) - program.mLineStart.at(i)));
+        appendValue<quint16>(cache, program.mWordsEnd.at(i));
+
+        if ((flags & GCODE_LINE_HAS_X) != 0) {
+            appendValue<double>(cache, program.mX.at(i));
+        }
+
+        if ((flags & GCODE_LINE_HAS_Y) != 0) {
+            appendValue<double>(cache, program.mY.at(i));
+        }
+
+        if ((flags & GCODE_LINE_HAS_Z) != 0) {
+            appendValue<double>(cache, program.mZ.at(i));
+        }
+
+        if ((flags & GCODE_LINE_HAS_F) != 0) {
+            appendValue<double>(cache, program.mF.at(i));
+            appendValue<quint16>(cache, program.mFeedStart.at(i));
+            appendValue<quint16>(cache, program.mFeedEnd.at(i));
+        }
+
+        if ((flags & GCODE_LINE_SPINDLE_STOP) != 0) {
+            appendValue<quint16>(cache, program.mSpindleStopStart.at(i));
+            appendValue<quint16>(cache, program.mSpindleStopEnd.at(i));
+        }
+    }
+
+    for (int i = 0; i < program.mComments.size(); i++) {
+        appendValue<qint32>(cache, program.mComments.at(i).line);
+        appendValue<quint16>(cache, program.mComments.at(i).start);
+        appendValue<quint16>(cache, program.mComments.at(i).end);
+    }
+
+    for (arc = program.mArcCentres.constBegin(); arc != program.mArcCentres.constEnd(); ++arc) {
+        appendValue<qint32>(cache, arc.key());
+        appendValue<double>(cache, arc.value().i);
+        appendValue<double>(cache, arc.value().j);
+    }
+
+    if (writer.open(partialFile) == false) {
+        LOG_WARNING("Unable to open the cache file " + partialFile + " for writing.");
+        return false;
+    }
+
+    writer.write(cache);
+
+    if (writer.close() == false) {
+        LOG_WARNING("Failed while writing the cache file " + partialFile + ".");
+        QFile::remove(partialFile);
+        return false;
+    }
+
+    if (QFile::exists(cacheFile) == true) {
+        QFile::remove(cacheFile);
+    }
+
+    if (QFile::rename(partialFile, cacheFile) == false) {
+        LOG_WARNING("Unable to rename " + partialFile + " to " + cacheFile + ".");
+        QFile::remove(partialFile);
+        return false;
+    }
+
+    LOG_DEBUG("Wrote the cache for " + filename + " (" + QString::number(cache.size()) + " bytes).");
+    return true;
+}
+
+/**
+ * @brief GCodeProgramCache::hashData - Hash the contents of a file.  This only needs to catch a file that
+ *      has changed without its size or modification time changing, so it is a fast (non-cryptographic) hash
+ *      that works on eight bytes at a time.
+ *
+ * @param data - The data to hash.
+ * @param size - The size of the data.
+ *
+ * @return quint64 containing the hash.
+ */
+quint64 GCodeProgramCache::hashData(const char *data, qint64 size)
+{
+    const char *end = data + size;
+    quint64 hash = GCODE_CACHE_HASH_MULTIPLIER ^ (quint64)size;
+    quint64 word;
+
+    while ((end - data) >= 8) {
+        memcpy(&word, data, 8);
+        hash = (hash ^ word) * GCODE_CACHE_HASH_MULTIPLIER;
+        hash ^= (hash >> 29);
+        data += 8;
+    }
+
+    if (data < end) {
+        word = 0;
+        memcpy(&word, data, end - data);
+        hash = (hash ^ word) * GCODE_CACHE_HASH_MULTIPLIER;
+        hash ^= (hash >> 29);
+    }
+
+    // Make sure every bit of the last word affects every bit of the result.
+    hash ^= (hash >> 32);
+    hash *= GCODE_CACHE_HASH_MULTIPLIER;
+    hash ^= (hash >> 29);
+
+    return hash;
+}
+
+/**
+ * @brief GCodeProgramCache::buildHeader - Build the start of the cache for a file.  (Everything in the key
+ *      except for the hash of the contents, which comes straight after it.)
+ *
+ * @param filename - The G-code file.
+ * @param size - The size of the G-code file.
+ *
+ * @return QByteArray containing the header.
+ */
+QByteArray GCodeProgramCache::buildHeader(QString filename, qint64 size)
+{
+    QFileInfo info(filename);
+    QByteArray path = info.canonicalFilePath().toUtf8();
+    QByteArray header;
+
+    header.append(GCODE_CACHE_MAGIC, sizeof(GCODE_CACHE_MAGIC));
+    appendValue<quint32>(header, GCODE_CACHE_VERSION);
+    appendValue<quint32>(header, GCODE_CACHE_BYTE_ORDER);
+    appendValue<qint64>(header, size);
+    appendValue<qint64>(header, info.lastModified().toMSecsSinceEpoch());
+    appendValue<quint32>(header, path.size());
+    header.append(path);
+
+    return header;
+}
+
+/**
+ * @brief GCodeProgramCache::readRecords - Fill in a program from the lines, comments and arcs in a cache.
+ *
+ * @param cursor - The first line in the cache.
+ * @param end - One past the end of the cache.
+ * @param data - The contents of the G-code file.
+ * @param size - The size of the G-code file.
+ * @param lineCount - The number of lines in the cache.
+ * @param commentCount - The number of comments in the cache.
+ * @param arcCount - The number of arc centres in the cache.
+ * @param program[out] - The program to fill in.
+ *
+ * @return true if the program was filled in.  false if the cache doesn't make sense.
+ */
+bool GCodeProgramCache::readRecords(const char *cursor, const char *end, const char *data, qint64 size, int lineCount,
+                                    int commentCount, int arcCount, GCodeProgram *program)
+{
+    GCodeProgramComment comment;
+    GCodeArcCentre centre;
+    qint32 arcLine;
+    quint16 flags;
+    quint32 length;
+    qint64 lineStart = 0;
+    quint8 *command;
+    quint32 *lineFlags;
+    double *x, *y, *z, *f;
+    quint16 *feedStart, *feedEnd;
+    quint16 *spindleStopStart, *spindleStopEnd;
+    quint16 *wordsEnd;
+    qint64 *lineStarts;
+
+    if ((lineCount < 0) || (commentCount < 0) || (arcCount < 0)) {
+        return false;
+    }
+
+    // Check that the counts fit in what is left of the cache before anything is sized by them, so that a
+    // damaged cache can't ask for more memory than it could possibly fill.
+    if ((((quint64)lineCount * GCODE_CACHE_MIN_LINE_RECORD) + ((quint64)commentCount * GCODE_CACHE_COMMENT_RECORD) +
+         ((quint64)arcCount * GCODE_CACHE_ARC_RECORD)) > (quint64)(end - cursor)) {
+        return false;
+    }
+
+    program->clear();
+    program->mText = QByteArray(data, size);
+
+    // Every line is filled in below, so size the arrays once and write to them directly.
+    program->mCommand.resize(lineCount);
+    program->mFlags.resize(lineCount);
+    program->mX.resize(lineCount);
+    program->mY.resize(lineCount);
+    program->mZ.resize(lineCount);
+    program->mF.resize(lineCount);
+    program->mFeedStart.resize(lineCount);
+    program->mFeedEnd.resize(lineCount);
+    program->mSpindleStopStart.resize(lineCount);
+    program->mSpindleStopEnd.resize(lineCount);
+    program->mWordsEnd.resize(lineCount);
+    program->mFeedText.fill(-1, lineCount);
+    program->mLineStart.resize(lineCount + 1);
+
+    command = program->mCommand.data();
+    lineFlags = program->mFlags.data();
+    x = program->mX.data();
+    y = program->mY.data();
+    z = program->mZ.data();
+    f = program->mF.data();
+    feedStart = program->mFeedStart.data();
+    feedEnd = program->mFeedEnd.data();
+    spindleStopStart = program->mSpindleStopStart.data();
+    spindleStopEnd = program->mSpindleStopEnd.data();
+    wordsEnd = program->mWordsEnd.data();
+    lineStarts = program->mLineStart.data();
+
+    lineStarts[0] = 0;
+
+    for (int i = 0; i < lineCount; i++) {
+        x[i] = 0;
+        y[i] = 0;
+        z[i] = 0;
+        f[i] = 0;
+        feedStart[i] = 0;
+        feedEnd[i] = 0;
+        spindleStopStart[i] = 0;
+        spindleStopEnd[i] = 0;
+
+        if ((readValue(&cursor, end, &command[i]) == false) || (readValue(&cursor, end, &flags) == false) ||
+                (readValue(&cursor, end, &length) == false) || (readValue(&cursor, end, &wordsEnd[i]) == false)) {
+            return false;
+        }
+
+        if ((flags & ~GCODE_CACHE_PARSED_FLAGS) != 0) {
+            return false;
+        }
+
+        lineFlags[i] = flags;
+
+        if (((flags & GCODE_LINE_HAS_X) != 0) && (readValue(&cursor, end, &x[i]) == false)) {
+            return false;
+        }
+
+        if (((flags & GCODE_LINE_HAS_Y) != 0) && (readValue(&cursor, end, &y[i]) == false)) {
+            return false;
+        }
+
+        if (((flags & GCODE_LINE_HAS_Z) != 0) && (readValue(&cursor, end, &z[i]) == false)) {
+            return false;
+        }
+
+        if ((flags & GCODE_LINE_HAS_F) != 0) {
+            if ((readValue(&cursor, end, &f[i]) == false) || (readValue(&cursor, end, &feedStart[i]) == false) ||
+                    (readValue(&cursor, end, &feedEnd[i]) == false)) {
+                return false;
+            }
+        }
+
+        if ((flags & GCODE_LINE_SPINDLE_STOP) != 0) {
+            if ((readValue(&cursor, end, &spindleStopStart[i]) == false) || (readValue(&cursor, end, &spindleStopEnd[i]) == false)) {
+                return false;
+            }
+        }
+
+        // Every position has to be within its line, and every line within the file.
+        if (((qint64)length > (size - lineStart)) || (wordsEnd[i] > length) || (feedStart[i] > feedEnd[i]) ||
+                (feedEnd[i] > length) || (spindleStopStart[i] > spindleStopEnd[i]) || (spindleStopEnd[i] > length)) {
+            return false;
+        }
+
+        lineStart += length;
+        lineStarts[i + 1] = lineStart;
+    }
+
+    if (lineStart != size) {
+        return false;
+    }
+
+    program->mComments.reserve(commentCount);
+
+    for (int i = 0; i < commentCount; i++) {
+        if ((readValue(&cursor, end, &comment.line) == false) || (readValue(&cursor, end, &comment.start) == false) ||
+                (readValue(&cursor, end, &comment.end) == false)) {
+            return false;
+        }
+
+        if ((comment.line < 0) || (comment.line >= lineCount) || (comment.start > comment.end) ||
+                (comment.end > (lineStarts[comment.line + 1] - lineStarts[comment.line]))) {
+            return false;
+        }
+
+        program->mComments.append(comment);
+    }
+
+    program->mArcCentres.reserve(arcCount);
+
+    for (int i = 0; i < arcCount; i++) {
+        if ((readValue(&cursor, end, &arcLine) == false) || (readValue(&cursor, end, &centre.i) == false) ||
+                (readValue(&cursor, end, &centre.j) == false)) {
+            return false;
+        }
+
+        if ((arcLine < 0) || (arcLine >= lineCount)) {
+            return false;
+        }
+
+        program->mArcCentres.insert(arcLine, centre);
+    }
+
+    return (cursor == end);
+}
@@ -0,0 +1,39 @@
+#ifndef GCODEPROGRAMCACHE_H
+#define GCODEPROGRAMCACHE_H
+
+#include <QString>
+#include <QByteArray>
+
+class GCodeProgram;
+
+// The cache for a G-code file is kept next to it, in a file with this added to its name.
+#define GCODE_CACHE_SUFFIX                   ".ftcache"
+
+// Bump this whenever the layout of the cache file, or what GCodeProgram::parse() finds, changes.  (Caches
+// with any other version are ignored, and written again.)
+#define GCODE_CACHE_VERSION                  3
+
+// The first bytes of every cache file.
+#define GCODE_CACHE_MAGIC                    "FTCACHE"
+
+// Saves the parsed form of a G-code file (a GCodeProgram) in a binary sidecar file, so that the next time
+// the same file is processed it doesn't have to be parsed again.  The cache is keyed by the path, size,
+// modification time, and a hash of the contents of the file, so a cache for a file that has changed in
+// any way is never used.
+class GCodeProgramCache
+{
+public:
+    static QString cacheFilename(QString filename);
+
+    static bool load(QString filename, const char *data, qint64 size, GCodeProgram *program);
+    static bool save(QString filename, const char *data, qint64 size, const GCodeProgram &program);
+
+    static quint64 hashData(const char *data, qint64 size);
+
+private:
+    static QByteArray buildHeader(QString filename, qint64 size);
+    static bool readRecords(const char *cursor, const char *end, const char *data, qint64 size, int lineCount,
+                            int commentCount, int arcCount, GCodeProgram *program);
+};
+
+#endif // GCODEPROGRAMCACHE_H
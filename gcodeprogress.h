@@ -0,0 +1,17 @@
+#ifndef GCODEPROGRESS_H
+#define GCODEPROGRESS_H
+
+#include <QtGlobal>
+
+// Something that wants to hear how a long running G-code operation is going, and may want to stop it.
+// Both calls are made on the thread that is doing the work.
+class GCodeProgress
+{
+public:
+    virtual ~GCodeProgress() {}
+
+    virtual void progress(qint64 bytesProcessed, qint64 totalBytes, quint64 lines) = 0;
+    virtual bool isCancelled() = 0;
+};
+
+#endif // GCODEPROGRESS_H
@@ -0,0 +1,406 @@
+#include "gcodescanner.h"
+
+#include <string.h>
+
+// The SIMD versions are only built with compilers that let us enable AVX2 on a per-function basis.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define GCODE_SCANNER_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// The set of scanning functions for one implementation.
+struct ScanFunctions
+{
+    GCodeScanner::Implementation implementation;
+    const char *(*findAny)(const char *start, const char *end, char a, char b, char c);
+    const char *(*skipWhitespace)(const char *start, const char *end);
+    size_t (*countByte)(const char *start, const char *end, char c);
+};
+
+/*
+ * Scalar implementation.  Used on CPUs (and compilers) without SSE2, and to finish off the last
+ * few bytes that don't fill a whole vector in the SIMD versions.
+ */
+
+static const char *scalarFindAny(const char *start, const char *end, char a, char b, char c)
+{
+    for (; start < end; start++) {
+        if ((*start == a) || (*start == b) || (*start == c)) {
+            return start;
+        }
+    }
+
+    return end;
+}
+
+static const char *scalarSkipWhitespace(const char *start, const char *end)
+{
+    while ((start < end) && ((*start == ' ') || (*start == '\t'))) {
+        start++;
+    }
+
+    return start;
+}
+
+static size_t scalarCountByte(const char *start, const char *end, char c)
+{
+    size_t count = 0;
+
+    for (; start < end; start++) {
+        if (*start == c) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+#ifdef GCODE_SCANNER_X86_SIMD
+
+/*
+ * SSE2 implementation.  (Always available on x86-64.)
+ */
+
+static const char *sse2FindAny(const char *start, const char *end, char a, char b, char c)
+{
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    const __m128i vc = _mm_set1_epi8(c);
+    __m128i data;
+    int mask;
+
+    while ((end - start) >= 16) {
+        data = _mm_loadu_si128((const __m128i *)start);
+        mask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(data, va), _mm_cmpeq_epi8(data, vb)),
+                                              _mm_cmpeq_epi8(data, vc)));
+        if (mask != 0) {
+            return start + __builtin_ctz(mask);
+        }
+
+        start += 16;
+    }
+
+    return scalarFindAny(start, end, a, b, c);
+}
+
+static const char *sse2SkipWhitespace(const char *start, const char *end)
+{
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    __m128i data;
+    int mask;
+
+    while ((end - start) >= 16) {
+        data = _mm_loadu_si128((const __m128i *)start);
+        mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(data, space), _mm_cmpeq_epi8(data, tab))) ^ 0xffff;
+        if (mask != 0) {
+            return start + __builtin_ctz(mask);
+        }
+
+        start += 16;
+    }
+
+    return scalarSkipWhitespace(start, end);
+}
+
+static size_t sse2CountByte(const char *start, const char *end, char c)
+{
+    const __m128i vc = _mm_set1_epi8(c);
+    size_t count = 0;
+
+    while ((end - start) >= 16) {
+        count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)start), vc)));
+        start += 16;
+    }
+
+    return count + scalarCountByte(start, end, c);
+}
+
+/*
+ * AVX2 implementation.  Compiled for AVX2 on a per-function basis, and only selected if the CPU
+ * supports it.
+ */
+
+__attribute__((target("avx2")))
+static const char *avx2FindAny(const char *start, const char *end, char a, char b, char c)
+{
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    const __m256i vc = _mm256_set1_epi8(c);
+    __m256i data;
+    unsigned int mask;
+
+    while ((end - start) >= 32) {
+        data = _mm256_loadu_si256((const __m256i *)start);
+        mask = (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(data, va),
+                                                                                  _mm256_cmpeq_epi8(data, vb)),
+                                                                  _mm256_cmpeq_epi8(data, vc)));
+        if (mask != 0) {
+            return start + __builtin_ctz(mask);
+        }
+
+        start += 32;
+    }
+
+    return sse2FindAny(start, end, a, b, c);
+}
+
+__attribute__((target("avx2")))
+static const char *avx2SkipWhitespace(const char *start, const char *end)
+{
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    __m256i data;
+    unsigned int mask;
+
+    while ((end - start) >= 32) {
+        data = _mm256_loadu_si256((const __m256i *)start);
+        mask = ~(unsigned int)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(data, space),
+                                                                   _mm256_cmpeq_epi8(data, tab)));
+        if (mask != 0) {
+            return start + __builtin_ctz(mask);
+        }
+
+        start += 32;
+    }
+
+    return sse2SkipWhitespace(start, end);
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t avx2CountByte(const char *start, const char *end, char c)
+{
+    const __m256i vc = _mm256_set1_epi8(c);
+    size_t count = 0;
+
+    while ((end - start) >= 32) {
+        count += __builtin_popcount((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)start), vc)));
+        start += 32;
+    }
+
+    return count + sse2CountByte(start, end, c);
+}
+
+#endif // GCODE_SCANNER_X86_SIMD
+
+static const ScanFunctions scalarFunctions = { GCodeScanner::Scalar, scalarFindAny, scalarSkipWhitespace, scalarCountByte };
+#ifdef GCODE_SCANNER_X86_SIMD
+static const ScanFunctions sse2Functions = { GCodeScanner::SSE2, sse2FindAny, sse2SkipWhitespace, sse2CountByte };
+static const ScanFunctions avx2Functions = { GCodeScanner::AVX2, avx2FindAny, avx2SkipWhitespace, avx2CountByte };
+#endif
+
+/**
+ * @brief functionsFor - Get the scanning functions for an implementation.
+ *
+ * @param implementation - The implementation to look up.
+ *
+ * @return const ScanFunctions* for the implementation, or NULL if it isn't supported by this CPU
+ *      (or wasn't built in.)
+ */
+static const ScanFunctions *functionsFor(GCodeScanner::Implementation implementation)
+{
+    switch (implementation) {
+    case GCodeScanner::Scalar:
+        return &scalarFunctions;
+
+#ifdef GCODE_SCANNER_X86_SIMD
+    case GCodeScanner::SSE2:
+        return &sse2Functions;
+
+    case GCodeScanner::AVX2:
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return &avx2Functions;
+        }
+        return NULL;
+#endif
+
+    default:
+        return NULL;
+    }
+}
+
+/**
+ * @brief bestFunctions - Pick the fastest implementation that this CPU supports.
+ *
+ * @return const ScanFunctions* for the implementation to use.
+ */
+static const ScanFunctions *bestFunctions()
+{
+    const ScanFunctions *functions;
+
+    functions = functionsFor(GCodeScanner::AVX2);
+    if (functions == NULL) {
+        functions = functionsFor(GCodeScanner::SSE2);
+    }
+
+    if (functions == NULL) {
+        functions = &scalarFunctions;
+    }
+
+    return functions;
+}
+
+// Start out with the scalar functions (which are set up before any code runs), then switch to the
+// best implementation during static initialization.
+static const ScanFunctions *activeFunctions = &scalarFunctions;
+
+static bool selectBestFunctions()
+{
+    activeFunctions = bestFunctions();
+    return true;
+}
+
+static bool bestFunctionsSelected = selectBestFunctions();
+
+/**
+ * @brief GCodeScanner::findByte - Find the first instance of a character.
+ *
+ * @param start - The first character to search.
+ * @param end - One past the last character to search.
+ * @param c - The character to look for.
+ *
+ * @return const char* pointing to the character, or end if it wasn't found.
+ */
+const char *GCodeScanner::findByte(const char *start, const char *end, char c)
+{
+    return activeFunctions->findAny(start, end, c, c, c);
+}
+
+/**
+ * @brief GCodeScanner::findNewline - Find the next '\n'.
+ *
+ * @param start - The first character to search.
+ * @param end - One past the last character to search.
+ *
+ * @return const char* pointing to the newline, or end if there isn't one.
+ */
+const char *GCodeScanner::findNewline(const char *start, const char *end)
+{
+    return activeFunctions->findAny(start, end, '\n', '\n', '\n');
+}
+
+/**
+ * @brief GCodeScanner::findCommentOrNewline - Find the start of the next comment (either a ';' or a '('),
+ *      or the next '\n', whichever comes first.
+ *
+ * @param start - The first character to search.
+ * @param end - One past the last character to search.
+ *
+ * @return const char* pointing to the ';', '(' or '\n', or end if there isn't one.
+ */
+const char *GCodeScanner::findCommentOrNewline(const char *start, const char *end)
+{
+    return activeFunctions->findAny(start, end, ';', '(', '\n');
+}
+
+/**
+ * @brief GCodeScanner::skipWhitespace - Skip over any spaces and tabs.
+ *
+ * @param start - The first character to check.
+ * @param end - One past the last character to check.
+ *
+ * @return const char* pointing to the first character that isn't a space or tab, or end.
+ */
+const char *GCodeScanner::skipWhitespace(const char *start, const char *end)
+{
+    return activeFunctions->skipWhitespace(start, end);
+}
+
+/**
+ * @brief GCodeScanner::trimTrailingWhitespace - Work backwards from the end of a range to drop any
+ *      trailing spaces and tabs.  (Trailing whitespace is almost always only a byte or two, so this
+ *      doesn't bother with SIMD.)
+ *
+ * @param start - The first character of the range.
+ * @param end - One past the last character of the range.
+ *
+ * @return const char* pointing one past the last character that isn't a space or tab.
+ */
+const char *GCodeScanner::trimTrailingWhitespace(const char *start, const char *end)
+{
+    while ((end > start) && ((end[-1] == ' ') || (end[-1] == '\t'))) {
+        end--;
+    }
+
+    return end;
+}
+
+/**
+ * @brief GCodeScanner::countNewlines - Count the '\n' characters in a range.
+ *
+ * @param start - The first character to check.
+ * @param end - One past the last character to check.
+ *
+ * @return size_t containing the number of newlines.
+ */
+size_t GCodeScanner::countNewlines(const char *start, const char *end)
+{
+    return activeFunctions->countByte(start, end, '\n');
+}
+
+/**
+ * @brief GCodeScanner::isImplementationSupported - Check if an implementation can be used on this CPU.
+ *
+ * @param implementation - The implementation to check.
+ *
+ * @return true if the implementation can be used.  false otherwise.
+ */
+bool GCodeScanner::isImplementationSupported(Implementation implementation)
+{
+    return (functionsFor(implementation) != NULL);
+}
+
+/**
+ * @brief GCodeScanner::setImplementation - Force the use of a specific implementation.  (This is mostly
+ *      useful for benchmarking, normally the best implementation is picked automatically.)  This shouldn't
+ *      be called while another thread is scanning.
+ *
+ * @param implementation - The implementation to use.
+ *
+ * @return true if the implementation is now in use.  false if this CPU doesn't support it.
+ */
+bool GCodeScanner::setImplementation(Implementation implementation)
+{
+    const ScanFunctions *functions = functionsFor(implementation);
+
+    if (functions == NULL) {
+        return false;
+    }
+
+    activeFunctions = functions;
+    return true;
+}
+
+/**
+ * @brief GCodeScanner::getImplementation - Returns the implementation that is currently in use.
+ *
+ * @return Implementation that is in use.
+ */
+GCodeScanner::Implementation GCodeScanner::getImplementation()
+{
+    return activeFunctions->implementation;
+}
+
+/**
+ * @brief GCodeScanner::implementationName - Get a human readable name for an implementation.
+ *
+ * @param implementation - The implementation to name.
+ *
+ * @return const char* containing the name.
+ */
+const char *GCodeScanner::implementationName(Implementation implementation)
+{
+    switch (implementation) {
+    case Scalar:
+        return "scalar";
+
+    case SSE2:
+        return "SSE2";
+
+    case AVX2:
+        return "AVX2";
+    }
+
+    return "unknown";
+}
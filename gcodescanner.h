@@ -0,0 +1,30 @@
+#ifndef GCODESCANNER_H
+#define GCODESCANNER_H
+
+#include <stddef.h>
+
+// Vectorized helpers for finding line endings, comments and whitespace in G-code.  The fastest
+// implementation that the CPU supports is selected the first time one of the helpers is used.
+class GCodeScanner
+{
+public:
+    enum Implementation {
+        Scalar,
+        SSE2,
+        AVX2
+    };
+
+    static const char *findByte(const char *start, const char *end, char c);
+    static const char *findNewline(const char *start, const char *end);
+    static const char *findCommentOrNewline(const char *start, const char *end);
+    static const char *skipWhitespace(const char *start, const char *end);
+    static const char *trimTrailingWhitespace(const char *start, const char *end);
+    static size_t countNewlines(const char *start, const char *end);
+
+    static bool isImplementationSupported(Implementation implementation);
+    static bool setImplementation(Implementation implementation);
+    static Implementation getImplementation();
+    static const char *implementationName(Implementation implementation);
+};
+
+#endif // GCODESCANNER_H
@@ -0,0 +1,563 @@
+#include "gcodetimeestimator.h"
+#include "gcodeprogram.h"
+#include "gcodetokenizer.h"
+#include "profiler.h"
+
+#include <math.h>
+#include <stdio.h>
+
+// Used for "no limit" on a speed or acceleration.
+#define GCODE_ESTIMATOR_UNLIMITED            1e30
+
+// Moves shorter than this (in mm) don't move the machine at all.
+#define GCODE_ESTIMATOR_MIN_LENGTH           1e-9
+
+// How long each of the straight moves an arc is split in to is.  (mm, the firmware's MM_PER_ARC_SEGMENT.)
+#define GCODE_ESTIMATOR_ARC_SEGMENT_LENGTH   1.0
+
+/**
+ * @brief trapezoidTime - Work out how long a move takes with a trapezoidal velocity profile.  (Accelerate from
+ *      the entry speed to the nominal speed, cruise, then decelerate to the exit speed.  If the move is too
+ *      short to reach the nominal speed, it accelerates to the highest speed it can and decelerates from there.)
+ *
+ * @param length - The length of the move.  (mm)
+ * @param entrySpeed - The speed the move starts at.  (mm/s)
+ * @param exitSpeed - The speed the move ends at.  (mm/s)
+ * @param nominalSpeed - The fastest the move can go.  (mm/s)
+ * @param acceleration - The acceleration along the move.  (mm/s^2)
+ *
+ * @return double containing the time in seconds.
+ */
+static double trapezoidTime(double length, double entrySpeed, double exitSpeed, double nominalSpeed, double acceleration)
+{
+    double inverseAcceleration = 1 / acceleration;
+    double accelerateDistance;
+    double decelerateDistance;
+    double peakSpeed;
+
+    nominalSpeed = qMax(nominalSpeed, qMax(entrySpeed, exitSpeed));
+
+    accelerateDistance = ((nominalSpeed * nominalSpeed) - (entrySpeed * entrySpeed)) * 0.5 * inverseAcceleration;
+    decelerateDistance = ((nominalSpeed * nominalSpeed) - (exitSpeed * exitSpeed)) * 0.5 * inverseAcceleration;
+
+    if ((accelerateDistance + decelerateDistance) <= length) {
+        return (((2 * nominalSpeed) - entrySpeed - exitSpeed) * inverseAcceleration) +
+                ((length - accelerateDistance - decelerateDistance) / nominalSpeed);
+    }
+
+    peakSpeed = sqrt(((2 * acceleration * length) + (entrySpeed * entrySpeed) + (exitSpeed * exitSpeed)) / 2);
+    peakSpeed = qMax(peakSpeed, qMax(entrySpeed, exitSpeed));
+
+    return ((2 * peakSpeed) - entrySpeed - exitSpeed) * inverseAcceleration;
+}
+
+GCodeTimeEstimator::GCodeTimeEstimator()
+{
+    setMaxFeedRates(GCODE_ESTIMATOR_DEFAULT_MAX_XY_FEED_RATE, GCODE_ESTIMATOR_DEFAULT_MAX_Z_FEED_RATE);
+    setAccelerations(GCODE_ESTIMATOR_DEFAULT_XY_ACCELERATION, GCODE_ESTIMATOR_DEFAULT_Z_ACCELERATION);
+    setJunctionDeviation(GCODE_ESTIMATOR_DEFAULT_JUNCTION_DEVIATION);
+
+    reset();
+}
+
+/**
+ * @brief GCodeTimeEstimator::setMaxFeedRates - Set the fastest each axis can move.  Rapid (G00) moves always
+ *      go this fast.
+ *
+ * @param xy - The fastest the X and Y axes can move.  (mm/min)
+ * @param z - The fastest the Z axis can move.  (mm/min)
+ */
+void GCodeTimeEstimator::setMaxFeedRates(double xy, double z)
+{
+    mMaxFeedRate[0] = xy / 60;
+    mMaxFeedRate[1] = xy / 60;
+    mMaxFeedRate[2] = z / 60;
+}
+
+/**
+ * @brief GCodeTimeEstimator::setAccelerations - Set how quickly each axis can change speed.
+ *
+ * @param xy - The acceleration of the X and Y axes.  (mm/s^2)
+ * @param z - The acceleration of the Z axis.  (mm/s^2)
+ */
+void GCodeTimeEstimator::setAccelerations(double xy, double z)
+{
+    mAcceleration[0] = xy;
+    mAcceleration[1] = xy;
+    mAcceleration[2] = z;
+}
+
+/**
+ * @brief GCodeTimeEstimator::setJunctionDeviation - Set how far the path is allowed to stray from a corner
+ *      while going around it.  The larger this is, the faster corners are taken.
+ *
+ * @param deviation - The junction deviation.  (mm)
+ */
+void GCodeTimeEstimator::setJunctionDeviation(double deviation)
+{
+    mJunctionDeviation = deviation;
+}
+
+/**
+ * @brief GCodeTimeEstimator::estimate - Work out how long a program takes to run.  Lines that have been
+ *      deleted are skipped, and changed feed rates are used, so the same program can be estimated before
+ *      and after it has been changed.  Lines are taken in the order they will be written in.  The machine
+ *      starts at 0,0,0 in absolute positioning.  Arcs with an I or J word are split in to short moves the way
+ *      the firmware does it.  (Arcs with an R word are counted as straight moves to their end points.)  Dwells
+ *      aren't counted.
+ *
+ * @param program - The program to estimate.
+ * @param result[out] - The totals for the program.
+ */
+void GCodeTimeEstimator::estimate(const GCodeProgram &program, GCodeTimeEstimate *result)
+{
+    int lineCount = program.getLineCount();
+    const quint8 *commands = program.commands();
+    const quint32 *flags = program.flags();
+    const double *x = program.xValues();
+    const double *y = program.yValues();
+    const double *z = program.zValues();
+    const double *feedRates = program.feedRates();
+    double position[3] = { 0, 0, 0 };
+    double start[3];
+    GCodeArcCentre centre;
+    double feedRate = GCODE_ESTIMATOR_DEFAULT_FEED_RATE;
+    bool absolute = true;
+    int motionMode = -1;
+    int i;
+
+    reset();
+
+    for (int n = 0; n < lineCount; n++) {
+        i = program.lineAt(n);
+        if ((flags[i] & GCODE_LINE_DELETED) != 0) {
+            continue;
+        }
+
+        if ((flags[i] & GCODE_LINE_ABSOLUTE) != 0) {
+            absolute = true;
+        } else if ((flags[i] & GCODE_LINE_RELATIVE) != 0) {
+            absolute = false;
+        }
+
+        if ((commands[i] >= GCODE_COMMAND_G0) && (commands[i] <= GCODE_COMMAND_G3)) {
+            motionMode = commands[i] - GCODE_COMMAND_G0;
+        }
+
+        if (program.setsFeedRate(i) == true) {
+            feedRate = feedRates[i];
+        }
+
+        if (((flags[i] & (GCODE_LINE_HAS_X | GCODE_LINE_HAS_Y | GCODE_LINE_HAS_Z)) == 0) || (motionMode < 0)) {
+            continue;
+        }
+
+        start[0] = position[0];
+        start[1] = position[1];
+        start[2] = position[2];
+
+        if ((flags[i] & GCODE_LINE_HAS_X) != 0) {
+            position[0] = (absolute == true) ? x[i] : (position[0] + x[i]);
+        }
+
+        if ((flags[i] & GCODE_LINE_HAS_Y) != 0) {
+            position[1] = (absolute == true) ? y[i] : (position[1] + y[i]);
+        }
+
+        if ((flags[i] & GCODE_LINE_HAS_Z) != 0) {
+            position[2] = (absolute == true) ? z[i] : (position[2] + z[i]);
+        }
+
+        if (((motionMode == 2) || (motionMode == 3)) && (program.getArcCentre(i, &centre) == true)) {
+            addArc(start, position, centre, (motionMode == 2), feedRate);
+        } else {
+            addMove(position[0], position[1], position[2], feedRate, (motionMode == 0));
+        }
+    }
+
+    finish(result);
+}
+
+/**
+ * @brief GCodeTimeEstimator::addArc - Add an arc in the XY plane, split in to straight moves of about
+ *      GCODE_ESTIMATOR_ARC_SEGMENT_LENGTH, the same as the firmware does.  (Any Z move is spread along it.)
+ *
+ * @param start - Where the arc starts.
+ * @param end - Where the arc ends.
+ * @param centre - The centre of the arc, relative to start.
+ * @param clockwise - true for a G02, false for a G03.
+ * @param feedRate - The feed rate of the arc.  (mm/min)
+ */
+void GCodeTimeEstimator::addArc(const double *start, const double *end, const GCodeArcCentre &centre, bool clockwise, double feedRate)
+{
+    double centreX = start[0] + centre.i;
+    double centreY = start[1] + centre.j;
+    double radius = sqrt((centre.i * centre.i) + (centre.j * centre.j));
+    double startAngle = atan2(-centre.j, -centre.i);
+    double sweep = atan2(end[1] - centreY, end[0] - centreX) - startAngle;
+    double angle;
+    int segments;
+
+    if (clockwise == true) {
+        if (sweep >= 0) {
+            sweep -= 2 * M_PI;
+        }
+    } else if (sweep <= 0) {
+        sweep += 2 * M_PI;
+    }
+
+    segments = (int)floor(fabs(sweep) * radius / GCODE_ESTIMATOR_ARC_SEGMENT_LENGTH);
+    for (int i = 1; i < segments; i++) {
+        angle = startAngle + (sweep * i / segments);
+        addMove(centreX + (radius * cos(angle)), centreY + (radius * sin(angle)),
+                start[2] + ((end[2] - start[2]) * i / segments), feedRate, false);
+    }
+
+    addMove(end[0], end[1], end[2], feedRate, false);
+}
+
+/**
+ * @brief GCodeTimeEstimator::reset - Forget every move, and start again from 0,0,0.
+ */
+void GCodeTimeEstimator::reset()
+{
+    for (int i = 0; i < 3; i++) {
+        mPosition[i] = 0;
+        mLastUnit[i] = 0;
+    }
+
+    mLastNominalSpeed = 0;
+    mHaveLastMove = false;
+
+    mFirstBlock = 0;
+    mBlockCount = 0;
+
+    mTotals.cutLength = 0;
+    mTotals.rapidLength = 0;
+    mTotals.cutSeconds = 0;
+    mTotals.rapidSeconds = 0;
+    mTotals.seconds = 0;
+    mTotals.moves = 0;
+}
+
+/**
+ * @brief GCodeTimeEstimator::addMove - Add a straight move from the end of the last one.  (For code that
+ *      creates moves itself, rather than estimating a program.)
+ *
+ * @param x - Where the move ends.
+ * @param y - Where the move ends.
+ * @param z - Where the move ends.
+ * @param feedRate - The feed rate of the move.  (mm/min, ignored for rapid moves.)
+ * @param rapid - true for a G00 move, false for a cutting move.
+ */
+void GCodeTimeEstimator::addMove(double x, double y, double z, double feedRate, bool rapid)
+{
+    GCodePlannerBlock *block;
+    double delta[3];
+    double unit[3];
+    double length;
+    double inverseAxis;
+    double cosTheta;
+    double sinHalfTheta;
+    double junctionSpeedSqr;
+    double nextEntrySpeedSqr;
+    double entrySpeedSqr;
+
+    delta[0] = x - mPosition[0];
+    delta[1] = y - mPosition[1];
+    delta[2] = z - mPosition[2];
+
+    mPosition[0] = x;
+    mPosition[1] = y;
+    mPosition[2] = z;
+
+    length = sqrt((delta[0] * delta[0]) + (delta[1] * delta[1]) + (delta[2] * delta[2]));
+    if (length < GCODE_ESTIMATOR_MIN_LENGTH) {
+        return;
+    }
+
+    if (mBlockCount == GCODE_ESTIMATOR_PLANNER_BLOCKS) {
+        runOldest();
+    }
+
+    block = &mBlocks[(mFirstBlock + mBlockCount) % GCODE_ESTIMATOR_PLANNER_BLOCKS];
+    mBlockCount++;
+
+    block->length = length;
+    block->rapid = rapid;
+    block->nominalSpeed = GCODE_ESTIMATOR_UNLIMITED;
+    block->acceleration = GCODE_ESTIMATOR_UNLIMITED;
+
+    if ((rapid == false) && (feedRate > 0)) {
+        block->nominalSpeed = feedRate / 60;
+    }
+
+    // Each axis that moves limits the speed and acceleration along the move.
+    for (int i = 0; i < 3; i++) {
+        unit[i] = delta[i] / length;
+
+        if (delta[i] != 0) {
+            inverseAxis = length / fabs(delta[i]);
+            block->nominalSpeed = qMin(block->nominalSpeed, mMaxFeedRate[i] * inverseAxis);
+            block->acceleration = qMin(block->acceleration, mAcceleration[i] * inverseAxis);
+        }
+    }
+
+    // The speed through the corner with the last move.  (The junction deviation model, as the firmware uses.)
+    if (mHaveLastMove == false) {
+        block->maxEntrySpeedSqr = 0;
+    } else {
+        cosTheta = -((unit[0] * mLastUnit[0]) + (unit[1] * mLastUnit[1]) + (unit[2] * mLastUnit[2]));
+
+        if (cosTheta < -0.999999) {
+            // Straight on.
+            junctionSpeedSqr = GCODE_ESTIMATOR_UNLIMITED;
+        } else if (cosTheta > 0.999999) {
+            // Straight back.
+            junctionSpeedSqr = 0;
+        } else {
+            sinHalfTheta = sqrt(0.5 * (1 - cosTheta));
+            junctionSpeedSqr = (block->acceleration * mJunctionDeviation * sinHalfTheta) / (1 - sinHalfTheta);
+        }
+
+        block->maxEntrySpeedSqr = qMin(junctionSpeedSqr, qMin(block->nominalSpeed * block->nominalSpeed,
+                                                              mLastNominalSpeed * mLastNominalSpeed));
+    }
+
+    // Plan it as if the machine has to stop at the end of it, then let the moves before it speed up, now
+    // that they don't have to stop either.  Planned speeds only ever go up as more moves are added, so once
+    // a move's speed doesn't change, none of the ones before it will either.  (The oldest move's speed is
+    // already fixed.)
+    block->entrySpeedSqr = qMin(block->maxEntrySpeedSqr, 2 * block->acceleration * length);
+    nextEntrySpeedSqr = block->entrySpeedSqr;
+
+    for (int i = mBlockCount - 2; i >= 1; i--) {
+        GCodePlannerBlock &earlier = mBlocks[(mFirstBlock + i) % GCODE_ESTIMATOR_PLANNER_BLOCKS];
+
+        entrySpeedSqr = qMin(earlier.maxEntrySpeedSqr, nextEntrySpeedSqr + (2 * earlier.acceleration * earlier.length));
+        if (entrySpeedSqr == earlier.entrySpeedSqr) {
+            break;
+        }
+
+        earlier.entrySpeedSqr = entrySpeedSqr;
+        nextEntrySpeedSqr = entrySpeedSqr;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        mLastUnit[i] = unit[i];
+    }
+    mLastNominalSpeed = block->nominalSpeed;
+    mHaveLastMove = true;
+}
+
+/**
+ * @brief GCodeTimeEstimator::finish - Run the moves that are still waiting (coming to a stop at the end), and
+ *      get the totals.  The estimator is reset afterwards.
+ *
+ * @param result[out] - The totals for every move that was added.
+ */
+void GCodeTimeEstimator::finish(GCodeTimeEstimate *result)
+{
+    while (mBlockCount > 0) {
+        runOldest();
+    }
+
+    mTotals.seconds = mTotals.cutSeconds + mTotals.rapidSeconds;
+    *result = mTotals;
+
+    reset();
+}
+
+/**
+ * @brief GCodeTimeEstimator::formatDuration - Format a time as hours, minutes and seconds.
+ *
+ * @param seconds - The time to format.
+ *
+ * @return QString containing the time as "h:mm:ss".
+ */
+QString GCodeTimeEstimator::formatDuration(double seconds)
+{
+    char text[32];
+    long long total = (long long)(seconds + 0.5);
+
+    snprintf(text, sizeof(text), "%lld:%02lld:%02lld", total / 3600, (total / 60) % 60, total % 60);
+
+    return QString(text);
+}
+
+/**
+ * @brief GCodeTimeEstimator::runOldest - Run the oldest waiting move.  Its start speed is already fixed, so it
+ *      ends at the planned start speed of the next move, unless it can't accelerate that much in its length.
+ */
+void GCodeTimeEstimator::runOldest()
+{
+    GCodePlannerBlock *oldest = &mBlocks[mFirstBlock];
+    GCodePlannerBlock *next;
+    double exitSpeedSqr = 0;
+
+    mFirstBlock = (mFirstBlock + 1) % GCODE_ESTIMATOR_PLANNER_BLOCKS;
+    mBlockCount--;
+
+    if (mBlockCount > 0) {
+        next = &mBlocks[mFirstBlock];
+        exitSpeedSqr = qMin(next->entrySpeedSqr, oldest->entrySpeedSqr + (2 * oldest->acceleration * oldest->length));
+        next->entrySpeedSqr = exitSpeedSqr;
+    }
+
+    runBlock(*oldest, sqrt(exitSpeedSqr));
+}
+
+/**
+ * @brief GCodeTimeEstimator::runBlock - Add a planned move to the totals.
+ *
+ * @param block - The move.
+ * @param exitSpeed - The speed the move ends at.
+ */
+void GCodeTimeEstimator::runBlock(const GCodePlannerBlock &block, double exitSpeed)
+{
+    double seconds = trapezoidTime(block.length, sqrt(block.entrySpeedSqr), exitSpeed, block.nominalSpeed, block.acceleration);
+
+    if (block.rapid == true) {
+        mTotals.rapidLength += block.length;
+        mTotals.rapidSeconds += seconds;
+    } else {
+        mTotals.cutLength += block.length;
+        mTotals.cutSeconds += seconds;
+    }
+
+    mTotals.moves++;
+}
+
+GCodeEstimatingOutput::GCodeEstimatingOutput(GCodeOutput *output, const GCodeTimeEstimator &estimator) :
+    GCodeLineOutput(output, PROFILE_STAGE_ESTIMATE),
+    mEstimator(estimator)
+{
+    mEstimator.reset();
+
+    mPosition[0] = 0;
+    mPosition[1] = 0;
+    mPosition[2] = 0;
+    mFeedRate = GCODE_ESTIMATOR_DEFAULT_FEED_RATE;
+    mAbsolute = true;
+    mMotionMode = -1;
+
+    mEstimate.cutLength = 0;
+    mEstimate.rapidLength = 0;
+    mEstimate.cutSeconds = 0;
+    mEstimate.rapidSeconds = 0;
+    mEstimate.seconds = 0;
+    mEstimate.moves = 0;
+}
+
+/**
+ * @brief GCodeEstimatingOutput::finish - Follow the last line, if it had no line ending, and run the moves
+ *      that are still waiting in the planner.
+ */
+void GCodeEstimatingOutput::finish()
+{
+    GCodeLineOutput::finish();
+
+    mEstimator.finish(&mEstimate);
+}
+
+/**
+ * @brief GCodeEstimatingOutput::getEstimate - Get the totals for the lines that were written.  (Once finish()
+ *      has been called.)
+ *
+ * @param result[out] - The totals.
+ */
+void GCodeEstimatingOutput::getEstimate(GCodeTimeEstimate *result) const
+{
+    *result = mEstimate;
+}
+
+/**
+ * @brief GCodeEstimatingOutput::processLine - Follow the modal state through a line, add its move to the
+ *      estimate, and pass it on.
+ *
+ * @param line - The line, with its line ending (if it has one).
+ * @param length - The length of the line.
+ */
+void GCodeEstimatingOutput::processLine(const char *line, size_t length)
+{
+    GCodeTokenizer tokenizer(line, length);
+    GCodeWord word;
+    GCodeArcCentre centre = { 0, 0 };
+    double value[3] = { 0, 0, 0 };
+    bool given[3] = { false, false, false };
+    bool haveCentre = false;
+    bool moving = false;
+    double start[3];
+    int code;
+    int axis;
+
+    while (tokenizer.nextWord(&word) == true) {
+        axis = -1;
+
+        switch (word.letter) {
+        case 'G':
+            code = (int)floor((word.value * 10) + 0.5);
+
+            if ((code == 0) || (code == 10) || (code == 20) || (code == 30)) {
+                mMotionMode = code / 10;
+            } else if (code == 900) {
+                mAbsolute = true;
+            } else if (code == 910) {
+                mAbsolute = false;
+            }
+            break;
+
+        case 'F':
+            mFeedRate = word.value;
+            break;
+
+        case 'I':
+            centre.i = word.value;
+            haveCentre = true;
+            break;
+
+        case 'J':
+            centre.j = word.value;
+            haveCentre = true;
+            break;
+
+        case 'X':
+            axis = 0;
+            break;
+
+        case 'Y':
+            axis = 1;
+            break;
+
+        case 'Z':
+            axis = 2;
+            break;
+        }
+
+        if (axis >= 0) {
+            given[axis] = true;
+            value[axis] = word.value;
+            moving = true;
+        }
+    }
+
+    if ((moving == true) && (mMotionMode >= 0)) {
+        for (int i = 0; i < 3; i++) {
+            start[i] = mPosition[i];
+
+            if (given[i] == true) {
+                mPosition[i] = (mAbsolute == true) ? value[i] : (mPosition[i] + value[i]);
+            }
+        }
+
+        if (((mMotionMode == 2) || (mMotionMode == 3)) && (haveCentre == true)) {
+            mEstimator.addArc(start, mPosition, centre, (mMotionMode == 2), mFeedRate);
+        } else {
+            mEstimator.addMove(mPosition[0], mPosition[1], mPosition[2], mFeedRate, (mMotionMode == 0));
+        }
+    }
+
+    if (mOutput != NULL) {
+        mOutput->write(line, length);
+    }
+}
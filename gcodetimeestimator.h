@@ -0,0 +1,116 @@
+#ifndef GCODETIMEESTIMATOR_H
+#define GCODETIMEESTIMATOR_H
+
+#include "gcodeoutput.h"
+
+#include <QString>
+
+class GCodeProgram;
+struct GCodeArcCentre;
+
+// The machine limits used when no others are set.  (mm/min for feed rates, mm/s^2 for accelerations.)
+#define GCODE_ESTIMATOR_DEFAULT_MAX_XY_FEED_RATE     12000
+#define GCODE_ESTIMATOR_DEFAULT_MAX_Z_FEED_RATE      900
+#define GCODE_ESTIMATOR_DEFAULT_XY_ACCELERATION      1000
+#define GCODE_ESTIMATOR_DEFAULT_Z_ACCELERATION       100
+#define GCODE_ESTIMATOR_DEFAULT_JUNCTION_DEVIATION   0.05
+
+// The feed rate (mm/min) of a cutting move that comes before any F word.  (The firmware's start up default.)
+#define GCODE_ESTIMATOR_DEFAULT_FEED_RATE            1500
+
+// How many moves the planner looks ahead, the same as the printer's firmware does.
+#define GCODE_ESTIMATOR_PLANNER_BLOCKS               16
+
+// The totals for a program.  (Lengths in mm, times in seconds.)
+struct GCodeTimeEstimate
+{
+    double cutLength;               // G01/G02/G03 moves.
+    double rapidLength;             // G00 moves.
+    double cutSeconds;
+    double rapidSeconds;
+    double seconds;
+    quint64 moves;
+};
+
+// One move waiting in the planner.
+struct GCodePlannerBlock
+{
+    double length;
+    double nominalSpeed;            // The fastest the move can go.  (mm/s)
+    double acceleration;            // mm/s^2, along the move.
+    double maxEntrySpeedSqr;        // The fastest the move can start (squared), from the corner it makes with the one before.
+    double entrySpeedSqr;           // The speed the move starts at (squared), as it is planned so far.
+    bool rapid;
+};
+
+// Works out how long a program takes to run, the way the firmware would run it.  Each move accelerates and
+// decelerates with a trapezoidal velocity profile, limited by the feed rate and the per axis feed rate and
+// acceleration limits.  The speed through each corner is limited by the junction deviation, and the planner
+// only looks GCODE_ESTIMATOR_PLANNER_BLOCKS moves ahead, so that it has to slow down where the firmware would.
+class GCodeTimeEstimator
+{
+public:
+    GCodeTimeEstimator();
+
+    void setMaxFeedRates(double xy, double z);
+    void setAccelerations(double xy, double z);
+    void setJunctionDeviation(double deviation);
+
+    void estimate(const GCodeProgram &program, GCodeTimeEstimate *result);
+
+    void reset();
+    void addMove(double x, double y, double z, double feedRate, bool rapid);
+    void finish(GCodeTimeEstimate *result);
+
+    static QString formatDuration(double seconds);
+
+private:
+    friend class GCodeEstimatingOutput;
+
+    void addArc(const double *start, const double *end, const GCodeArcCentre &centre, bool clockwise, double feedRate);
+    void runOldest();
+    void runBlock(const GCodePlannerBlock &block, double exitSpeed);
+
+    double mMaxFeedRate[3];         // mm/s
+    double mAcceleration[3];
+    double mJunctionDeviation;
+
+    // Where the last move ended, and which way it was going.
+    double mPosition[3];
+    double mLastUnit[3];
+    double mLastNominalSpeed;
+    bool mHaveLastMove;
+
+    // The moves that are waiting to be run.  (A ring, oldest first.)
+    GCodePlannerBlock mBlocks[GCODE_ESTIMATOR_PLANNER_BLOCKS];
+    int mFirstBlock;
+    int mBlockCount;
+
+    GCodeTimeEstimate mTotals;
+};
+
+// Estimates the run time of the lines that are written through it, a line at a time, so that a file can be
+// estimated while it is read or written without holding it in memory.  Lines are passed on to the output
+// unchanged, if there is one.  The lines are followed the same way estimate() follows a program.
+class GCodeEstimatingOutput : public GCodeLineOutput
+{
+public:
+    GCodeEstimatingOutput(GCodeOutput *output, const GCodeTimeEstimator &estimator);
+
+    void finish();
+    void getEstimate(GCodeTimeEstimate *result) const;
+
+protected:
+    void processLine(const char *line, size_t length);
+
+private:
+    GCodeTimeEstimator mEstimator;
+    GCodeTimeEstimate mEstimate;    // Set by finish().
+
+    double mPosition[3];
+    double mFeedRate;
+    bool mAbsolute;
+    int mMotionMode;                // 0-3, or -1 before the first G00-G03.
+};
+
+#endif // GCODETIMEESTIMATOR_H
@@ -0,0 +1,169 @@
+#include "gcodetokenizer.h"
+#include "gcodescanner.h"
+
+// The most significant digits of a number that are used.  (A double holds about 17, and 19 still fit in the
+// mantissa without overflowing it.)
+#define GCODE_TOKENIZER_MAX_DIGITS           19
+
+// Powers of ten that can be represented exactly as a double.
+static const double powersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/**
+ * @brief GCodeTokenizer::GCodeTokenizer - Set up to walk the words on one line of G-code.  The line
+ *      isn't copied, so it needs to stay valid for as long as the tokenizer is in use.
+ *
+ * @param line - The first character of the line.
+ * @param length - The number of characters on the line.  (A line ending is allowed, but not required.)
+ */
+GCodeTokenizer::GCodeTokenizer(const char *line, size_t length)
+{
+    mCursor = line;
+    mEnd = line + length;
+    mWordsEnd = line;
+}
+
+/**
+ * @brief GCodeTokenizer::nextWord - Find the next word on the line.  Comments in parentheses are skipped,
+ *      and anything following a ';' (or a line ending) is ignored.
+ *
+ * @param word[out] - The word that was found.
+ *
+ * @return true if a word was found.  false if there are no more words on the line.
+ */
+bool GCodeTokenizer::nextWord(GCodeWord *word)
+{
+    const char *cursor = mCursor;
+    const char *end = mEnd;
+    char c;
+
+    while (cursor < end) {
+        c = *cursor;
+
+        if (((c >= 'A') && (c <= 'Z')) || ((c >= 'a') && (c <= 'z'))) {
+            word->start = cursor;
+            word->letter = c & ~0x20;        // Upper case.
+            cursor++;
+            word->valueStart = cursor;
+
+            if ((cursor < end) && ((*cursor == '-') || (*cursor == '+'))) {
+                cursor++;
+            }
+
+            while ((cursor < end) && (((*cursor >= '0') && (*cursor <= '9')) || (*cursor == '.'))) {
+                cursor++;
+            }
+
+            word->end = cursor;
+            word->value = parseNumber(word->valueStart, cursor);
+
+            mCursor = cursor;
+            mWordsEnd = cursor;
+            return true;
+        }
+
+        if ((c == ';') || (c == '\r') || (c == '\n')) {
+            // The rest of the line is a comment (or the line ending).
+            break;
+        }
+
+        if (c == '(') {
+            cursor = GCodeScanner::findByte(cursor, end, ')');
+            if (cursor >= end) {
+                // The comment is never closed, so it runs to the end of the line.
+                break;
+            }
+        }
+
+        // Whitespace, the end of a comment, or something we don't understand.
+        cursor++;
+    }
+
+    mCursor = end;
+    return false;
+}
+
+/**
+ * @brief GCodeTokenizer::getWordsEnd - Returns the position just after the last word that was found.
+ *      This is where a new word should be added to the line, ahead of any comment or line ending.
+ *
+ * @return const char* pointing just past the last word returned by nextWord().
+ */
+const char *GCodeTokenizer::getWordsEnd()
+{
+    return mWordsEnd;
+}
+
+/**
+ * @brief GCodeTokenizer::parseNumber - Convert the text of a G-code number to a double.  This is done by
+ *      hand, rather than with strtod(), so that it is fast, and so that the result doesn't depend on the
+ *      locale.  Numbers with up to 15 significant digits (and no more than 22 digits after the point) are
+ *      converted exactly.  Longer numbers keep their first GCODE_TOKENIZER_MAX_DIGITS significant digits,
+ *      which is more than a double can hold anyway.
+ *
+ * @param start - The first character of the number.
+ * @param end - One past the last character of the number.
+ *
+ * @return double containing the value of the number.
+ */
+double GCodeTokenizer::parseNumber(const char *start, const char *end)
+{
+    bool negative = false;
+    unsigned long long mantissa = 0;
+    int digits = 0;
+    int exponent = 0;               // The power of ten the mantissa is multiplied by.
+    bool fraction = false;
+    const char *cursor;
+    double value;
+
+    if ((start < end) && ((*start == '-') || (*start == '+'))) {
+        negative = (*start == '-');
+        start++;
+    }
+
+    for (cursor = start; cursor < end; cursor++) {
+        if (*cursor == '.') {
+            fraction = true;
+            continue;
+        }
+
+        if (digits < GCODE_TOKENIZER_MAX_DIGITS) {
+            mantissa = (mantissa * 10) + (*cursor - '0');
+            if (fraction == true) {
+                exponent--;
+            }
+
+            // Leading zeros don't use up any precision.
+            if (mantissa != 0) {
+                digits++;
+            }
+        } else if (fraction == false) {
+            // The digits that don't fit still count in the whole part, but not after the point.
+            exponent++;
+        }
+    }
+
+    value = (double)mantissa;
+
+    if ((digits <= 15) && (exponent >= -22) && (exponent <= 22)) {
+        // Both the mantissa and the power of ten are exact, so one operation rounds it correctly.
+        value = (exponent < 0) ? (value / powersOfTen[-exponent]) : (value * powersOfTen[exponent]);
+    } else {
+        // Too many digits to do it exactly, so settle for close.
+        while (exponent < -22) {
+            value /= powersOfTen[22];
+            exponent += 22;
+        }
+
+        while (exponent > 22) {
+            value *= powersOfTen[22];
+            exponent -= 22;
+        }
+
+        value = (exponent < 0) ? (value / powersOfTen[-exponent]) : (value * powersOfTen[exponent]);
+    }
+
+    return (negative == true) ? -value : value;
+}
@@ -0,0 +1,33 @@
+#ifndef GCODETOKENIZER_H
+#define GCODETOKENIZER_H
+
+#include <stddef.h>
+
+// One word (a letter followed by a number) from a line of G-code.  The pointers refer to the
+// line that was handed to the tokenizer, nothing is copied.
+struct GCodeWord
+{
+    char letter;                // Always upper case.
+    double value;
+    const char *start;          // The letter.
+    const char *valueStart;     // The first character of the number.
+    const char *end;            // One past the last character of the number.
+};
+
+class GCodeTokenizer
+{
+public:
+    GCodeTokenizer(const char *line, size_t length);
+
+    bool nextWord(GCodeWord *word);
+    const char *getWordsEnd();
+
+    static double parseNumber(const char *start, const char *end);
+
+private:
+    const char *mCursor;
+    const char *mEnd;
+    const char *mWordsEnd;
+};
+
+#endif // GCODETOKENIZER_H
@@ -0,0 +1,883 @@
+#include "gcodetraveloptimizer.h"
+#include "gcodeprogram.h"
+#include "gcodetokenizer.h"
+#include "gcodetimeestimator.h"
+
+#include <QList>
+#include <QThread>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include <math.h>
+#include <string.h>
+
+/**
+ * @brief distance - Get the distance between two points in the X/Y plane.
+ */
+static inline double distance(double x1, double y1, double x2, double y2)
+{
+    double dx = x2 - x1;
+    double dy = y2 - y1;
+
+    return sqrt((dx * dx) + (dy * dy));
+}
+
+/**
+ * @brief hop - Get the X/Y travel from the end of one block to the start of another.
+ */
+static inline double hop(const GCodeTravelBlock &from, const GCodeTravelBlock &to)
+{
+    return distance(from.exitX, from.exitY, to.entryX, to.entryY);
+}
+
+/**
+ * @brief sameFeedRate - Check if two lines set the same feed rate.
+ *
+ * @param feedRates - The feed rates of the program.
+ * @param line1 - A line that sets the feed rate, or -1 if none has been set.
+ * @param line2 - Another line that sets the feed rate, or -1 if none has been set.
+ *
+ * @return true if the feed rates are the same.
+ */
+static inline bool sameFeedRate(const double *feedRates, int line1, int line2)
+{
+    if ((line1 < 0) || (line2 < 0)) {
+        return (line1 == line2);
+    }
+
+    return (feedRates[line1] == feedRates[line2]);
+}
+
+/**
+ * @brief onlyArcWords - Check that a G02/G03 line with other words on it has nothing on it but the words of an
+ *      arc.  (I and J are counted as other words, so are the words we don't know about.)
+ *
+ * @param program - The program the line is in.
+ * @param line - The line to check.
+ *
+ * @return true if the line only has G00-G03, G90, X, Y, Z, F, I and J words.
+ */
+static bool onlyArcWords(const GCodeProgram &program, int line)
+{
+    GCodeArcCentre centre;
+    QByteArray text;
+    GCodeWord word;
+
+    if (program.getArcCentre(line, &centre) == false) {
+        return false;
+    }
+
+    if ((program.getFlags(line) & GCODE_LINE_REPLACED) != 0) {
+        // The arc fitter wrote it.
+        return true;
+    }
+
+    text = program.getLineText(line);
+    GCodeTokenizer tokenizer(text.constData(), text.size());
+
+    while (tokenizer.nextWord(&word) == true) {
+        if (word.letter == 'G') {
+            if ((word.value != 0) && (word.value != 1) && (word.value != 2) && (word.value != 3) && (word.value != 90)) {
+                return false;
+            }
+        } else if ((word.letter != 'X') && (word.letter != 'Y') && (word.letter != 'Z') && (word.letter != 'F') &&
+                   (word.letter != 'I') && (word.letter != 'J')) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief improveSlice - Improve the order of a slice of blocks with 2-opt, until no more improvements are found
+ *      or the time runs out.  Each pass tries reversing every run of blocks in the slice, and keeps the ones
+ *      that shorten the travel.  (The blocks themselves are always cut the way they were written, so the travel
+ *      inside a reversed run is worked out again, from running totals of the travel each way.)
+ *
+ * @param blocks - Every block.
+ * @param order[in/out] - The order of the blocks.  Only places first to last are changed.
+ * @param first - The first place that can change.
+ * @param last - The last place that can change.
+ * @param fromX - Where the machine is before the block at first.
+ * @param fromY
+ * @param openEnd - true if nothing comes after last.  Otherwise the block at last + 1 stays where it is.
+ * @param timer - Started when the optimization started.
+ * @param timeBudget - When (in ms, on the timer) to stop.
+ *
+ * @return The travel that was saved.  (mm)
+ */
+static double improveSlice(const GCodeTravelBlock *blocks, int *order, int first, int last, double fromX, double fromY,
+                           bool openEnd, const QElapsedTimer *timer, int timeBudget)
+{
+    int count = last - first + 1;
+    QVector<double> forward(count);     // The travel from place first to each place, in the order.
+    QVector<double> backward(count);    // The same, with every hop the other way around.
+    int *slice = order + first;
+    double saved = 0;
+    double prevX;
+    double prevY;
+    double before;
+    double after;
+    bool improved = true;
+    bool changed = true;                // The running totals need working out again.
+
+    if (count < 2) {
+        return 0;
+    }
+
+    while (improved == true) {
+        improved = false;
+
+        for (int i = 0; i < (count - 1); i++) {
+            if (timer->elapsed() >= timeBudget) {
+                return saved;
+            }
+
+            if (changed == true) {
+                changed = false;
+                forward[0] = 0;
+                backward[0] = 0;
+                for (int k = 1; k < count; k++) {
+                    forward[k] = forward[k - 1] + hop(blocks[slice[k - 1]], blocks[slice[k]]);
+                    backward[k] = backward[k - 1] + hop(blocks[slice[k]], blocks[slice[k - 1]]);
+                }
+            }
+
+            prevX = (i == 0) ? fromX : blocks[slice[i - 1]].exitX;
+            prevY = (i == 0) ? fromY : blocks[slice[i - 1]].exitY;
+
+            const GCodeTravelBlock &startBlock = blocks[slice[i]];
+            double in = distance(prevX, prevY, startBlock.entryX, startBlock.entryY);
+
+            for (int j = i + 1; j < count; j++) {
+                const GCodeTravelBlock &endBlock = blocks[slice[j]];
+
+                // Reverse the blocks from i to j.
+                before = in + (forward[j] - forward[i]);
+                after = distance(prevX, prevY, endBlock.entryX, endBlock.entryY) + (backward[j] - backward[i]);
+
+                if ((j < (count - 1)) || (openEnd == false)) {
+                    const GCodeTravelBlock &next = blocks[slice[j + 1]];
+
+                    before += hop(endBlock, next);
+                    after += hop(startBlock, next);
+                }
+
+                if (after < (before - GCODE_TRAVEL_MIN_GAIN)) {
+                    for (int a = i, b = j; a < b; a++, b--) {
+                        int swap = slice[a];
+                        slice[a] = slice[b];
+                        slice[b] = swap;
+                    }
+
+                    saved += before - after;
+                    improved = true;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    return saved;
+}
+
+// A slice of the order, improved on a worker thread.
+class TravelSliceJob : public QRunnable
+{
+public:
+    TravelSliceJob(const GCodeTravelBlock *blocks, int *order, int first, int last, double fromX, double fromY,
+                   bool openEnd, const QElapsedTimer *timer, int timeBudget);
+
+    void run();
+
+    double mSaved;
+
+private:
+    const GCodeTravelBlock *mBlocks;
+    int *mOrder;
+    int mFirst;
+    int mLast;
+    double mFromX;
+    double mFromY;
+    bool mOpenEnd;
+    const QElapsedTimer *mTimer;
+    int mTimeBudget;
+};
+
+TravelSliceJob::TravelSliceJob(const GCodeTravelBlock *blocks, int *order, int first, int last, double fromX,
+                               double fromY, bool openEnd, const QElapsedTimer *timer, int timeBudget)
+{
+    mBlocks = blocks;
+    mOrder = order;
+    mFirst = first;
+    mLast = last;
+    mFromX = fromX;
+    mFromY = fromY;
+    mOpenEnd = openEnd;
+    mTimer = timer;
+    mTimeBudget = timeBudget;
+    mSaved = 0;
+
+    // We hang on to the job until its result has been added up.
+    setAutoDelete(false);
+}
+
+/**
+ * @brief TravelSliceJob::run - Improve the slice.  (Called on a worker thread.)
+ */
+void TravelSliceJob::run()
+{
+    mSaved = improveSlice(mBlocks, mOrder, mFirst, mLast, mFromX, mFromY, mOpenEnd, mTimer, mTimeBudget);
+}
+
+GCodeTravelOptimizer::GCodeTravelOptimizer()
+{
+    mTimeBudget = GCODE_TRAVEL_DEFAULT_TIME_BUDGET;
+    mThreadCount = 1;
+}
+
+/**
+ * @brief GCodeTravelOptimizer::setTimeBudget - Set how long the order of the blocks may be improved for.
+ *
+ * @param milliseconds - The time.  (0 to stop at the nearest neighbour order.)
+ */
+void GCodeTravelOptimizer::setTimeBudget(int milliseconds)
+{
+    mTimeBudget = milliseconds;
+}
+
+/**
+ * @brief GCodeTravelOptimizer::setThreadCount - Set how many threads long runs of blocks are improved on.
+ *
+ * @param threads - The number of threads, or 0 for one per core.
+ */
+void GCodeTravelOptimizer::setThreadCount(int threads)
+{
+    mThreadCount = threads;
+}
+
+/**
+ * @brief GCodeTravelOptimizer::optimize - Put the blocks of a program in a better order.  This has to be the
+ *      last change made to the program, since it sets the order the lines are written in.  Nothing is changed
+ *      unless the travel is shorter.
+ *
+ * @param program - The program to change.
+ * @param report[out] - What was changed.
+ */
+void GCodeTravelOptimizer::optimize(GCodeProgram &program, GCodeTravelReport *report)
+{
+    GCodeTimeEstimator estimator;
+    GCodeTimeEstimate before;
+    GCodeTimeEstimate after;
+    QVector<int> positions;
+    double lowest;
+    double highest;
+    double startX;
+    double startY;
+    int first = 0;
+    int runFirst;
+    int end;
+
+    report->blocks = 0;
+    report->runs = 0;
+    report->travelBefore = 0;
+    report->travelAfter = 0;
+    report->secondsSaved = 0;
+
+    mTimer.start();
+    findBlocks(program);
+
+    mBlockOrder.resize(mBlocks.size());
+    for (int i = 0; i < mBlocks.size(); i++) {
+        mBlockOrder[i] = i;
+        if (mBlocks.at(i).movable == true) {
+            report->blocks++;
+        }
+    }
+
+    while (first < mBlocks.size()) {
+        if (mBlocks.at(first).movable == false) {
+            first++;
+            continue;
+        }
+
+        // The run of movable blocks from here, as long as every travel in it clears every cut in it.
+        lowest = mBlocks.at(first).lowestTravelZ;
+        highest = mBlocks.at(first).highestCutZ;
+        for (end = first + 1; (end < mBlocks.size()) && (mBlocks.at(end).movable == true); end++) {
+            if ((qMin(lowest, mBlocks.at(end).lowestTravelZ) < qMax(highest, mBlocks.at(end).highestCutZ)) ||
+                    (lowest < highest)) {
+                break;
+            }
+
+            lowest = qMin(lowest, mBlocks.at(end).lowestTravelZ);
+            highest = qMax(highest, mBlocks.at(end).highestCutZ);
+        }
+
+        // If we don't know where the machine is before the run, its first block has to stay first.
+        runFirst = first;
+        startX = mBlocks.at(first).beforeX;
+        startY = mBlocks.at(first).beforeY;
+        if (mBlocks.at(first).beforeKnown == false) {
+            runFirst = first + 1;
+            startX = mBlocks.at(first).exitX;
+            startY = mBlocks.at(first).exitY;
+        }
+
+        if (((end - runFirst) >= GCODE_TRAVEL_MIN_BLOCKS) && (lowest >= highest)) {
+            // Whatever comes after the run has to be safe to reach from any block in it.  If it isn't, the last
+            // block stays last.
+            reorderRun(program, runFirst, end - runFirst, startX, startY,
+                       (end < mBlocks.size()) && ((mBlocks.at(end).retracts == false) || (mBlocks.at(end).retractZ < highest)),
+                       report);
+        }
+
+        first = end;
+    }
+
+    if (report->runs == 0) {
+        return;
+    }
+
+    estimator.estimate(program, &before);
+
+    fixFeedRates(program);
+
+    // Lay the lines out in the new order.
+    positions.reserve(program.getLineCount());
+    for (int i = 0; i < mBlocks.at(0).firstPosition; i++) {
+        positions.append(program.lineAt(i));
+    }
+
+    for (int i = 0; i < mBlockOrder.size(); i++) {
+        const GCodeTravelBlock &block = mBlocks.at(mBlockOrder.at(i));
+
+        for (int n = block.firstPosition; n < block.endPosition; n++) {
+            positions.append(program.lineAt(n));
+        }
+    }
+
+    program.setLineOrder(positions);
+
+    estimator.estimate(program, &after);
+    report->secondsSaved = before.seconds - after.seconds;
+}
+
+/**
+ * @brief GCodeTravelOptimizer::findBlocks - Split a program in to blocks, and work out which of them could be
+ *      moved.  (The lines before the first travel aren't in a block.)
+ *
+ * @param program - The program to look at.
+ */
+void GCodeTravelOptimizer::findBlocks(const GCodeProgram &program)
+{
+    int lineCount = program.getLineCount();
+    const quint8 *commands = program.commands();
+    const quint32 *flags = program.flags();
+    const double *x = program.xValues();
+    const double *y = program.yValues();
+    const double *z = program.zValues();
+    static const quint16 axisFlags[3] = { GCODE_LINE_HAS_X, GCODE_LINE_HAS_Y, GCODE_LINE_HAS_Z };
+    const double *values[3] = { x, y, z };
+    double position[3] = { 0, 0, 0 };
+    bool known[3] = { false, false, false };
+    GCodeTravelBlock *block = NULL;
+    GCodeTravelBlock newBlock;
+    bool absolute = true;
+    int motionMode = -1;
+    int feedLine = -1;                  // The line that set the feed rate in use.
+    bool inTravel = false;
+    bool travelSetX = false;
+    bool travelSetY = false;
+    bool haveCut = false;
+    bool motion;
+    double startX;
+    double startY;
+    double startZ;
+    int i;
+
+    mBlocks.clear();
+
+    for (int n = 0; n < lineCount; n++) {
+        i = program.lineAt(n);
+        if ((flags[i] & GCODE_LINE_DELETED) != 0) {
+            continue;
+        }
+
+        if ((flags[i] & GCODE_LINE_ABSOLUTE) != 0) {
+            absolute = true;
+        } else if ((flags[i] & GCODE_LINE_RELATIVE) != 0) {
+            absolute = false;
+        }
+
+        if ((commands[i] >= GCODE_COMMAND_G0) && (commands[i] <= GCODE_COMMAND_G3)) {
+            motionMode = commands[i] - GCODE_COMMAND_G0;
+        }
+
+        motion = (((flags[i] & (GCODE_LINE_HAS_X | GCODE_LINE_HAS_Y | GCODE_LINE_HAS_Z)) != 0) && (motionMode >= 0));
+
+        if ((motion == true) && (motionMode == 0) && (inTravel == false)) {
+            // A travel, so a new block starts here.
+            if (block != NULL) {
+                block->endPosition = n;
+                block->movable = block->movable && haveCut && travelSetX && travelSetY;
+            }
+
+            newBlock.firstPosition = n;
+            newBlock.endPosition = lineCount;
+            newBlock.beforeX = position[0];
+            newBlock.beforeY = position[1];
+            newBlock.beforeKnown = (known[0] == true) && (known[1] == true);
+            newBlock.entryX = 0;
+            newBlock.entryY = 0;
+            newBlock.exitX = 0;
+            newBlock.exitY = 0;
+            newBlock.retracts = ((commands[i] == GCODE_COMMAND_G0) && (absolute == true) &&
+                                 ((flags[i] & (GCODE_LINE_HAS_X | GCODE_LINE_HAS_Y | GCODE_LINE_HAS_Z)) == GCODE_LINE_HAS_Z));
+            newBlock.retractZ = z[i];
+            newBlock.lowestTravelZ = HUGE_VAL;
+            newBlock.highestCutZ = -HUGE_VAL;
+            newBlock.movable = newBlock.retracts;
+            newBlock.feedLine = -1;
+            newBlock.incomingFeedLine = feedLine;
+            newBlock.lastFeedLine = -1;
+
+            mBlocks.append(newBlock);
+            block = &mBlocks.last();
+
+            inTravel = true;
+            travelSetX = false;
+            travelSetY = false;
+            haveCut = false;
+        }
+
+        if (block != NULL) {
+            // Anything that the block might leave behind, or that might depend on what came before it.
+            if ((absolute == false) || ((flags[i] & (GCODE_LINE_RAW | GCODE_LINE_SPINDLE_STOP)) != 0)) {
+                block->movable = false;
+            } else if (((flags[i] & GCODE_LINE_OTHER_WORDS) != 0) &&
+                       ((motion == false) || (motionMode < 2) || (onlyArcWords(program, i) == false))) {
+                block->movable = false;
+            }
+
+            if ((motion == true) && (motionMode > 0) && (block->feedLine < 0) && (block->lastFeedLine < 0) &&
+                    (program.setsFeedRate(i) == false)) {
+                // The first cutting move uses the feed rate from before the block, so it might need its own.
+                block->feedLine = i;
+                if (((flags[i] & GCODE_LINE_FIXED) != 0) || (feedLine < 0)) {
+                    block->movable = false;
+                }
+            }
+        }
+
+        if (program.setsFeedRate(i) == true) {
+            feedLine = i;
+            if (block != NULL) {
+                block->lastFeedLine = i;
+            }
+        }
+
+        if ((commands[i] == GCODE_COMMAND_OTHER) && ((flags[i] & GCODE_LINE_OTHER_WORDS) != 0)) {
+            // Something like a G28 or G92 might have moved the machine somewhere we don't know about.
+            known[0] = false;
+            known[1] = false;
+            known[2] = false;
+        }
+
+        if (motion == false) {
+            continue;
+        }
+
+        startX = position[0];
+        startY = position[1];
+        startZ = position[2];
+
+        for (int axis = 0; axis < 3; axis++) {
+            if ((flags[i] & axisFlags[axis]) != 0) {
+                position[axis] = (absolute == true) ? values[axis][i] : (position[axis] + values[axis][i]);
+                known[axis] = (absolute == true) || known[axis];
+            }
+        }
+
+        if (block == NULL) {
+            continue;
+        }
+
+        if (motionMode == 0) {
+            if ((flags[i] & (GCODE_LINE_HAS_X | GCODE_LINE_HAS_Y)) != 0) {
+                block->lowestTravelZ = qMin(block->lowestTravelZ, qMin(startZ, position[2]));
+                travelSetX = travelSetX || ((flags[i] & GCODE_LINE_HAS_X) != 0);
+                travelSetY = travelSetY || ((flags[i] & GCODE_LINE_HAS_Y) != 0);
+            }
+        } else {
+            if (inTravel == true) {
+                block->entryX = startX;
+                block->entryY = startY;
+                inTravel = false;
+            }
+
+            block->highestCutZ = qMax(block->highestCutZ, position[2]);
+            haveCut = true;
+        }
+
+        block->exitX = position[0];
+        block->exitY = position[1];
+    }
+
+    if (block != NULL) {
+        block->movable = block->movable && haveCut && travelSetX && travelSetY;
+    }
+}
+
+/**
+ * @brief GCodeTravelOptimizer::reorderRun - Find a better order for a run of blocks.  The nearest neighbour
+ *      order and the order the blocks were written in are both tried as a starting point, and the shorter one
+ *      is improved.  The new order is only kept if it is shorter, and the feed rates can be kept right.
+ *
+ * @param program - The program the blocks are in.
+ * @param first - The first block of the run.
+ * @param count - The number of blocks in the run.
+ * @param startX - Where the machine is before the run.
+ * @param startY
+ * @param fixedEnd - true if the last block has to stay last.
+ * @param report[in/out] - The runs and travel are added to it.
+ *
+ * @return true if the run was put in a new order.
+ */
+bool GCodeTravelOptimizer::reorderRun(const GCodeProgram &program, int first, int count, double startX, double startY,
+                                      bool fixedEnd, GCodeTravelReport *report)
+{
+    int *order = mBlockOrder.data() + first;
+    QVector<int> nearest(count);
+    double originalLength;
+    double nearestLength;
+    double newLength;
+
+    nearestNeighbourOrder(first, (fixedEnd == true) ? (count - 1) : count, startX, startY, nearest.data());
+    if (fixedEnd == true) {
+        nearest[count - 1] = first + count - 1;
+    }
+
+    originalLength = travelLength(order, count, startX, startY);
+    nearestLength = travelLength(nearest.constData(), count, startX, startY);
+    if (nearestLength < originalLength) {
+        memcpy(order, nearest.constData(), count * sizeof(int));
+    }
+
+    improveOrder(order, count, startX, startY, fixedEnd);
+
+    newLength = travelLength(order, count, startX, startY);
+    if ((newLength >= (originalLength - GCODE_TRAVEL_MIN_GAIN)) || (canFixFeedRates(program, first, count, order) == false)) {
+        for (int i = 0; i < count; i++) {
+            order[i] = first + i;
+        }
+        return false;
+    }
+
+    report->runs++;
+    report->travelBefore += originalLength;
+    report->travelAfter += newLength;
+
+    return true;
+}
+
+/**
+ * @brief GCodeTravelOptimizer::canFixFeedRates - Check that the feed rate that a run of blocks leaves behind
+ *      in a new order can be fixed for whatever comes after the run.  (The feed rates of the blocks in the run
+ *      can always be fixed, or they wouldn't be movable.)
+ *
+ * @param program - The program the blocks are in.
+ * @param first - The first block of the run.
+ * @param count - The number of blocks in the run.
+ * @param order - The new order of the run.
+ *
+ * @return true if the feed rates can be fixed.
+ */
+bool GCodeTravelOptimizer::canFixFeedRates(const GCodeProgram &program, int first, int count, const int *order) const
+{
+    const double *feedRates = program.feedRates();
+    int current = mBlocks.at(first).incomingFeedLine;
+
+    for (int i = 0; i < count; i++) {
+        const GCodeTravelBlock &block = mBlocks.at(order[i]);
+
+        if (block.lastFeedLine >= 0) {
+            current = block.lastFeedLine;
+        } else if (block.feedLine >= 0) {
+            current = block.incomingFeedLine;
+        }
+    }
+
+    // The blocks after the run carry on with the feed rate it leaves, until one sets its own.
+    for (int i = first + count; i < mBlocks.size(); i++) {
+        const GCodeTravelBlock &block = mBlocks.at(i);
+
+        if (block.feedLine >= 0) {
+            return ((sameFeedRate(feedRates, current, block.incomingFeedLine) == true) ||
+                    ((block.incomingFeedLine >= 0) && ((program.getFlags(block.feedLine) & GCODE_LINE_FIXED) == 0)));
+        }
+
+        if (block.lastFeedLine >= 0) {
+            break;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief GCodeTravelOptimizer::fixFeedRates - Give the first cutting move of each block the feed rate it had
+ *      before, where the block before it in the new order leaves a different one.
+ *
+ * @param program - The program to change.
+ */
+void GCodeTravelOptimizer::fixFeedRates(GCodeProgram &program) const
+{
+    const double *feedRates = program.feedRates();
+    int current = (mBlocks.isEmpty() == true) ? -1 : mBlocks.at(0).incomingFeedLine;
+
+    for (int i = 0; i < mBlockOrder.size(); i++) {
+        const GCodeTravelBlock &block = mBlocks.at(mBlockOrder.at(i));
+
+        if ((block.feedLine >= 0) && (sameFeedRate(feedRates, current, block.incomingFeedLine) == false) &&
+                (block.incomingFeedLine >= 0) && ((program.getFlags(block.feedLine) & GCODE_LINE_FIXED) == 0)) {
+            program.setFeedRate(block.feedLine, program.getFeedRateText(block.incomingFeedLine));
+        }
+
+        if (block.lastFeedLine >= 0) {
+            current = block.lastFeedLine;
+        } else if (block.feedLine >= 0) {
+            current = block.incomingFeedLine;
+        }
+    }
+}
+
+/**
+ * @brief GCodeTravelOptimizer::nearestNeighbourOrder - Order a run of blocks by always going to the nearest
+ *      block that hasn't been cut yet.  The blocks are put in a grid of cells by where they start, and the
+ *      cells are searched in rings out from where the machine is, so each step only looks at the blocks
+ *      nearby.
+ *
+ * @param first - The first block of the run.
+ * @param count - The number of blocks in the run.
+ * @param startX - Where the machine is before the run.
+ * @param startY
+ * @param order[out] - The blocks, in the order they should be cut.
+ */
+void GCodeTravelOptimizer::nearestNeighbourOrder(int first, int count, double startX, double startY, int *order) const
+{
+    double minX = HUGE_VAL, minY = HUGE_VAL;
+    double maxX = -HUGE_VAL, maxY = -HUGE_VAL;
+    double cellSize;
+    int columns;
+    int rows;
+    QVector<int> cellOf(count);
+    QVector<int> cellStart;
+    QVector<int> cellLive;              // The blocks in each cell that haven't been used yet.
+    QVector<int> items(count);
+    QVector<int> where(count);          // The index of each block in items.
+    double x = startX;
+    double y = startY;
+    int column;
+    int row;
+    int best;
+    double bestDistance;
+    double d;
+
+    if (count <= 0) {
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        const GCodeTravelBlock &block = mBlocks.at(first + i);
+
+        minX = qMin(minX, block.entryX);
+        maxX = qMax(maxX, block.entryX);
+        minY = qMin(minY, block.entryY);
+        maxY = qMax(maxY, block.entryY);
+    }
+
+    // Square cells, with about GCODE_TRAVEL_GRID_BLOCKS blocks in each.  (Or along a line, if they are on one.)
+    cellSize = sqrt(((maxX - minX) * (maxY - minY) * GCODE_TRAVEL_GRID_BLOCKS) / count);
+    cellSize = qMax(cellSize, (qMax(maxX - minX, maxY - minY) * GCODE_TRAVEL_GRID_BLOCKS) / count);
+    if (cellSize <= 0) {
+        cellSize = 1;
+    }
+
+    columns = (int)((maxX - minX) / cellSize) + 1;
+    rows = (int)((maxY - minY) / cellSize) + 1;
+
+    cellStart.fill(0, (columns * rows) + 1);
+    cellLive.fill(0, columns * rows);
+
+    for (int i = 0; i < count; i++) {
+        const GCodeTravelBlock &block = mBlocks.at(first + i);
+
+        column = qMin((int)((block.entryX - minX) / cellSize), columns - 1);
+        row = qMin((int)((block.entryY - minY) / cellSize), rows - 1);
+        cellOf[i] = (row * columns) + column;
+        cellLive[cellOf.at(i)]++;
+    }
+
+    for (int cell = 0; cell < (columns * rows); cell++) {
+        cellStart[cell + 1] = cellStart.at(cell) + cellLive.at(cell);
+        cellLive[cell] = 0;
+    }
+
+    for (int i = 0; i < count; i++) {
+        where[i] = cellStart.at(cellOf.at(i)) + cellLive.at(cellOf.at(i));
+        items[where.at(i)] = i;
+        cellLive[cellOf.at(i)]++;
+    }
+
+    for (int step = 0; step < count; step++) {
+        column = qBound(0, (int)floor((x - minX) / cellSize), columns - 1);
+        row = qBound(0, (int)floor((y - minY) / cellSize), rows - 1);
+        best = -1;
+        bestDistance = HUGE_VAL;
+
+        // Every block in ring r is at least (r - 1) cells away, so stop once one closer than that is found.
+        for (int r = 0; r <= qMax(columns, rows); r++) {
+            if ((best >= 0) && (bestDistance <= ((r - 1) * cellSize))) {
+                break;
+            }
+
+            for (int dy = -r; dy <= r; dy++) {
+                if (((row + dy) < 0) || ((row + dy) >= rows)) {
+                    continue;
+                }
+
+                for (int dx = -r; dx <= r; dx += ((dy == -r) || (dy == r) || (r == 0)) ? 1 : (2 * r)) {
+                    int cell = ((row + dy) * columns) + column + dx;
+
+                    if (((column + dx) < 0) || ((column + dx) >= columns)) {
+                        continue;
+                    }
+
+                    for (int k = cellStart.at(cell); k < (cellStart.at(cell) + cellLive.at(cell)); k++) {
+                        const GCodeTravelBlock &block = mBlocks.at(first + items.at(k));
+
+                        d = distance(x, y, block.entryX, block.entryY);
+                        if ((d < bestDistance) || ((d == bestDistance) && (items.at(k) < best))) {
+                            best = items.at(k);
+                            bestDistance = d;
+                        }
+                    }
+                }
+            }
+        }
+
+        order[step] = first + best;
+        x = mBlocks.at(first + best).exitX;
+        y = mBlocks.at(first + best).exitY;
+
+        // Take the block out of its cell, by moving the last one in the cell in to its place.
+        int cell = cellOf.at(best);
+        int last = cellStart.at(cell) + cellLive.at(cell) - 1;
+
+        items[where.at(best)] = items.at(last);
+        where[items.at(last)] = where.at(best);
+        cellLive[cell]--;
+    }
+}
+
+/**
+ * @brief GCodeTravelOptimizer::improveOrder - Improve the order of a run of blocks with 2-opt, until nothing
+ *      more is found or the time budget runs out.  Short runs are improved in one go.  Longer ones are split
+ *      in to slices of GCODE_TRAVEL_SLICE_BLOCKS, with one block between each that stays where it is, and the
+ *      slices are improved at the same time on a pool of threads.  (Or one after the other, with one thread.)  Each round the slices are moved along by half a slice,
+ *      so that blocks can move across the boundaries of the round before.
+ *
+ * @param order[in/out] - The order of the run.
+ * @param count - The number of blocks in the run.
+ * @param startX - Where the machine is before the run.
+ * @param startY
+ * @param fixedEnd - true if the last block has to stay last.
+ */
+void GCodeTravelOptimizer::improveOrder(int *order, int count, double startX, double startY, bool fixedEnd)
+{
+    int threads = mThreadCount;
+    int freeCount = (fixedEnd == true) ? (count - 1) : count;
+    const GCodeTravelBlock *blocks = mBlocks.constData();
+    QList<TravelSliceJob *> jobs;
+    QThreadPool pool;
+    int offset = 0;
+    int idleRounds = 0;
+    int first;
+    int last;
+    double saved;
+
+    if (threads <= 0) {
+        threads = QThread::idealThreadCount();
+    }
+
+    if (freeCount <= (2 * GCODE_TRAVEL_SLICE_BLOCKS)) {
+        improveSlice(blocks, order, 0, freeCount - 1, startX, startY, (fixedEnd == false), &mTimer, mTimeBudget);
+        return;
+    }
+
+    pool.setMaxThreadCount(threads);
+
+    while ((idleRounds < 2) && (mTimer.elapsed() < mTimeBudget)) {
+        first = 0;
+        last = ((offset > 0) ? offset : GCODE_TRAVEL_SLICE_BLOCKS) - 1;
+
+        while (first < freeCount) {
+            last = qMin(last, freeCount - 1);
+
+            jobs.append(new TravelSliceJob(blocks, order, first, last,
+                                           (first == 0) ? startX : blocks[order[first - 1]].exitX,
+                                           (first == 0) ? startY : blocks[order[first - 1]].exitY,
+                                           (last == (count - 1)), &mTimer, mTimeBudget));
+            if (threads > 1) {
+                pool.start(jobs.last());
+            } else {
+                jobs.last()->run();
+            }
+
+            // The block after the slice stays where it is this round.
+            first = last + 2;
+            last = first + GCODE_TRAVEL_SLICE_BLOCKS - 1;
+        }
+
+        pool.waitForDone();
+
+        saved = 0;
+        while (jobs.isEmpty() == false) {
+            saved += jobs.first()->mSaved;
+            delete jobs.takeFirst();
+        }
+
+        idleRounds = (saved > GCODE_TRAVEL_MIN_GAIN) ? 0 : (idleRounds + 1);
+        offset = (offset == 0) ? (GCODE_TRAVEL_SLICE_BLOCKS / 2) : 0;
+    }
+}
+
+/**
+ * @brief GCodeTravelOptimizer::travelLength - Add up the X/Y travel between the blocks of a run.
+ *
+ * @param order - The order of the run.
+ * @param count - The number of blocks in the run.
+ * @param startX - Where the machine is before the run.
+ * @param startY
+ *
+ * @return The travel.  (mm)
+ */
+double GCodeTravelOptimizer::travelLength(const int *order, int count, double startX, double startY) const
+{
+    double length = 0;
+    double x = startX;
+    double y = startY;
+
+    for (int i = 0; i < count; i++) {
+        const GCodeTravelBlock &block = mBlocks.at(order[i]);
+
+        length += distance(x, y, block.entryX, block.entryY);
+        x = block.exitX;
+        y = block.exitY;
+    }
+
+    return length;
+}
@@ -0,0 +1,98 @@
+#ifndef GCODETRAVELOPTIMIZER_H
+#define GCODETRAVELOPTIMIZER_H
+
+#include <QVector>
+#include <QElapsedTimer>
+
+class GCodeProgram;
+
+// How long (in ms) the order of the blocks is improved for, when no other time is set.  (Finding the blocks
+// and the first order always runs to the end.)
+#define GCODE_TRAVEL_DEFAULT_TIME_BUDGET     1000
+
+// Runs of fewer blocks than this are left alone.
+#define GCODE_TRAVEL_MIN_BLOCKS              3
+
+// The number of blocks that each worker improves the order of at a time.  Runs of blocks that are longer than
+// two of these are split up between the threads.
+#define GCODE_TRAVEL_SLICE_BLOCKS            512
+
+// About how many blocks go in each cell of the grid used to find the nearest block.
+#define GCODE_TRAVEL_GRID_BLOCKS             4
+
+// A change has to save at least this much travel (in mm) to be made.
+#define GCODE_TRAVEL_MIN_GAIN                1e-6
+
+// What a travel optimization pass changed.
+struct GCodeTravelReport
+{
+    unsigned long blocks;               // Blocks that could be moved.
+    unsigned long runs;                 // Runs of blocks that were put in a new order.
+    double travelBefore;                // The X/Y rapid travel between the blocks that were reordered.  (mm)
+    double travelAfter;
+    double secondsSaved;                // The run time that was saved, estimated with the default machine limits.
+};
+
+// One block of a program : a travel (a retract, rapid moves across, and maybe a rapid move down) followed by
+// the cutting moves up to the next travel.
+struct GCodeTravelBlock
+{
+    int firstPosition;                  // The position of the first line of the travel.  (See GCodeProgram::lineAt().)
+    int endPosition;                    // One past the position of the last line of the block.
+    double beforeX;                     // Where the machine is when the block starts.
+    double beforeY;
+    bool beforeKnown;
+    double entryX;                      // Where the travel ends.
+    double entryY;
+    double exitX;                       // Where the cutting ends.
+    double exitY;
+    double retractZ;                    // The Z of the first move, if it is a retract.
+    double lowestTravelZ;               // The lowest Z that the travel moves across X/Y at.
+    double highestCutZ;                 // The highest Z that a cutting move ends at.
+    bool retracts;                      // true if the first move is a G00 that only moves Z.
+    bool movable;                       // true if the block doesn't depend on where the machine was before it.
+    int feedLine;                       // The first cutting move, if it uses the feed rate from before the block.  Otherwise -1.
+    int incomingFeedLine;               // The line that set the feed rate the block starts with, or -1.
+    int lastFeedLine;                   // The last line in the block that sets the feed rate, or -1.
+};
+
+// Puts the blocks of a program that are separated by rapid travel (like the holes of a drilling job, or the
+// pockets of a milling job) in an order that cuts down the distance travelled between them.  A first order
+// is found by always going to the nearest block next, and is then improved by 2-opt (reversing the order of
+// a run of blocks) until nothing more is found or the time budget runs out.  Long runs of blocks are split in
+// to slices that are improved on separate threads, with the slice boundaries moved each round.
+//
+// Only blocks that are self contained are moved : every move is absolute, the travel starts with a G00 that
+// only moves Z, both X and Y are set by the travel, and there is nothing but G00-G03, G90, X, Y, Z, F, I and J
+// words (and comments).  The blocks in a run are only reordered if every travel crosses at or above the
+// highest point that any block in the run cuts at.  Feed rates that a block took from the block before it are
+// written on its first cutting move, where the new order needs it.
+class GCodeTravelOptimizer
+{
+public:
+    GCodeTravelOptimizer();
+
+    void setTimeBudget(int milliseconds);
+    void setThreadCount(int threads);
+
+    void optimize(GCodeProgram &program, GCodeTravelReport *report);
+
+private:
+    void findBlocks(const GCodeProgram &program);
+    bool reorderRun(const GCodeProgram &program, int first, int count, double startX, double startY, bool fixedEnd,
+                    GCodeTravelReport *report);
+    bool canFixFeedRates(const GCodeProgram &program, int first, int count, const int *order) const;
+    void fixFeedRates(GCodeProgram &program) const;
+    void nearestNeighbourOrder(int first, int count, double startX, double startY, int *order) const;
+    void improveOrder(int *order, int count, double startX, double startY, bool fixedEnd);
+    double travelLength(const int *order, int count, double startX, double startY) const;
+
+    int mTimeBudget;                    // ms
+    int mThreadCount;                   // 0 for one per core.
+    QElapsedTimer mTimer;
+
+    QVector<GCodeTravelBlock> mBlocks;
+    QVector<int> mBlockOrder;           // The block at each place in the new order.
+};
+
+#endif // GCODETRAVELOPTIMIZER_H
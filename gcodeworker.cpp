@@ -0,0 +1,176 @@
+#include "gcodeworker.h"
+#include "gcodetimeestimator.h"
+
+#include <QMutexLocker>
+
+// How often progress is sent to the GUI.
+#define GCODE_WORKER_PROGRESS_INTERVAL_MS    100
+
+GCodeWorker::GCodeWorker(QObject *parent) :
+    QThread(parent)
+{
+    mJob = NoJob;
+    mCancelled = false;
+}
+
+/**
+ * @brief GCodeWorker::changeFeedRates - Start changing the feed rates in a G-code file.  The worker must not
+ *      already be running.
+ *
+ * @param feedRates - The configured feed rate changes to make.
+ */
+void GCodeWorker::changeFeedRates(const ChangeGCodeFeedRates &feedRates)
+{
+    mFeedRates = feedRates;
+    mFeedRates.setProgress(this);
+    mFeedRates.setRunTimeEstimates(&mBeforeEstimate, &mAfterEstimate);
+
+    startJob(FeedRateJob);
+}
+
+/**
+ * @brief GCodeWorker::createBedLeveling - Start creating a bed leveling G-code file.  The worker must not
+ *      already be running.
+ *
+ * @param bedLeveling - The configured bed leveling settings.
+ * @param filename - The file to create.
+ */
+void GCodeWorker::createBedLeveling(const CreateBedLevelingGCode &bedLeveling, QString filename)
+{
+    mBedLeveling = bedLeveling;
+    mBedLeveling.setProgress(this);
+    mBedLevelingFile = filename;
+
+    startJob(BedLevelingJob);
+}
+
+/**
+ * @brief GCodeWorker::cancel - Ask the current job to stop.  workFinished() is still emitted once it has.
+ */
+void GCodeWorker::cancel()
+{
+    QMutexLocker locker(&mMutex);
+
+    mCancelled = true;
+}
+
+/**
+ * @brief GCodeWorker::progress - Pass progress on to the GUI, at most every GCODE_WORKER_PROGRESS_INTERVAL_MS.
+ *      (Called on the worker thread.)
+ *
+ * @param bytesProcessed - How much of the input has been processed.
+ * @param totalBytes - The size of the input.
+ * @param lines - How many lines have been processed.
+ */
+void GCodeWorker::progress(qint64 bytesProcessed, qint64 totalBytes, quint64 lines)
+{
+    double seconds;
+
+    if ((bytesProcessed < totalBytes) && (mProgressTimer.elapsed() < GCODE_WORKER_PROGRESS_INTERVAL_MS)) {
+        return;
+    }
+
+    mProgressTimer.restart();
+
+    seconds = (double)mJobTimer.elapsed() / 1000.0;
+    if (seconds <= 0) {
+        seconds = 0.001;
+    }
+
+    emit progressChanged(bytesProcessed, totalBytes, (qint64)lines, ((double)bytesProcessed / (1024.0 * 1024.0)) / seconds);
+}
+
+/**
+ * @brief GCodeWorker::isCancelled - Check if cancel() has been called.
+ *
+ * @return true if the current job should stop.  false otherwise.
+ */
+bool GCodeWorker::isCancelled()
+{
+    QMutexLocker locker(&mMutex);
+
+    return mCancelled;
+}
+
+/**
+ * @brief GCodeWorker::run - Do the job.  (Called on the worker thread.)
+ */
+void GCodeWorker::run()
+{
+    QString error;
+    int result;
+
+    mJobTimer.start();
+    mProgressTimer.start();
+
+    switch (mJob) {
+    case FeedRateJob:
+        result = mFeedRates.processGCodeFile();
+        if (result != CHANGE_GCODE_SUCCESS) {
+            emit workFinished(false, mFeedRates.resultCodeAsString(result));
+            break;
+        }
+
+        emit workFinished(true, estimateSavings());
+        break;
+
+    case BedLevelingJob:
+        error = mBedLeveling.createGCodeFile(mBedLevelingFile);
+        if (error.isEmpty() == false) {
+            emit workFinished(false, error);
+        } else {
+            emit workFinished(true, estimateBedLeveling());
+        }
+        break;
+
+    case NoJob:
+        break;
+    }
+}
+
+/**
+ * @brief GCodeWorker::estimateSavings - Describe how much quicker the file that was just changed runs than it
+ *      did before.  (The run times were worked out while the file was processed.)
+ *
+ * @return QString describing the run times.
+ */
+QString GCodeWorker::estimateSavings()
+{
+    return tr("Estimated run time : %1 before, %2 after (%3 minutes saved).")
+            .arg(GCodeTimeEstimator::formatDuration(mBeforeEstimate.seconds))
+            .arg(GCodeTimeEstimator::formatDuration(mAfterEstimate.seconds))
+            .arg((mBeforeEstimate.seconds - mAfterEstimate.seconds) / 60, 0, 'f', 1);
+}
+
+/**
+ * @brief GCodeWorker::estimateBedLeveling - Describe how long the bed leveling file that was just created takes
+ *      to run.  (Called on the worker thread.)
+ *
+ * @return QString describing the run time.
+ */
+QString GCodeWorker::estimateBedLeveling()
+{
+    GCodeTimeEstimate estimate;
+
+    mBedLeveling.getEstimate(&estimate);
+
+    return tr("Estimated run time : %1 (%2 m of cutting).")
+            .arg(GCodeTimeEstimator::formatDuration(estimate.seconds))
+            .arg(estimate.cutLength / 1000, 0, 'f', 2);
+}
+
+/**
+ * @brief GCodeWorker::startJob - Clear any earlier cancel, and start the thread.
+ *
+ * @param job - The job that has been set up.
+ */
+void GCodeWorker::startJob(Job job)
+{
+    {
+        QMutexLocker locker(&mMutex);
+        mCancelled = false;
+    }
+
+    mJob = job;
+    start();
+}
@@ -0,0 +1,63 @@
+#ifndef GCODEWORKER_H
+#define GCODEWORKER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QString>
+#include <QElapsedTimer>
+
+#include "gcodeprogress.h"
+#include "gcodetimeestimator.h"
+#include "changegcodefeedrates.h"
+#include "createbedlevelinggcode.h"
+
+// Runs the G-code operations on a thread of their own, so that the GUI stays responsive.  Progress and
+// the result are reported with signals.
+class GCodeWorker : public QThread, public GCodeProgress
+{
+    Q_OBJECT
+
+public:
+    explicit GCodeWorker(QObject *parent = 0);
+
+    void changeFeedRates(const ChangeGCodeFeedRates &feedRates);
+    void createBedLeveling(const CreateBedLevelingGCode &bedLeveling, QString filename);
+    void cancel();
+
+    void progress(qint64 bytesProcessed, qint64 totalBytes, quint64 lines);
+    bool isCancelled();
+
+signals:
+    void progressChanged(qint64 bytesProcessed, qint64 totalBytes, qint64 lines, double megabytesPerSecond);
+    void workFinished(bool success, QString message);
+
+protected:
+    void run();
+
+private:
+    enum Job {
+        NoJob,
+        FeedRateJob,
+        BedLevelingJob
+    };
+
+    void startJob(Job job);
+    QString estimateSavings();
+    QString estimateBedLeveling();
+
+    Job mJob;
+    ChangeGCodeFeedRates mFeedRates;
+    CreateBedLevelingGCode mBedLeveling;
+    QString mBedLevelingFile;
+
+    GCodeTimeEstimate mBeforeEstimate;  // The run times of the file being changed, worked out as it is processed.
+    GCodeTimeEstimate mAfterEstimate;
+
+    QMutex mMutex;                  // Protects mCancelled.
+    bool mCancelled;
+
+    QElapsedTimer mJobTimer;
+    QElapsedTimer mProgressTimer;   // Used to limit how often progress is reported.
+};
+
+#endif // GCODEWORKER_H
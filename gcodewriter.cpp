@@ -0,0 +1,148 @@
+#include "gcodewriter.h"
+#include "profiler.h"
+
+#include <QFile>
+
+#include <string.h>
+
+GCodeWriter::GCodeWriter(size_t bufferSize)
+{
+    mFile = NULL;
+    mBuffer.resize(bufferSize);
+    mBufferUsed = 0;
+    mBytesWritten = 0;
+    mError = false;
+}
+
+GCodeWriter::~GCodeWriter()
+{
+    close();
+}
+
+/**
+ * @brief GCodeWriter::open - Open (and truncate) the file that buffered output should be written to.
+ *
+ * @param filename - The file to write to.
+ *
+ * @return true if the file was opened.  false otherwise.
+ */
+bool GCodeWriter::open(QString filename)
+{
+    close();
+
+    mBufferUsed = 0;
+    mBytesWritten = 0;
+    mError = false;
+
+    mFile = fopen(QFile::encodeName(filename).constData(), "wb");
+    if (mFile == NULL) {
+        mError = true;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief GCodeWriter::close - Flush anything that is still buffered, and close the output file.
+ *
+ * @return true if everything that was written made it to the file.  false otherwise.
+ */
+bool GCodeWriter::close()
+{
+    if (mFile == NULL) {
+        return (mError == false);
+    }
+
+    flush();
+
+    if (fclose(mFile) != 0) {
+        mError = true;
+    }
+
+    mFile = NULL;
+
+    return (mError == false);
+}
+
+/**
+ * @brief GCodeWriter::write - Append data to the output.  Small writes are collected in the buffer,
+ *      anything larger than the buffer is written straight through.
+ *
+ * @param data - The bytes to write.
+ * @param length - The number of bytes in data.
+ */
+void GCodeWriter::write(const char *data, size_t length)
+{
+    size_t bufferSize = mBuffer.size();
+
+    if (mFile == NULL) {
+        mError = true;
+        return;
+    }
+
+    if ((mBufferUsed + length) > bufferSize) {
+        flush();
+
+        if (length >= bufferSize) {
+            PROFILE_SCOPE(PROFILE_STAGE_WRITE);
+            PROFILE_COUNT(PROFILE_STAGE_WRITE, PROFILE_COUNTER_BYTES_OUT, length);
+
+            if (fwrite(data, 1, length, mFile) != length) {
+                mError = true;
+            }
+
+            mBytesWritten += length;
+            return;
+        }
+    }
+
+    memcpy(mBuffer.data() + mBufferUsed, data, length);
+    mBufferUsed += length;
+    mBytesWritten += length;
+}
+
+void GCodeWriter::write(const QByteArray &data)
+{
+    write(data.constData(), data.size());
+}
+
+/**
+ * @brief GCodeWriter::getBytesWritten - Returns the number of bytes that have been handed to the writer
+ *      since the file was opened.
+ *
+ * @return quint64 containing the number of bytes written.
+ */
+quint64 GCodeWriter::getBytesWritten()
+{
+    return mBytesWritten;
+}
+
+/**
+ * @brief GCodeWriter::hasError - Returns true if any write to the output file has failed.
+ *
+ * @return true if there was an error.  false otherwise.
+ */
+bool GCodeWriter::hasError()
+{
+    return mError;
+}
+
+/**
+ * @brief GCodeWriter::flush - Push everything in our buffer out to the file.
+ */
+void GCodeWriter::flush()
+{
+    if ((mFile == NULL) || (mBufferUsed == 0)) {
+        return;
+    }
+
+    PROFILE_SCOPE(PROFILE_STAGE_WRITE);
+    PROFILE_COUNT(PROFILE_STAGE_WRITE, PROFILE_COUNTER_BYTES_OUT, mBufferUsed);
+
+    if (fwrite(mBuffer.constData(), 1, mBufferUsed, mFile) != mBufferUsed) {
+        mError = true;
+    }
+
+    mBufferUsed = 0;
+}
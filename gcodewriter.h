@@ -0,0 +1,39 @@
+#ifndef GCODEWRITER_H
+#define GCODEWRITER_H
+
+#include <QString>
+#include <QByteArray>
+
+#include "gcodeoutput.h"
+
+#include <stdio.h>
+
+// The size of the output buffer used when no other size is requested.
+#define GCODE_WRITER_DEFAULT_BUFFER_SIZE     (1024 * 1024)
+
+class GCodeWriter : public GCodeOutput
+{
+public:
+    GCodeWriter(size_t bufferSize = GCODE_WRITER_DEFAULT_BUFFER_SIZE);
+    ~GCodeWriter();
+
+    bool open(QString filename);
+    bool close();
+
+    void write(const char *data, size_t length);
+    void write(const QByteArray &data);
+
+    quint64 getBytesWritten();
+    bool hasError();
+
+private:
+    void flush();
+
+    FILE *mFile;
+    QByteArray mBuffer;
+    size_t mBufferUsed;
+    quint64 mBytesWritten;
+    bool mError;
+};
+
+#endif // GCODEWRITER_H
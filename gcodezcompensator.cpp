@@ -0,0 +1,254 @@
+#include "gcodezcompensator.h"
+
+#include "gcodeheightmap.h"
+#include "gcodetokenizer.h"
+#include "gcodenumberformatter.h"
+#include "profiler.h"
+
+#include <math.h>
+#include <string.h>
+
+// The room set aside for a rewritten line, so that the buffer doesn't have to grow.
+#define GCODE_COMPENSATION_LINE_RESERVE      128
+
+GCodeZCompensator::GCodeZCompensator(GCodeOutput *output, const GCodeHeightMap *heightMap) :
+    GCodeLineOutput(output, PROFILE_STAGE_COMPENSATE)
+{
+    mHeightMap = heightMap;
+    mSegmentLength = GCODE_COMPENSATION_DEFAULT_SEGMENT_LENGTH;
+
+    mLineBuffer.reserve(GCODE_COMPENSATION_LINE_RESERVE);
+
+    memset(&mReport, 0, sizeof(mReport));
+}
+
+/**
+ * @brief GCodeZCompensator::setSegmentLength - Set the longest that a cutting move can be before it is split.
+ *
+ * @param length - The length, in mm.  0 (or less) to never split moves.
+ */
+void GCodeZCompensator::setSegmentLength(double length)
+{
+    mSegmentLength = length;
+}
+
+/**
+ * @brief GCodeZCompensator::getReport - Get what has been changed so far.
+ *
+ * @param report[out] - The totals.
+ */
+void GCodeZCompensator::getReport(GCodeCompensationReport *report) const
+{
+    *report = mReport;
+}
+
+/**
+ * @brief GCodeZCompensator::processLine - Follow the modal state through a line, and compensate it if it is a
+ *      move.
+ *
+ * @param line - The line, with its line ending (if it has one).
+ * @param length - The length of the line.
+ */
+void GCodeZCompensator::processLine(const char *line, size_t length)
+{
+    GCodeTokenizer tokenizer(line, length);
+    GCodeWord word;
+    GCodeModalLine modal;
+    double target[3];
+    double start[3];
+    double piece[3];
+    double xyLength;
+    double unitScale;
+    bool startKnown;
+    int motion;
+    int pieces;
+
+    while (tokenizer.nextWord(&word) == true) {
+        mModalTracker.addWord(word);
+    }
+
+    mModalTracker.endLine(&modal);
+    motion = mModalTracker.getMotionMode();
+    unitScale = mModalTracker.getUnitScale();
+
+    if (modal.isMove == false) {
+        mOutput->write(line, length);
+        return;
+    }
+
+    startKnown = ((modal.startKnown[0] == true) && (modal.startKnown[1] == true) && (modal.startKnown[2] == true));
+
+    // The move is written in program units.
+    for (int i = 0; i < 3; i++) {
+        start[i] = modal.start[i] / unitScale;
+        target[i] = modal.target[i] / unitScale;
+    }
+
+    if ((motion < 0) || (mModalTracker.isAbsolute() == false) || (mModalTracker.isKnown(0) == false) ||
+            (mModalTracker.isKnown(1) == false) || (mModalTracker.isKnown(2) == false)) {
+        mReport.movesSkipped++;
+        mOutput->write(line, length);
+        return;
+    }
+
+    mReport.movesCompensated++;
+
+    // Only cutting moves are split.  (Rapid moves are well clear of the board, and arcs are left to the firmware.)
+    pieces = 1;
+    if ((motion == 1) && (startKnown == true) && (mSegmentLength > 0)) {
+        xyLength = sqrt(((modal.target[0] - modal.start[0]) * (modal.target[0] - modal.start[0])) +
+                        ((modal.target[1] - modal.start[1]) * (modal.target[1] - modal.start[1])));
+        if (xyLength > mSegmentLength) {
+            pieces = (int)ceil(xyLength / mSegmentLength);
+        }
+    }
+
+    if (pieces == 1) {
+        // Only the words that were on the line (and Z) are written.
+        for (int i = 0; i < 2; i++) {
+            if (modal.given[i] == false) {
+                target[i] = NAN;
+            }
+        }
+
+        writeMove(line, length, target, true);
+        return;
+    }
+
+    for (int n = 1; n <= pieces; n++) {
+        for (int i = 0; i < 3; i++) {
+            piece[i] = (n == pieces) ? target[i] : start[i] + (((target[i] - start[i]) * n) / pieces);
+        }
+
+        // The first piece keeps everything else that was on the line, so that a new feed rate applies to all of them.
+        writeMove(line, length, piece, (n == 1));
+    }
+
+    mReport.segmentsAdded += pieces - 1;
+}
+
+/**
+ * @brief GCodeZCompensator::writeMove - Write a move to a position, with the height of the board added to its Z.
+ *
+ * @param line - The line the move came from, with its line ending (if it has one).
+ * @param length - The length of the line.
+ * @param target - Where the move goes, before compensation.  X or Y can be NAN to leave them off.
+ * @param keepLine - true to write the line with its X, Y and Z words replaced.  false to write a new "G1" line.
+ */
+void GCodeZCompensator::writeMove(const char *line, size_t length, const double *target, bool keepLine)
+{
+    GCodeTokenizer tokenizer(line, length);
+    GCodeWord word;
+    const char *end = line + length;
+    const char *copied = line;
+    const char *wordsEnd;
+    const char *lineEnding;
+    int insertAt = -1;
+    char position[((GCODE_NUMBER_MAX_LENGTH + 2) * 3) + 1];
+    size_t positionLength = formatPosition(position, target);
+
+    lineEnding = end;
+    while ((lineEnding > line) && ((lineEnding[-1] == '\n') || (lineEnding[-1] == '\r'))) {
+        lineEnding--;
+    }
+
+    mLineBuffer.resize(0);
+
+    if (keepLine == false) {
+        if (lineEnding == end) {
+            // The line we are adding to doesn't end, so this one has to start on a new line.
+            mLineBuffer.append("\n", 1);
+        }
+
+        mLineBuffer.append("G1", 2);
+        mLineBuffer.append(position, positionLength);
+        mLineBuffer.append(lineEnding, end - lineEnding);
+        mOutput->write(mLineBuffer.constData(), mLineBuffer.size());
+        return;
+    }
+
+    // Copy the line, leaving out the X, Y and Z words (and the space in front of them).
+    while (tokenizer.nextWord(&word) == true) {
+        if ((word.letter == 'X') || (word.letter == 'Y') || (word.letter == 'Z')) {
+            mLineBuffer.append(copied, word.start - copied);
+            while ((mLineBuffer.isEmpty() == false) && ((mLineBuffer.endsWith(' ') == true) || (mLineBuffer.endsWith('\t') == true))) {
+                mLineBuffer.chop(1);
+            }
+
+            if (insertAt < 0) {
+                insertAt = mLineBuffer.size();
+            }
+
+            copied = word.end;
+        }
+    }
+
+    wordsEnd = tokenizer.getWordsEnd();
+    if (wordsEnd > copied) {
+        mLineBuffer.append(copied, wordsEnd - copied);
+        copied = wordsEnd;
+    }
+
+    // Then put the new ones where the first of the old ones was, or after the last word (ahead of any comment).
+    if (insertAt < 0) {
+        insertAt = mLineBuffer.size();
+    }
+
+    if ((insertAt < mLineBuffer.size()) && (mLineBuffer.at(insertAt) != ' ') && (mLineBuffer.at(insertAt) != '\t')) {
+        // Keep them apart from the word that follows.
+        position[positionLength++] = ' ';
+    }
+
+    if (insertAt == 0) {
+        mLineBuffer.insert(0, position + 1, (int)positionLength - 1);
+    } else {
+        mLineBuffer.insert(insertAt, position, (int)positionLength);
+    }
+
+    mLineBuffer.append(copied, end - copied);
+    mOutput->write(mLineBuffer.constData(), mLineBuffer.size());
+}
+
+/**
+ * @brief GCodeZCompensator::formatPosition - Format the X, Y and Z words for a move, with the height of the
+ *      board added to Z.
+ *
+ * @param buffer - Where to write the words.  (Each one is written with a space in front of it.)
+ * @param target - Where the move goes, before compensation.  X or Y can be NAN to leave them off.
+ *
+ * @return size_t containing the number of characters written.
+ */
+size_t GCodeZCompensator::formatPosition(char *buffer, const double *target)
+{
+    static const char letters[3] = { 'X', 'Y', 'Z' };
+    double value[3];
+    double unitScale = mModalTracker.getUnitScale();
+    double x = target[0] * unitScale;
+    double y = target[1] * unitScale;
+    size_t length = 0;
+
+    // The height is looked up where the move ends, which is where it already was if X or Y aren't moving.
+    if (x != x) {
+        x = mModalTracker.getPosition(0);
+    }
+
+    if (y != y) {
+        y = mModalTracker.getPosition(1);
+    }
+
+    value[0] = target[0];
+    value[1] = target[1];
+    value[2] = target[2] + (mHeightMap->heightAt(x, y) / unitScale);
+
+    for (int i = 0; i < 3; i++) {
+        if (value[i] != value[i]) {
+            continue;
+        }
+
+        buffer[length++] = ' ';
+        buffer[length++] = letters[i];
+        length += GCodeNumberFormatter::formatFixed(buffer + length, value[i], GCODE_COMPENSATION_DECIMALS, true);
+    }
+
+    return length;
+}
@@ -0,0 +1,59 @@
+#ifndef GCODEZCOMPENSATOR_H
+#define GCODEZCOMPENSATOR_H
+
+#include <QByteArray>
+
+#include "gcodeoutput.h"
+#include "gcodemodaltracker.h"
+
+class GCodeHeightMap;
+
+// The longest (in mm) that a cutting move can be before it is split, when no other length is set.
+#define GCODE_COMPENSATION_DEFAULT_SEGMENT_LENGTH    2
+
+// The number of decimal places the compensated positions are written with.
+#define GCODE_COMPENSATION_DECIMALS                  4
+
+// What a compensation pass changed.
+struct GCodeCompensationReport
+{
+    unsigned long movesCompensated;     // Moves that had the height of the board added to them.
+    unsigned long segmentsAdded;        // Lines added when long moves were split.
+    unsigned long movesSkipped;         // Moves that were left as they are, because they are relative, or where they started wasn't known.
+};
+
+// Adds the height of the board (from a heightmap) to every move in absolute positioning, as the lines are
+// written, so that a job follows the surface of a board that isn't flat.  G01 moves longer than the segment
+// length are split in to pieces, so that the height is followed along them.  G00 moves and arcs have the
+// height at their end point added, but aren't split.
+//
+// Lines are handed on to the next output as soon as they are complete.  A move is only changed once its
+// X, Y and Z are all known, so the first move of a job should set all three.  Moves in relative positioning
+// (G91), and moves after a G28, G38.x or G53 until the position is set again, are passed on as they are.
+class GCodeZCompensator : public GCodeLineOutput
+{
+public:
+    GCodeZCompensator(GCodeOutput *output, const GCodeHeightMap *heightMap);
+
+    void setSegmentLength(double length);
+
+    void getReport(GCodeCompensationReport *report) const;
+
+protected:
+    void processLine(const char *line, size_t length);
+
+private:
+    void writeMove(const char *line, size_t length, const double *target, bool keepLine);
+    size_t formatPosition(char *buffer, const double *target);
+
+    const GCodeHeightMap *mHeightMap;
+    double mSegmentLength;              // mm
+
+    QByteArray mLineBuffer;             // A line as it is rewritten.
+
+    GCodeModalTracker mModalTracker;    // The modal state of the program, as it has been written so far.
+
+    GCodeCompensationReport mReport;
+};
+
+#endif // GCODEZCOMPENSATOR_H
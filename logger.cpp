@@ -1,36 +1,280 @@
 #include "logger.h"
+#include "profiler.h"
 
+#include <QByteArray>
+
+#include <string.h>
 #include <iostream>
 
-Logger::Logger() :
-    mLogFile("fabtweaktom.log"), mTextStream(&mLogFile)
+// How much is collected from the ring before it is written to the file.
+#define LOGGER_BATCH_SIZE                    (64 * 1024)
+
+// The one logger for the whole process.
+Logger logger;
+
+Logger::Logger()
 {
-    if (mLogFile.open(QIODevice::WriteOnly) == false) {
+    mSlots = new LoggerSlot[LOGGER_SLOT_COUNT];
+    for (size_t i = 0; i < LOGGER_SLOT_COUNT; i++) {
+        mSlots[i].sequence.store(i, std::memory_order_relaxed);
+        mSlots[i].length = 0;
+    }
+
+    mEnqueuePosition.store(0, std::memory_order_relaxed);
+    mDequeuePosition = 0;
+    mDroppedLines.store(0, std::memory_order_relaxed);
+    mReportedDroppedLines = 0;
+    mStopping = false;
+    mLevel.store(LOG_DEFAULT_LEVEL, std::memory_order_relaxed);
+
+    mLogFile = fopen("fabtweaktom.log", "wb");
+    if (mLogFile == NULL) {
         std::cerr << "Unable to open fabtweaktom.log!\n";
         return;
     }
 
-    addLine("FAB-tweak-tom -- G-code tweaker for the FABtotum 3D Printer");
+    mFlushThread = std::thread(&Logger::flushThread, this);
+
+    addLine(LOG_LEVEL_INFO, "FAB-tweak-tom -- G-code tweaker for the FABtotum 3D Printer");
+}
+
+Logger::~Logger()
+{
+    if (mFlushThread.joinable() == true) {
+        {
+            std::lock_guard<std::mutex> lock(mWakeMutex);
+            mStopping = true;
+        }
+
+        mWakeCondition.notify_one();
+        mFlushThread.join();
+    }
+
+    if (mLogFile != NULL) {
+        fclose(mLogFile);
+        mLogFile = NULL;
+    }
+
+    delete[] mSlots;
 }
 
 /**
- * @brief Logger::addLine - Write a line to our log file.
+ * @brief Logger::addLine - Queue a line to be written to our log file.  This never blocks.  If too many lines
+ *      are already waiting, the line is dropped.
  *
+ * @param level - One of the LOG_LEVEL_* values.  Anything other than INFO is marked in the log.
  * @param logline - The log line to write.
  */
-void Logger::addLine(QString logline)
+void Logger::addLine(int level, QString logline)
 {
-    if (mLogFile.isOpen() == false) {
+    QByteArray text;
+    LoggerSlot *slot;
+    size_t position;
+    size_t sequence;
+    unsigned int length;
+
+    if (mLogFile == NULL) {
         // Nothing we can do.. :-(
         return;
     }
 
+    // Claim a slot.  Its sequence matches our position when it is free for us to use.
+    position = mEnqueuePosition.load(std::memory_order_relaxed);
+    while (true) {
+        slot = &mSlots[position & (LOGGER_SLOT_COUNT - 1)];
+        sequence = slot->sequence.load(std::memory_order_acquire);
+
+        if (sequence == position) {
+            if (mEnqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed) == true) {
+                break;
+            }
+        } else if ((ptrdiff_t)(sequence - position) < 0) {
+            // The flusher hasn't emptied this slot yet, so the ring is full.
+            mDroppedLines.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            // Another thread claimed it first.
+            position = mEnqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    switch (level) {
+    case LOG_LEVEL_TRACE:
+        text = "[TRACE] ";
+        break;
+
+    case LOG_LEVEL_DEBUG:
+        text = "[DEBUG] ";
+        break;
+
+    case LOG_LEVEL_WARNING:
+        text = "[WARNING] ";
+        break;
+
+    case LOG_LEVEL_ERROR:
+        text = "[ERROR] ";
+        break;
+    }
+
+    text += logline.toUtf8();
+    length = (text.size() < LOGGER_MAX_LINE_LENGTH) ? text.size() : LOGGER_MAX_LINE_LENGTH;
+
     // Make sure the line ends with a newline.
-    if (logline.endsWith("\n") == false) {
-        logline += "\n";
+    if ((length > 0) && (text.at(length - 1) == '\n')) {
+        length--;
     }
 
-    // Write it to the log.
-    mTextStream << logline;
+    memcpy(slot->text, text.constData(), length);
+    slot->text[length] = '\n';
+    slot->length = length + 1;
+
+    // Hand the slot to the flusher.
+    slot->sequence.store(position + 1, std::memory_order_release);
+
+    // Don't wait for the timer if lines are arriving fast enough to fill the ring before it fires.
+    if ((position % (LOGGER_SLOT_COUNT / 2)) == 0) {
+        mWakeCondition.notify_one();
+    }
 }
 
+/**
+ * @brief Logger::setLevel - Change the least important level that is logged.  (Levels that were removed at
+ *      compile time can't be turned back on.)
+ *
+ * @param level - One of the LOG_LEVEL_* values.
+ */
+void Logger::setLevel(int level)
+{
+    mLevel.store(level, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Logger::getLevel - Returns the least important level that is logged.
+ *
+ * @return int containing one of the LOG_LEVEL_* values.
+ */
+int Logger::getLevel()
+{
+    return mLevel.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Logger::levelFromName - Convert the name of a level (like "debug") to its value.
+ *
+ * @param name - The name of the level.  Case doesn't matter.
+ *
+ * @return int containing one of the LOG_LEVEL_* values, or -1 if the name isn't a level.
+ */
+int Logger::levelFromName(QString name)
+{
+    name = name.toLower();
+
+    if (name == "trace") {
+        return LOG_LEVEL_TRACE;
+    } else if (name == "debug") {
+        return LOG_LEVEL_DEBUG;
+    } else if (name == "info") {
+        return LOG_LEVEL_INFO;
+    } else if ((name == "warning") || (name == "warn")) {
+        return LOG_LEVEL_WARNING;
+    } else if (name == "error") {
+        return LOG_LEVEL_ERROR;
+    } else if (name == "none") {
+        return LOG_LEVEL_NONE;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Logger::getDroppedLines - Returns the number of lines that were dropped because too many were
+ *      waiting to be written.
+ *
+ * @return quint64 containing the number of dropped lines.
+ */
+quint64 Logger::getDroppedLines()
+{
+    return mDroppedLines.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Logger::flushThread - Write out the waiting lines every LOGGER_FLUSH_INTERVAL_MS, until we are
+ *      told to stop.  (Runs on its own thread.)
+ */
+void Logger::flushThread()
+{
+    std::unique_lock<std::mutex> lock(mWakeMutex);
+
+    while (mStopping == false) {
+        lock.unlock();
+        writeWaitingLines();
+        lock.lock();
+
+        mWakeCondition.wait_for(lock, std::chrono::milliseconds(LOGGER_FLUSH_INTERVAL_MS));
+    }
+
+    lock.unlock();
+
+    // Anything that was logged while we were stopping.
+    writeWaitingLines();
+}
+
+/**
+ * @brief Logger::writeWaitingLines - Take every line that is waiting out of the ring, and write them to the
+ *      log file with a single write.
+ */
+void Logger::writeWaitingLines()
+{
+    char batch[LOGGER_BATCH_SIZE];      // Lines are collected here and written whenever it fills up.
+    size_t used = 0;
+    bool wrote = false;
+    LoggerSlot *slot;
+    quint64 dropped;
+    quint64 lines = 0;
+    quint64 bytes = 0;
+
+    PROFILE_SCOPE(PROFILE_STAGE_LOG);
+
+    while (true) {
+        slot = &mSlots[mDequeuePosition & (LOGGER_SLOT_COUNT - 1)];
+        if (slot->sequence.load(std::memory_order_acquire) != (mDequeuePosition + 1)) {
+            // Nothing more is waiting.  (Or the next line is still being filled in.)
+            break;
+        }
+
+        if ((used + slot->length) > sizeof(batch)) {
+            fwrite(batch, 1, used, mLogFile);
+            used = 0;
+            wrote = true;
+        }
+
+        memcpy(batch + used, slot->text, slot->length);
+        used += slot->length;
+        bytes += slot->length;
+        lines++;
+
+        // Give the slot back to the producers, for use the next time around the ring.
+        slot->sequence.store(mDequeuePosition + LOGGER_SLOT_COUNT, std::memory_order_release);
+        mDequeuePosition++;
+    }
+
+    if (used > 0) {
+        fwrite(batch, 1, used, mLogFile);
+        wrote = true;
+    }
+
+    PROFILE_COUNT(PROFILE_STAGE_LOG, PROFILE_COUNTER_LINES, lines);
+    PROFILE_COUNT(PROFILE_STAGE_LOG, PROFILE_COUNTER_BYTES_OUT, bytes);
+
+    dropped = mDroppedLines.load(std::memory_order_relaxed);
+    if (dropped != mReportedDroppedLines) {
+        fprintf(mLogFile, "(%llu log lines were dropped because the log couldn't keep up.)\n",
+                (unsigned long long)(dropped - mReportedDroppedLines));
+        mReportedDroppedLines = dropped;
+        wrote = true;
+    }
+
+    if (wrote == true) {
+        fflush(mLogFile);
+    }
+}
@@ -1,21 +1,132 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
-#include <QFile>
-#include <QTextStream>
+#include <QString>
 
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+// Log levels, from the most to the least detailed.
+#define LOG_LEVEL_TRACE                      0
+#define LOG_LEVEL_DEBUG                      1
+#define LOG_LEVEL_INFO                       2
+#define LOG_LEVEL_WARNING                    3
+#define LOG_LEVEL_ERROR                      4
+#define LOG_LEVEL_NONE                       5
+
+// Log calls below this level are removed at compile time, along with the work done to build their text.
+// Release builds keep INFO and above, debug builds keep everything.  Define it to override that.
+#ifndef LOG_COMPILE_MIN_LEVEL
+#ifdef QT_NO_DEBUG
+#define LOG_COMPILE_MIN_LEVEL                LOG_LEVEL_INFO
+#else
+#define LOG_COMPILE_MIN_LEVEL                LOG_LEVEL_TRACE
+#endif
+#endif
+
+// The level that is logged at run time when nothing else has been selected.
+#define LOG_DEFAULT_LEVEL                    LOG_LEVEL_INFO
+
+// The number of lines that can be waiting to be written.  (Must be a power of 2.)  With the line length
+// below, this caps the memory used by waiting lines at about 2 MB.
+#define LOGGER_SLOT_COUNT                    4096
+
+// The longest line that will be logged.  Longer lines are cut short.
+#define LOGGER_MAX_LINE_LENGTH               500
+
+// How often the background thread writes out the waiting lines.
+#define LOGGER_FLUSH_INTERVAL_MS             50
+
+// One line waiting to be written.
+struct LoggerSlot
+{
+    std::atomic<size_t> sequence;   // Tells producers and the flusher whose turn it is to use the slot.
+    unsigned int length;
+    char text[LOGGER_MAX_LINE_LENGTH + 1];
+};
+
+// Writes the log file.  Lines are put in a fixed size ring buffer without taking any locks, and written out
+// in batches by a background thread, so logging costs very little on the thread that does it.  If the ring
+// fills up, new lines are dropped (and counted) rather than making the caller wait.
 class Logger
 {
 public:
     Logger();
+    ~Logger();
+
+    void addLine(int level, QString logline);
+
+    void setLevel(int level);
+    int getLevel();
+    bool isEnabled(int level) { return (level >= mLevel.load(std::memory_order_relaxed)); }
 
-    void addLine(QString logline);
+    static int levelFromName(QString name);
+
+    quint64 getDroppedLines();
 
 private:
-    QFile mLogFile;
-    QTextStream mTextStream;
+    void flushThread();
+    void writeWaitingLines();
+
+    FILE *mLogFile;
+    std::atomic<int> mLevel;
+
+    LoggerSlot *mSlots;
+    std::atomic<size_t> mEnqueuePosition;
+    size_t mDequeuePosition;                // Only used by the flusher.
+    std::atomic<quint64> mDroppedLines;
+    quint64 mReportedDroppedLines;          // Only used by the flusher.
+
+    std::thread mFlushThread;
+    std::mutex mWakeMutex;
+    std::condition_variable mWakeCondition; // Wakes the flusher early, or tells it to stop.
+    bool mStopping;
 };
 
-static Logger logger;
+extern Logger logger;
+
+// Log a line if the level is enabled, both at compile time and run time.  The text is only built if the
+// line is actually going to be logged.
+#define LOG_AT_LEVEL(level, text) \
+    do { \
+        if (logger.isEnabled(level) == true) { \
+            logger.addLine((level), (text)); \
+        } \
+    } while (0)
+
+#define LOG_DISCARDED(text)                  do { } while (0)
+
+#if LOG_COMPILE_MIN_LEVEL <= LOG_LEVEL_TRACE
+#define LOG_TRACE(text)                      LOG_AT_LEVEL(LOG_LEVEL_TRACE, text)
+#else
+#define LOG_TRACE(text)                      LOG_DISCARDED(text)
+#endif
+
+#if LOG_COMPILE_MIN_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(text)                      LOG_AT_LEVEL(LOG_LEVEL_DEBUG, text)
+#else
+#define LOG_DEBUG(text)                      LOG_DISCARDED(text)
+#endif
+
+#if LOG_COMPILE_MIN_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(text)                       LOG_AT_LEVEL(LOG_LEVEL_INFO, text)
+#else
+#define LOG_INFO(text)                       LOG_DISCARDED(text)
+#endif
+
+#if LOG_COMPILE_MIN_LEVEL <= LOG_LEVEL_WARNING
+#define LOG_WARNING(text)                    LOG_AT_LEVEL(LOG_LEVEL_WARNING, text)
+#else
+#define LOG_WARNING(text)                    LOG_DISCARDED(text)
+#endif
+
+#if LOG_COMPILE_MIN_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(text)                      LOG_AT_LEVEL(LOG_LEVEL_ERROR, text)
+#else
+#define LOG_ERROR(text)                      LOG_DISCARDED(text)
+#endif
 
 #endif // LOGGER_H
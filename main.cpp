@@ -1,11 +1,30 @@
+#include "commandline.h"
+
+#include <QCoreApplication>
+
+#ifndef FABTWEAKTOM_NO_GUI
 #include "mainwindow.h"
 #include <QApplication>
+#endif
 
 int main(int argc, char *argv[])
 {
+    // With any arguments we run from the command line, and don't need (or want) a GUI.
+    if (CommandLine::wantsCommandLine(argc, argv) == true) {
+        QCoreApplication a(argc, argv);
+        CommandLine commandLine;
+
+        return commandLine.run(a.arguments());
+    }
+
+#ifdef FABTWEAKTOM_NO_GUI
+    CommandLine::printUsage();
+    return 2;
+#else
     QApplication a(argc, argv);
     MainWindow w;
     w.show();
 
     return a.exec();
+#endif
 }
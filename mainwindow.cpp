@@ -3,9 +3,11 @@
 
 #include <QFileDialog>
 #include <QMessageBox>
+#include <QCloseEvent>
 
 #include "createbedlevelinggcode.h"
 #include "changegcodefeedrates.h"
+#include "gcodeworker.h"
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
@@ -13,7 +15,10 @@ MainWindow::MainWindow(QWidget *parent) :
 {
     ui->setupUi(this);
 
+    mWorker = new GCodeWorker(this);
+
     connectSignalsAndSlots();
+    setBusy(false);
 
     // Set our default widget.
     ui->stackedWidget->setCurrentIndex(0);
@@ -21,6 +26,10 @@ MainWindow::MainWindow(QWidget *parent) :
 
 MainWindow::~MainWindow()
 {
+    // Don't leave the worker running on a window that is going away.
+    mWorker->cancel();
+    mWorker->wait();
+
     disconnectSignalsAndSlots();
 
     delete ui;
@@ -46,6 +55,12 @@ void MainWindow::connectSignalsAndSlots()
     connect(ui->feedRateTweakingInputFileButton, SIGNAL(clicked(bool)), this, SLOT(slotFeedRateTweakingInputFileClicked()));
     connect(ui->feedRateTweakerOutputFileButton, SIGNAL(clicked(bool)), this, SLOT(slotFeedRateTweakingOutputFileClicked()));
     connect(ui->feedRateTweakingCreateButton, SIGNAL(clicked(bool)), this, SLOT(slotFeedRateTweakingCreateButtonClicked()));
+
+    // Worker slots/signals.
+    connect(ui->bedLevelCancelButton, SIGNAL(clicked(bool)), this, SLOT(slotCancelClicked()));
+    connect(ui->feedRateTweakingCancelButton, SIGNAL(clicked(bool)), this, SLOT(slotCancelClicked()));
+    connect(mWorker, SIGNAL(progressChanged(qint64,qint64,qint64,double)), this, SLOT(slotWorkerProgress(qint64,qint64,qint64,double)));
+    connect(mWorker, SIGNAL(workFinished(bool,QString)), this, SLOT(slotWorkerFinished(bool,QString)));
 }
 
 /**
@@ -68,6 +83,12 @@ void MainWindow::disconnectSignalsAndSlots()
     disconnect(ui->feedRateTweakingInputFileButton, SIGNAL(clicked(bool)), this, SLOT(slotFeedRateTweakingInputFileClicked()));
     disconnect(ui->feedRateTweakerOutputFileButton, SIGNAL(clicked(bool)), this, SLOT(slotFeedRateTweakingOutputFileClicked()));
     disconnect(ui->feedRateTweakingCreateButton, SIGNAL(clicked(bool)), this, SLOT(slotFeedRateTweakingCreateButtonClicked()));
+
+    // Worker slots/signals.
+    disconnect(ui->bedLevelCancelButton, SIGNAL(clicked(bool)), this, SLOT(slotCancelClicked()));
+    disconnect(ui->feedRateTweakingCancelButton, SIGNAL(clicked(bool)), this, SLOT(slotCancelClicked()));
+    disconnect(mWorker, SIGNAL(progressChanged(qint64,qint64,qint64,double)), this, SLOT(slotWorkerProgress(qint64,qint64,qint64,double)));
+    disconnect(mWorker, SIGNAL(workFinished(bool,QString)), this, SLOT(slotWorkerFinished(bool,QString)));
 }
 
 /**
@@ -94,6 +115,67 @@ void MainWindow::getNewSaveFile(QLineEdit *toUpdateLineEdit)
     }
 }
 
+/**
+ * @brief MainWindow::setBusy - Update the window for a job starting or finishing.  While a job is running only
+ *      its progress bar and cancel button are usable.
+ *
+ * @param busy - true if a job is starting.  false if it has finished.
+ */
+void MainWindow::setBusy(bool busy)
+{
+    ui->bedLevelProgressBar->setVisible(busy);
+    ui->bedLevelCancelButton->setVisible(busy);
+    ui->bedLevelCancelButton->setEnabled(true);
+    ui->bedLevelCreatePushButton->setEnabled(!busy);
+
+    ui->feedRateTweakingProgressBar->setVisible(busy);
+    ui->feedRateTweakingCancelButton->setVisible(busy);
+    ui->feedRateTweakingCancelButton->setEnabled(true);
+    ui->feedRateTweakingCreateButton->setEnabled(!busy);
+
+    // Don't let the page change under a running job.
+    ui->actionAdd_Edit_feed_rates_in_a_G_code_file->setEnabled(!busy);
+    ui->actionCreate_Bed_Leveling_G_code->setEnabled(!busy);
+
+    if (busy == true) {
+        // Show a "busy" bar until we know how big the job is.
+        activeProgressBar()->setRange(0, 0);
+        activeProgressBar()->setValue(0);
+    } else {
+        statusBar()->clearMessage();
+    }
+}
+
+/**
+ * @brief MainWindow::activeProgressBar - Get the progress bar on the page that is being shown.
+ *
+ * @return QProgressBar* for the current page.
+ */
+QProgressBar *MainWindow::activeProgressBar()
+{
+    if (ui->stackedWidget->currentIndex() == 1) {
+        return ui->bedLevelProgressBar;
+    }
+
+    return ui->feedRateTweakingProgressBar;
+}
+
+/**
+ * @brief MainWindow::closeEvent - Called when the window is closing.  Stop any running job first, so that
+ *      it doesn't leave a partial output file behind.
+ *
+ * @param event - The close event.
+ */
+void MainWindow::closeEvent(QCloseEvent *event)
+{
+    if (mWorker->isRunning() == true) {
+        mWorker->cancel();
+        mWorker->wait();
+    }
+
+    event->accept();
+}
+
 /**
  * @brief MainWindow::actionBedLevelMenuSelection - Called when the user selects the menu option to create
  *      a bed leveling gcode file.  It should change our active stacked widget, and set up any associated values.
@@ -158,11 +240,14 @@ void MainWindow::slotBedLevelCreateClicked()
     bedleveling.setXYFeedRate(ui->bedlevelXYFeedRateSpinBox->value());
     bedleveling.setZFeedRate(ui->bedLevelZFeedRateSpinBox->value());
 
-    if (bedleveling.createGCodeFile(ui->bedLevelFileToCreateField->text()).isEmpty() == false) {
-        QMessageBox::critical(this, tr("File Not Created"), tr("Unable to create the G-code file!"));
-    } else {
-        QMessageBox::information(this, tr("File Created"), tr("The bed leveling G-code has been created."));
-    }
+    // The combo box items are in the same order as the BED_LEVEL_STRATEGY_* and BED_LEVEL_DIRECTION_* values.
+    bedleveling.setStrategy(ui->bedLevelStrategyComboBox->currentIndex());
+    bedleveling.setMillingDirection(ui->bedLevelDirectionComboBox->currentIndex());
+    bedleveling.setMaxStepDown(ui->bedLevelStepDownSpinBox->value());
+    bedleveling.setTileSize(ui->bedLevelTileSizeSpinBox->value());
+
+    setBusy(true);
+    mWorker->createBedLeveling(bedleveling, ui->bedLevelFileToCreateField->text());
 }
 
 /**
@@ -206,5 +291,82 @@ void MainWindow::slotFeedRateTweakingCreateButtonClicked()
 {
     ChangeGCodeFeedRates feedRates;
 
-    QMessageBox::information(this, "Not implemented", "This isn't implemented!  How lucky for you!");
+    feedRates.setInputFile(ui->feedRateTweakingInputFileField->text());
+    feedRates.setOutputFile(ui->feedRateTweakerOutputFileField->text());
+
+    feedRates.setCleanUpGCode(ui->feedRateTweakingCleanUpGcodeGroupCheckBox->isChecked());
+    feedRates.setFeedRateSameLine(ui->feedRateTweakingAllFeedRatesAlignedCheckBox->isChecked());
+    feedRates.setReplaceM05(ui->feedRateTweakingReplaceM05CheckBox->isChecked());
+    feedRates.setStripComments(ui->feedRateTweakingStripCommentsCheckBox->isChecked());
+
+    feedRates.setRedefineFeedRates(ui->feedRateTweakingRedefineFeedRateGroupCheckBox->isChecked());
+    feedRates.setOnlyReplaceExistingFeedRates(ui->feedRateTweakerOnlyReplaceFeedRateCheckBox->isChecked());
+    feedRates.setNewXYFeedRate(QString::number(ui->feedRateTweakerXYFeedRateSpinBox->value()));
+    feedRates.setNewZFeedRate(QString::number(ui->feedRateTweakingZFeedRateSpinBox->value()));
+
+    // Use every core we have.
+    feedRates.setThreadCount(0);
+
+    setBusy(true);
+    mWorker->changeFeedRates(feedRates);
+}
+
+/**
+ * @brief MainWindow::slotCancelClicked - Called when the user clicks on the "Cancel" button while a job is running.
+ *      The job stops at its next progress check, and slotWorkerFinished() is called as usual.
+ */
+void MainWindow::slotCancelClicked()
+{
+    ui->bedLevelCancelButton->setEnabled(false);
+    ui->feedRateTweakingCancelButton->setEnabled(false);
+    statusBar()->showMessage(tr("Cancelling..."));
+
+    mWorker->cancel();
+}
+
+/**
+ * @brief MainWindow::slotWorkerProgress - Called (on the GUI thread) as the worker makes progress.
+ *
+ * @param bytesProcessed - How much of the input has been processed.
+ * @param totalBytes - The size of the input.
+ * @param lines - How many lines have been processed.
+ * @param megabytesPerSecond - How fast the input is being processed.
+ */
+void MainWindow::slotWorkerProgress(qint64 bytesProcessed, qint64 totalBytes, qint64 lines, double megabytesPerSecond)
+{
+    QProgressBar *progressBar = activeProgressBar();
+
+    if (totalBytes > 0) {
+        progressBar->setRange(0, 1000);
+        progressBar->setValue((int)((bytesProcessed * 1000) / totalBytes));
+    }
+
+    statusBar()->showMessage(tr("%1 of %2 bytes, %3 lines processed (%4 MB/s)").arg(bytesProcessed).arg(totalBytes)
+                             .arg(lines).arg(megabytesPerSecond, 0, 'f', 1));
+}
+
+/**
+ * @brief MainWindow::slotWorkerFinished - Called (on the GUI thread) when the worker has finished a job.
+ *
+ * @param success - true if the job worked.
+ * @param message - A description of the result.
+ */
+void MainWindow::slotWorkerFinished(bool success, QString message)
+{
+    bool cancelled = mWorker->isCancelled();
+    bool bedLeveling = (ui->stackedWidget->currentIndex() == 1);
+
+    // Make sure the thread is completely done before it can be started again.
+    mWorker->wait();
+    setBusy(false);
+
+    if ((success == false) && (cancelled == true)) {
+        QMessageBox::information(this, tr("Cancelled"), tr("The operation was cancelled.  No file was written."));
+    } else if (success == false) {
+        QMessageBox::critical(this, tr("File Not Created"), tr("Unable to create the G-code file!") + "\n\n" + message);
+    } else if (bedLeveling == true) {
+        QMessageBox::information(this, tr("File Created"), tr("The bed leveling G-code has been created.") + "\n\n" + message);
+    } else {
+        QMessageBox::information(this, tr("File Created"), tr("The edited G-code file has been created.") + "\n\n" + message);
+    }
 }
@@ -3,6 +3,10 @@
 
 #include <QMainWindow>
 #include <QLineEdit>
+#include <QProgressBar>
+#include <QPushButton>
+
+class GCodeWorker;
 
 namespace Ui {
 class MainWindow;
@@ -27,12 +31,22 @@ private slots:
     void slotFeedRateTweakingOutputFileClicked();
     void slotFeedRateTweakingCreateButtonClicked();
 
+    void slotCancelClicked();
+    void slotWorkerProgress(qint64 bytesProcessed, qint64 totalBytes, qint64 lines, double megabytesPerSecond);
+    void slotWorkerFinished(bool success, QString message);
+
+protected:
+    void closeEvent(QCloseEvent *event);
+
 private:
     void connectSignalsAndSlots();
     void disconnectSignalsAndSlots();
     void getNewSaveFile(QLineEdit *toUpdateLineEdit);
+    void setBusy(bool busy);
+    QProgressBar *activeProgressBar();
 
     Ui::MainWindow *ui;
+    GCodeWorker *mWorker;           // Does the actual work, so that the window doesn't freeze.
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,298 @@
+#include "profiler.h"
+
+#include <QFile>
+
+#include <chrono>
+
+// The innermost scope that is running on each thread, so that its time can be taken out of the one around it.
+static thread_local ProfilerScope *currentScope = NULL;
+
+// Threads are numbered in the trace in the order they first finish a scope.
+static thread_local int traceThread = 0;
+static std::atomic<int> nextTraceThread(1);
+
+Profiler::Profiler()
+{
+    mEnabled.store(false, std::memory_order_relaxed);
+    reset();
+}
+
+/**
+ * @brief Profiler::instance - The one profiler for the whole process.  It is created the first time it is
+ *      used, and never destroyed, so that anything still running while the process exits (the logger's last
+ *      flush, which happens as its own static is destroyed) can use it safely.
+ *
+ * @return Profiler& for the profiler.
+ */
+Profiler &Profiler::instance()
+{
+    static Profiler *theProfiler = new Profiler();
+
+    return *theProfiler;
+}
+
+/**
+ * @brief Profiler::setEnabled - Turn the profiler on or off.  Turning it on starts again from nothing.
+ *      (Do this before any work starts, as scopes that are already running are left out.)
+ *
+ * @param enabled - true to collect times and counts, false to stop.
+ */
+void Profiler::setEnabled(bool enabled)
+{
+    if ((enabled == true) && (isEnabled() == false)) {
+        reset();
+    }
+
+    mEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Profiler::reset - Throw away everything that has been collected.
+ */
+void Profiler::reset()
+{
+    for (int i = 0; i < PROFILE_STAGE_COUNT; i++) {
+        mCalls[i].store(0, std::memory_order_relaxed);
+        mSelfTime[i].store(0, std::memory_order_relaxed);
+
+        for (int j = 0; j < PROFILE_COUNTER_COUNT; j++) {
+            mCounters[i][j].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mEventMutex);
+    mEvents.clear();
+    mDroppedEvents = 0;
+    mStartTime = now();
+}
+
+/**
+ * @brief Profiler::addScope - Add the time of a finished scope to its stage.  Scopes that took long enough
+ *      are added to the trace as well.
+ *
+ * @param stage - One of the PROFILE_STAGE_* values.
+ * @param start - When the scope started.  (From now().)
+ * @param duration - How long the scope took, in ns.
+ * @param selfDuration - How long the scope took, less the scopes inside it, in ns.
+ */
+void Profiler::addScope(int stage, qint64 start, qint64 duration, qint64 selfDuration)
+{
+    ProfilerEvent event;
+
+    mCalls[stage].fetch_add(1, std::memory_order_relaxed);
+    mSelfTime[stage].fetch_add(selfDuration, std::memory_order_relaxed);
+
+    if (duration < (PROFILER_MIN_TRACE_DURATION_US * 1000)) {
+        return;
+    }
+
+    if (traceThread == 0) {
+        traceThread = nextTraceThread.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    event.stage = stage;
+    event.thread = traceThread;
+    event.duration = duration;
+
+    std::lock_guard<std::mutex> lock(mEventMutex);
+
+    if (mEvents.size() >= PROFILER_MAX_TRACE_EVENTS) {
+        mDroppedEvents++;
+        return;
+    }
+
+    event.start = start - mStartTime;
+    mEvents.push_back(event);
+}
+
+/**
+ * @brief Profiler::addCount - Add to one of the counters of a stage.  (Use PROFILE_COUNT(), which only
+ *      calls this when the profiler is on.)
+ *
+ * @param stage - One of the PROFILE_STAGE_* values.
+ * @param counter - One of the PROFILE_COUNTER_* values.
+ * @param amount - How much to add.
+ */
+void Profiler::addCount(int stage, int counter, quint64 amount)
+{
+    mCounters[stage][counter].fetch_add(amount, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Profiler::writeReport - Print the totals for every stage that did anything.
+ *
+ * @param file - Where to print them.  (stdout, say.)
+ */
+void Profiler::writeReport(FILE *file)
+{
+    quint64 calls;
+    quint64 selfTime;
+    quint64 bytes;
+    double milliseconds;
+    double rate;
+
+    fprintf(file, "Profile :\n");
+    fprintf(file, "  %-12s %9s %11s %9s %13s %13s %11s %11s\n", "Stage", "Calls", "Self (ms)", "MB/s", "Bytes in",
+            "Bytes out", "Lines", "Rewritten");
+
+    for (int i = 0; i < PROFILE_STAGE_COUNT; i++) {
+        calls = mCalls[i].load(std::memory_order_relaxed);
+        selfTime = mSelfTime[i].load(std::memory_order_relaxed);
+
+        bytes = 0;
+        for (int j = 0; j < PROFILE_COUNTER_COUNT; j++) {
+            bytes |= mCounters[i][j].load(std::memory_order_relaxed);
+        }
+
+        if ((calls == 0) && (bytes == 0)) {
+            continue;
+        }
+
+        // The rate is of whichever side of the stage moved more data.
+        bytes = mCounters[i][PROFILE_COUNTER_BYTES_IN].load(std::memory_order_relaxed);
+        if (mCounters[i][PROFILE_COUNTER_BYTES_OUT].load(std::memory_order_relaxed) > bytes) {
+            bytes = mCounters[i][PROFILE_COUNTER_BYTES_OUT].load(std::memory_order_relaxed);
+        }
+
+        milliseconds = (double)selfTime / 1e6;
+        rate = (milliseconds > 0) ? (((double)bytes / (1024.0 * 1024.0)) / (milliseconds / 1000)) : 0;
+
+        fprintf(file, "  %-12s %9llu %11.1f %9.1f %13llu %13llu %11llu %11llu\n", stageName(i),
+                (unsigned long long)calls, milliseconds, rate,
+                (unsigned long long)mCounters[i][PROFILE_COUNTER_BYTES_IN].load(std::memory_order_relaxed),
+                (unsigned long long)mCounters[i][PROFILE_COUNTER_BYTES_OUT].load(std::memory_order_relaxed),
+                (unsigned long long)mCounters[i][PROFILE_COUNTER_LINES].load(std::memory_order_relaxed),
+                (unsigned long long)mCounters[i][PROFILE_COUNTER_WORDS_REWRITTEN].load(std::memory_order_relaxed));
+    }
+
+    fprintf(file, "  (Self time leaves out the stages inside a stage, and is added up over every thread.  Stages that are\n"
+                  "  handed a line at a time include the cost of timing them.)\n");
+}
+
+/**
+ * @brief Profiler::writeTrace - Write the scopes that were long enough to be kept as a Chrome trace event
+ *      file.
+ *
+ * @param filename - The file to write.
+ *
+ * @return true if the file was written.  false otherwise.
+ */
+bool Profiler::writeTrace(QString filename)
+{
+    FILE *file;
+    int threads = 0;
+
+    file = fopen(QFile::encodeName(filename).constData(), "w");
+    if (file == NULL) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mEventMutex);
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":%llu},\"traceEvents\":[\n",
+            (unsigned long long)mDroppedEvents);
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"FAB-tweak-tom\"}}");
+
+    for (size_t i = 0; i < mEvents.size(); i++) {
+        const ProfilerEvent &event = mEvents[i];
+
+        if (event.thread > threads) {
+            threads = event.thread;
+        }
+
+        fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"fabtweaktom\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                stageName(event.stage), event.thread, (double)event.start / 1000, (double)event.duration / 1000);
+    }
+
+    for (int i = 1; i <= threads; i++) {
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"Thread %d\"}}", i, i);
+    }
+
+    fprintf(file, "\n]}\n");
+
+    return (fclose(file) == 0);
+}
+
+/**
+ * @brief Profiler::now - Get the time from a clock that only goes forward.
+ *
+ * @return qint64 containing the time, in ns.
+ */
+qint64 Profiler::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Profiler::stageName - Get the name of a stage, as it is shown in the report and the trace.
+ *
+ * @param stage - One of the PROFILE_STAGE_* values.
+ *
+ * @return const char* containing the name.
+ */
+const char *Profiler::stageName(int stage)
+{
+    switch (stage) {
+    case PROFILE_STAGE_READ:
+        return "read";
+
+    case PROFILE_STAGE_PARSE:
+        return "parse";
+
+    case PROFILE_STAGE_REWRITE:
+        return "rewrite";
+
+    case PROFILE_STAGE_OPTIMIZE:
+        return "optimize";
+
+    case PROFILE_STAGE_COMPENSATE:
+        return "heightmap";
+
+    case PROFILE_STAGE_FEED_POLICY:
+        return "feed policy";
+
+    case PROFILE_STAGE_LOOK_AHEAD:
+        return "look-ahead";
+
+    case PROFILE_STAGE_WRITE:
+        return "write";
+
+    case PROFILE_STAGE_LOG:
+        return "log";
+
+    case PROFILE_STAGE_ESTIMATE:
+        return "estimate";
+    }
+
+    return "unknown";
+}
+
+/**
+ * @brief ProfilerScope::begin - Start timing, inside whatever scope is already running on this thread.
+ *
+ * @param stage - One of the PROFILE_STAGE_* values.
+ */
+void ProfilerScope::begin(int stage)
+{
+    mStage = stage;
+    mChildTime = 0;
+    mParent = currentScope;
+    currentScope = this;
+    mStart = Profiler::now();
+}
+
+/**
+ * @brief ProfilerScope::end - Stop timing, and add the time to the stage.  The scope around this one has
+ *      this time taken out of its own.
+ */
+void ProfilerScope::end()
+{
+    qint64 duration = Profiler::now() - mStart;
+
+    currentScope = mParent;
+    if (mParent != NULL) {
+        mParent->mChildTime += duration;
+    }
+
+    Profiler::instance().addScope(mStage, mStart, duration, duration - mChildTime);
+}
@@ -0,0 +1,131 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <QString>
+
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// The stages of processing that time and counts are added to.
+#define PROFILE_STAGE_READ                   0       // Reading the input file.
+#define PROFILE_STAGE_PARSE                  1       // Building a GCodeProgram, or loading it from the cache.
+#define PROFILE_STAGE_REWRITE                2       // Cleaning up lines and changing their feed rates.
+#define PROFILE_STAGE_OPTIMIZE               3       // The move optimizer, arc fitter and travel optimizer.
+#define PROFILE_STAGE_COMPENSATE             4       // Following a heightmap.
+#define PROFILE_STAGE_FEED_POLICY            5
+#define PROFILE_STAGE_LOOK_AHEAD             6
+#define PROFILE_STAGE_WRITE                  7       // Writing the output file.
+#define PROFILE_STAGE_LOG                    8       // Writing the log file.  (On the logger's own thread.)
+#define PROFILE_STAGE_ESTIMATE               9       // Following the input and output to estimate their run times.
+#define PROFILE_STAGE_COUNT                  10
+
+// The counters kept for each stage.
+#define PROFILE_COUNTER_BYTES_IN             0
+#define PROFILE_COUNTER_BYTES_OUT            1
+#define PROFILE_COUNTER_LINES                2
+#define PROFILE_COUNTER_WORDS_REWRITTEN      3       // Words (or whole lines) that were added or changed.
+#define PROFILE_COUNTER_COUNT                4
+
+// Scopes shorter than this (in microseconds) are only added to the totals, and not to the trace, so that
+// timing something once per line doesn't fill the trace up.
+#define PROFILER_MIN_TRACE_DURATION_US       20
+
+// The most events the trace holds.  (About 24 MB.)  Later events are dropped, and counted.
+#define PROFILER_MAX_TRACE_EVENTS            (1024 * 1024)
+
+// One finished scope, as it is written to the trace.
+struct ProfilerEvent
+{
+    int stage;
+    int thread;
+    qint64 start;                   // ns, since the profiler was enabled.
+    qint64 duration;                // ns
+};
+
+// Adds up where the time goes while G-code is processed.  The processing classes time themselves with
+// PROFILE_SCOPE() and count what they did with PROFILE_COUNT().  Both check a single flag and do nothing
+// else when the profiler is off.  (And they compile to nothing at all when FABTWEAKTOM_NO_PROFILER is
+// defined.)  Each stage keeps its self time (with the time of any scopes inside it taken out), so the
+// stages add up to the time that was spent, and nothing is counted twice.
+//
+// The totals can be printed with writeReport(), and the scopes can be written as a Chrome trace event
+// file with writeTrace(), to be looked at in chrome://tracing or Perfetto.
+class Profiler
+{
+public:
+    static Profiler &instance();
+
+    void setEnabled(bool enabled);
+    bool isEnabled() { return mEnabled.load(std::memory_order_relaxed); }
+    void reset();
+
+    void addScope(int stage, qint64 start, qint64 duration, qint64 selfDuration);
+    void addCount(int stage, int counter, quint64 amount);
+
+    void writeReport(FILE *file);
+    bool writeTrace(QString filename);
+
+    static qint64 now();
+    static const char *stageName(int stage);
+
+private:
+    Profiler();
+
+    std::atomic<bool> mEnabled;
+    qint64 mStartTime;
+
+    std::atomic<quint64> mCalls[PROFILE_STAGE_COUNT];
+    std::atomic<quint64> mSelfTime[PROFILE_STAGE_COUNT];           // ns, summed over every thread.
+    std::atomic<quint64> mCounters[PROFILE_STAGE_COUNT][PROFILE_COUNTER_COUNT];
+
+    std::mutex mEventMutex;
+    std::vector<ProfilerEvent> mEvents;
+    quint64 mDroppedEvents;
+};
+
+// Times the block it is in, and adds the time to a stage.  (Made through PROFILE_SCOPE().)
+class ProfilerScope
+{
+public:
+    ProfilerScope(int stage)
+    {
+        mStart = -1;
+        if (Profiler::instance().isEnabled() == true) {
+            begin(stage);
+        }
+    }
+
+    ~ProfilerScope()
+    {
+        if (mStart >= 0) {
+            end();
+        }
+    }
+
+private:
+    void begin(int stage);
+    void end();
+
+    int mStage;
+    qint64 mStart;                  // ns, or -1 if the profiler was off when the scope started.
+    qint64 mChildTime;              // ns spent in scopes inside this one.
+    ProfilerScope *mParent;
+};
+
+#ifndef FABTWEAKTOM_NO_PROFILER
+#define PROFILE_SCOPE(stage)                 ProfilerScope profilerScope(stage)
+
+#define PROFILE_COUNT(stage, counter, amount) \
+    do { \
+        if (Profiler::instance().isEnabled() == true) { \
+            Profiler::instance().addCount((stage), (counter), (amount)); \
+        } \
+    } while (0)
+#else
+#define PROFILE_SCOPE(stage)                 do { } while (0)
+#define PROFILE_COUNT(stage, counter, amount) do { } while (0)
+#endif
+
+#endif // PROFILER_H
@@ -0,0 +1,112 @@
+#include "feedpolicytest.h"
+
+#include "gcodeoutput.h"
+
+#include <QtTest>
+
+#include <math.h>
+
+// The feed rates the tests are run with.  (mm/min)
+#define FEED_POLICY_TEST_XY_FEED_RATE        1000
+#define FEED_POLICY_TEST_Z_FEED_RATE         100
+
+/**
+ * @brief FeedPolicyTest::setUp - Give a feed policy the feed rates the tests expect, with short moves left alone.
+ *
+ * @param policy - The policy to set up.
+ */
+void FeedPolicyTest::setUp(GCodeFeedPolicy &policy)
+{
+    policy.setXYFeedRate(FEED_POLICY_TEST_XY_FEED_RATE);
+    policy.setZFeedRate(FEED_POLICY_TEST_Z_FEED_RATE);
+    policy.setShortSegmentLength(0);
+}
+
+/**
+ * @brief FeedPolicyTest::run - Stream some G-code through a feed policy.  It is written in two pieces, split
+ *      part way through a line.
+ *
+ * @param text - The G-code.
+ * @param report[out] - What the policy changed.
+ *
+ * @return QByteArray containing the G-code that the policy wrote.
+ */
+QByteArray FeedPolicyTest::run(const QByteArray &text, GCodeFeedPolicyReport *report)
+{
+    QByteArray result;
+    GCodeMemoryOutput output(&result);
+    GCodeFeedPolicy policy(&output);
+    int split = text.size() / 2;
+
+    setUp(policy);
+
+    policy.write(text.constData(), split);
+    policy.write(text.constData() + split, text.size() - split);
+    policy.finish();
+    policy.getReport(report);
+
+    return result;
+}
+
+void FeedPolicyTest::choosesFeedRateByDirection()
+{
+    GCodeNullOutput output;
+    GCodeFeedPolicy policy(&output);
+
+    setUp(policy);
+
+    QCOMPARE(policy.feedRateFor(10, 0, 0), 1000.0);
+    QCOMPARE(policy.feedRateFor(0, 0, -1), 100.0);
+    QCOMPARE(policy.feedRateFor(0, 0, 0), 0.0);
+
+    // A shallow ramp is held back by X/Y, and a steep one by Z.  (Each along the length of the move.)
+    QVERIFY(fabs(policy.feedRateFor(10, 0, -0.5) - (100 * sqrt(100.25))) < 1e-9);
+    QVERIFY(fabs(policy.feedRateFor(1, 0, -1) - (100 * sqrt(2.0))) < 1e-9);
+
+    policy.setPlungeFeedRate(50);
+    policy.setRetractFeedRate(200);
+    QCOMPARE(policy.feedRateFor(0, 0, -1), 50.0);
+    QCOMPARE(policy.feedRateFor(0, 0, 1), 200.0);
+
+    // Short moves are slowed down in proportion to their length, to no less than the scale.
+    policy.setShortSegmentLength(1);
+    policy.setShortSegmentScale(0.25);
+    QCOMPARE(policy.feedRateFor(0.5, 0, 0), 500.0);
+    QCOMPARE(policy.feedRateFor(0.1, 0, 0), 250.0);
+    QCOMPARE(policy.feedRateFor(2, 0, 0), 1000.0);
+}
+
+void FeedPolicyTest::writesFeedRateWhenItChanges()
+{
+    GCodeFeedPolicyReport report;
+
+    QCOMPARE(run("G90 G21\nG00 X0 Y0 Z1\nG01 Z-1 (down)\nG01 X10\nG01 X20 F500\nG01 X20.2\nG00 Z1\n", &report),
+             QByteArray("G90 G21\nG00 X0 Y0 Z1\nG01 Z-1 F100 (down)\nG01 X10 F1000\nG01 X20 F1000\nG01 X20.2\nG00 Z1\n"));
+    QCOMPARE(report.movesRated, 4UL);
+    QCOMPARE(report.feedRatesWritten, 3UL);
+    QCOMPARE(report.movesSkipped, 0UL);
+
+    // Until the machine has been somewhere, a relative move is the only one that can be measured.
+    QCOMPARE(run("G90\nG01 X10\nG91\nG01 X10\n", &report), QByteArray("G90\nG01 X10\nG91\nG01 X10 F1000\n"));
+    QCOMPARE(report.movesSkipped, 1UL);
+}
+
+void FeedPolicyTest::writesFeedRateInProgramUnits()
+{
+    GCodeFeedPolicyReport report;
+
+    // 1000 mm/min is 39.37 inches/min.
+    QCOMPARE(run("G90 G20\nG00 X0 Y0 Z0\nG01 X1\nG21\nG01 X30", &report),
+             QByteArray("G90 G20\nG00 X0 Y0 Z0\nG01 X1 F39.4\nG21\nG01 X30 F1000"));
+    QCOMPARE(report.feedRatesWritten, 2UL);
+}
+
+void FeedPolicyTest::passesInverseTimeMovesOn()
+{
+    GCodeFeedPolicyReport report;
+
+    // In G93 the F word is a time, not a speed.
+    QCOMPARE(run("G90 G93\nG00 X0 Y0 Z0\nG01 X10 F2\nG94\nG01 X20\n", &report),
+             QByteArray("G90 G93\nG00 X0 Y0 Z0\nG01 X10 F2\nG94\nG01 X20 F1000\n"));
+    QCOMPARE(report.feedRatesWritten, 1UL);
+}
@@ -0,0 +1,25 @@
+#ifndef FEEDPOLICYTEST_H
+#define FEEDPOLICYTEST_H
+
+#include "gcodefeedpolicy.h"
+
+#include <QObject>
+#include <QByteArray>
+
+// Checks the feed rates that the feed policy picks, and where it writes them.
+class FeedPolicyTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void choosesFeedRateByDirection();
+    void writesFeedRateWhenItChanges();
+    void writesFeedRateInProgramUnits();
+    void passesInverseTimeMovesOn();
+
+private:
+    void setUp(GCodeFeedPolicy &policy);
+    QByteArray run(const QByteArray &text, GCodeFeedPolicyReport *report);
+};
+
+#endif // FEEDPOLICYTEST_H
@@ -0,0 +1,95 @@
+#include "heightmaptest.h"
+
+#include "gcodeheightmap.h"
+
+#include <QtTest>
+
+#include <math.h>
+
+// How close a height has to be to what is expected.  (mm)
+#define HEIGHT_MAP_TEST_TOLERANCE            1e-9
+
+// The heights of a 3 by 3 grid, 10 mm apart, a row at a time from Y0.
+static const double gridHeights[9] = {
+    0.0, 0.1, 0.2,
+    0.3, 0.5, 0.4,
+    0.6, 0.7, 0.9
+};
+
+/**
+ * @brief HeightMapTest::gridPoints - Get the points of the test grid, as setPoints() takes them.  They are
+ *      listed from the last one back, since the order shouldn't matter.
+ *
+ * @return QVector<double> containing X, Y and Z for each point.
+ */
+QVector<double> HeightMapTest::gridPoints()
+{
+    QVector<double> points;
+
+    for (int i = 8; i >= 0; i--) {
+        points << ((i % 3) * 10.0) << ((i / 3) * 10.0) << gridHeights[i];
+    }
+
+    return points;
+}
+
+void HeightMapTest::interpolatesBilinear()
+{
+    GCodeHeightMap heightMap;
+
+    QVERIFY(heightMap.setPoints(gridPoints()).isEmpty() == true);
+    heightMap.setInterpolation(HEIGHT_MAP_BILINEAR);
+    QCOMPARE(heightMap.getColumns(), 3);
+    QCOMPARE(heightMap.getRows(), 3);
+
+    // The middle of a cell is the average of its corners, and the middle of an edge the average of its ends.
+    QVERIFY(fabs(heightMap.heightAt(5, 5) - 0.225) < HEIGHT_MAP_TEST_TOLERANCE);
+    QVERIFY(fabs(heightMap.heightAt(15, 15) - 0.625) < HEIGHT_MAP_TEST_TOLERANCE);
+    QVERIFY(fabs(heightMap.heightAt(20, 5) - 0.3) < HEIGHT_MAP_TEST_TOLERANCE);
+    QVERIFY(fabs(heightMap.heightAt(12.5, 10) - 0.475) < HEIGHT_MAP_TEST_TOLERANCE);
+}
+
+void HeightMapTest::clampsOutsideGrid()
+{
+    GCodeHeightMap heightMap;
+
+    QVERIFY(heightMap.setPoints(gridPoints()).isEmpty() == true);
+    heightMap.setInterpolation(HEIGHT_MAP_BILINEAR);
+
+    // Points off the grid get the height of the nearest edge (or corner).
+    QVERIFY(fabs(heightMap.heightAt(-10, -10) - 0.0) < HEIGHT_MAP_TEST_TOLERANCE);
+    QVERIFY(fabs(heightMap.heightAt(100, 100) - 0.9) < HEIGHT_MAP_TEST_TOLERANCE);
+    QVERIFY(fabs(heightMap.heightAt(100, 5) - 0.3) < HEIGHT_MAP_TEST_TOLERANCE);
+    QVERIFY(fabs(heightMap.heightAt(5, -50) - 0.05) < HEIGHT_MAP_TEST_TOLERANCE);
+}
+
+void HeightMapTest::bicubicPassesThroughPoints()
+{
+    GCodeHeightMap heightMap;
+    double height;
+
+    QVERIFY(heightMap.setPoints(gridPoints()).isEmpty() == true);
+    heightMap.setInterpolation(HEIGHT_MAP_BICUBIC);
+
+    for (int i = 0; i < 9; i++) {
+        height = heightMap.heightAt((i % 3) * 10.0, (i / 3) * 10.0);
+        QVERIFY2(fabs(height - gridHeights[i]) < HEIGHT_MAP_TEST_TOLERANCE, qPrintable(QString::number(i)));
+    }
+
+    // Between the points it stays within reach of them.
+    height = heightMap.heightAt(15, 15);
+    QVERIFY((height > 0.4) && (height < 0.9));
+}
+
+void HeightMapTest::rejectsIncompleteGrid()
+{
+    GCodeHeightMap heightMap;
+    QVector<double> points = gridPoints();
+
+    points.resize(points.size() - 3);
+    QVERIFY(heightMap.setPoints(points).isEmpty() == false);
+    QVERIFY(heightMap.isEmpty() == true);
+
+    // An empty heightmap is flat.
+    QCOMPARE(heightMap.heightAt(5, 5), 0.0);
+}
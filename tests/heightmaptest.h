@@ -0,0 +1,22 @@
+#ifndef HEIGHTMAPTEST_H
+#define HEIGHTMAPTEST_H
+
+#include <QObject>
+#include <QVector>
+
+// Checks the heights that a heightmap gives between, on, and outside of the points of its grid.
+class HeightMapTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void interpolatesBilinear();
+    void clampsOutsideGrid();
+    void bicubicPassesThroughPoints();
+    void rejectsIncompleteGrid();
+
+private:
+    QVector<double> gridPoints();
+};
+
+#endif // HEIGHTMAPTEST_H
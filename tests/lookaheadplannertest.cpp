@@ -0,0 +1,108 @@
+#include "lookaheadplannertest.h"
+
+#include "gcodeoutput.h"
+#include "gcodetokenizer.h"
+
+#include <QtTest>
+#include <QList>
+
+/**
+ * @brief LookAheadPlannerTest::plan - Stream some G-code through the planner, with its default limits.
+ *
+ * @param text - The G-code.
+ * @param report[out] - What the planner changed.
+ *
+ * @return QByteArray containing the G-code that the planner wrote.
+ */
+QByteArray LookAheadPlannerTest::plan(const QByteArray &text, GCodePlannerReport *report)
+{
+    QByteArray result;
+    GCodeMemoryOutput output(&result);
+    GCodeLookAheadPlanner planner(&output);
+
+    planner.write(text.constData(), text.size());
+    planner.finish();
+    planner.getReport(report);
+
+    return result;
+}
+
+/**
+ * @brief LookAheadPlannerTest::feedRateOn - Get the F word on a line of some G-code.
+ *
+ * @param text - The G-code.
+ * @param line - The line to look at.
+ *
+ * @return double containing the value of the F word, or -1 if the line doesn't have one.
+ */
+double LookAheadPlannerTest::feedRateOn(const QByteArray &text, int line)
+{
+    QList<QByteArray> lines = text.split('\n');
+    GCodeWord word;
+
+    if (line >= lines.size()) {
+        return -1;
+    }
+
+    GCodeTokenizer tokenizer(lines.at(line).constData(), lines.at(line).size());
+    while (tokenizer.nextWord(&word) == true) {
+        if (word.letter == 'F') {
+            return word.value;
+        }
+    }
+
+    return -1;
+}
+
+void LookAheadPlannerTest::leavesReachableSpeedAlone()
+{
+    GCodePlannerReport report;
+    QByteArray text("G90 G21\nG00 X0 Y0 Z0\nG01 X100 F600\nG01 X200\nG01 X300\nG01 Y100\n");
+
+    // 10 mm/s is reached in a fraction of a mm, so every move can run at its feed rate.
+    QCOMPARE(plan(text, &report), text);
+    QCOMPARE(report.segmentsPlanned, 4UL);
+    QCOMPARE(report.segmentsSlowed, 0UL);
+    QCOMPARE(report.feedRatesWritten, 0UL);
+}
+
+void LookAheadPlannerTest::slowsDownForCorner()
+{
+    GCodePlannerReport report;
+    QByteArray straight;
+    QByteArray corner;
+
+    // A 1 mm move can't get anywhere near 100 mm/s.  It can go faster on the way in to a straight line than on
+    // the way in to a right angle, which it has to brake for.
+    straight = plan("G90 G21\nG00 X0 Y0 Z0\nG01 X1 F6000\nG01 X2\n", &report);
+    QCOMPARE(report.segmentsSlowed, 2UL);
+
+    corner = plan("G90 G21\nG00 X0 Y0 Z0\nG01 X1 F6000\nG01 Y1\n", &report);
+    QCOMPARE(report.segmentsSlowed, 2UL);
+
+    QVERIFY(feedRateOn(straight, 2) > 0);
+    QVERIFY(feedRateOn(straight, 2) < 6000);
+    QVERIFY(feedRateOn(corner, 2) > 0);
+    QVERIFY(feedRateOn(corner, 2) < feedRateOn(straight, 2));
+
+    // The move after the corner peaks at the same speed, so it carries on with the feed rate that was just written.
+    QCOMPARE(feedRateOn(corner, 3), -1.0);
+    QCOMPARE(report.feedRatesWritten, 1UL);
+}
+
+void LookAheadPlannerTest::onlyLowersFeedRates()
+{
+    GCodePlannerReport report;
+    QByteArray result;
+
+    // The rapid move gets back the feed rate the program set, so the long move after it runs at that.
+    result = plan("G90 G21\nG00 X0 Y0 Z0\nG01 X1 F6000\nG01 Y1\nG00 X0 Y0\nG01 X1000\n", &report);
+    QCOMPARE(report.segmentsPlanned, 3UL);
+    QVERIFY(feedRateOn(result, 2) < 6000);
+    QCOMPARE(feedRateOn(result, 4), 6000.0);
+    QCOMPARE(feedRateOn(result, 5), -1.0);
+
+    for (int i = 0; i < 7; i++) {
+        QVERIFY(feedRateOn(result, i) <= 6000);
+    }
+}
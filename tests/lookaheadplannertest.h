@@ -0,0 +1,24 @@
+#ifndef LOOKAHEADPLANNERTEST_H
+#define LOOKAHEADPLANNERTEST_H
+
+#include "gcodelookaheadplanner.h"
+
+#include <QObject>
+#include <QByteArray>
+
+// Checks the feed rates that the look-ahead planner writes, at corners and on the straight.
+class LookAheadPlannerTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void leavesReachableSpeedAlone();
+    void slowsDownForCorner();
+    void onlyLowersFeedRates();
+
+private:
+    QByteArray plan(const QByteArray &text, GCodePlannerReport *report);
+    double feedRateOn(const QByteArray &text, int line);
+};
+
+#endif // LOOKAHEADPLANNERTEST_H
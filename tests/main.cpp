@@ -0,0 +1,37 @@
+#include "moveoptimizertest.h"
+#include "numberformattertest.h"
+#include "tokenizertest.h"
+#include "piecetabletest.h"
+#include "programcachetest.h"
+#include "feedpolicytest.h"
+#include "lookaheadplannertest.h"
+#include "heightmaptest.h"
+#include "traveloptimizertest.h"
+
+#include <QtTest>
+
+int main(int argc, char *argv[])
+{
+    MoveOptimizerTest moveOptimizerTest;
+    NumberFormatterTest numberFormatterTest;
+    TokenizerTest tokenizerTest;
+    PieceTableTest pieceTableTest;
+    ProgramCacheTest programCacheTest;
+    FeedPolicyTest feedPolicyTest;
+    LookAheadPlannerTest lookAheadPlannerTest;
+    HeightMapTest heightMapTest;
+    TravelOptimizerTest travelOptimizerTest;
+    int failures = 0;
+
+    failures += QTest::qExec(&moveOptimizerTest, argc, argv);
+    failures += QTest::qExec(&numberFormatterTest, argc, argv);
+    failures += QTest::qExec(&tokenizerTest, argc, argv);
+    failures += QTest::qExec(&pieceTableTest, argc, argv);
+    failures += QTest::qExec(&programCacheTest, argc, argv);
+    failures += QTest::qExec(&feedPolicyTest, argc, argv);
+    failures += QTest::qExec(&lookAheadPlannerTest, argc, argv);
+    failures += QTest::qExec(&heightMapTest, argc, argv);
+    failures += QTest::qExec(&travelOptimizerTest, argc, argv);
+
+    return (failures == 0) ? 0 : 1;
+}
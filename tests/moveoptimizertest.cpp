@@ -0,0 +1,56 @@
+#include "moveoptimizertest.h"
+
+#include "gcodeprogram.h"
+#include "gcodeoutput.h"
+
+#include <QtTest>
+
+/**
+ * @brief MoveOptimizerTest::optimize - Run the optimizer over some G-code.
+ *
+ * @param text - The G-code.
+ * @param report[out] - What the optimizer changed.
+ *
+ * @return QByteArray containing the G-code that the optimizer left.
+ */
+QByteArray MoveOptimizerTest::optimize(const QByteArray &text, GCodeOptimizerReport *report)
+{
+    GCodeProgram program;
+    GCodeMoveOptimizer optimizer;
+    QByteArray result;
+    GCodeMemoryOutput output(&result);
+
+    program.parse(text.constData(), text.size());
+    optimizer.optimize(program, report);
+    program.write(&output);
+
+    return result;
+}
+
+void MoveOptimizerTest::keepsZeroLengthMoveThatChangesMode()
+{
+    GCodeOptimizerReport report;
+    QByteArray text("G90\nG00 X5\nG01 X5\nX10\n");
+
+    // Without the G01, the X10 would be a rapid move instead of a cut.
+    QCOMPARE(optimize(text, &report), text);
+    QCOMPARE(report.zeroLengthMoves, 0UL);
+}
+
+void MoveOptimizerTest::deletesZeroLengthMoveInSameMode()
+{
+    GCodeOptimizerReport report;
+
+    QCOMPARE(optimize("G90\nG01 X5 F100\nG01 X5\nX10\n", &report), QByteArray("G90\nG01 X5 F100\nX10\n"));
+    QCOMPARE(report.zeroLengthMoves, 1UL);
+}
+
+void MoveOptimizerTest::keepsMoveWhoseAxisIsLeftOut()
+{
+    GCodeOptimizerReport report;
+    QByteArray text("G90\nG00 X0 Y0 Z0\nG01 X10 Y0.01 F100\nG01 X20\n");
+
+    // Merging the moves would leave the machine at Y0, when every later move thinks it is at Y0.01.
+    QCOMPARE(optimize(text, &report), text);
+    QCOMPARE(report.mergedMoves, 0UL);
+}
@@ -0,0 +1,23 @@
+#ifndef MOVEOPTIMIZERTEST_H
+#define MOVEOPTIMIZERTEST_H
+
+#include "gcodemoveoptimizer.h"
+
+#include <QObject>
+#include <QByteArray>
+
+// Checks that the move optimizer never changes where the machine goes, or how it gets there.
+class MoveOptimizerTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void keepsZeroLengthMoveThatChangesMode();
+    void deletesZeroLengthMoveInSameMode();
+    void keepsMoveWhoseAxisIsLeftOut();
+
+private:
+    QByteArray optimize(const QByteArray &text, GCodeOptimizerReport *report);
+};
+
+#endif // MOVEOPTIMIZERTEST_H
@@ -0,0 +1,121 @@
+#include "numberformattertest.h"
+
+#include "gcodenumberformatter.h"
+
+#include <QtTest>
+
+// How many random values to check.
+#define NUMBER_FORMATTER_TEST_VALUES         (100 * 1000)
+
+/**
+ * @brief NumberFormatterTest::format - Format a number with the formatter.
+ *
+ * @param value - The number to write.
+ * @param decimals - The number of decimal places to write.
+ * @param trimZeros - Passed to the formatter.
+ *
+ * @return QByteArray containing the formatted number.
+ */
+QByteArray NumberFormatterTest::format(double value, int decimals, bool trimZeros)
+{
+    char buffer[GCODE_NUMBER_MAX_LENGTH];
+    size_t length;
+
+    length = GCodeNumberFormatter::formatFixed(buffer, value, decimals, trimZeros);
+
+    return QByteArray(buffer, (int)length);
+}
+
+/**
+ * @brief NumberFormatterTest::expected - Format a number the way the formatter should.
+ *
+ * @param value - The number to write.
+ * @param decimals - The number of decimal places to write.
+ *
+ * @return QByteArray containing what QString::number() writes, without the sign of a negative zero.  (The
+ *      formatter never writes "-0.0000".)
+ */
+QByteArray NumberFormatterTest::expected(double value, int decimals)
+{
+    QByteArray text = QString::number(value, 'f', decimals).toLatin1();
+
+    if ((text.startsWith('-') == true) && (text.toDouble() == 0)) {
+        text.remove(0, 1);
+    }
+
+    return text;
+}
+
+void NumberFormatterTest::matchesQStringOnTies_data()
+{
+    QTest::addColumn<double>("value");
+    QTest::addColumn<int>("decimals");
+
+    // Exactly half way between two outputs.
+    QTest::newRow("0.125") << 0.125 << 2;
+    QTest::newRow("0.375") << 0.375 << 2;
+    QTest::newRow("-0.125") << -0.125 << 2;
+    QTest::newRow("0.5") << 0.5 << 0;
+    QTest::newRow("1.5") << 1.5 << 0;
+    QTest::newRow("2.5") << 2.5 << 0;
+    QTest::newRow("-2.5") << -2.5 << 0;
+    QTest::newRow("1.03125") << 1.03125 << 4;
+    QTest::newRow("0.0009765625") << 0.0009765625 << 9;
+
+    // Written as ties, but the double is just below (or above) half way, which scaling it by 10^decimals
+    // rounds away.
+    QTest::newRow("0.00005") << 0.00005 << 4;
+    QTest::newRow("999.99995") << 999.99995 << 4;
+    QTest::newRow("1.0005") << 1.0005 << 3;
+    QTest::newRow("1.005") << 1.005 << 2;
+    QTest::newRow("2.675") << 2.675 << 2;
+    QTest::newRow("0.15") << 0.15 << 1;
+    QTest::newRow("0.45") << 0.45 << 1;
+    QTest::newRow("123.45665") << 123.45665 << 4;
+    QTest::newRow("-8.00015") << -8.00015 << 4;
+}
+
+void NumberFormatterTest::matchesQStringOnTies()
+{
+    QFETCH(double, value);
+    QFETCH(int, decimals);
+
+    QCOMPARE(format(value, decimals, false), expected(value, decimals));
+}
+
+void NumberFormatterTest::matchesQStringOnRandomValues()
+{
+    unsigned int seed = 12345;
+    double value;
+    int decimals;
+
+    for (int i = 0; i < NUMBER_FORMATTER_TEST_VALUES; i++) {
+        // A simple LCG, so the values are the same on every run.
+        seed = (seed * 1103515245) + 12345;
+        decimals = i % (GCODE_NUMBER_MAX_FAST_DECIMALS + 1);
+
+        if ((i % 2) == 0) {
+            // Values with a short binary fraction, so that many of them are exact ties.
+            value = ((double)(seed % 2000000) - 1000000.0) / (double)(1 << (i % 13));
+        } else {
+            value = ((double)(seed % 2000000) - 1000000.0) / (double)(1 + (i % 7) * 997);
+        }
+
+        QCOMPARE(format(value, decimals, false), expected(value, decimals));
+    }
+}
+
+void NumberFormatterTest::leavesSignOffZero()
+{
+    QCOMPARE(format(-0.00001, 4, false), QByteArray("0.0000"));
+    QCOMPARE(format(-0.4, 0, false), QByteArray("0"));
+    QCOMPARE(format(-0.00005, 4, false), QByteArray("-0.0001"));
+}
+
+void NumberFormatterTest::trimsZeros()
+{
+    QCOMPARE(format(1.5, 4, true), QByteArray("1.5"));
+    QCOMPARE(format(2.0, 4, true), QByteArray("2"));
+    QCOMPARE(format(0.0501, 4, true), QByteArray("0.0501"));
+    QCOMPARE(format(-3.99999, 4, true), QByteArray("-4"));
+}
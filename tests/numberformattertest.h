@@ -0,0 +1,24 @@
+#ifndef NUMBERFORMATTERTEST_H
+#define NUMBERFORMATTERTEST_H
+
+#include <QObject>
+#include <QByteArray>
+
+// Checks that the number formatter writes the same digits QString::number() does.
+class NumberFormatterTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void matchesQStringOnTies_data();
+    void matchesQStringOnTies();
+    void matchesQStringOnRandomValues();
+    void leavesSignOffZero();
+    void trimsZeros();
+
+private:
+    QByteArray format(double value, int decimals, bool trimZeros);
+    QByteArray expected(double value, int decimals);
+};
+
+#endif // NUMBERFORMATTERTEST_H
@@ -0,0 +1,125 @@
+#include "piecetabletest.h"
+
+#include "gcodepiecetable.h"
+#include "gcodeoutput.h"
+
+#include <QtTest>
+
+/**
+ * @brief PieceTableTest::lines - Get every line of a piece table, one after the other.
+ *
+ * @param table - The piece table.
+ *
+ * @return QByteArray containing the lines, separated by '|'.
+ */
+QByteArray PieceTableTest::lines(GCodePieceTable &table)
+{
+    QByteArray result;
+
+    for (int i = 0; i < table.getLineCount(); i++) {
+        if (i > 0) {
+            result.append('|');
+        }
+
+        result.append(table.getLine(i));
+    }
+
+    return result;
+}
+
+void PieceTableTest::editsLines()
+{
+    QByteArray original("G90\r\nG01 X1\nG01 X2");
+    GCodePieceTable table;
+
+    // Line endings aren't part of the line, and the last line doesn't need one.
+    table.setOriginal(original.constData(), original.size());
+    QCOMPARE(table.getLineCount(), 3);
+    QCOMPARE(lines(table), QByteArray("G90|G01 X1|G01 X2"));
+
+    table.insertLine(1, "G00 Z5");
+    QCOMPARE(lines(table), QByteArray("G90|G00 Z5|G01 X1|G01 X2"));
+
+    table.replaceLine(2, "G01 X1.5");
+    QCOMPARE(lines(table), QByteArray("G90|G00 Z5|G01 X1.5|G01 X2"));
+
+    table.removeLines(0, 2);
+    QCOMPARE(lines(table), QByteArray("G01 X1.5|G01 X2"));
+
+    table.insertLine(table.getLineCount(), "M05");
+    QCOMPARE(lines(table), QByteArray("G01 X1.5|G01 X2|M05"));
+    QCOMPARE(table.getLine(3), QByteArray());
+}
+
+void PieceTableTest::undoesAndRedoesEdits()
+{
+    QByteArray original("G90\nG01 X1\nG01 X2\n");
+    GCodePieceTable table;
+    int line;
+
+    table.setOriginal(original.constData(), original.size());
+    table.insertLine(1, "G00 Z5");
+    table.replaceLine(3, "G01 X3");
+    table.removeLines(0, 1);
+    QCOMPARE(lines(table), QByteArray("G00 Z5|G01 X1|G01 X3"));
+
+    QVERIFY(table.undo(&line) == true);
+    QCOMPARE(line, 0);
+    QCOMPARE(lines(table), QByteArray("G90|G00 Z5|G01 X1|G01 X3"));
+
+    QVERIFY(table.undo(&line) == true);
+    QCOMPARE(line, 3);
+    QCOMPARE(lines(table), QByteArray("G90|G00 Z5|G01 X1|G01 X2"));
+
+    QVERIFY(table.undo(&line) == true);
+    QCOMPARE(lines(table), QByteArray("G90|G01 X1|G01 X2"));
+    QVERIFY(table.canUndo() == false);
+    QVERIFY(table.undo(&line) == false);
+
+    QVERIFY(table.redo(&line) == true);
+    QVERIFY(table.redo(&line) == true);
+    QCOMPARE(lines(table), QByteArray("G90|G00 Z5|G01 X1|G01 X3"));
+
+    // A new edit throws away what could have been redone.
+    table.insertLine(0, "G21");
+    QVERIFY(table.canRedo() == false);
+    QCOMPARE(lines(table), QByteArray("G21|G90|G00 Z5|G01 X1|G01 X3"));
+}
+
+void PieceTableTest::mergesConsecutiveInserts()
+{
+    QByteArray original("G90\nM05\n");
+    GCodePieceTable table;
+    int line;
+
+    // Typing in a few lines, one after the other, is undone in one go.
+    table.setOriginal(original.constData(), original.size());
+    table.insertLine(1, "G01 X1");
+    table.insertLine(2, "G01 X2");
+    table.insertLine(3, "G01 X3");
+    QCOMPARE(lines(table), QByteArray("G90|G01 X1|G01 X2|G01 X3|M05"));
+
+    QVERIFY(table.undo(&line) == true);
+    QCOMPARE(line, 1);
+    QCOMPARE(lines(table), QByteArray("G90|M05"));
+    QVERIFY(table.canUndo() == false);
+
+    QVERIFY(table.redo(&line) == true);
+    QCOMPARE(line, 4);
+    QCOMPARE(lines(table), QByteArray("G90|G01 X1|G01 X2|G01 X3|M05"));
+}
+
+void PieceTableTest::writesLineEndings()
+{
+    QByteArray original("G90\r\nG01 X1\nG01 X2");
+    GCodePieceTable table;
+    QByteArray result;
+    GCodeMemoryOutput output(&result);
+
+    // The original lines are written as they were, and every line ends up with a line ending.
+    table.setOriginal(original.constData(), original.size());
+    table.insertLine(2, "G00 Z5");
+    table.write(&output);
+
+    QCOMPARE(result, QByteArray("G90\r\nG01 X1\nG00 Z5\nG01 X2\n"));
+}
@@ -0,0 +1,24 @@
+#ifndef PIECETABLETEST_H
+#define PIECETABLETEST_H
+
+#include <QObject>
+#include <QByteArray>
+
+class GCodePieceTable;
+
+// Checks that the piece table edits the lines it is asked to, and that undo and redo put them back.
+class PieceTableTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void editsLines();
+    void undoesAndRedoesEdits();
+    void mergesConsecutiveInserts();
+    void writesLineEndings();
+
+private:
+    QByteArray lines(GCodePieceTable &table);
+};
+
+#endif // PIECETABLETEST_H
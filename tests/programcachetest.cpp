@@ -0,0 +1,148 @@
+#include "programcachetest.h"
+
+#include "gcodeprogram.h"
+#include "gcodeprogramcache.h"
+#include "gcodeoutput.h"
+
+#include <QtTest>
+#include <QFile>
+#include <QTemporaryDir>
+
+// A program with something in it for every part of the cache.  (Feed rates, comments, arcs and an M05.)
+#define PROGRAM_CACHE_TEST_PROGRAM           "G90 G21\n(Header)\nG00 X0 Y0 Z5\nG01 Z-1 F100\nG02 X10 Y0 I5 J0 ; arc\n" \
+                                             "G01 X20 Y5.5 (across)\nM05\nG00 Z5"
+
+/**
+ * @brief ProgramCacheTest::writeFile - Write a G-code file.
+ *
+ * @param filename - The file to write.
+ * @param data - What to write to it.
+ *
+ * @return true if the file was written.
+ */
+bool ProgramCacheTest::writeFile(const QString &filename, const QByteArray &data)
+{
+    QFile file(filename);
+
+    if (file.open(QIODevice::WriteOnly) == false) {
+        return false;
+    }
+
+    return (file.write(data) == data.size());
+}
+
+/**
+ * @brief ProgramCacheTest::edit - Make every kind of edit that uses what was parsed, and write the result.
+ *
+ * @param program - The program to change.
+ *
+ * @return QByteArray containing the changed program.
+ */
+QByteArray ProgramCacheTest::edit(GCodeProgram &program)
+{
+    QByteArray result;
+    GCodeMemoryOutput output(&result);
+
+    for (int i = 0; i < program.getLineCount(); i++) {
+        if ((program.getFlags(i) & GCODE_LINE_HAS_X) != 0) {
+            program.setFeedRate(i, 250.0);
+        }
+
+        program.replaceSpindleStop(i);
+        program.stripComments(i);
+    }
+
+    program.write(&output);
+
+    return result;
+}
+
+void ProgramCacheTest::loadsWhatWasSaved()
+{
+    QTemporaryDir dir;
+    QString filename = dir.path() + "/program.nc";
+    QByteArray data(PROGRAM_CACHE_TEST_PROGRAM);
+    GCodeProgram parsed;
+    GCodeProgram loaded;
+    GCodeArcCentre parsedCentre;
+    GCodeArcCentre loadedCentre;
+
+    QVERIFY(dir.isValid() == true);
+    QVERIFY(writeFile(filename, data) == true);
+
+    parsed.parse(data.constData(), data.size());
+    QVERIFY(GCodeProgramCache::save(filename, data.constData(), data.size(), parsed) == true);
+    QVERIFY(QFile::exists(GCodeProgramCache::cacheFilename(filename)) == true);
+    QVERIFY(GCodeProgramCache::load(filename, data.constData(), data.size(), &loaded) == true);
+
+    QCOMPARE(loaded.getLineCount(), parsed.getLineCount());
+    for (int i = 0; i < parsed.getLineCount(); i++) {
+        QCOMPARE(loaded.getCommand(i), parsed.getCommand(i));
+        QCOMPARE(loaded.getFlags(i), parsed.getFlags(i));
+        QCOMPARE(loaded.getLineText(i), parsed.getLineText(i));
+        QCOMPARE(loaded.getComments(i), parsed.getComments(i));
+        QCOMPARE(loaded.getArcCentre(i, &loadedCentre), parsed.getArcCentre(i, &parsedCentre));
+    }
+
+    QVERIFY(loaded.getArcCentre(4, &loadedCentre) == true);
+    QCOMPARE(loadedCentre.i, 5.0);
+    QCOMPARE(loadedCentre.j, 0.0);
+
+    // The positions of the words that are edited have to have come through too.
+    QCOMPARE(edit(loaded), edit(parsed));
+}
+
+void ProgramCacheTest::rejectsChangedContents()
+{
+    QTemporaryDir dir;
+    QString filename = dir.path() + "/program.nc";
+    QByteArray data(PROGRAM_CACHE_TEST_PROGRAM);
+    QByteArray changed(data);
+    GCodeProgram program;
+
+    QVERIFY(dir.isValid() == true);
+    QVERIFY(writeFile(filename, data) == true);
+
+    program.parse(data.constData(), data.size());
+    QVERIFY(GCodeProgramCache::save(filename, data.constData(), data.size(), program) == true);
+
+    // The same size, path and time, but not the same file.
+    changed.replace("X20", "X21");
+    QCOMPARE(changed.size(), data.size());
+
+    program.clear();
+    QVERIFY(GCodeProgramCache::load(filename, changed.constData(), changed.size(), &program) == false);
+
+    // A file of another size isn't even hashed.
+    changed.append('\n');
+    QVERIFY(GCodeProgramCache::load(filename, changed.constData(), changed.size(), &program) == false);
+}
+
+void ProgramCacheTest::rejectsDamagedCache()
+{
+    QTemporaryDir dir;
+    QString filename = dir.path() + "/program.nc";
+    QByteArray data(PROGRAM_CACHE_TEST_PROGRAM);
+    GCodeProgram program;
+    QFile cache(GCodeProgramCache::cacheFilename(filename));
+    qint64 cacheSize;
+
+    QVERIFY(dir.isValid() == true);
+    QVERIFY(writeFile(filename, data) == true);
+
+    program.parse(data.constData(), data.size());
+    QVERIFY(GCodeProgramCache::save(filename, data.constData(), data.size(), program) == true);
+    cacheSize = cache.size();
+
+    // Cut short.
+    QVERIFY(cache.resize(cacheSize - 1) == true);
+    QVERIFY(GCodeProgramCache::load(filename, data.constData(), data.size(), &program) == false);
+    QCOMPARE(program.getLineCount(), 0);
+
+    // With something left on the end.
+    program.parse(data.constData(), data.size());
+    QVERIFY(GCodeProgramCache::save(filename, data.constData(), data.size(), program) == true);
+    QVERIFY(cache.resize(cacheSize + 1) == true);
+    QVERIFY(GCodeProgramCache::load(filename, data.constData(), data.size(), &program) == false);
+    QCOMPARE(program.getLineCount(), 0);
+}
@@ -0,0 +1,26 @@
+#ifndef PROGRAMCACHETEST_H
+#define PROGRAMCACHETEST_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+
+class GCodeProgram;
+
+// Checks that a program loaded from its cache is the same as the one that was parsed, and that a cache that
+// doesn't match its file is never used.
+class ProgramCacheTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void loadsWhatWasSaved();
+    void rejectsChangedContents();
+    void rejectsDamagedCache();
+
+private:
+    bool writeFile(const QString &filename, const QByteArray &data);
+    QByteArray edit(GCodeProgram &program);
+};
+
+#endif // PROGRAMCACHETEST_H
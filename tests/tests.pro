@@ -0,0 +1,70 @@
+#-------------------------------------------------
+#
+# Tests for the G-code processing code.
+#
+#-------------------------------------------------
+
+QT       += core testlib
+QT       -= gui
+
+TARGET = FAB-tweak-tom-tests
+CONFIG   += console testcase
+CONFIG   -= app_bundle
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+SOURCES += main.cpp \
+    moveoptimizertest.cpp \
+    numberformattertest.cpp \
+    tokenizertest.cpp \
+    piecetabletest.cpp \
+    programcachetest.cpp \
+    feedpolicytest.cpp \
+    lookaheadplannertest.cpp \
+    heightmaptest.cpp \
+    traveloptimizertest.cpp \
+    ../gcodemoveoptimizer.cpp \
+    ../gcodeprogram.cpp \
+    ../gcodetokenizer.cpp \
+    ../gcodescanner.cpp \
+    ../gcodeoutput.cpp \
+    ../gcodenumberformatter.cpp \
+    ../gcodepiecetable.cpp \
+    ../gcodeprogramcache.cpp \
+    ../gcodewriter.cpp \
+    ../gcodefeedpolicy.cpp \
+    ../gcodelookaheadplanner.cpp \
+    ../gcodemodaltracker.cpp \
+    ../gcodeheightmap.cpp \
+    ../gcodetraveloptimizer.cpp \
+    ../gcodetimeestimator.cpp \
+    ../logger.cpp \
+    ../profiler.cpp
+
+HEADERS  += moveoptimizertest.h \
+    numberformattertest.h \
+    tokenizertest.h \
+    piecetabletest.h \
+    programcachetest.h \
+    feedpolicytest.h \
+    lookaheadplannertest.h \
+    heightmaptest.h \
+    traveloptimizertest.h \
+    ../gcodemoveoptimizer.h \
+    ../gcodeprogram.h \
+    ../gcodetokenizer.h \
+    ../gcodescanner.h \
+    ../gcodeoutput.h \
+    ../gcodenumberformatter.h \
+    ../gcodepiecetable.h \
+    ../gcodeprogramcache.h \
+    ../gcodewriter.h \
+    ../gcodefeedpolicy.h \
+    ../gcodelookaheadplanner.h \
+    ../gcodemodaltracker.h \
+    ../gcodeheightmap.h \
+    ../gcodetraveloptimizer.h \
+    ../gcodetimeestimator.h \
+    ../logger.h \
+    ../profiler.h
@@ -0,0 +1,119 @@
+#include "tokenizertest.h"
+
+#include "gcodetokenizer.h"
+
+#include <QtTest>
+
+#include <math.h>
+#include <stdlib.h>
+
+// How many words to put on the long line.  (Enough to make it well over 64K.)
+#define TOKENIZER_TEST_LONG_LINE_WORDS       20000
+
+/**
+ * @brief TokenizerTest::words - Get every word on a line.
+ *
+ * @param line - The line.  (It has to stay valid for as long as the words are used.)
+ *
+ * @return QList<GCodeWord> containing the words, in order.
+ */
+QList<GCodeWord> TokenizerTest::words(const QByteArray &line)
+{
+    GCodeTokenizer tokenizer(line.constData(), line.size());
+    QList<GCodeWord> result;
+    GCodeWord word;
+
+    while (tokenizer.nextWord(&word) == true) {
+        result.append(word);
+    }
+
+    return result;
+}
+
+void TokenizerTest::readsLongLine()
+{
+    QByteArray line("G1");
+    QList<GCodeWord> found;
+
+    for (int i = 0; i < TOKENIZER_TEST_LONG_LINE_WORDS; i++) {
+        line.append(" X" + QByteArray::number(i) + ".5");
+    }
+
+    line.append("\n");
+    QVERIFY(line.size() > 0x10000);
+
+    found = words(line);
+    QCOMPARE(found.size(), TOKENIZER_TEST_LONG_LINE_WORDS + 1);
+    QCOMPARE(found.first().letter, 'G');
+    QCOMPARE(found.last().letter, 'X');
+    QCOMPARE(found.last().value, (TOKENIZER_TEST_LONG_LINE_WORDS - 1) + 0.5);
+    QVERIFY(found.last().end == line.constData() + line.size() - 1);
+}
+
+void TokenizerTest::skipsComments()
+{
+    QByteArray line("G1 (X5) X1 (Y2) ; Z3\n");
+    QByteArray unclosed("G1 X1 (Y2 Z3\n");
+    QList<GCodeWord> found;
+    GCodeWord word;
+
+    found = words(line);
+    QCOMPARE(found.size(), 2);
+    QCOMPARE(found.at(1).letter, 'X');
+    QCOMPARE(found.at(1).value, 1.0);
+
+    // A comment that is never closed runs to the end of the line.
+    found = words(unclosed);
+    QCOMPARE(found.size(), 2);
+    QCOMPARE(found.at(1).letter, 'X');
+
+    // New words go after the last one, ahead of the comments.
+    GCodeTokenizer tokenizer(line.constData(), line.size());
+    while (tokenizer.nextWord(&word) == true) {
+        QVERIFY(word.letter != 'Z');
+    }
+
+    QVERIFY(tokenizer.getWordsEnd() == line.constData() + line.indexOf(" (Y2"));
+}
+
+void TokenizerTest::startsNewWordAtE()
+{
+    QByteArray line("X1.5E3 y-2e-1");
+    QList<GCodeWord> found;
+
+    // G-code numbers don't have exponents, so an E is the start of the next word.  (Like an extruder move.)
+    found = words(line);
+    QCOMPARE(found.size(), 4);
+    QCOMPARE(found.at(0).value, 1.5);
+    QCOMPARE(found.at(1).letter, 'E');
+    QCOMPARE(found.at(1).value, 3.0);
+    QCOMPARE(found.at(2).letter, 'Y');
+    QCOMPARE(found.at(2).value, -2.0);
+    QCOMPARE(found.at(3).letter, 'E');
+    QCOMPARE(found.at(3).value, -1.0);
+}
+
+void TokenizerTest::parsesLongFractions_data()
+{
+    QTest::addColumn<QByteArray>("number");
+
+    QTest::newRow("pi") << QByteArray("3.14159265358979323846");
+    QTest::newRow("third") << QByteArray("0.333333333333333333333333");
+    QTest::newRow("22 decimals") << QByteArray("0.1234567890123456789012");
+    QTest::newRow("20 digits") << QByteArray("12345.678901234567890");
+    QTest::newRow("long whole part") << QByteArray("98765432109876543210.5");
+    QTest::newRow("tiny") << QByteArray("-0.000000000000000000000012345678901234567");
+    QTest::newRow("just over one") << QByteArray("1.00000000000000000001");
+    QTest::newRow("leading zeros") << QByteArray("+000000000000000000000000.75");
+}
+
+void TokenizerTest::parsesLongFractions()
+{
+    QFETCH(QByteArray, number);
+    double expected = strtod(number.constData(), NULL);
+    double value = GCodeTokenizer::parseNumber(number.constData(), number.constData() + number.size());
+    double ulp = nextafter(fabs(expected), HUGE_VAL) - fabs(expected);
+
+    // Numbers longer than a double can hold are only close, but never more than one place out.
+    QVERIFY2(fabs(value - expected) <= ulp, qPrintable(QString::number(value, 'g', 17)));
+}
@@ -0,0 +1,27 @@
+#ifndef TOKENIZERTEST_H
+#define TOKENIZERTEST_H
+
+#include "gcodetokenizer.h"
+
+#include <QObject>
+#include <QByteArray>
+#include <QList>
+
+// Checks that the tokenizer finds the words on a line, skips its comments, and reads its numbers the way
+// strtod() does.
+class TokenizerTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void readsLongLine();
+    void skipsComments();
+    void startsNewWordAtE();
+    void parsesLongFractions_data();
+    void parsesLongFractions();
+
+private:
+    QList<GCodeWord> words(const QByteArray &line);
+};
+
+#endif // TOKENIZERTEST_H
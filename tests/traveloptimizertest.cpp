@@ -0,0 +1,79 @@
+#include "traveloptimizertest.h"
+
+#include "gcodeprogram.h"
+#include "gcodeoutput.h"
+
+#include <QtTest>
+
+/**
+ * @brief TravelOptimizerTest::optimize - Run the optimizer over some G-code.
+ *
+ * @param text - The G-code.
+ * @param report[out] - What the optimizer changed.
+ *
+ * @return QByteArray containing the G-code, in the order the optimizer left it.
+ */
+QByteArray TravelOptimizerTest::optimize(const QByteArray &text, GCodeTravelReport *report)
+{
+    GCodeProgram program;
+    GCodeTravelOptimizer optimizer;
+    QByteArray result;
+    GCodeMemoryOutput output(&result);
+
+    program.parse(text.constData(), text.size());
+    optimizer.optimize(program, report);
+    program.write(&output);
+
+    return result;
+}
+
+void TravelOptimizerTest::writesFeedRateOfMovedBlock()
+{
+    GCodeTravelReport report;
+    QByteArray text("G90\n"
+                    "G00 Z5\nG00 X0 Y0\nG01 Z-1 F100\nG01 X1\n"
+                    "G00 Z5\nG00 X100 Y0\nG01 Z-1 F200\nG01 X101\n"
+                    "G00 Z5\nG00 X1 Y1\nG01 Z-1\nG01 X2\n"
+                    "G00 Z5\nG00 X101 Y1\nG01 Z-1\nG01 X102\n");
+
+    // The third block is cut second, after the first block left the feed rate at 100, so it needs its 200
+    // back.  The last block still follows the second, so it doesn't.
+    QCOMPARE(optimize(text, &report),
+             QByteArray("G90\n"
+                        "G00 Z5\nG00 X0 Y0\nG01 Z-1 F100\nG01 X1\n"
+                        "G00 Z5\nG00 X1 Y1\nG01 Z-1 F200\nG01 X2\n"
+                        "G00 Z5\nG00 X100 Y0\nG01 Z-1 F200\nG01 X101\n"
+                        "G00 Z5\nG00 X101 Y1\nG01 Z-1\nG01 X102\n"));
+    QCOMPARE(report.blocks, 4UL);
+    QCOMPARE(report.runs, 1UL);
+    QVERIFY(report.travelAfter < report.travelBefore);
+}
+
+void TravelOptimizerTest::leavesShortestOrderAlone()
+{
+    GCodeTravelReport report;
+    QByteArray text("G90\n"
+                    "G00 Z5\nG00 X0 Y0\nG01 Z-1 F100\nG01 X1\n"
+                    "G00 Z5\nG00 X1 Y1\nG01 Z-1\nG01 X2\n"
+                    "G00 Z5\nG00 X100 Y0\nG01 Z-1 F200\nG01 X101\n"
+                    "G00 Z5\nG00 X101 Y1\nG01 Z-1\nG01 X102\n");
+
+    QCOMPARE(optimize(text, &report), text);
+    QCOMPARE(report.blocks, 4UL);
+    QCOMPARE(report.runs, 0UL);
+}
+
+void TravelOptimizerTest::leavesRelativeBlocksAlone()
+{
+    GCodeTravelReport report;
+    QByteArray text("G90\n"
+                    "G00 Z5\nG00 X0 Y0\nG01 Z-1 F100\nG01 X1\n"
+                    "G00 Z5\nG00 X100 Y0\nG01 Z-1\nG91\nG01 X1\nG90\n"
+                    "G00 Z5\nG00 X1 Y1\nG01 Z-1\nG01 X2\n"
+                    "G00 Z5\nG00 X101 Y1\nG01 Z-1\nG01 X102\n");
+
+    // The block with the relative move can't be moved, which leaves too few blocks on either side of it.
+    QCOMPARE(optimize(text, &report), text);
+    QCOMPARE(report.blocks, 3UL);
+    QCOMPARE(report.runs, 0UL);
+}
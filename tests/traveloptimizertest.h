@@ -0,0 +1,24 @@
+#ifndef TRAVELOPTIMIZERTEST_H
+#define TRAVELOPTIMIZERTEST_H
+
+#include "gcodetraveloptimizer.h"
+
+#include <QObject>
+#include <QByteArray>
+
+// Checks that the travel optimizer puts blocks in a shorter order, and that every block still runs at the
+// feed rate it had.
+class TravelOptimizerTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void writesFeedRateOfMovedBlock();
+    void leavesShortestOrderAlone();
+    void leavesRelativeBlocksAlone();
+
+private:
+    QByteArray optimize(const QByteArray &text, GCodeTravelReport *report);
+};
+
+#endif // TRAVELOPTIMIZERTEST_H